@@ -0,0 +1,241 @@
+/******************************
+ * bench_codec
+ *
+ * Check and benchmark of the compression of int24 codes in codec.c.
+ *
+ * First checks every block decodes to exactly the codes which were
+ * coded, for 1 to 16 channels, block lengths around the partition
+ * size and the orders of prediction, and signals from silence to
+ * full scale noise and alternating full scale codes, which give the
+ * largest residuals. Then times coding and decoding blocks of 2
+ * channels the size the acquisition thread reads, of a vibration
+ * signal as the ADC would give it, with its noise, and gives the
+ * samples per second and how much smaller than int24 it is.
+ * A 2 channel scan at 51.2 kHz is 102400 samples per second.
+ *
+ * usage: bench_codec [number of blocks]
+ * returns - 0 if every block decodes correctly, 1 if not
+ ****************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "codec.h"
+
+#define BENCH_CHANNELS 2
+#define BENCH_FRAMES 8192               //READ_BUF_SAMPLES, a block of the ring
+#define BENCH_RATE 51200.0
+#define CHECK_MAX_CHANNELS 16
+#define CHECK_MAX_FRAMES 4099
+
+/* signals checked */
+enum bench_signal
+{
+    SIGNAL_VIBRATION,                   //sines and ADC noise
+    SIGNAL_SILENCE,                     //the same code
+    SIGNAL_NOISE,                       //full scale noise
+    SIGNAL_EXTREMES,                    //alternating largest and smallest codes
+    SIGNAL_IMPULSES,                    //small noise with full scale spikes
+    SIGNAL_COUNT
+};
+
+static const char* signal_names[SIGNAL_COUNT] = {"vibration", "silence",
+    "noise", "extremes", "impulses"};
+
+/* block lengths checked, short ones have no prediction */
+static const uint32_t check_frames[] = {1, 2, 4, 5, 6, 255, 256, 257, 260,
+    517, CHECK_MAX_FRAMES};
+
+#define NUM_CHECK_FRAMES (sizeof(check_frames) / sizeof(check_frames[0]))
+
+/* local function declarations */
+static void make_codes(int32_t*, uint32_t, int, int);
+static int32_t noise(int32_t);
+static int check_block(const int32_t*, uint32_t, int, uint32_t*, uint8_t*, int32_t*);
+static double now(void);
+
+int main(int argc, char* argv[])
+{
+    int blocks = 500;
+    int32_t* codes;
+    int32_t* decoded;
+    uint32_t* scratch;
+    uint8_t* coded;
+    uint32_t bytes = 0;
+    double encode_time, decode_time;
+    int errors = 0;
+    size_t f;
+    int nch;
+    int s;
+    int i;
+
+    if (argc > 1)
+    {
+        blocks = atoi(argv[1]);
+    }
+
+    codes = malloc(sizeof(int32_t) * BENCH_FRAMES * CHECK_MAX_CHANNELS);
+    decoded = malloc(sizeof(int32_t) * BENCH_FRAMES * CHECK_MAX_CHANNELS);
+    scratch = malloc(sizeof(uint32_t) * BENCH_FRAMES);
+    coded = malloc(codec_max_bytes(BENCH_FRAMES, CHECK_MAX_CHANNELS));
+    if ((codes == NULL) || (decoded == NULL) || (scratch == NULL) || (coded == NULL))
+    {
+        fprintf(stderr, "bench_codec: out of memory\n");
+        return 1;
+    }
+
+    //check every block decodes to the codes coded
+    for (s = 0; s < SIGNAL_COUNT; s++)
+    {
+        for (nch = 1; nch <= CHECK_MAX_CHANNELS; nch++)
+        {
+            for (f = 0; f < NUM_CHECK_FRAMES; f++)
+            {
+                make_codes(codes, check_frames[f], nch, s);
+                if (check_block(codes, check_frames[f], nch, scratch, coded, decoded))
+                {
+                    printf("FAIL - %s, %d channels, %u frames\n", signal_names[s],
+                        nch, check_frames[f]);
+                    errors++;
+                }
+            }
+        }
+    }
+    if (errors)
+    {
+        printf("FAIL - blocks did not decode to the codes coded\n");
+        return 1;
+    }
+    printf("every block decodes to the codes coded\n");
+
+    printf("%-10s %14s %14s %9s\n", "signal", "encode Ms/s", "decode Ms/s", "ratio");
+    for (s = 0; s < SIGNAL_COUNT; s++)
+    {
+        make_codes(codes, BENCH_FRAMES, BENCH_CHANNELS, s);
+        encode_time = now();
+        for (i = 0; i < blocks; i++)
+        {
+            bytes = codec_encode(codes, BENCH_FRAMES, BENCH_CHANNELS, scratch, coded);
+        }
+        encode_time = now() - encode_time;
+
+        decode_time = now();
+        for (i = 0; i < blocks; i++)
+        {
+            codec_decode(coded, bytes, BENCH_FRAMES, BENCH_CHANNELS, decoded);
+        }
+        decode_time = now() - decode_time;
+
+        printf("%-10s %14.1f %14.1f %8.2fx\n", signal_names[s],
+            1e-6 * blocks * BENCH_FRAMES * BENCH_CHANNELS / encode_time,
+            1e-6 * blocks * BENCH_FRAMES * BENCH_CHANNELS / decode_time,
+            3.0 * BENCH_FRAMES * BENCH_CHANNELS / bytes);
+    }
+
+    free(codes);
+    free(decoded);
+    free(scratch);
+    free(coded);
+    return 0;
+}
+
+
+/****************************
+ * make_codes() - int24 codes of a signal
+ *
+ * The vibration is 1 and 0.3 g at 100 mV/g, about 20000 and 6000
+ * codes, with an offset and ADC noise of about 20 codes.
+ ****************************/
+static void
+make_codes(int32_t* codes, uint32_t frames, int num_channels, int signal)
+{
+    uint32_t i;
+    int ch;
+    int32_t* c;
+
+    for (i = 0; i < frames; i++)
+    {
+        double t = i / BENCH_RATE;
+        for (ch = 0; ch < num_channels; ch++)
+        {
+            c = &codes[i * num_channels + ch];
+            switch (signal)
+            {
+                case SIGNAL_VIBRATION:
+                    *c = (int32_t)lrint(167772.0 * (0.1 * sin(2 * M_PI * (29.5 + ch) * t) +
+                        0.03 * sin(2 * M_PI * (1200 + 37 * ch) * t) + 0.01 * ch)) +
+                        noise(20);
+                    break;
+                case SIGNAL_SILENCE:
+                    *c = -1000 * ch;
+                    break;
+                case SIGNAL_NOISE:
+                    *c = noise(8388607);
+                    break;
+                case SIGNAL_EXTREMES:
+                    *c = ((i + ch) & 1) ? 8388607 : -8388608;
+                    break;
+                default:
+                    *c = ((i % 97) == (uint32_t)ch) ? ((i & 1) ? 8388607 : -8388608) :
+                        noise(5);
+                    break;
+            }
+        }
+    }
+}
+
+
+/****************************
+ * noise() - random code from -amplitude to amplitude
+ ****************************/
+static int32_t
+noise(int32_t amplitude)
+{
+    static uint64_t state = 88172645463325252ull;
+
+    //xorshift, the same every run
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return (int32_t)(state % (2 * (uint64_t)amplitude + 1)) - amplitude;
+}
+
+
+/****************************
+ * check_block() - codes and decodes a block
+ *
+ * returns - 1 if the decoded codes differ or the block is too big, 0 if not
+ ****************************/
+static int
+check_block(const int32_t* codes, uint32_t frames, int num_channels,
+    uint32_t* scratch, uint8_t* coded, int32_t* decoded)
+{
+    uint32_t bytes = codec_encode(codes, frames, num_channels, scratch, coded);
+
+    if ((bytes > codec_max_bytes(frames, num_channels)) ||
+        !codec_decode(coded, bytes, frames, num_channels, decoded) ||
+        (memcmp(codes, decoded, sizeof(int32_t) * frames * num_channels) != 0))
+    {
+        return 1;
+    }
+    //one byte short is an error, not garbage
+    if ((bytes > 0) && codec_decode(coded, bytes - 1, frames, num_channels, decoded) &&
+        (memcmp(codes, decoded, sizeof(int32_t) * frames * num_channels) != 0))
+    {
+        return 1;
+    }
+    return 0;
+}
+
+
+/****************************
+ * now() - monotonic time in seconds
+ ****************************/
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
@@ -0,0 +1,324 @@
+/******************************
+ * bench_dsp
+ *
+ * Benchmark of the DSP kernels in dsp.c.
+ *
+ * First checks the SIMD version of each kernel gives the same result
+ * as its scalar version, for 1 to 16 channels and odd lengths, so
+ * the ends which do not fill a vector are covered. Sums are added in
+ * a different order, so they are compared to a relative tolerance.
+ * Then compares the speed of the two, in samples per second, on
+ * blocks of 2 channels the size the acquisition thread reads.
+ *
+ * usage: bench_dsp [number of blocks]
+ * returns - 0 if the versions agree, 1 if not
+ ****************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "dsp.h"
+
+#define BENCH_CHANNELS 2
+#define BENCH_FRAMES 8192               //READ_BUF_SAMPLES, a block of the ring
+#define BENCH_RATE 51200.0
+#define BENCH_TOLERANCE 1e-12           //relative, for sums in a different order
+#define CHECK_FRAMES 4099               //odd, for the ends
+
+/* kernels timed, both versions */
+enum bench_kernel
+{
+    KERNEL_DEINTERLEAVE,
+    KERNEL_SCALE,
+    KERNEL_WINDOW,
+    KERNEL_SUM,
+    KERNEL_DOT,
+    KERNEL_SUM_MINMAX,
+    KERNEL_MOMENTS,
+    KERNEL_COUNT
+};
+
+static const char* kernel_names[KERNEL_COUNT] = {"deinterleave", "scale",
+    "window", "sum", "dot", "sum_minmax", "moments"};
+
+/* local function declarations */
+static void make_samples(double*, uint32_t, int);
+static int check_kernels(int);
+static int check_close(const char*, int, const double*, const double*, int);
+static double run_kernel(int, int, const double*, double*, const double*, int);
+static double now(void);
+
+/* the result of each run is added to this, so no run is optimised away */
+static volatile double sink;
+
+int main(int argc, char* argv[])
+{
+    int blocks = 2000;
+    double* samples;
+    double* out;
+    double* window;
+    double scalar_time, simd_time;
+    uint32_t i;
+    int errors = 0;
+    int nch;
+    int k;
+
+    if (argc > 1)
+    {
+        blocks = atoi(argv[1]);
+    }
+
+    //check the SIMD versions against the scalar versions
+    for (nch = 1; nch <= DSP_MAX_CHANNELS; nch++)
+    {
+        errors += check_kernels(nch);
+    }
+    if (errors)
+    {
+        printf("FAIL - SIMD and scalar results differ\n");
+        return 1;
+    }
+    printf("SIMD %s, results agree with the scalar versions\n", DSP_SIMD);
+
+    samples = malloc(sizeof(double) * BENCH_FRAMES * BENCH_CHANNELS);
+    out = malloc(sizeof(double) * BENCH_FRAMES * BENCH_CHANNELS);
+    window = malloc(sizeof(double) * BENCH_FRAMES * BENCH_CHANNELS);
+    if ((samples == NULL) || (out == NULL) || (window == NULL))
+    {
+        fprintf(stderr, "bench_dsp: out of memory\n");
+        return 1;
+    }
+    make_samples(samples, BENCH_FRAMES, BENCH_CHANNELS);
+    for (i = 0; i < BENCH_FRAMES * BENCH_CHANNELS; i++)
+    {
+        window[i] = 0.5 - 0.5 * cos(2.0 * M_PI * i / (BENCH_FRAMES * BENCH_CHANNELS));
+    }
+
+    printf("%-14s %14s %14s %9s\n", "kernel", "scalar Ms/s", "SIMD Ms/s", "speed up");
+    for (k = 0; k < KERNEL_COUNT; k++)
+    {
+        scalar_time = run_kernel(k, 0, samples, out, window, blocks);
+        simd_time = run_kernel(k, 1, samples, out, window, blocks);
+        printf("%-14s %14.1f %14.1f %8.1fx\n", kernel_names[k],
+            1e-6 * blocks * BENCH_FRAMES * BENCH_CHANNELS / scalar_time,
+            1e-6 * blocks * BENCH_FRAMES * BENCH_CHANNELS / simd_time,
+            scalar_time / simd_time);
+    }
+
+    free(samples);
+    free(out);
+    free(window);
+    return 0;
+}
+
+
+/****************************
+ * make_samples() - values as they would come from a scan, in g
+ ****************************/
+static void
+make_samples(double* samples, uint32_t frames, int num_channels)
+{
+    uint32_t i;
+    int ch;
+
+    for (i = 0; i < frames; i++)
+    {
+        double t = i / BENCH_RATE;
+        for (ch = 0; ch < num_channels; ch++)
+        {
+            samples[i * num_channels + ch] = (ch + 1) * sin(2 * M_PI * (100 + 37 * ch) * t) +
+                0.2 * ch + 0.01 * ((rand() % 1000) - 500) / 500.0;
+        }
+    }
+}
+
+
+/****************************
+ * check_kernels() - compares the two versions of every kernel
+ *
+ * returns - number of kernels which differ
+ ****************************/
+static int
+check_kernels(int num_channels)
+{
+    uint32_t frames = CHECK_FRAMES;
+    uint32_t n = frames * num_channels;
+    double* data = malloc(sizeof(double) * n);
+    double* a = malloc(sizeof(double) * n);
+    double* b = malloc(sizeof(double) * n);
+    double r1[DSP_MAX_CHANNELS * 3], r2[DSP_MAX_CHANNELS * 3];
+    double mean[DSP_MAX_CHANNELS];
+    int errors = 0;
+    int ch;
+
+    make_samples(data, frames, num_channels);
+
+    for (ch = 0; ch < num_channels; ch++)
+    {
+        dsp_deinterleave(a, data, frames, num_channels, ch);
+        dsp_deinterleave_scalar(b, data, frames, num_channels, ch);
+        errors += check_close("deinterleave", num_channels, a, b, frames);
+    }
+
+    dsp_scale(a, data, n, 0.25, 3.5);
+    dsp_scale_scalar(b, data, n, 0.25, 3.5);
+    errors += check_close("scale", num_channels, a, b, n);
+
+    dsp_window(a, data, data + 1, n - 1, 0.25);
+    dsp_window_scalar(b, data, data + 1, n - 1, 0.25);
+    errors += check_close("window", num_channels, a, b, n - 1);
+
+    r1[0] = dsp_sum(data, n);
+    r2[0] = dsp_sum_scalar(data, n);
+    r1[1] = dsp_dot(data, data + 1, n - 1);
+    r2[1] = dsp_dot_scalar(data, data + 1, n - 1);
+    errors += check_close("sum, dot", num_channels, r1, r2, 2);
+
+    dsp_sum_minmax(data, frames, num_channels, r1, r1 + DSP_MAX_CHANNELS,
+        r1 + 2 * DSP_MAX_CHANNELS);
+    dsp_sum_minmax_scalar(data, frames, num_channels, r2, r2 + DSP_MAX_CHANNELS,
+        r2 + 2 * DSP_MAX_CHANNELS);
+    for (ch = 0; ch < num_channels; ch++)
+    {
+        errors += check_close("sum_minmax", num_channels, r1 + ch, r2 + ch, 1);
+        errors += check_close("sum_minmax", num_channels,
+            r1 + DSP_MAX_CHANNELS + ch, r2 + DSP_MAX_CHANNELS + ch, 1);
+        errors += check_close("sum_minmax", num_channels,
+            r1 + 2 * DSP_MAX_CHANNELS + ch, r2 + 2 * DSP_MAX_CHANNELS + ch, 1);
+        mean[ch] = r2[ch] / frames;
+    }
+
+    dsp_moments(data, frames, num_channels, mean, r1, r1 + DSP_MAX_CHANNELS,
+        r1 + 2 * DSP_MAX_CHANNELS);
+    dsp_moments_scalar(data, frames, num_channels, mean, r2, r2 + DSP_MAX_CHANNELS,
+        r2 + 2 * DSP_MAX_CHANNELS);
+    for (ch = 0; ch < num_channels; ch++)
+    {
+        errors += check_close("moments", num_channels, r1 + ch, r2 + ch, 1);
+        errors += check_close("moments", num_channels,
+            r1 + DSP_MAX_CHANNELS + ch, r2 + DSP_MAX_CHANNELS + ch, 1);
+        errors += check_close("moments", num_channels,
+            r1 + 2 * DSP_MAX_CHANNELS + ch, r2 + 2 * DSP_MAX_CHANNELS + ch, 1);
+    }
+
+    free(data);
+    free(a);
+    free(b);
+    return errors;
+}
+
+
+/****************************
+ * check_close() - compares values to BENCH_TOLERANCE
+ *
+ * returns - 0 if all close, 1 if not
+ ****************************/
+static int
+check_close(const char* name, int num_channels, const double* a,
+    const double* b, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+    {
+        if (fabs(a[i] - b[i]) > BENCH_TOLERANCE * fmax(1.0, fabs(b[i])))
+        {
+            printf("%s, %d channels, value %d: SIMD %.17g scalar %.17g\n",
+                name, num_channels, i, a[i], b[i]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+/****************************
+ * run_kernel() - runs a kernel on a block of samples, blocks times
+ *
+ * returns - seconds taken
+ ****************************/
+static double
+run_kernel(int kernel, int simd, const double* samples, double* out,
+    const double* window, int blocks)
+{
+    uint32_t n = BENCH_FRAMES * BENCH_CHANNELS;
+    double mean[BENCH_CHANNELS] = {0.0, 0.2};
+    double r[BENCH_CHANNELS * 3];
+    double start = now();
+    double total = 0.0;
+    int i;
+    int ch;
+
+    for (i = 0; i < blocks; i++)
+    {
+        switch (kernel)
+        {
+            case KERNEL_DEINTERLEAVE:
+                for (ch = 0; ch < BENCH_CHANNELS; ch++)
+                {
+                    if (simd)
+                        dsp_deinterleave(out + ch * BENCH_FRAMES, samples,
+                            BENCH_FRAMES, BENCH_CHANNELS, ch);
+                    else
+                        dsp_deinterleave_scalar(out + ch * BENCH_FRAMES, samples,
+                            BENCH_FRAMES, BENCH_CHANNELS, ch);
+                }
+                total += out[i % n];
+                break;
+            case KERNEL_SCALE:
+                if (simd)
+                    dsp_scale(out, samples, n, 0.25, 3.5);
+                else
+                    dsp_scale_scalar(out, samples, n, 0.25, 3.5);
+                total += out[i % n];
+                break;
+            case KERNEL_WINDOW:
+                if (simd)
+                    dsp_window(out, samples, window, n, 0.25);
+                else
+                    dsp_window_scalar(out, samples, window, n, 0.25);
+                total += out[i % n];
+                break;
+            case KERNEL_SUM:
+                total += simd ? dsp_sum(samples, n) : dsp_sum_scalar(samples, n);
+                break;
+            case KERNEL_DOT:
+                total += simd ? dsp_dot(samples, window, n) :
+                    dsp_dot_scalar(samples, window, n);
+                break;
+            case KERNEL_SUM_MINMAX:
+                if (simd)
+                    dsp_sum_minmax(samples, BENCH_FRAMES, BENCH_CHANNELS, r,
+                        r + BENCH_CHANNELS, r + 2 * BENCH_CHANNELS);
+                else
+                    dsp_sum_minmax_scalar(samples, BENCH_FRAMES, BENCH_CHANNELS, r,
+                        r + BENCH_CHANNELS, r + 2 * BENCH_CHANNELS);
+                total += r[0];
+                break;
+            default:
+                if (simd)
+                    dsp_moments(samples, BENCH_FRAMES, BENCH_CHANNELS, mean, r,
+                        r + BENCH_CHANNELS, r + 2 * BENCH_CHANNELS);
+                else
+                    dsp_moments_scalar(samples, BENCH_FRAMES, BENCH_CHANNELS, mean, r,
+                        r + BENCH_CHANNELS, r + 2 * BENCH_CHANNELS);
+                total += r[0];
+                break;
+        }
+    }
+    sink += total;
+    return now() - start;
+}
+
+
+/****************************
+ * now() - monotonic time in seconds
+ ****************************/
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
@@ -0,0 +1,486 @@
+/******************************
+ * bench_e2e
+ *
+ * End to end benchmark of the acquisition to disk path.
+ *
+ * Runs scantofile_sim, scantofile linked with the simulated MCC 172
+ * library, for each log format, channel count and scan rate, each in
+ * its own directory with its own vib_params, as a continuous scan of
+ * the given number of seconds. So everything main() does is measured,
+ * the acquisition threads, the ring, the merge, the formatting and the
+ * writes to disk, only the hardware is simulated.
+ *
+ * With fast pacing the simulated boards have data as soon as it is
+ * read, so samples per second is the most scantofile can keep up
+ * with. With realtime pacing the data arrives at the scan rate, the
+ * CPU use is what the scan costs, and the scan buffer high water mark
+ * shows how close it came to an overrun. The CPU time includes making
+ * the simulated samples.
+ *
+ * Each run gives the samples per second, CPU use as a percentage of
+ * one core, bytes written per second, the ring and scan buffer high
+ * water marks and the percentiles of the time the writer thread took
+ * for each block, from the scan report, and whether it failed, from
+ * the error log. The results are written to stdout as JSON, progress
+ * to stderr.
+ *
+ * usage: bench_e2e [program] [seconds] [fast | realtime]
+ *  program - scantofile_sim, "../scantofile_sim" by default, as "make sim" leaves it
+ *  seconds - of data in each run, 5 by default
+ * returns - 0 if every run finished, 1 if not
+ ****************************/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <ftw.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "dsp.h"
+
+#define BENCH_DIR "/tmp/bench_e2e_XXXXXX"
+#define BENCH_RESULTS "results"
+#define BENCH_REPORT "_scanreport"       //ends the name of the scan report
+#define BENCH_ERRORS "_errorlog"        //and the error log
+#define BENCH_LINE 1024
+
+/* runs, every format for every channel count for every scan rate */
+static const char* formats[] = {"none", "binary", "compressed", "text"};
+static const int channels[] = {1, 2, 4, 8, 16};
+static const double rates[] = {6400.0, 25600.0, 51200.0};
+
+#define NUM_FORMATS (sizeof(formats) / sizeof(formats[0]))
+#define NUM_CHANNELS (sizeof(channels) / sizeof(channels[0]))
+#define NUM_RATES (sizeof(rates) / sizeof(rates[0]))
+
+/* what a run measured */
+struct bench_run
+{
+    int exit_status;                    //of scantofile_sim, -1 if it did not exit
+    double wall_time;                   //seconds
+    double cpu_time;                    //user and system seconds, all threads
+    uint64_t samples;                   //samples per channel of every board
+    uint64_t bytes;                     //written to the results directory
+    uint32_t ring_high_water;           //blocks, most of any board
+    uint32_t ring_blocks;
+    uint32_t ring_full;                 //times, all boards
+    uint32_t buffer_high_water;         //samples per channel, most of any board
+    uint32_t buffer_samples;
+    unsigned long long write_blocks;    //blocks the writer thread handled
+    uint32_t latency[5];                //p50, p90, p99, p99.9, max in us
+    char error[BENCH_LINE];             //first line of the error log
+};
+
+/* local function declarations */
+static bool run_one(const char*, const char*, int, double, double, bool,
+    struct bench_run*);
+static bool write_params(const char*, const char*, int, double, double);
+static void read_results(const char*, struct bench_run*);
+static void read_report(const char*, struct bench_run*);
+static void read_errors(const char*, struct bench_run*);
+static bool ends_with(const char*, const char*);
+static int remove_entry(const char*, const struct stat*, int, struct FTW*);
+static void print_json_string(const char*);
+static double now(void);
+
+int main(int argc, char* argv[])
+{
+    char program[PATH_MAX];
+    const char* path = "../scantofile_sim";
+    double seconds = 5.0;
+    bool realtime = false;
+    struct bench_run run;
+    bool first = true;
+    int failed = 0;
+    size_t f, c, r;
+
+    if (argc > 1)
+    {
+        path = argv[1];
+    }
+    if (argc > 2)
+    {
+        seconds = atof(argv[2]);
+    }
+    if (argc > 3)
+    {
+        realtime = (strcmp(argv[3], "realtime") == 0);
+    }
+    if ((realpath(path, program) == NULL) || (access(program, X_OK) != 0) ||
+        (seconds <= 0.0))
+    {
+        fprintf(stderr, "usage: bench_e2e [program] [seconds] [fast | realtime]\n"
+            "%s not found, \"make sim\" builds it\n", path);
+        return 1;
+    }
+
+    printf("{\n  \"benchmark\": \"bench_e2e\",\n  \"program\": ");
+    print_json_string(program);
+    printf(",\n  \"simd\": \"%s\",\n  \"pacing\": \"%s\",\n  \"seconds\": %g,\n"
+        "  \"runs\": [", DSP_SIMD, realtime ? "realtime" : "fast", seconds);
+
+    for (f = 0; f < NUM_FORMATS; f++)
+    {
+        for (c = 0; c < NUM_CHANNELS; c++)
+        {
+            for (r = 0; r < NUM_RATES; r++)
+            {
+                fprintf(stderr, "bench_e2e: %s, %d channels, %.0f Hz\n",
+                    formats[f], channels[c], rates[r]);
+                if (!run_one(program, formats[f], channels[c], rates[r],
+                    seconds, realtime, &run))
+                {
+                    printf("\n  ]\n}\n");
+                    return 1;
+                }
+                if ((run.exit_status != 0) || (run.error[0] != '\0'))
+                {
+                    failed++;
+                }
+
+                printf("%s\n    {\"format\": \"%s\", \"channels\": %d, \"scan_rate\": %.0f, "
+                    "\"exit_status\": %d, \"error\": ",
+                    first ? "" : ",", formats[f], channels[c], rates[r],
+                    run.exit_status);
+                print_json_string(run.error);
+                printf(",\n     \"wall_seconds\": %.3f, \"cpu_seconds\": %.3f, "
+                    "\"cpu_percent\": %.1f, \"realtime_factor\": %.2f,\n",
+                    run.wall_time, run.cpu_time,
+                    100.0 * run.cpu_time / run.wall_time,
+                    run.samples / (rates[r] * run.wall_time));
+                printf("     \"samples\": %llu, \"samples_per_second\": %.0f, "
+                    "\"bytes\": %llu, \"bytes_per_second\": %.0f,\n",
+                    (unsigned long long)run.samples * channels[c],
+                    run.samples * channels[c] / run.wall_time,
+                    (unsigned long long)run.bytes, run.bytes / run.wall_time);
+                printf("     \"ring_high_water_blocks\": %u, \"ring_blocks\": %u, "
+                    "\"ring_full\": %u, \"buffer_high_water_samples\": %u, "
+                    "\"buffer_samples\": %u,\n",
+                    run.ring_high_water, run.ring_blocks, run.ring_full,
+                    run.buffer_high_water, run.buffer_samples);
+                printf("     \"write_blocks\": %llu, \"latency_us\": {\"p50\": %u, "
+                    "\"p90\": %u, \"p99\": %u, \"p99.9\": %u, \"max\": %u}}",
+                    run.write_blocks, run.latency[0], run.latency[1],
+                    run.latency[2], run.latency[3], run.latency[4]);
+                fflush(stdout);
+                first = false;
+            }
+        }
+    }
+    printf("\n  ]\n}\n");
+
+    if (failed > 0)
+    {
+        fprintf(stderr, "bench_e2e: %d runs failed, see \"error\"\n", failed);
+        return 1;
+    }
+    return 0;
+}
+
+
+/****************************
+ * run_one() - runs scantofile_sim once and measures it
+ *
+ * In a new directory under /tmp, which is removed afterwards.
+ * Boards of 2 channels are added for more channels, as in a stack.
+ *
+ * returns - false if the run could not be started
+ ****************************/
+static bool
+run_one(const char* program, const char* format, int num_channels,
+    double rate, double seconds, bool realtime, struct bench_run* run)
+{
+    char dir[] = BENCH_DIR;
+    char boards[16];
+    struct rusage usage;
+    double start;
+    pid_t pid;
+    int status;
+    int fd;
+
+    memset(run, 0, sizeof(*run));
+    if ((mkdtemp(dir) == NULL) ||
+        !write_params(dir, format, num_channels, rate, seconds))
+    {
+        fprintf(stderr, "bench_e2e: cannot set up %s\n", dir);
+        return false;
+    }
+    sprintf(boards, "%d", (num_channels + 1) / 2);
+
+    start = now();
+    pid = fork();
+    if (pid < 0)
+    {
+        perror("bench_e2e: fork");
+        return false;
+    }
+    if (pid == 0)
+    {
+        fd = open("/dev/null", O_WRONLY);
+        if ((fd < 0) || (chdir(dir) != 0))
+        {
+            _exit(127);
+        }
+        dup2(fd, STDOUT_FILENO);
+        setenv("MCC172_SIM_BOARDS", boards, 1);
+        setenv("MCC172_SIM_PACING", realtime ? "realtime" : "fast", 1);
+        setenv("MCC172_SIM_TRIGGER", "0", 1);
+        execl(program, program, (char*)NULL);
+        _exit(127);
+    }
+    if (wait4(pid, &status, 0, &usage) != pid)
+    {
+        perror("bench_e2e: wait4");
+        return false;
+    }
+    run->wall_time = now() - start;
+    run->cpu_time = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 +
+        usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+    run->exit_status = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+
+    read_results(dir, run);
+    nftw(dir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    return true;
+}
+
+
+/****************************
+ * write_params() - writes the vib_params of a run
+ *
+ * The compressed format is a binary log file with compressed samples,
+ * the binary format has float32 samples, the default.
+ *
+ * returns - false if the file could not be written
+ ****************************/
+static bool
+write_params(const char* dir, const char* format, int num_channels,
+    double rate, double seconds)
+{
+    char filename[PATH_MAX];
+    bool compressed = (strcmp(format, "compressed") == 0);
+    FILE* fp;
+
+    snprintf(filename, sizeof(filename), "%s/vib_params", dir);
+    fp = fopen(filename, "w");
+    if (fp == NULL)
+    {
+        return false;
+    }
+    fprintf(fp, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<options>16</options>\n"
+        "<scan_rate>%.0f</scan_rate>\n"
+        "<samples_per_channel>%.0f</samples_per_channel>\n"
+        "<capture_seconds>%g</capture_seconds>\n"
+        "<number_of_channels>%d</number_of_channels>\n"
+        "<number_of_boards>%d</number_of_boards>\n"
+        "<sensitivity>100.0</sensitivity>\n"
+        "<iepe_supply>on</iepe_supply>\n"
+        "<read_mode>wait</read_mode>\n"
+        "<log_format>%s</log_format>\n"
+        "<sample_format>%s</sample_format>\n",
+        rate, rate * seconds, seconds, (num_channels == 1) ? 1 : 2,
+        (num_channels + 1) / 2, compressed ? "binary" : format,
+        compressed ? "compressed" : "float32");
+    return fclose(fp) == 0;
+}
+
+
+/****************************
+ * read_results() - adds up the bytes written and reads the report and errors
+ *
+ * Every file in the results directory is output of the scan, except
+ * the scan report and the error log, which are named after the host
+ * and the date, like the log file.
+ ****************************/
+static void
+read_results(const char* dir, struct bench_run* run)
+{
+    char path[PATH_MAX];
+    struct dirent* entry;
+    struct stat st;
+    DIR* d;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, BENCH_RESULTS);
+    d = opendir(path);
+    if (d == NULL)
+    {
+        strcpy(run->error, "no results directory");
+        return;
+    }
+    while ((entry = readdir(d)) != NULL)
+    {
+        snprintf(path, sizeof(path), "%s/%s/%s", dir, BENCH_RESULTS,
+            entry->d_name);
+        if ((stat(path, &st) != 0) || !S_ISREG(st.st_mode))
+        {
+            continue;
+        }
+        if (ends_with(entry->d_name, BENCH_REPORT))
+        {
+            read_report(path, run);
+        }
+        else if (ends_with(entry->d_name, BENCH_ERRORS))
+        {
+            read_errors(path, run);
+        }
+        else
+        {
+            run->bytes += st.st_size;
+        }
+    }
+    closedir(d);
+}
+
+
+/****************************
+ * read_report() - gets the measurements of the scan report
+ *
+ * A line for each board, then a line for the writer thread.
+ ****************************/
+static void
+read_report(const char* filename, struct bench_run* run)
+{
+    char line[BENCH_LINE];
+    unsigned long long samples;
+    unsigned int board, blocks, block_samples, high_water, percent, full;
+    unsigned int buffer_high_water, buffer_samples;
+    char* p;
+    FILE* fp;
+
+    fp = fopen(filename, "r");
+    if (fp == NULL)
+    {
+        return;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        //after the time and severity the logger adds to each line
+        p = strstr(line, "Scan complete: ");
+        if (p == NULL)
+        {
+            continue;
+        }
+        if (sscanf(p, "Scan complete: board %u, %llu samples per channel, "
+            "ring %u blocks of %u samples, high water %u blocks (%u%%), "
+            "ring full %u times, scan buffer high water %u of %u samples",
+            &board, &samples, &blocks, &block_samples, &high_water, &percent,
+            &full, &buffer_high_water, &buffer_samples) == 9)
+        {
+            //every board reads the same number of samples
+            run->samples = samples;
+            run->ring_blocks = blocks;
+            run->ring_full += full;
+            run->buffer_samples = buffer_samples;
+            if (high_water > run->ring_high_water)
+            {
+                run->ring_high_water = high_water;
+            }
+            if (buffer_high_water > run->buffer_high_water)
+            {
+                run->buffer_high_water = buffer_high_water;
+            }
+        }
+        else
+        {
+            sscanf(p, "Scan complete: writer, %llu blocks, latency p50 %u us, "
+                "p90 %u us, p99 %u us, p99.9 %u us, max %u us",
+                &run->write_blocks, &run->latency[0], &run->latency[1],
+                &run->latency[2], &run->latency[3], &run->latency[4]);
+        }
+    }
+    fclose(fp);
+}
+
+
+/****************************
+ * read_errors() - gets the first line of the error log
+ ****************************/
+static void
+read_errors(const char* filename, struct bench_run* run)
+{
+    FILE* fp;
+
+    fp = fopen(filename, "r");
+    if (fp == NULL)
+    {
+        return;
+    }
+    if (fgets(run->error, sizeof(run->error), fp) != NULL)
+    {
+        run->error[strcspn(run->error, "\n")] = '\0';
+    }
+    fclose(fp);
+}
+
+
+/****************************
+ * ends_with() - whether a string ends with another
+ ****************************/
+static bool
+ends_with(const char* s, const char* end)
+{
+    size_t len = strlen(s);
+    size_t end_len = strlen(end);
+
+    return (len >= end_len) && (strcmp(s + len - end_len, end) == 0);
+}
+
+
+/****************************
+ * remove_entry() - removes a file or directory, for nftw()
+ ****************************/
+static int
+remove_entry(const char* path, const struct stat* st, int flag, struct FTW* ftw)
+{
+    (void)st;
+    (void)flag;
+    (void)ftw;
+    remove(path);
+    return 0;
+}
+
+
+/****************************
+ * print_json_string() - prints a string in quotes, escaped for JSON
+ ****************************/
+static void
+print_json_string(const char* s)
+{
+    putchar('"');
+    for (; *s != '\0'; s++)
+    {
+        if ((*s == '"') || (*s == '\\'))
+        {
+            printf("\\%c", *s);
+        }
+        else if ((unsigned char)*s < 0x20)
+        {
+            printf("\\u%04x", *s);
+        }
+        else
+        {
+            putchar(*s);
+        }
+    }
+    putchar('"');
+}
+
+
+/****************************
+ * now() - monotonic time in seconds
+ ****************************/
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
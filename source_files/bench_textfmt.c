@@ -0,0 +1,397 @@
+/******************************
+ * bench_textfmt
+ *
+ * Benchmark of the text log formatting.
+ *
+ * Compares the original formatting path, sprintf() and strstr() for
+ * the time then fprintf("%s%s, %12.7f, %12.7f\n"), with textfmt_line()
+ * and a textbuf, in samples per second written to /dev/null.
+ * First checks the two give byte identical output, for a simulated
+ * scan and for values chosen to be hard to round, and that a line of
+ * the widest values fits in TEXTFMT_MAX_LINE.
+ * Then checks textfmt_parse() reads back the values formatted the same
+ * as strtod() does, and compares the two in values per second.
+ *
+ * usage: bench_textfmt [number of samples per channel]
+ * returns - 0 if the outputs are identical, 1 if not
+ ****************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "textfmt.h"
+
+#define BENCH_CHANNELS 2
+#define BENCH_DATE "2020-08-23 19:00:00"
+#define BENCH_RATE 51200.0
+
+/* local function declarations */
+static void make_samples(double*, uint32_t);
+static void write_stdio(FILE*, double*, uint32_t, int);
+static void write_textfmt(struct textbuf*, double*, uint32_t, int);
+static int check_identical(double*, uint32_t, int);
+static int check_widest(void);
+static char* format_values(double*, uint32_t);
+static int check_parse(const char*, uint32_t);
+static double time_parse(const char*, uint32_t, bool);
+static double now(void);
+
+int main(int argc, char* argv[])
+{
+    uint32_t frames = 2000000;
+    double* samples;
+    double* hard;
+    double start, stdio_time, textfmt_time, strtod_time, parse_time;
+    char* text;
+    uint32_t i;
+    int errors = 0;
+
+    if (argc > 1)
+    {
+        frames = strtoul(argv[1], NULL, 10);
+    }
+
+    samples = malloc(frames * BENCH_CHANNELS * sizeof(double));
+    hard = malloc(frames * BENCH_CHANNELS * sizeof(double));
+    if ((samples == NULL) || (hard == NULL))
+    {
+        fprintf(stderr, "bench_textfmt: out of memory\n");
+        return 1;
+    }
+    make_samples(samples, frames);
+
+    //values on and near the rounding boundaries, negative zero, large values
+    srand(172);
+    for (i = 0; i < frames * BENCH_CHANNELS; i++)
+    {
+        double v = (rand() % 2000001 - 1000000) / 1e7;
+        switch (i % 6)
+        {
+            case 0: hard[i] = v + 0.5e-7; break;
+            case 1: hard[i] = nextafter(v + 0.5e-7, 1.0); break;
+            case 2: hard[i] = nextafter(v + 0.5e-7, -1.0); break;
+            case 3: hard[i] = -(rand() % 100) * 1e-9; break;
+            case 4: hard[i] = v * 1e6 * (rand() % 1000); break;
+            default: hard[i] = ldexp(rand(), -(rand() % 60)); break;
+        }
+    }
+
+    //check both ways of formatting give the same output
+    errors += check_identical(samples, frames, 1);
+    errors += check_identical(samples, frames, 2);
+    errors += check_identical(hard, frames, 2);
+    errors += check_widest();
+    if (errors)
+    {
+        printf("FAIL - output differs\n");
+        return 1;
+    }
+    printf("output identical, %u samples per channel\n", frames);
+
+    //reading the values back
+    text = format_values(hard, frames * BENCH_CHANNELS);
+    errors += check_parse(text, frames * BENCH_CHANNELS);
+    free(text);
+    text = format_values(samples, frames * BENCH_CHANNELS);
+    errors += check_parse(text, frames * BENCH_CHANNELS);
+    if (errors)
+    {
+        printf("FAIL - values read differ from strtod()\n");
+        return 1;
+    }
+    printf("values read identical to strtod()\n");
+    strtod_time = time_parse(text, frames * BENCH_CHANNELS, false);
+    parse_time = time_parse(text, frames * BENCH_CHANNELS, true);
+    free(text);
+
+    FILE* fp = fopen("/dev/null", "w");
+    start = now();
+    write_stdio(fp, samples, frames, BENCH_CHANNELS);
+    fflush(fp);
+    stdio_time = now() - start;
+    fclose(fp);
+
+    struct textbuf tb;
+    textbuf_init(&tb, open("/dev/null", O_WRONLY), TEXTFMT_BUF_SIZE);
+    start = now();
+    write_textfmt(&tb, samples, frames, BENCH_CHANNELS);
+    textbuf_flush(&tb);
+    textfmt_time = now() - start;
+    close(tb.fd);
+    textbuf_free(&tb);
+
+    printf("%-10s %12.0f samples/s\n", "stdio",
+        frames * BENCH_CHANNELS / stdio_time);
+    printf("%-10s %12.0f samples/s\n", "textfmt",
+        frames * BENCH_CHANNELS / textfmt_time);
+    printf("speed up   %12.1f x\n", stdio_time / textfmt_time);
+    printf("%-10s %12.0f values/s\n", "strtod",
+        frames * BENCH_CHANNELS / strtod_time);
+    printf("%-10s %12.0f values/s\n", "parse",
+        frames * BENCH_CHANNELS / parse_time);
+    printf("speed up   %12.1f x\n", strtod_time / parse_time);
+
+    free(samples);
+    free(hard);
+    return 0;
+}
+
+
+/****************************
+ * make_samples() - values as they would come from a scan, in g
+ ****************************/
+static void
+make_samples(double* samples, uint32_t frames)
+{
+    uint32_t i;
+    for (i = 0; i < frames; i++)
+    {
+        double t = i / BENCH_RATE;
+        samples[i * 2] = 0.5 * sin(2 * M_PI * 100 * t) + 0.01 * ((rand() % 1000) - 500) / 500.0;
+        samples[i * 2 + 1] = 5.0 * cos(2 * M_PI * 1200 * t);
+    }
+}
+
+
+/****************************
+ * write_stdio() - the original formatting in main()
+ ****************************/
+static void
+write_stdio(FILE* fp, double* samples, uint32_t frames, int num_channels)
+{
+    char tmp_str[200];
+    double sample_time = 0.0;
+    uint32_t i;
+
+    for (i = 0; i < frames; i++)
+    {
+        int index = i * num_channels;
+        sprintf(tmp_str, "%.9f", sample_time);
+        char* s = strstr(tmp_str, ".");
+        if (num_channels == 1)
+        {
+            fprintf(fp, "%s%s, %12.7f\n", BENCH_DATE, s, samples[index]);
+        }
+        else
+        {
+            fprintf(fp, "%s%s, %12.7f, %12.7f\n", BENCH_DATE, s,
+                samples[index], samples[index + 1]);
+        }
+        sample_time += 1.0 / BENCH_RATE;
+    }
+}
+
+
+/****************************
+ * write_textfmt() - the formatting in scan_write_block()
+ ****************************/
+static void
+write_textfmt(struct textbuf* tb, double* samples, uint32_t frames,
+    int num_channels)
+{
+    size_t date_len = strlen(BENCH_DATE);
+    double sample_time = 0.0;
+    uint32_t i;
+    char* p;
+
+    for (i = 0; i < frames; i++)
+    {
+        p = textbuf_reserve(tb);
+        p = textfmt_line(p, BENCH_DATE, date_len, sample_time,
+            &samples[i * num_channels], num_channels);
+        tb->len = p - tb->buf;
+        sample_time += 1.0 / BENCH_RATE;
+    }
+}
+
+
+/****************************
+ * check_identical() - compares the output of both ways of formatting
+ *
+ * returns - 0 if identical, 1 if not
+ ****************************/
+static int
+check_identical(double* samples, uint32_t frames, int num_channels)
+{
+    char* expected = NULL;
+    size_t expected_len = 0;
+    char path[] = "/tmp/bench_textfmtXXXXXX";
+    struct textbuf tb;
+    int result = 0;
+
+    FILE* fp = open_memstream(&expected, &expected_len);
+    write_stdio(fp, samples, frames, num_channels);
+    fclose(fp);
+
+    int fd = mkstemp(path);
+    unlink(path);
+    textbuf_init(&tb, fd, TEXTFMT_BUF_SIZE);
+    write_textfmt(&tb, samples, frames, num_channels);
+    textbuf_flush(&tb);
+    textbuf_free(&tb);
+
+    size_t actual_len = lseek(fd, 0, SEEK_END);
+    char* actual = malloc(actual_len + 1);
+    pread(fd, actual, actual_len, 0);
+    close(fd);
+
+    if ((actual_len != expected_len) || memcmp(actual, expected, actual_len))
+    {
+        size_t i = 0;
+        while ((i < actual_len) && (i < expected_len) && (actual[i] == expected[i]))
+        {
+            i++;
+        }
+        while ((i > 0) && (expected[i - 1] != '\n'))
+        {
+            i--;
+        }
+        printf("%d channel output differs at byte %zu\nstdio:   %.80s\ntextfmt: %.80s\n",
+            num_channels, i, expected + i, actual + i);
+        result = 1;
+    }
+    free(actual);
+    free(expected);
+    return result;
+}
+
+
+/****************************
+ * check_widest() - a line of the widest values, compared with snprintf()
+ *
+ * -DBL_MAX, and the infinities and nan, are formatted by snprintf() in
+ * textfmt_f12_7(), the line has to be no longer than TEXTFMT_MAX_LINE.
+ *
+ * returns - 0 if identical and it fits, 1 if not
+ ****************************/
+static int
+check_widest(void)
+{
+    double values[TEXTFMT_MAX_CHANNELS];
+    char* expected = malloc(2 * TEXTFMT_MAX_LINE);
+    char* actual = malloc(TEXTFMT_MAX_LINE);
+    size_t len;
+    int result = 0;
+    int i;
+    int n;
+
+    for (i = 0; i < TEXTFMT_MAX_CHANNELS; i++)
+    {
+        values[i] = (i == 1) ? INFINITY : (i == 2) ? NAN : -DBL_MAX;
+    }
+    n = sprintf(expected, "%s%s", BENCH_DATE, ".000000000");
+    for (i = 0; i < TEXTFMT_MAX_CHANNELS; i++)
+    {
+        n += sprintf(expected + n, ", %12.7f", values[i]);
+    }
+    expected[n++] = '\n';
+
+    len = textfmt_line(actual, BENCH_DATE, strlen(BENCH_DATE), 0.0, values,
+        TEXTFMT_MAX_CHANNELS) - actual;
+    if ((n > TEXTFMT_MAX_LINE) || (len != (size_t)n) || memcmp(actual, expected, len))
+    {
+        printf("widest line of %d chars differs or is longer than %d\n", n,
+            TEXTFMT_MAX_LINE);
+        result = 1;
+    }
+    free(actual);
+    free(expected);
+    return result;
+}
+
+
+/****************************
+ * format_values() - values formatted as in the text log, one per line
+ ****************************/
+static char*
+format_values(double* values, uint32_t count)
+{
+    //the values of the benchmark are less than 1e15, 24 chars at most
+    char* text = malloc((size_t)count * 32 + 1);
+    char* p = text;
+    uint32_t i;
+
+    for (i = 0; i < count; i++)
+    {
+        p = textfmt_f12_7(p, values[i]);
+        *p++ = '\n';
+    }
+    *p = '\0';
+    return text;
+}
+
+
+/****************************
+ * check_parse() - compares textfmt_parse() with strtod() for each value
+ *
+ * returns - 0 if identical, 1 if not
+ ****************************/
+static int
+check_parse(const char* text, uint32_t count)
+{
+    const char* p = text;
+    double parsed;
+    double expected;
+    uint32_t i;
+
+    for (i = 0; i < count; i++)
+    {
+        expected = strtod(p, NULL);
+        p = textfmt_parse(p, &parsed);
+        if ((p == NULL) || (*p != '\n') ||
+            (memcmp(&parsed, &expected, sizeof(parsed)) != 0))
+        {
+            printf("value %u read as %.17g, strtod() gives %.17g\n", i,
+                parsed, expected);
+            return 1;
+        }
+        p++;
+    }
+    return 0;
+}
+
+
+/****************************
+ * time_parse() - time to read the values, with textfmt_parse() or strtod()
+ ****************************/
+static double
+time_parse(const char* text, uint32_t count, bool fast)
+{
+    const char* p = text;
+    volatile double sum = 0.0;
+    double value;
+    double start = now();
+    char* end;
+    uint32_t i;
+
+    for (i = 0; i < count; i++)
+    {
+        if (fast)
+        {
+            p = textfmt_parse(p, &value);
+        }
+        else
+        {
+            value = strtod(p, &end);
+            p = end;
+        }
+        sum += value;
+        p++;
+    }
+    return now() - start;
+}
+
+
+/****************************
+ * now() - monotonic time in seconds
+ ****************************/
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
@@ -0,0 +1,636 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <math.h>
+#include "binlog.h"
+#include "dsp.h"
+
+/* local function declarations */
+static uint32_t binlog_convert(struct binlog*, double*, uint32_t);
+static void binlog_codes(struct binlog*, double*, uint32_t);
+static bool binlog_chunk_add(struct binlog*, double*, uint32_t);
+static bool binlog_chunk_write(struct binlog*);
+static uint32_t binlog_columns(struct binlog*, uint32_t);
+
+/*****************************
+ * binlog_header_init() - sets up a header with default values
+ *
+ * Calibration is set for scaled data, slope of one and zero offset,
+ * and the sensitivity to 1000 mV per unit, so the caller only sets
+ * the values which are different, such as the start time.
+ *
+ * param header - header to initialise
+ * param sample_format - one of enum binlog_format
+ * param num_channels - number of channels in each frame
+ * param scan_rate - actual scan rate per channel
+****************************/
+
+void
+binlog_header_init(struct binlog_header* header, uint32_t sample_format,
+    int num_channels, double scan_rate)
+{
+    int i;
+
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, BINLOG_MAGIC, sizeof(header->magic));
+    header->version = BINLOG_VERSION;
+    header->header_size = BINLOG_HEADER_SIZE;
+    header->sample_format = sample_format;
+    header->num_channels = num_channels;
+    header->scan_rate = scan_rate;
+    header->code_lsb = BINLOG_CODE_LSB;
+
+    for (i = 0; i < BINLOG_MAX_CHANNELS; i++)
+    {
+        header->sensitivity[i] = 1000.0;
+        header->cal_slope[i] = 1.0;
+        header->cal_offset[i] = 0.0;
+    }
+
+    //hostname is not null terminated if too long, keep the last char zero
+    gethostname(header->hostname, sizeof(header->hostname) - 1);
+}
+
+
+/*****************************
+ * binlog_sample_size() - number of bytes of a sample in a binlog file
+ *
+ * Compressed samples are the size of an int24 code before they are coded.
+ *
+ * param sample_format - one of enum binlog_format
+ * returns - size in bytes or 0 if the format is not valid
+****************************/
+
+uint32_t
+binlog_sample_size(uint32_t sample_format)
+{
+    switch (sample_format)
+    {
+        case BINLOG_FLOAT32:
+            return 4;
+        case BINLOG_FLOAT64:
+            return 8;
+        case BINLOG_INT24:
+        case BINLOG_COMPRESSED:
+            return 3;
+        default:
+            return 0;
+    }
+}
+
+
+/*****************************
+ * binlog_open() - creates a binlog file and writes the header
+ *
+ * The file is written by filewriter.c, with space reserved for the
+ * frames expected. Compressed files are written the same way, but
+ * their size is not known, so space is reserved as they grow.
+ * If the header has BINLOG_FLAG_CHUNKED set, the frames are kept
+ * until there are chunk_frames of them, so the buffers are for a
+ * chunk, 8 bytes per sample for the frames, and as much again.
+ *
+ * Any errors return false, otherwise return true
+ *
+ * param log - binlog to open
+ * param filename - name of file, including path
+ * param header - header for the file, copied into log
+ * param max_frames - most frames passed to each binlog_write() call
+ * param expected_frames - frames the file is expected to have, 0 if not known
+ * returns - false if error creating the file
+****************************/
+
+bool
+binlog_open(struct binlog* log, char* filename, struct binlog_header* header,
+    uint32_t max_frames, uint64_t expected_frames)
+{
+    bool compressed = header->sample_format == BINLOG_COMPRESSED;
+    bool chunked = (header->flags & BINLOG_FLAG_CHUNKED) != 0;
+    uint32_t frames = chunked ? header->chunk_frames : max_frames;
+
+    memset(log, 0, sizeof(*log));
+    log->file.fd = -1;
+    log->header = *header;
+    log->header.chunk_count = 0;
+    log->header.index_offset = 0;
+    log->frame_size = binlog_sample_size(header->sample_format) *
+        header->num_channels;
+    if ((log->frame_size == 0) || (header->num_channels > BINLOG_MAX_CHANNELS) ||
+        (frames == 0))
+    {
+        return false;
+    }
+
+    log->buffer_frames = max_frames;
+    if (compressed)
+    {
+        log->buffer = malloc(sizeof(struct codec_block) +
+            codec_max_bytes(frames, header->num_channels));
+        log->scratch = malloc(sizeof(uint32_t) * frames);
+    }
+    else
+    {
+        log->buffer = malloc((size_t)frames * log->frame_size);
+    }
+    if (compressed || (header->sample_format == BINLOG_INT24))
+    {
+        log->codes = malloc(sizeof(int32_t) * frames * header->num_channels);
+    }
+    if (chunked)
+    {
+        log->chunk = malloc(sizeof(double) * frames * header->num_channels);
+        log->columns = compressed ? NULL : malloc((size_t)frames * log->frame_size);
+    }
+    if ((log->buffer == NULL) || (compressed && (log->scratch == NULL)) ||
+        ((log->codes == NULL) && (compressed || (header->sample_format == BINLOG_INT24))) ||
+        (chunked && ((log->chunk == NULL) || (!compressed && (log->columns == NULL)))))
+    {
+        binlog_close(log);
+        return false;
+    }
+
+    if (compressed)
+    {
+        expected_frames = 0;
+    }
+    if (!filewriter_open(&log->file, filename,
+        header->header_size + expected_frames * log->frame_size))
+    {
+        binlog_close(log);
+        return false;
+    }
+
+    if (!filewriter_write(&log->file, &log->header, sizeof(log->header)))
+    {
+        binlog_close(log);
+        return false;
+    }
+    return true;
+}
+
+
+/*****************************
+ * binlog_write() - appends frames to a binlog file
+ *
+ * The samples are interleaved, as returned by mcc172_a_in_scan_read(),
+ * and converted to the sample format of the file. If the header has
+ * BINLOG_FLAG_RAW_CODES set, the samples are ADC codes and are only
+ * rounded and packed.
+ * Compressed frames are written as one block. The frames of a chunked
+ * file are added to the chunk, which is written when it is full.
+ *
+ * Any errors return false, otherwise return true
+ *
+ * param log - binlog to write to
+ * param data - samples, num_channels per frame
+ * param frames - number of frames, not more than max_frames
+ * returns - false if error writing to the file
+****************************/
+
+bool
+binlog_write(struct binlog* log, double* data, uint32_t frames)
+{
+    uint32_t bytes;
+
+    if (frames > log->buffer_frames)
+    {
+        return false;
+    }
+    if (log->header.flags & BINLOG_FLAG_CHUNKED)
+    {
+        return binlog_chunk_add(log, data, frames);
+    }
+
+    if (log->header.sample_format == BINLOG_FLOAT64)
+    {
+        //already in the right format, no need to copy
+        bytes = frames * log->frame_size;
+        if (!filewriter_write(&log->file, data, bytes))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        bytes = binlog_convert(log, data, frames);
+        if (!filewriter_write(&log->file, log->buffer, bytes))
+        {
+            return false;
+        }
+    }
+
+    log->header.frame_count += frames;
+    return true;
+}
+
+
+/*****************************
+ * binlog_close() - closes a binlog file
+ *
+ * Updates the frame count in the header, then closes the file.
+ * A chunked file has the last chunk written, then the index, which
+ * the header is updated to point to.
+ *
+ * Any errors return false, otherwise return true
+ *
+ * param log - binlog to close
+ * returns - false if error updating the header or closing the file
+****************************/
+
+bool
+binlog_close(struct binlog* log)
+{
+    bool ok = true;
+
+    if (log->file.fd >= 0)
+    {
+        if (log->header.flags & BINLOG_FLAG_CHUNKED)
+        {
+            ok = binlog_chunk_write(log);
+            log->header.index_offset = log->file.offset + log->file.fill;
+            if (!ok || !filewriter_write(&log->file, log->index,
+                sizeof(struct binlog_chunk) * log->header.chunk_count))
+            {
+                //a reader finds the chunks without the index
+                log->header.index_offset = 0;
+                log->header.chunk_count = 0;
+                ok = false;
+            }
+        }
+        if (!filewriter_rewrite(&log->file, &log->header, sizeof(log->header), 0))
+        {
+            ok = false;
+        }
+    }
+    ok = filewriter_close(&log->file) && ok;
+    free(log->buffer);
+    free(log->codes);
+    free(log->scratch);
+    free(log->chunk);
+    free(log->columns);
+    free(log->index);
+    log->buffer = NULL;
+    log->codes = NULL;
+    log->scratch = NULL;
+    log->chunk = NULL;
+    log->columns = NULL;
+    log->index = NULL;
+    return ok;
+}
+
+
+/*****************************
+ * binlog_frames_in() - most frames a binlog file of a size can hold
+ *
+ * Each chunk of a chunked file takes the size of its struct twice,
+ * before its samples and in the index.
+ *
+ * param header - header of the file
+ * param bytes - size of the file, including the header
+ * returns - number of frames, 0 if compressed, as the size of a frame
+ *           is not known, or if there is no room for one
+****************************/
+
+uint64_t
+binlog_frames_in(const struct binlog_header* header, uint64_t bytes)
+{
+    uint64_t frame_size = (uint64_t)binlog_sample_size(header->sample_format) *
+        header->num_channels;
+    uint64_t overhead = 2 * sizeof(struct binlog_chunk);
+    uint64_t chunk_size;
+    uint64_t frames;
+
+    if ((header->sample_format == BINLOG_COMPRESSED) || (frame_size == 0) ||
+        (bytes <= header->header_size))
+    {
+        return 0;
+    }
+    bytes -= header->header_size;
+    if (!(header->flags & BINLOG_FLAG_CHUNKED) || (header->chunk_frames == 0))
+    {
+        return bytes / frame_size;
+    }
+
+    chunk_size = overhead + header->chunk_frames * frame_size;
+    frames = bytes / chunk_size * header->chunk_frames;
+    bytes %= chunk_size;
+    if (bytes > overhead)
+    {
+        frames += (bytes - overhead) / frame_size;
+    }
+    return frames;
+}
+
+
+/*****************************
+ * binlog_crc32() - CRC-32 of bytes, the checksum of a chunk
+ *
+ * The same CRC-32 as zlib, and Python's zlib.crc32(), so the chunks
+ * can be checked with other tools. The table is worked out each call,
+ * which is little next to the bytes of a chunk, and leaves nothing
+ * shared between threads.
+ *
+ * param crc - CRC-32 of the bytes before, 0 to start
+ * param data - bytes
+ * param size - number of bytes
+ * returns - CRC-32 of the bytes before and these
+****************************/
+
+uint32_t
+binlog_crc32(uint32_t crc, const void* data, size_t size)
+{
+    const uint8_t* p = data;
+    uint32_t table[256];
+    uint32_t c;
+    int i;
+    int k;
+
+    for (i = 0; i < 256; i++)
+    {
+        c = i;
+        for (k = 0; k < 8; k++)
+        {
+            c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+        }
+        table[i] = c;
+    }
+
+    crc = ~crc;
+    while (size-- > 0)
+    {
+        crc = table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+
+/*****************************
+ * binlog_convert() - converts frames into the sample format of the file
+ *
+ * param log - binlog with the buffer to convert into
+ * param data - samples, num_channels per frame
+ * param frames - number of frames
+ * returns - number of bytes in the buffer
+****************************/
+
+static uint32_t
+binlog_convert(struct binlog* log, double* data, uint32_t frames)
+{
+    uint32_t num_samples = frames * log->header.num_channels;
+    struct codec_block block;
+    uint32_t i;
+
+    if (log->header.sample_format == BINLOG_FLOAT32)
+    {
+        float* out = (float*)log->buffer;
+        for (i = 0; i < num_samples; i++)
+        {
+            out[i] = (float)data[i];
+        }
+        return num_samples * sizeof(float);
+    }
+
+    binlog_codes(log, data, frames);
+    if (log->header.sample_format == BINLOG_COMPRESSED)
+    {
+        block.frames = frames;
+        block.bytes = codec_encode(log->codes, frames, log->header.num_channels,
+            log->scratch, log->buffer + sizeof(block));
+        memcpy(log->buffer, &block, sizeof(block));
+        return sizeof(block) + block.bytes;
+    }
+
+    uint8_t* out = log->buffer;
+    for (i = 0; i < num_samples; i++)
+    {
+        int32_t c = log->codes[i];
+        out[0] = c & 0xff;
+        out[1] = (c >> 8) & 0xff;
+        out[2] = (c >> 16) & 0xff;
+        out += 3;
+    }
+    return num_samples * 3;
+}
+
+
+/*****************************
+ * binlog_codes() - converts frames into int24 codes
+ *
+ * param log - binlog with the codes to convert into
+ * param data - samples, num_channels per frame
+ * param frames - number of frames
+****************************/
+
+static void
+binlog_codes(struct binlog* log, double* data, uint32_t frames)
+{
+    uint32_t num_samples = frames * log->header.num_channels;
+    int32_t* out = log->codes;
+    uint32_t i;
+    int ch = 0;
+
+    if (log->header.flags & BINLOG_FLAG_RAW_CODES)
+    {
+        /* codes in the range of the ADC, no scaling, calibrated or decimated
+         * codes are rounded, and clipped as the filters can overshoot full scale
+         */
+        for (i = 0; i < num_samples; i++)
+        {
+            double code = nearbyint(data[i]);
+            if (code > BINLOG_MAX_CODE) code = BINLOG_MAX_CODE;
+            if (code < BINLOG_MIN_CODE) code = BINLOG_MIN_CODE;
+            out[i] = (int32_t)code;
+        }
+    }
+    else
+    {
+        /* Quantise to a code, which is converted back to units with
+         * value = (code - cal_offset) * cal_slope * code_lsb * 1000 / sensitivity
+         */
+        double codes_per_unit[BINLOG_MAX_CHANNELS];
+        for (ch = 0; ch < log->header.num_channels; ch++)
+        {
+            codes_per_unit[ch] = log->header.sensitivity[ch] /
+                (log->header.cal_slope[ch] * log->header.code_lsb * 1000.0);
+        }
+
+        ch = 0;
+        for (i = 0; i < num_samples; i++)
+        {
+            double code = nearbyint(data[i] * codes_per_unit[ch] +
+                log->header.cal_offset[ch]);
+            if (code > BINLOG_MAX_CODE) code = BINLOG_MAX_CODE;
+            if (code < BINLOG_MIN_CODE) code = BINLOG_MIN_CODE;
+            out[i] = (int32_t)code;
+            if (++ch == log->header.num_channels)
+            {
+                ch = 0;
+            }
+        }
+    }
+}
+
+
+/*****************************
+ * binlog_chunk_add() - adds frames to the chunk being filled
+ *
+ * Writes the chunk each time it is full.
+ *
+ * param log - chunked binlog
+ * param data - samples, num_channels per frame
+ * param frames - number of frames
+ * returns - false if error writing to the file
+****************************/
+
+static bool
+binlog_chunk_add(struct binlog* log, double* data, uint32_t frames)
+{
+    uint32_t num_channels = log->header.num_channels;
+    uint32_t n;
+
+    while (frames > 0)
+    {
+        n = log->header.chunk_frames - log->chunk_fill;
+        if (n > frames)
+        {
+            n = frames;
+        }
+        memcpy(log->chunk + (size_t)log->chunk_fill * num_channels, data,
+            sizeof(double) * n * num_channels);
+        log->chunk_fill += n;
+        log->header.frame_count += n;
+        data += (size_t)n * num_channels;
+        frames -= n;
+        if ((log->chunk_fill == log->header.chunk_frames) && !binlog_chunk_write(log))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/*****************************
+ * binlog_chunk_write() - writes the chunk, and adds it to the index
+ *
+ * The statistics are of the samples as they are logged, before they
+ * are converted to the sample format, with dsp_sum_minmax() and
+ * dsp_moments(), as in the stats file. The RMS includes the mean.
+ *
+ * param log - chunked binlog
+ * returns - false if error writing to the file, or allocating the index
+****************************/
+
+static bool
+binlog_chunk_write(struct binlog* log)
+{
+    uint32_t num_channels = log->header.num_channels;
+    uint32_t frames = log->chunk_fill;
+    double sum[BINLOG_MAX_CHANNELS];
+    double min[BINLOG_MAX_CHANNELS];
+    double max[BINLOG_MAX_CHANNELS];
+    double mean[BINLOG_MAX_CHANNELS];
+    double m2[BINLOG_MAX_CHANNELS];
+    double m3[BINLOG_MAX_CHANNELS];
+    double m4[BINLOG_MAX_CHANNELS];
+    struct binlog_chunk chunk;
+    struct binlog_chunk* index;
+    const uint8_t* samples;
+    uint32_t size;
+    uint32_t ch;
+
+    if (frames == 0)
+    {
+        return true;
+    }
+    log->chunk_fill = 0;
+
+    memset(&chunk, 0, sizeof(chunk));
+    chunk.first_frame = log->header.frame_count - frames;
+    chunk.offset = log->file.offset + log->file.fill + sizeof(chunk);
+    chunk.frames = frames;
+
+    dsp_sum_minmax(log->chunk, frames, num_channels, sum, min, max);
+    for (ch = 0; ch < num_channels; ch++)
+    {
+        mean[ch] = sum[ch] / frames;
+    }
+    dsp_moments(log->chunk, frames, num_channels, mean, m2, m3, m4);
+    for (ch = 0; ch < num_channels; ch++)
+    {
+        chunk.min[ch] = (float)min[ch];
+        chunk.max[ch] = (float)max[ch];
+        chunk.mean[ch] = (float)mean[ch];
+        chunk.rms[ch] = (float)sqrt(mean[ch] * mean[ch] + m2[ch] / frames);
+    }
+
+    if (log->header.sample_format == BINLOG_COMPRESSED)
+    {
+        binlog_codes(log, log->chunk, frames);
+        chunk.bytes = codec_encode(log->codes, frames, num_channels, log->scratch,
+            log->buffer);
+        samples = log->buffer;
+    }
+    else
+    {
+        chunk.bytes = binlog_columns(log, frames);
+        samples = log->columns;
+    }
+    chunk.checksum = binlog_crc32(0, samples, chunk.bytes);
+
+    if (log->header.chunk_count == log->index_size)
+    {
+        size = (log->index_size > 0) ? 2 * log->index_size : 64;
+        index = realloc(log->index, sizeof(struct binlog_chunk) * size);
+        if (index == NULL)
+        {
+            return false;
+        }
+        log->index = index;
+        log->index_size = size;
+    }
+    log->index[log->header.chunk_count++] = chunk;
+
+    return filewriter_write(&log->file, &chunk, sizeof(chunk)) &&
+        filewriter_write(&log->file, samples, chunk.bytes);
+}
+
+
+/*****************************
+ * binlog_columns() - converts the frames of a chunk into columns
+ *
+ * The frames are converted into the sample format, then the samples
+ * of each channel are put together, one channel after the other.
+ *
+ * param log - chunked binlog, not compressed
+ * param frames - number of frames in the chunk
+ * returns - number of bytes in columns
+****************************/
+
+static uint32_t
+binlog_columns(struct binlog* log, uint32_t frames)
+{
+    uint32_t num_channels = log->header.num_channels;
+    uint32_t size = binlog_sample_size(log->header.sample_format);
+    const uint8_t* in = (const uint8_t*)log->chunk;
+    uint8_t* out = log->columns;
+    uint32_t ch;
+    uint32_t i;
+
+    if (log->header.sample_format != BINLOG_FLOAT64)
+    {
+        binlog_convert(log, log->chunk, frames);
+        in = log->buffer;
+    }
+    for (ch = 0; ch < num_channels; ch++)
+    {
+        const uint8_t* p = in + ch * size;
+        for (i = 0; i < frames; i++)
+        {
+            memcpy(out, p, size);
+            out += size;
+            p += log->frame_size;
+        }
+    }
+    return frames * log->frame_size;
+}
@@ -0,0 +1,169 @@
+/*****************************************
+ * binlog.h
+ *
+ * Compact binary log file format
+ *
+ * A binlog file is a struct binlog_header followed by frames.
+ * A frame holds one sample for each channel, in channel order,
+ * in the sample format given in the header. With more than one
+ * board the channels of each board follow those of the board before,
+ * in the order of board_address. Sample times are not
+ * stored, sample n of the file was taken at
+ *
+ *      start_sec + start_nsec / 1e9 + n / scan_rate
+ *
+ * All values are little endian, as on the Raspberry Pi.
+ *
+ * int24 samples are converted back to units with
+ *
+ *      value = (code - cal_offset) * cal_slope * code_lsb * 1000 / sensitivity
+ *
+ * For scaled data cal_slope is 1 and cal_offset is 0, so the
+ * quantisation step is the resolution of the ADC.
+ *
+ * If the flag BINLOG_FLAG_RAW_CODES is set the scan was made with
+ * OPTS_NOSCALEDATA, and the int24 samples are the ADC codes read,
+ * rounded, as the library calibrates them unless OPTS_NOCALIBRATEDATA
+ * is set, which gives them a fraction. If OPTS_NOCALIBRATEDATA was
+ * used too, the codes are as read, with no rounding, and cal_slope
+ * and cal_offset are the calibration coefficients of the channel,
+ * as the library applies them, so the formula above gives calibrated
+ * values.
+ *
+ * The decimated log file of a scan has the same header, with the
+ * decimated rate as the scan rate. Decimated raw codes are rounded.
+ *
+ * In the compressed sample format the samples are int24 codes, as
+ * above, coded in blocks by codec.c, so they take about a third of the
+ * space, and vibdecode gives back the int24 file. A block is a struct
+ * codec_block, with the number of frames in it, then the block, see
+ * codec.h. If the file was not closed the frame count is 0, and the
+ * blocks run to the end of the file.
+ *
+ * A long scan can be split into segments, each a binlog file with its
+ * own header. Frame n of a segment is frame first_frame + n of the
+ * scan, and its start time is that of the frame, so the segments
+ * follow on from each other with no frames missing or repeated.
+ *
+ * If the flag BINLOG_FLAG_CHUNKED is set the frames are in chunks of
+ * chunk_frames, the last can have fewer. A chunk is a struct
+ * binlog_chunk, then its samples, a column for each channel in turn,
+ * or a block of codec.c if compressed, with no struct codec_block.
+ * The struct has where the chunk is in the file and the scan, the
+ * minimum, maximum, mean and RMS of each channel, and a CRC-32 of
+ * the samples. When the file is closed a copy of every struct, the
+ * index, is added at the end, at index_offset, so a reader can find
+ * the chunks of a time, or show the whole file from the statistics,
+ * by reading the index alone. If the file was not closed index_offset
+ * is 0, and the chunks can be found by reading each struct in turn.
+ *****************************************/
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "codec.h"
+#include "filewriter.h"
+
+//header guard
+
+#ifndef BINLOG_H
+#define BINLOG_H
+
+#define BINLOG_MAGIC "MCC172BL"         //first 8 bytes of the file, no null
+#define BINLOG_VERSION 1
+#define BINLOG_HEADER_SIZE 1024
+#define BINLOG_MAX_CHANNELS 16
+#define BINLOG_FILE_EXT ".bin"
+
+/* volts per ADC code, +/-5V over 24 bits */
+#define BINLOG_CODE_LSB (5.0 / 8388608.0)
+#define BINLOG_MAX_CODE 8388607
+#define BINLOG_MIN_CODE (-8388608)
+
+/* sample formats */
+enum binlog_format
+{
+    BINLOG_FLOAT32 = 1,
+    BINLOG_FLOAT64 = 2,
+    BINLOG_INT24 = 3,
+    BINLOG_COMPRESSED = 4                   //int24 codes, in blocks coded by codec.c
+};
+
+/* header flags */
+#define BINLOG_FLAG_RAW_CODES 0x0001    //int24 samples are ADC codes, as read
+#define BINLOG_FLAG_CHUNKED 0x0002      //frames are in chunks, with an index at the end
+
+struct binlog_header
+{
+    char magic[8];                          //BINLOG_MAGIC
+    uint32_t version;                       //BINLOG_VERSION
+    uint32_t header_size;                   //bytes before the first frame
+    uint32_t sample_format;                 //one of enum binlog_format
+    uint32_t num_channels;
+    uint32_t options;                       //scan options, OPTS_*
+    uint32_t flags;                         //BINLOG_FLAG_*
+    double scan_rate;                       //actual scan rate per channel
+    int64_t start_sec;                      //time of first sample, since 1970
+    int64_t start_nsec;
+    uint64_t frame_count;                   //number of frames, 0 if unknown
+    double code_lsb;                        //volts per ADC code
+    double sensitivity[BINLOG_MAX_CHANNELS];//mV per unit
+    double cal_slope[BINLOG_MAX_CHANNELS];  //int24 calibration
+    double cal_offset[BINLOG_MAX_CHANNELS];
+    char hostname[64];
+    char start_date[32];                    //yy-mm-dd hh:mm:ss, as in text log
+    uint32_t num_boards;                    //boards the channels came from
+    uint8_t board_address[8];               //address of each board, master first
+    uint32_t segment;                       //number of the segment, from 1, 0 if not one
+    uint64_t first_frame;                   //frame of the scan the file starts at
+    uint32_t chunk_frames;                  //chunked, frames in each chunk
+    uint32_t chunk_count;                   //chunked, chunks in the index, 0 if not closed
+    uint64_t index_offset;                  //chunked, where the index starts, 0 if not closed
+    uint8_t reserved[432];                  //zero, pads header to 1024 bytes
+};
+
+_Static_assert(sizeof(struct binlog_header) == BINLOG_HEADER_SIZE,
+    "binlog header size");
+
+/* a chunk of a chunked file, before its samples and in the index */
+struct binlog_chunk
+{
+    uint64_t first_frame;                   //frame of the file the chunk starts at
+    uint64_t offset;                        //where the samples of the chunk start
+    uint32_t frames;                        //frames in the chunk
+    uint32_t bytes;                         //bytes of samples
+    uint32_t checksum;                      //CRC-32 of the bytes of samples
+    uint32_t reserved;                      //zero
+    float min[BINLOG_MAX_CHANNELS];         //of each channel, as logged, before conversion
+    float max[BINLOG_MAX_CHANNELS];
+    float mean[BINLOG_MAX_CHANNELS];
+    float rms[BINLOG_MAX_CHANNELS];
+};
+
+_Static_assert(sizeof(struct binlog_chunk) == 288, "binlog chunk size");
+
+struct binlog
+{
+    struct filewriter file;
+    struct binlog_header header;
+    uint8_t* buffer;                        //frames converted for writing
+    uint32_t buffer_frames;
+    uint32_t frame_size;                    //bytes per frame, of the codes if compressed
+    int32_t* codes;                         //int24 and compressed, the codes of the frames
+    uint32_t* scratch;                      //compressed, the residuals of a channel
+    double* chunk;                          //chunked, frames of the chunk being filled
+    uint32_t chunk_fill;                    //frames in chunk
+    uint8_t* columns;                       //chunked, samples of a chunk in columns
+    struct binlog_chunk* index;             //chunked, every chunk written
+    uint32_t index_size;                    //entries allocated in index
+};
+
+/* function declarations */
+void binlog_header_init(struct binlog_header*, uint32_t, int, double);
+uint32_t binlog_sample_size(uint32_t);
+bool binlog_open(struct binlog*, char*, struct binlog_header*, uint32_t, uint64_t);
+bool binlog_write(struct binlog*, double*, uint32_t);
+bool binlog_close(struct binlog*);
+uint64_t binlog_frames_in(const struct binlog_header*, uint64_t);
+uint32_t binlog_crc32(uint32_t, const void*, size_t);
+
+#endif
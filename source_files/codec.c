@@ -0,0 +1,558 @@
+#include <stdlib.h>
+#include <string.h>
+#include "codec.h"
+
+#define CODEC_ORDER_BITS 3
+#define CODEC_CODE_BITS 24
+#define CODEC_RICE_BITS 5
+#define CODEC_MAX_ZEROS (1u << 30)      //longest run of zeros a valid block can have
+
+/* bits being written, or read, most significant bit first */
+struct codec_bits
+{
+    uint8_t* p;                         //next byte written
+    const uint8_t* in;                  //next byte read
+    const uint8_t* end;                 //end of the bytes read
+    uint64_t acc;                       //the last n bits are waiting
+    int n;
+};
+
+/* local function declarations */
+static void codec_encode_channel(struct codec_bits*, const int32_t*, int,
+    uint32_t, uint32_t*);
+static int codec_order(const int32_t*, int, uint32_t);
+static void codec_residuals(const int32_t*, int, uint32_t, int, uint32_t*);
+static void codec_partition(struct codec_bits*, const uint32_t*, uint32_t);
+static bool codec_decode_channel(struct codec_bits*, int32_t*, int, uint32_t);
+static void codec_put(struct codec_bits*, uint32_t, int);
+static void codec_put_zeros(struct codec_bits*, uint32_t);
+static bool codec_get(struct codec_bits*, int, uint32_t*);
+static bool codec_get_zeros(struct codec_bits*, uint32_t*);
+
+/*****************************
+ * codec_max_bytes() - largest a block can be once coded
+ *
+ * A partition is only Rice coded if that is smaller than storing it
+ * with the width of its largest value, which is at most 29 bits, so
+ * no residual takes more than 30 bits.
+ *
+ * param frames - frames in the block
+ * param num_channels - number of channels in each frame
+ * returns - size of the buffer codec_encode() needs
+****************************/
+
+uint32_t
+codec_max_bytes(uint32_t frames, int num_channels)
+{
+    uint64_t partitions = frames / CODEC_PARTITION + 1;
+    uint64_t bits = CODEC_ORDER_BITS + CODEC_MAX_ORDER * CODEC_CODE_BITS +
+        partitions * 2 * CODEC_RICE_BITS + (uint64_t)frames * 30;
+
+    return (uint32_t)((bits * num_channels + 7) / 8);
+}
+
+
+/*****************************
+ * codec_encode() - codes a block of int24 codes
+ *
+ * For each channel the order of prediction with the smallest sum of
+ * residuals is used, so a slowly changing signal is coded as the
+ * change from one code to the next, or the change in that. Then the
+ * Rice parameter of each partition is picked to suit the size of its
+ * residuals, which follows the vibration as it rises and falls.
+ * Only integer arithmetic is used, so decoding gives back exactly
+ * the codes which were coded.
+ *
+ * param codes - codes, num_channels per frame, in the range of int24
+ * param frames - number of frames
+ * param num_channels - number of channels in each frame
+ * param scratch - room for frames values, for the residuals of a channel
+ * param out - the block, at least codec_max_bytes() long
+ * returns - number of bytes of the block
+****************************/
+
+uint32_t
+codec_encode(const int32_t* codes, uint32_t frames, int num_channels,
+    uint32_t* scratch, uint8_t* out)
+{
+    struct codec_bits bits = {0};
+    int ch;
+
+    bits.p = out;
+    for (ch = 0; ch < num_channels; ch++)
+    {
+        codec_encode_channel(&bits, codes + ch, num_channels, frames, scratch);
+    }
+    if (bits.n > 0)
+    {
+        codec_put(&bits, 0, 8 - bits.n);
+    }
+    return bits.p - out;
+}
+
+
+/*****************************
+ * codec_decode() - decodes a block coded by codec_encode()
+ *
+ * Any errors return false, otherwise return true
+ *
+ * param in - the block
+ * param bytes - number of bytes of the block
+ * param frames - number of frames in the block
+ * param num_channels - number of channels in each frame
+ * param codes - the codes, num_channels per frame
+ * returns - false if the block is not valid, or ends too soon
+****************************/
+
+bool
+codec_decode(const uint8_t* in, uint32_t bytes, uint32_t frames,
+    int num_channels, int32_t* codes)
+{
+    struct codec_bits bits = {0};
+    int ch;
+
+    bits.in = in;
+    bits.end = in + bytes;
+    for (ch = 0; ch < num_channels; ch++)
+    {
+        if (!codec_decode_channel(&bits, codes + ch, num_channels, frames))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/*****************************
+ * codec_encode_channel() - codes the codes of one channel
+ *
+ * param bits - bits being written
+ * param x - first code of the channel
+ * param stride - codes from one frame to the next
+ * param frames - number of frames
+ * param scratch - room for frames residuals
+****************************/
+
+static void
+codec_encode_channel(struct codec_bits* bits, const int32_t* x, int stride,
+    uint32_t frames, uint32_t* scratch)
+{
+    int order = codec_order(x, stride, frames);
+    uint32_t n;
+    uint32_t i;
+
+    codec_put(bits, order, CODEC_ORDER_BITS);
+    for (i = 0; i < (uint32_t)order; i++)
+    {
+        codec_put(bits, (uint32_t)x[i * stride] & 0xffffff, CODEC_CODE_BITS);
+    }
+
+    codec_residuals(x, stride, frames, order, scratch);
+    for (i = 0; i < frames - order; i += n)
+    {
+        n = (frames - order - i < CODEC_PARTITION) ? frames - order - i : CODEC_PARTITION;
+        codec_partition(bits, &scratch[i], n);
+    }
+}
+
+
+/*****************************
+ * codec_order() - order of prediction with the smallest residuals
+ *
+ * The residual of order k is the k'th difference of the codes, so the
+ * residuals of every order are worked out together, each from the one
+ * below. The first CODEC_MAX_ORDER codes are left out, so each order
+ * is compared over the same codes.
+ *
+ * param x - first code of the channel
+ * param stride - codes from one frame to the next
+ * param frames - number of frames
+ * returns - the order, 0 if there are too few frames to compare them
+****************************/
+
+static int
+codec_order(const int32_t* x, int stride, uint32_t frames)
+{
+    uint64_t sum[CODEC_MAX_ORDER + 1] = {0};
+    int32_t last[CODEC_MAX_ORDER] = {0};
+    int32_t e[CODEC_MAX_ORDER + 1];
+    int order = 0;
+    uint32_t i;
+    int k;
+
+    if (frames <= CODEC_MAX_ORDER)
+    {
+        return 0;
+    }
+    for (i = 0; i < frames; i++)
+    {
+        e[0] = x[i * stride];
+        for (k = 1; k <= CODEC_MAX_ORDER; k++)
+        {
+            e[k] = e[k - 1] - last[k - 1];
+        }
+        for (k = 0; k < CODEC_MAX_ORDER; k++)
+        {
+            last[k] = e[k];
+        }
+        if (i >= CODEC_MAX_ORDER)
+        {
+            for (k = 0; k <= CODEC_MAX_ORDER; k++)
+            {
+                sum[k] += (uint32_t)abs(e[k]);
+            }
+        }
+    }
+
+    for (k = 1; k <= CODEC_MAX_ORDER; k++)
+    {
+        if (sum[k] < sum[order])
+        {
+            order = k;
+        }
+    }
+    return order;
+}
+
+
+/*****************************
+ * codec_residuals() - residuals of a channel, mapped to unsigned values
+ *
+ * The k'th difference only depends on the code and the k codes before
+ * it, so from the order'th code on it is the residual.
+ *
+ * param x - first code of the channel
+ * param stride - codes from one frame to the next
+ * param frames - number of frames
+ * param order - order of prediction
+ * param u - set to frames - order residuals, 0, -1, 1 ... as 0, 1, 2 ...
+****************************/
+
+static void
+codec_residuals(const int32_t* x, int stride, uint32_t frames, int order,
+    uint32_t* u)
+{
+    int32_t last[CODEC_MAX_ORDER] = {0};
+    int32_t e;
+    int32_t d;
+    uint32_t i;
+    int k;
+
+    for (i = 0; i < frames; i++)
+    {
+        e = x[i * stride];
+        for (k = 0; k < order; k++)
+        {
+            d = e - last[k];
+            last[k] = e;
+            e = d;
+        }
+        if (i >= (uint32_t)order)
+        {
+            u[i - order] = ((uint32_t)e << 1) ^ (uint32_t)(e >> 31);
+        }
+    }
+}
+
+
+/*****************************
+ * codec_partition() - codes a partition of residuals
+ *
+ * The Rice parameter k for which the residuals average about 2^k is
+ * found from their sum, then the exact sizes with k - 1, k and k + 1
+ * are worked out in one pass, and the smallest used, unless storing
+ * the residuals with the width of the largest is smaller, as it is
+ * when they are all 0 or a few are very large.
+ *
+ * param bits - bits being written
+ * param u - residuals, mapped to unsigned values
+ * param n - number of residuals, 1 to CODEC_PARTITION
+****************************/
+
+static void
+codec_partition(struct codec_bits* bits, const uint32_t* u, uint32_t n)
+{
+    uint64_t sum = 0;
+    uint64_t size[3] = {0};
+    uint64_t best;
+    uint32_t all = 0;
+    uint32_t i;
+    int width;
+    int first;
+    int k;
+    int j;
+
+    for (i = 0; i < n; i++)
+    {
+        sum += u[i];
+        all |= u[i];
+    }
+    width = (all == 0) ? 0 : 32 - __builtin_clz(all);
+
+    for (k = 0; (k < CODEC_MAX_RICE) && (((uint64_t)n << (k + 1)) <= sum); k++)
+    {
+    }
+    first = (k > 0) ? k - 1 : 0;
+    if (first > CODEC_MAX_RICE - 2)
+    {
+        first = CODEC_MAX_RICE - 2;
+    }
+    for (i = 0; i < n; i++)
+    {
+        size[0] += u[i] >> first;
+        size[1] += u[i] >> (first + 1);
+        size[2] += u[i] >> (first + 2);
+    }
+
+    best = CODEC_RICE_BITS + (uint64_t)n * width;
+    k = CODEC_ESCAPE;
+    for (j = 0; j < 3; j++)
+    {
+        size[j] += (uint64_t)n * (first + j + 1);
+        if (size[j] < best)
+        {
+            best = size[j];
+            k = first + j;
+        }
+    }
+
+    codec_put(bits, k, CODEC_RICE_BITS);
+    if (k == CODEC_ESCAPE)
+    {
+        codec_put(bits, width, CODEC_RICE_BITS);
+        for (i = 0; (i < n) && (width > 0); i++)
+        {
+            codec_put(bits, u[i], width);
+        }
+        return;
+    }
+    for (i = 0; i < n; i++)
+    {
+        codec_put_zeros(bits, u[i] >> k);
+        codec_put(bits, 1, 1);
+        if (k > 0)
+        {
+            codec_put(bits, u[i] & ((1u << k) - 1), k);
+        }
+    }
+}
+
+
+/*****************************
+ * codec_decode_channel() - decodes the codes of one channel
+ *
+ * param bits - bits being read
+ * param x - first code of the channel
+ * param stride - codes from one frame to the next
+ * param frames - number of frames
+ * returns - false if the bits are not valid, or run out
+****************************/
+
+static bool
+codec_decode_channel(struct codec_bits* bits, int32_t* x, int stride,
+    uint32_t frames)
+{
+    uint32_t order;
+    uint32_t k;
+    uint32_t width = 0;
+    uint32_t u;
+    uint32_t q;
+    uint32_t i;
+    uint32_t end;
+    int32_t r;
+    int32_t* p;
+
+    if (!codec_get(bits, CODEC_ORDER_BITS, &order) || (order > CODEC_MAX_ORDER) ||
+        ((order > 0) && (frames <= CODEC_MAX_ORDER)))
+    {
+        return false;
+    }
+    for (i = 0; i < order; i++)
+    {
+        if (!codec_get(bits, CODEC_CODE_BITS, &u))
+        {
+            return false;
+        }
+        x[i * stride] = (int32_t)(u << 8) >> 8;
+    }
+
+    for (i = order; i < frames; i = end)
+    {
+        end = (frames - i < CODEC_PARTITION) ? frames : i + CODEC_PARTITION;
+        if (!codec_get(bits, CODEC_RICE_BITS, &k) ||
+            ((k == CODEC_ESCAPE) && (!codec_get(bits, CODEC_RICE_BITS, &width) ||
+            (width > 30))))
+        {
+            return false;
+        }
+
+        for (; i < end; i++)
+        {
+            if (k == CODEC_ESCAPE)
+            {
+                u = 0;
+                if ((width > 0) && !codec_get(bits, width, &u))
+                {
+                    return false;
+                }
+            }
+            else
+            {
+                if (!codec_get_zeros(bits, &q) || !codec_get(bits, 1, &u) ||
+                    (q > (UINT32_MAX >> k)))
+                {
+                    return false;
+                }
+                u = q << k;
+                if (k > 0)
+                {
+                    if (!codec_get(bits, k, &q))
+                    {
+                        return false;
+                    }
+                    u |= q;
+                }
+            }
+
+            r = (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+            p = &x[i * stride];
+            switch (order)
+            {
+                case 0:
+                    *p = r;
+                    break;
+                case 1:
+                    *p = r + p[-stride];
+                    break;
+                case 2:
+                    *p = r + 2 * p[-stride] - p[-2 * stride];
+                    break;
+                case 3:
+                    *p = r + 3 * p[-stride] - 3 * p[-2 * stride] + p[-3 * stride];
+                    break;
+                default:
+                    *p = r + 4 * p[-stride] - 6 * p[-2 * stride] +
+                        4 * p[-3 * stride] - p[-4 * stride];
+                    break;
+            }
+        }
+    }
+    return true;
+}
+
+
+/*****************************
+ * codec_put() - writes bits
+ *
+ * param bits - bits being written
+ * param value - the bits, in the low bits, nothing above them
+ * param n - number of bits, 1 to 32
+****************************/
+
+static void
+codec_put(struct codec_bits* bits, uint32_t value, int n)
+{
+    //n is less than 8 before, so the bits waiting never pass 40
+    bits->acc = (bits->acc << n) | value;
+    bits->n += n;
+    while (bits->n >= 8)
+    {
+        bits->n -= 8;
+        *bits->p++ = (uint8_t)(bits->acc >> bits->n);
+    }
+}
+
+
+/*****************************
+ * codec_put_zeros() - writes a run of zeros
+ *
+ * param bits - bits being written
+ * param q - number of zeros
+****************************/
+
+static void
+codec_put_zeros(struct codec_bits* bits, uint32_t q)
+{
+    while (q >= 32)
+    {
+        codec_put(bits, 0, 32);
+        q -= 32;
+    }
+    if (q > 0)
+    {
+        codec_put(bits, 0, q);
+    }
+}
+
+
+/*****************************
+ * codec_get() - reads bits
+ *
+ * param bits - bits being read
+ * param n - number of bits, 1 to 30
+ * param value - set to the bits
+ * returns - false if the block ends first
+****************************/
+
+static bool
+codec_get(struct codec_bits* bits, int n, uint32_t* value)
+{
+    while (bits->n < n)
+    {
+        if (bits->in == bits->end)
+        {
+            return false;
+        }
+        bits->acc = (bits->acc << 8) | *bits->in++;
+        bits->n += 8;
+    }
+    bits->n -= n;
+    *value = (uint32_t)(bits->acc >> bits->n) & ((1u << n) - 1);
+    return true;
+}
+
+
+/*****************************
+ * codec_get_zeros() - reads a run of zeros, up to the next one
+ *
+ * The one is left to be read.
+ *
+ * param bits - bits being read
+ * param q - set to the number of zeros
+ * returns - false if the block ends first, or the run is too long
+****************************/
+
+static bool
+codec_get_zeros(struct codec_bits* bits, uint32_t* q)
+{
+    uint32_t waiting;
+
+    *q = 0;
+    for (;;)
+    {
+        if (bits->n == 0)
+        {
+            if (bits->in == bits->end)
+            {
+                return false;
+            }
+            bits->acc = (bits->acc << 8) | *bits->in++;
+            bits->n = 8;
+        }
+        waiting = (uint32_t)bits->acc & ((1u << bits->n) - 1);
+        if (waiting != 0)
+        {
+            //zeros before the highest bit set of the bits waiting
+            *q += bits->n - (32 - __builtin_clz(waiting));
+            bits->n = 32 - __builtin_clz(waiting);
+            return true;
+        }
+        *q += bits->n;
+        bits->n = 0;
+        if (*q > CODEC_MAX_ZEROS)
+        {
+            return false;
+        }
+    }
+}
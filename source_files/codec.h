@@ -0,0 +1,59 @@
+/*****************************************
+ * codec.h
+ *
+ * Lossless compression of blocks of int24 codes
+ *
+ * A block is frames of codes, num_channels per frame. Each channel is
+ * coded in turn, in a bit stream which is written most significant bit
+ * first and padded to a whole byte at the end of the block:
+ *
+ *      order               3 bits, 0 to CODEC_MAX_ORDER
+ *      warm up codes       order codes, 24 bits each, two's complement
+ *      partitions          the residuals of the rest of the codes, in
+ *                          partitions of CODEC_PARTITION residuals, the
+ *                          last one can be shorter
+ *
+ * The residual is the code less the fixed polynomial prediction
+ * of the order, from the codes before it:
+ *
+ *      order 0     0
+ *      order 1     x[n-1]
+ *      order 2     2x[n-1] - x[n-2]
+ *      order 3     3x[n-1] - 3x[n-2] + x[n-3]
+ *      order 4     4x[n-1] - 6x[n-2] + 4x[n-3] - x[n-4]
+ *
+ * and is mapped to an unsigned value u, 0, -1, 1, -2, 2 ... to 0, 1, 2, 3, 4 ...
+ * Each partition starts with a 5 bit Rice parameter k, and each u is
+ * u >> k zeros, a one, then the low k bits of u. If k is CODEC_ESCAPE,
+ * a 5 bit width follows and each u is width bits.
+ *
+ * In a binlog file each block is a struct codec_block followed by the
+ * bytes of the block.
+ *****************************************/
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+//header guard
+
+#ifndef CODEC_H
+#define CODEC_H
+
+#define CODEC_MAX_ORDER 4               //highest order of the prediction
+#define CODEC_PARTITION 256             //residuals sharing a Rice parameter
+#define CODEC_ESCAPE 31                 //Rice parameter of a partition stored as it is
+#define CODEC_MAX_RICE 30               //largest Rice parameter
+
+/* before each block in a file */
+struct codec_block
+{
+    uint32_t frames;                    //frames in the block
+    uint32_t bytes;                     //bytes of the block after this
+};
+
+/* function declarations */
+uint32_t codec_max_bytes(uint32_t, int);
+uint32_t codec_encode(const int32_t*, uint32_t, int, uint32_t*, uint8_t*);
+bool codec_decode(const uint8_t*, uint32_t, uint32_t, int, int32_t*);
+
+#endif
@@ -0,0 +1,509 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "config.h"
+
+#define CONFIG_READ_SIZE 4096           //first size of the text, doubled as needed
+#define CONFIG_FIRST_SLOTS 64           //first size of the table, a power of 2
+
+/* local function declarations */
+static bool config_read(struct config*, const char*);
+static void config_strip_comments(char*);
+static bool config_add(struct config*, const char*, const char*);
+static bool config_grow(struct config*);
+static struct config_entry* config_find(struct config*, const char*, uint32_t);
+static uint32_t config_hash(const char*);
+static const struct config_tag* config_known(const struct config_tag*, const char*);
+static bool config_is_number(const char*, double*);
+
+/*****************************
+ * config_load() - reads an xml parameters file into a table of tags
+ *
+ * The whole file is read, whatever its size, then split into tags
+ * and values in one pass, so looking up a tag does not read the file
+ * again. As before, a line starting with "<!" is a comment, and so is
+ * the "<?xml" line, a comment cannot span lines. Anything between an
+ * opening tag and its closing tag is the value, spaces included.
+ * If a tag is in the file more than once the first value is used,
+ * config_check() reports it.
+ *
+ * Any errors return false, otherwise return true
+ *
+ * param config - table to set up
+ * param filename - name of xml file
+ * returns - false if error reading the file or allocating memory
+****************************/
+
+bool
+config_load(struct config* config, const char* filename)
+{
+    char* p;
+    char* name;
+    char* end;
+    char* close;
+    size_t len;
+
+    memset(config, 0, sizeof(*config));
+    if (!config_read(config, filename))
+    {
+        return false;
+    }
+    config_strip_comments(config->text);
+
+    p = config->text;
+    while ((p = strchr(p, '<')) != NULL)
+    {
+        name = p + 1;
+        end = strchr(name, '>');
+        if (end == NULL)
+        {
+            break;
+        }
+        p = end + 1;
+        if ((*name == '/') || (*name == '!') || (*name == '?'))
+        {
+            continue;
+        }
+
+        //the closing tag is "</" the name ">"
+        len = end - name;
+        for (close = strstr(p, "</"); close != NULL; close = strstr(close + 2, "</"))
+        {
+            if ((strncmp(close + 2, name, len) == 0) && (close[len + 2] == '>'))
+            {
+                break;
+            }
+        }
+        if (close == NULL)
+        {
+            continue;
+        }
+
+        *end = '\0';
+        *close = '\0';
+        if (!config_add(config, name, end + 1))
+        {
+            config_free(config);
+            return false;
+        }
+        p = close + len + 3;
+    }
+    return true;
+}
+
+
+/*****************************
+ * config_get() - value of a tag
+ *
+ * param config - table read by config_load()
+ * param tag - tag we are looking for
+ * returns - value, NULL if the tag is not in the file
+****************************/
+
+const char*
+config_get(struct config* config, const char* tag)
+{
+    struct config_entry* entry;
+
+    if (config->size == 0)
+    {
+        return NULL;
+    }
+    entry = config_find(config, tag, config_hash(tag));
+    return (entry->tag != NULL) ? entry->value : NULL;
+}
+
+
+/*****************************
+ * config_get_d() - value of a tag as a double
+ *
+ * The value of a number tag is converted once, by config_check(),
+ * and kept in the table, so getting it again is only the look up.
+ * Any other value is converted the first time it is got.
+ *
+ * param config - table read by config_load()
+ * param tag - tag we are looking for
+ * returns - value, 0.0 if the tag is not in the file, or not a number
+****************************/
+
+double
+config_get_d(struct config* config, const char* tag)
+{
+    struct config_entry* entry;
+
+    if (config->size == 0)
+    {
+        return 0.0;
+    }
+    entry = config_find(config, tag, config_hash(tag));
+    if (entry->tag == NULL)
+    {
+        return 0.0;
+    }
+    if (!entry->parsed)
+    {
+        entry->number = strtod(entry->value, NULL);
+        entry->parsed = true;
+    }
+    return entry->number;
+}
+
+
+/*****************************
+ * config_check() - checks every tag in the file, before any are used
+ *
+ * Each tag has to be one of the tags, or a per channel tag with
+ * CONFIG_CHANNEL_SUFFIX and a channel from 0 to CONFIG_MAX_CHANNELS - 1
+ * added, and be in the file once. The value of a number tag has to be
+ * a number, or empty, which is the same as the tag being missing,
+ * and the number is kept in the table for config_get_d().
+ * So a mistyped tag, which would otherwise be ignored, is an error.
+ * The first problem in the file is reported.
+ *
+ * param config - table read by config_load()
+ * param tags - the tags the file can have, ending with a NULL tag
+ * param bad_tag - set to the tag with the problem, if there is one
+ * returns - one of enum config_result
+****************************/
+
+int
+config_check(struct config* config, const struct config_tag* tags,
+    const char** bad_tag)
+{
+    const struct config_tag* known;
+    struct config_entry* entry;
+    int result = CONFIG_OK;
+    int problem;
+    uint32_t i;
+
+    *bad_tag = NULL;
+    for (i = 0; i < config->size; i++)
+    {
+        entry = &config->entries[i];
+        if (entry->tag == NULL)
+        {
+            continue;
+        }
+
+        known = config_known(tags, entry->tag);
+        if (known == NULL)
+        {
+            problem = CONFIG_UNKNOWN;
+        }
+        else if (entry->count > 1)
+        {
+            problem = CONFIG_TWICE;
+        }
+        else if ((known->type == CONFIG_NUMBER) &&
+            !config_is_number(entry->value, &entry->number))
+        {
+            problem = CONFIG_NOT_NUMBER;
+        }
+        else
+        {
+            entry->parsed = entry->parsed || (known->type == CONFIG_NUMBER);
+            continue;
+        }
+
+        //the tags are in the text in the order of the file
+        if ((*bad_tag == NULL) || (entry->tag < *bad_tag))
+        {
+            *bad_tag = entry->tag;
+            result = problem;
+        }
+    }
+    return result;
+}
+
+
+/*****************************
+ * config_free() - frees the memory of a table
+ *
+ * param config - table read by config_load()
+****************************/
+
+void
+config_free(struct config* config)
+{
+    free(config->text);
+    free(config->entries);
+    memset(config, 0, sizeof(*config));
+}
+
+
+/*****************************
+ * config_read() - reads the whole of a file into memory
+ *
+ * param config - table, text is set to the file, ending with a 0
+ * param filename - name of xml file
+ * returns - false if error reading the file or allocating memory
+****************************/
+
+static bool
+config_read(struct config* config, const char* filename)
+{
+    size_t size = CONFIG_READ_SIZE;
+    size_t len = 0;
+    size_t n;
+    char* text;
+    FILE* fp;
+
+    fp = fopen(filename, "r");
+    if (fp == NULL)
+    {
+        return false;
+    }
+
+    config->text = malloc(size);
+    while (config->text != NULL)
+    {
+        n = fread(config->text + len, 1, size - len - 1, fp);
+        len += n;
+        if (len < size - 1)
+        {
+            break;
+        }
+        size *= 2;
+        text = realloc(config->text, size);
+        if (text == NULL)
+        {
+            free(config->text);
+        }
+        config->text = text;
+    }
+
+    if ((config->text == NULL) || ferror(fp))
+    {
+        fclose(fp);
+        config_free(config);
+        return false;
+    }
+    fclose(fp);
+    config->text[len] = '\0';
+    return true;
+}
+
+
+/*****************************
+ * config_strip_comments() - blanks the comment lines of a file
+ *
+ * param text - the file, comment lines are overwritten with spaces
+****************************/
+
+static void
+config_strip_comments(char* text)
+{
+    char* line = text;
+    char* end;
+
+    while (*line != '\0')
+    {
+        end = strchr(line, '\n');
+        if (end == NULL)
+        {
+            end = line + strlen(line);
+        }
+        if ((line[0] == '<') && ((line[1] == '!') || (line[1] == '?')))
+        {
+            memset(line, ' ', end - line);
+        }
+        line = (*end == '\0') ? end : end + 1;
+    }
+}
+
+
+/*****************************
+ * config_add() - adds a tag to the table
+ *
+ * param config - table
+ * param tag - tag, in the text of the file
+ * param value - its value, in the text of the file
+ * returns - false if error allocating memory
+****************************/
+
+static bool
+config_add(struct config* config, const char* tag, const char* value)
+{
+    struct config_entry* entry;
+    uint32_t hash = config_hash(tag);
+
+    //at most half full, so a search soon finds an empty slot
+    if ((2 * (config->count + 1) > config->size) && !config_grow(config))
+    {
+        return false;
+    }
+
+    entry = config_find(config, tag, hash);
+    if (entry->tag == NULL)
+    {
+        entry->tag = tag;
+        entry->value = value;
+        entry->hash = hash;
+        config->count++;
+    }
+    entry->count++;
+    return true;
+}
+
+
+/*****************************
+ * config_grow() - doubles the size of the table
+ *
+ * param config - table
+ * returns - false if error allocating memory
+****************************/
+
+static bool
+config_grow(struct config* config)
+{
+    struct config_entry* old = config->entries;
+    uint32_t old_size = config->size;
+    struct config_entry* entry;
+    uint32_t i;
+
+    config->size = (old_size == 0) ? CONFIG_FIRST_SLOTS : 2 * old_size;
+    config->entries = calloc(config->size, sizeof(struct config_entry));
+    if (config->entries == NULL)
+    {
+        config->entries = old;
+        config->size = old_size;
+        return false;
+    }
+
+    for (i = 0; i < old_size; i++)
+    {
+        if (old[i].tag != NULL)
+        {
+            entry = config_find(config, old[i].tag, old[i].hash);
+            *entry = old[i];
+        }
+    }
+    free(old);
+    return true;
+}
+
+
+/*****************************
+ * config_find() - slot of a tag, or the empty slot it would go in
+ *
+ * param config - table, with at least one empty slot
+ * param tag - tag we are looking for
+ * param hash - config_hash() of the tag
+ * returns - the slot
+****************************/
+
+static struct config_entry*
+config_find(struct config* config, const char* tag, uint32_t hash)
+{
+    uint32_t mask = config->size - 1;
+    uint32_t i = hash & mask;
+    struct config_entry* entry;
+
+    for (;;)
+    {
+        entry = &config->entries[i];
+        if ((entry->tag == NULL) ||
+            ((entry->hash == hash) && (strcmp(entry->tag, tag) == 0)))
+        {
+            return entry;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+
+/*****************************
+ * config_hash() - FNV-1a hash of a tag
+ *
+ * param tag - tag
+ * returns - hash
+****************************/
+
+static uint32_t
+config_hash(const char* tag)
+{
+    uint32_t hash = 2166136261u;
+
+    while (*tag != '\0')
+    {
+        hash = (hash ^ (uint8_t)*tag++) * 16777619u;
+    }
+    return hash;
+}
+
+
+/*****************************
+ * config_known() - finds which of the tags a tag in the file is
+ *
+ * param tags - the tags the file can have, ending with a NULL tag
+ * param tag - tag in the file
+ * returns - the tag it is, NULL if it is none of them
+****************************/
+
+static const struct config_tag*
+config_known(const struct config_tag* tags, const char* tag)
+{
+    size_t len;
+    size_t suffix = strlen(CONFIG_CHANNEL_SUFFIX);
+    const char* digits;
+    char* end;
+    long channel;
+
+    for (; tags->tag != NULL; tags++)
+    {
+        if (strcmp(tag, tags->tag) == 0)
+        {
+            return tags;
+        }
+
+        len = strlen(tags->tag);
+        if (!tags->per_channel || (strncmp(tag, tags->tag, len) != 0) ||
+            (strncmp(tag + len, CONFIG_CHANNEL_SUFFIX, suffix) != 0))
+        {
+            continue;
+        }
+        digits = tag + len + suffix;
+        channel = strtol(digits, &end, 10);
+        if (isdigit((unsigned char)*digits) && (*end == '\0') &&
+            (channel < CONFIG_MAX_CHANNELS))
+        {
+            return tags;
+        }
+    }
+    return NULL;
+}
+
+
+/*****************************
+ * config_is_number() - whether a value is a number
+ *
+ * param value - value of a tag
+ * param number - set to the number, 0 if only spaces
+ * returns - true if a number with only spaces round it, or only spaces
+****************************/
+
+static bool
+config_is_number(const char* value, double* number)
+{
+    char* end;
+
+    *number = 0.0;
+    while (isspace((unsigned char)*value))
+    {
+        value++;
+    }
+    if (*value == '\0')
+    {
+        return true;
+    }
+    *number = strtod(value, &end);
+    if (end == value)
+    {
+        return false;
+    }
+    while (isspace((unsigned char)*end))
+    {
+        end++;
+    }
+    return *end == '\0';
+}
@@ -0,0 +1,68 @@
+/*****************************************
+ * config.h
+ *
+ * The xml parameters file, read once into a table of tags
+ *****************************************/
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+//header guard
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#define CONFIG_CHANNEL_SUFFIX "_ch"     //added to a tag, with the channel, for one channel
+#define CONFIG_MAX_CHANNELS 16          //8 boards of 2 channels
+
+/* what a tag's value has to be, for config_check() */
+enum config_type
+{
+    CONFIG_WORD = 0,                    //anything, such as a choice, checked when it is used
+    CONFIG_NUMBER = 1                   //a number, nothing after it but spaces
+};
+
+/* results of config_check() */
+enum config_result
+{
+    CONFIG_OK = 0,
+    CONFIG_UNKNOWN = 1,                 //tag is not one of the tags
+    CONFIG_TWICE = 2,                   //tag is in the file more than once
+    CONFIG_NOT_NUMBER = 3               //value of a number tag is not a number
+};
+
+/* a tag the file can have */
+struct config_tag
+{
+    const char* tag;
+    int type;                           //one of enum config_type
+    bool per_channel;                   //can also have CONFIG_CHANNEL_SUFFIX and a channel
+};
+
+/* a tag in the file, tag and value point into the text of the file */
+struct config_entry
+{
+    const char* tag;                    //NULL if the slot is empty
+    const char* value;
+    uint32_t hash;
+    int count;                          //times the tag is in the file
+    bool parsed;                        //number has been set
+    double number;                      //value as a number, 0 if empty
+};
+
+struct config
+{
+    char* text;                         //the file, with the ends of tags and values set to 0
+    struct config_entry* entries;       //hash table, open addressing
+    uint32_t size;                      //slots in entries, a power of 2
+    uint32_t count;                     //tags in entries
+};
+
+/* function declarations */
+bool config_load(struct config*, const char*);
+const char* config_get(struct config*, const char*);
+double config_get_d(struct config*, const char*);
+int config_check(struct config*, const struct config_tag*, const char**);
+void config_free(struct config*);
+
+#endif
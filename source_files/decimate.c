@@ -0,0 +1,322 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "decimate.h"
+#include "dsp.h"
+
+/* local function declarations */
+static bool decimate_design(struct decimate_stage*, int, double, double);
+static double bessel_i0(double);
+
+/*****************************
+ * decimate_open() - sets up the decimation of a scan
+ *
+ * The scan rate is divided by the whole number nearest to the rate
+ * wanted. The factor is split into its prime factors, which are
+ * combined into stages of at most DECIMATE_STAGE_FACTOR, largest first.
+ * Each stage is a linear phase low pass FIR, which only works out the
+ * samples it keeps, the polyphase form. A few short filters at falling
+ * rates take far fewer multiplies than one long filter at the scan rate.
+ *
+ * Frequencies up to DECIMATE_PASSBAND of the output rate are kept, and
+ * anything which would alias onto them is attenuated by
+ * DECIMATE_ATTENUATION dB. Each stage only has to stop what would alias
+ * onto that band, so the early stages have wide transitions and few taps.
+ *
+ * Any errors return false, otherwise return true
+ *
+ * param dec - decimation to set up
+ * param num_channels - number of channels in each frame
+ * param scan_rate - actual scan rate per channel
+ * param rate - rate wanted after decimation
+ * param max_frames - most frames passed to decimate_add() at a time
+ * returns - false if a parameter is not valid or error allocating memory
+****************************/
+
+bool
+decimate_open(struct decimate* dec, int num_channels, double scan_rate,
+    double rate, uint32_t max_frames)
+{
+    uint32_t primes[32];
+    int num_primes = 0;
+    uint32_t factor;
+    uint32_t p;
+    double in_rate;
+    int i;
+    int s;
+
+    memset(dec, 0, sizeof(*dec));
+    if ((num_channels < 1) || (num_channels > DECIMATE_MAX_CHANNELS) ||
+        (rate <= 0.0) || (rate >= scan_rate))
+    {
+        return false;
+    }
+    factor = (uint32_t)(scan_rate / rate + 0.5);
+    if (factor < 2)
+    {
+        return false;
+    }
+
+    dec->num_channels = num_channels;
+    dec->scan_rate = scan_rate;
+    dec->factor = factor;
+    dec->out_rate = scan_rate / factor;
+
+    //prime factors, largest first
+    for (p = 2; factor > 1; p++)
+    {
+        while ((factor % p) == 0)
+        {
+            primes[num_primes++] = p;
+            factor /= p;
+        }
+    }
+    for (i = num_primes - 1; i >= 0; i--)
+    {
+        if ((dec->num_stages > 0) && (dec->stages[dec->num_stages - 1].factor *
+            primes[i] <= DECIMATE_STAGE_FACTOR))
+        {
+            dec->stages[dec->num_stages - 1].factor *= primes[i];
+        }
+        else if (dec->num_stages < DECIMATE_MAX_STAGES)
+        {
+            dec->stages[dec->num_stages++].factor = primes[i];
+        }
+        else
+        {
+            dec->factor = 0;
+            return false;
+        }
+    }
+
+    in_rate = scan_rate;
+    for (s = 0; s < dec->num_stages; s++)
+    {
+        if (!decimate_design(&dec->stages[s], num_channels, in_rate,
+            DECIMATE_PASSBAND * dec->out_rate))
+        {
+            decimate_free(dec);
+            return false;
+        }
+        in_rate /= dec->stages[s].factor;
+    }
+
+    //each stage gives at most one sample more than its share
+    dec->max_frames = max_frames / dec->factor + dec->num_stages + 1;
+    dec->out = malloc(sizeof(double) * dec->max_frames * num_channels);
+    if (dec->out == NULL)
+    {
+        decimate_free(dec);
+        return false;
+    }
+    return true;
+}
+
+
+/*****************************
+ * decimate_add() - decimates frames of samples
+ *
+ * The frames go through the stages DECIMATE_BLOCK at a time. The
+ * filters are dot products of the coefficients and the delay line,
+ * with dsp_dot(), the filters are symmetric so it is not reversed. The
+ * output of each stage is appended to the delay lines of the next,
+ * and the output of the last stage to out, interleaved as the input.
+ * A line keeps its last taps - 1 samples for the next block.
+ *
+ * Output n is centred on input sample n * factor, so it was taken at
+ * n / out_rate from the start of the scan, the delay of the filters
+ * is taken out. The first outputs are filtered with zeros before the
+ * start of the scan.
+ *
+ * param dec - decimation of the scan
+ * param data - samples, num_channels per frame
+ * param frames - number of frames, at most max_frames given to decimate_open()
+ * returns - number of decimated frames in out
+****************************/
+
+uint32_t
+decimate_add(struct decimate* dec, const double* data, uint32_t frames)
+{
+    int nch = dec->num_channels;
+    uint32_t out_frames = 0;
+    uint32_t n;
+    int ch;
+    int s;
+
+    while (frames > 0)
+    {
+        n = (frames < DECIMATE_BLOCK) ? frames : DECIMATE_BLOCK;
+
+        struct decimate_stage* first = &dec->stages[0];
+        for (ch = 0; ch < nch; ch++)
+        {
+            dsp_deinterleave(first->lines[ch] + first->fill, data, n, nch, ch);
+        }
+        first->fill += n;
+
+        for (s = 0; s < dec->num_stages; s++)
+        {
+            struct decimate_stage* st = &dec->stages[s];
+            struct decimate_stage* to = &dec->stages[s + 1];
+            bool last = (s == dec->num_stages - 1);
+            uint32_t keep = st->taps - 1;
+            uint32_t pos = st->next;
+            uint32_t count = 0;
+
+            for (ch = 0; ch < nch; ch++)
+            {
+                double* line = st->lines[ch];
+                count = 0;
+                for (pos = st->next; pos < st->fill; pos += st->factor)
+                {
+                    double y = dsp_dot(st->coeffs, line + pos - keep, st->taps);
+                    if (last)
+                    {
+                        dec->out[(size_t)(out_frames + count) * nch + ch] = y;
+                    }
+                    else
+                    {
+                        to->lines[ch][to->fill + count] = y;
+                    }
+                    count++;
+                }
+                memmove(line, line + st->fill - keep, sizeof(double) * keep);
+            }
+
+            st->next = pos - (st->fill - keep);
+            st->fill = keep;
+            if (last)
+            {
+                out_frames += count;
+            }
+            else
+            {
+                to->fill += count;
+            }
+        }
+
+        data += (size_t)n * nch;
+        frames -= n;
+    }
+    return out_frames;
+}
+
+
+/*****************************
+ * decimate_free() - frees the memory of a decimation
+ *
+ * param dec - decimation of the scan
+****************************/
+
+void
+decimate_free(struct decimate* dec)
+{
+    int s;
+    int ch;
+
+    for (s = 0; s < DECIMATE_MAX_STAGES; s++)
+    {
+        free(dec->stages[s].coeffs);
+        dec->stages[s].coeffs = NULL;
+        for (ch = 0; ch < DECIMATE_MAX_CHANNELS; ch++)
+        {
+            free(dec->stages[s].lines[ch]);
+            dec->stages[s].lines[ch] = NULL;
+        }
+    }
+    free(dec->out);
+    dec->out = NULL;
+}
+
+
+/*****************************
+ * decimate_design() - works out the filter of a stage
+ *
+ * A windowed sinc, with a Kaiser window. The number of taps is
+ * from Kaiser's formula for the attenuation and the transition,
+ * from the pass band edge up to where the stage's output rate
+ * would alias onto it. The gain at 0 Hz is one.
+ *
+ * The lines start with taps - 1 zeros, and the first output is
+ * centred on the first sample, so the delay of the filter is taken out.
+ *
+ * param st - stage with its factor set
+ * param num_channels - number of channels in each frame
+ * param in_rate - input rate of the stage
+ * param passband - highest frequency kept, Hz
+ * returns - false if error allocating memory
+****************************/
+
+static bool
+decimate_design(struct decimate_stage* st, int num_channels, double in_rate,
+    double passband)
+{
+    double stopband = in_rate / st->factor - passband;
+    double width = (stopband - passband) / in_rate;
+    double beta = 0.1102 * (DECIMATE_ATTENUATION - 8.7);
+    double fc = (passband + stopband) / 2.0 / in_rate;
+    double sum = 0.0;
+    double mid;
+    uint32_t i;
+    int ch;
+
+    st->taps = (uint32_t)ceil((DECIMATE_ATTENUATION - 7.95) / (14.36 * width)) + 1;
+    st->taps |= 1;
+    mid = (st->taps - 1) / 2.0;
+
+    st->coeffs = malloc(sizeof(double) * st->taps);
+    if (st->coeffs == NULL)
+    {
+        return false;
+    }
+    for (i = 0; i < st->taps; i++)
+    {
+        double t = i - mid;
+        double r = t / mid;
+        double sinc = (t == 0.0) ? 2.0 * fc : sin(2.0 * M_PI * fc * t) / (M_PI * t);
+        st->coeffs[i] = sinc * bessel_i0(beta * sqrt(1.0 - r * r)) / bessel_i0(beta);
+        sum += st->coeffs[i];
+    }
+    for (i = 0; i < st->taps; i++)
+    {
+        st->coeffs[i] /= sum;
+    }
+
+    for (ch = 0; ch < num_channels; ch++)
+    {
+        st->lines[ch] = calloc(st->taps - 1 + DECIMATE_BLOCK, sizeof(double));
+        if (st->lines[ch] == NULL)
+        {
+            return false;
+        }
+    }
+    st->fill = st->taps - 1;
+    st->next = st->taps - 1 + (st->taps - 1) / 2;
+    return true;
+}
+
+
+/*****************************
+ * bessel_i0() - modified Bessel function of the first kind, order 0
+ *
+ * From its power series, which converges quickly for the values
+ * a Kaiser window needs.
+ *
+ * param x - value
+ * returns - I0(x)
+****************************/
+
+static double
+bessel_i0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    int k;
+
+    for (k = 1; term > 1e-12 * sum; k++)
+    {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
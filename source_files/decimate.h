@@ -0,0 +1,49 @@
+/*****************************************
+ * decimate.h
+ *
+ * Multi-stage polyphase FIR decimation of each channel, for trend logging
+ *****************************************/
+#include <stdbool.h>
+#include <stdint.h>
+
+//header guard
+
+#ifndef DECIMATE_H
+#define DECIMATE_H
+
+#define DECIMATE_MAX_CHANNELS 16
+#define DECIMATE_MAX_STAGES 8
+#define DECIMATE_STAGE_FACTOR 8         //prime factors are combined into stages up to this
+#define DECIMATE_BLOCK 1024             //samples each stage filters at a time
+#define DECIMATE_PASSBAND 0.4           //pass band edge, fraction of the output rate
+#define DECIMATE_ATTENUATION 100.0      //stop band attenuation, dB
+
+/* a stage keeps one sample in factor, after a low pass filter */
+struct decimate_stage
+{
+    uint32_t factor;
+    uint32_t taps;                      //length of the filter, odd
+    double* coeffs;                     //impulse response, symmetric
+    double* lines[DECIMATE_MAX_CHANNELS];   //taps - 1 old samples then the new ones
+    uint32_t fill;                      //samples in each line
+    uint32_t next;                      //line index of the newest sample of the next output
+};
+
+struct decimate
+{
+    int num_channels;
+    double scan_rate;                   //input rate per channel
+    double out_rate;                    //output rate per channel
+    uint32_t factor;                    //product of the stage factors, 0 if none
+    int num_stages;
+    struct decimate_stage stages[DECIMATE_MAX_STAGES];
+    double* out;                        //decimated frames of the last decimate_add()
+    uint32_t max_frames;                //size of out in frames
+};
+
+/* function declarations */
+bool decimate_open(struct decimate*, int, double, double, uint32_t);
+uint32_t decimate_add(struct decimate*, const double*, uint32_t);
+void decimate_free(struct decimate*);
+
+#endif
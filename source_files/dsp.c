@@ -0,0 +1,515 @@
+#include <string.h>
+#include <math.h>
+#include "dsp.h"
+
+/* two doubles at a time, the same on x86 and 64 bit ARM */
+#if defined(__SSE2__)
+#include <immintrin.h>
+#define DSP_V2
+typedef __m128d v2d;
+#define V2_LOAD(p) _mm_loadu_pd(p)
+#define V2_STORE(p, a) _mm_storeu_pd(p, a)
+#define V2_SET(x) _mm_set1_pd(x)
+#define V2_ADD(a, b) _mm_add_pd(a, b)
+#define V2_SUB(a, b) _mm_sub_pd(a, b)
+#define V2_MUL(a, b) _mm_mul_pd(a, b)
+#define V2_MIN(a, b) _mm_min_pd(a, b)
+#define V2_MAX(a, b) _mm_max_pd(a, b)
+#define V2_LO(a, b) _mm_unpacklo_pd(a, b)       //first of each
+#define V2_HI(a, b) _mm_unpackhi_pd(a, b)       //second of each
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define DSP_V2
+typedef float64x2_t v2d;
+#define V2_LOAD(p) vld1q_f64(p)
+#define V2_STORE(p, a) vst1q_f64(p, a)
+#define V2_SET(x) vdupq_n_f64(x)
+#define V2_ADD(a, b) vaddq_f64(a, b)
+#define V2_SUB(a, b) vsubq_f64(a, b)
+#define V2_MUL(a, b) vmulq_f64(a, b)
+#define V2_MIN(a, b) vminq_f64(a, b)
+#define V2_MAX(a, b) vmaxq_f64(a, b)
+#define V2_LO(a, b) vzip1q_f64(a, b)
+#define V2_HI(a, b) vzip2q_f64(a, b)
+#endif
+
+/*****************************
+ * dsp_deinterleave() - copies the samples of one channel from frames
+ *
+ * With two channels, two frames are loaded at a time and split into
+ * the two samples of the channel.
+ *
+ * param out - samples of the channel, frames values
+ * param in - samples, num_channels per frame
+ * param frames - number of frames
+ * param num_channels - number of channels in each frame
+ * param ch - channel to copy
+****************************/
+
+void
+dsp_deinterleave(double* out, const double* in, uint32_t frames,
+    int num_channels, int ch)
+{
+    uint32_t i = 0;
+
+#ifdef DSP_V2
+    if ((num_channels == 2) && (ch == 0))
+    {
+        for (; i + 4 <= frames; i += 4)
+        {
+            const double* x = in + 2 * i;
+            V2_STORE(out + i, V2_LO(V2_LOAD(x), V2_LOAD(x + 2)));
+            V2_STORE(out + i + 2, V2_LO(V2_LOAD(x + 4), V2_LOAD(x + 6)));
+        }
+    }
+    else if (num_channels == 2)
+    {
+        for (; i + 4 <= frames; i += 4)
+        {
+            const double* x = in + 2 * i;
+            V2_STORE(out + i, V2_HI(V2_LOAD(x), V2_LOAD(x + 2)));
+            V2_STORE(out + i + 2, V2_HI(V2_LOAD(x + 4), V2_LOAD(x + 6)));
+        }
+    }
+#endif
+    dsp_deinterleave_scalar(out + i, in + (size_t)i * num_channels, frames - i,
+        num_channels, ch);
+}
+
+
+/*****************************
+ * dsp_scale() - takes an offset from samples and multiplies them by a gain
+ *
+ * As calibration, or converting ADC codes to volts.
+ *
+ * param out - scaled samples, can be the same as in
+ * param in - samples
+ * param n - number of samples
+ * param offset - taken from each sample
+ * param gain - multiplies each sample
+****************************/
+
+void
+dsp_scale(double* out, const double* in, uint32_t n, double offset,
+    double gain)
+{
+    uint32_t i = 0;
+
+#ifdef DSP_V2
+    v2d o = V2_SET(offset);
+    v2d g = V2_SET(gain);
+    for (; i + 4 <= n; i += 4)
+    {
+        V2_STORE(out + i, V2_MUL(V2_SUB(V2_LOAD(in + i), o), g));
+        V2_STORE(out + i + 2, V2_MUL(V2_SUB(V2_LOAD(in + i + 2), o), g));
+    }
+#endif
+    dsp_scale_scalar(out + i, in + i, n - i, offset, gain);
+}
+
+
+/*****************************
+ * dsp_window() - takes an offset from samples and multiplies them by a window
+ *
+ * The offset is usually the mean, so a DC offset does not leak into
+ * the spectrum.
+ *
+ * param out - windowed samples, can be the same as in
+ * param in - samples
+ * param window - coefficients, n values
+ * param n - number of samples
+ * param offset - taken from each sample
+****************************/
+
+void
+dsp_window(double* out, const double* in, const double* window, uint32_t n,
+    double offset)
+{
+    uint32_t i = 0;
+
+#ifdef DSP_V2
+    v2d o = V2_SET(offset);
+    for (; i + 4 <= n; i += 4)
+    {
+        V2_STORE(out + i, V2_MUL(V2_SUB(V2_LOAD(in + i), o), V2_LOAD(window + i)));
+        V2_STORE(out + i + 2, V2_MUL(V2_SUB(V2_LOAD(in + i + 2), o),
+            V2_LOAD(window + i + 2)));
+    }
+#endif
+    dsp_window_scalar(out + i, in + i, window + i, n - i, offset);
+}
+
+
+/*****************************
+ * dsp_sum() - sum of samples
+ *
+ * param x - samples
+ * param n - number of samples
+ * returns - the sum
+****************************/
+
+double
+dsp_sum(const double* x, uint32_t n)
+{
+    double sum = 0.0;
+    uint32_t i = 0;
+
+#ifdef DSP_V2
+    double part[2];
+    v2d acc0 = V2_SET(0.0);
+    v2d acc1 = V2_SET(0.0);
+    for (; i + 4 <= n; i += 4)
+    {
+        acc0 = V2_ADD(acc0, V2_LOAD(x + i));
+        acc1 = V2_ADD(acc1, V2_LOAD(x + i + 2));
+    }
+    V2_STORE(part, V2_ADD(acc0, acc1));
+    sum = part[0] + part[1];
+#endif
+    return sum + dsp_sum_scalar(x + i, n - i);
+}
+
+
+/*****************************
+ * dsp_dot() - dot product of two vectors
+ *
+ * For FIR filters, which are symmetric, so the samples do not have
+ * to be reversed. AVX does four products at a time, with fused
+ * multiply add if the compiler targets it.
+ *
+ * param a - first vector
+ * param b - second vector
+ * param n - number of values in each
+ * returns - sum of a[i] * b[i]
+****************************/
+
+double
+dsp_dot(const double* a, const double* b, uint32_t n)
+{
+    double sum = 0.0;
+    uint32_t i = 0;
+
+#if defined(__AVX__)
+    __m256d acc = _mm256_setzero_pd();
+    for (; i + 4 <= n; i += 4)
+    {
+#if defined(__FMA__)
+        acc = _mm256_fmadd_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), acc);
+#else
+        acc = _mm256_add_pd(acc, _mm256_mul_pd(_mm256_loadu_pd(a + i),
+            _mm256_loadu_pd(b + i)));
+#endif
+    }
+    __m128d pair = _mm_add_pd(_mm256_castpd256_pd128(acc),
+        _mm256_extractf128_pd(acc, 1));
+    sum = _mm_cvtsd_f64(_mm_add_sd(pair, _mm_unpackhi_pd(pair, pair)));
+#elif defined(DSP_V2)
+    double part[2];
+    v2d acc0 = V2_SET(0.0);
+    v2d acc1 = V2_SET(0.0);
+    for (; i + 4 <= n; i += 4)
+    {
+        acc0 = V2_ADD(acc0, V2_MUL(V2_LOAD(a + i), V2_LOAD(b + i)));
+        acc1 = V2_ADD(acc1, V2_MUL(V2_LOAD(a + i + 2), V2_LOAD(b + i + 2)));
+    }
+    V2_STORE(part, V2_ADD(acc0, acc1));
+    sum = part[0] + part[1];
+#endif
+    return sum + dsp_dot_scalar(a + i, b + i, n - i);
+}
+
+
+/*****************************
+ * dsp_sum_minmax() - sum, minimum and maximum of each channel
+ *
+ * With an even number of channels each vector holds a pair of
+ * channels, so a frame is a few vector loads and no shuffling.
+ * Two frames are done at a time, into separate sums. One channel
+ * is done as two, the even and odd samples, which are then added.
+ *
+ * param data - samples, num_channels per frame
+ * param frames - number of frames
+ * param num_channels - number of channels in each frame
+ * param sum - holds the sum of each channel on return
+ * param min - holds the smallest sample of each channel, INFINITY if no frames
+ * param max - holds the largest sample of each channel, -INFINITY if no frames
+****************************/
+
+void
+dsp_sum_minmax(const double* data, uint32_t frames, int num_channels,
+    double* sum, double* min, double* max)
+{
+#ifdef DSP_V2
+    if (num_channels == 1)
+    {
+        double s[2], lo[2], hi[2];
+        dsp_sum_minmax(data, frames / 2, 2, s, lo, hi);
+        dsp_sum_minmax_scalar(data + (frames & ~1u), frames & 1u, 1, sum, min, max);
+        sum[0] += s[0] + s[1];
+        min[0] = fmin(min[0], fmin(lo[0], lo[1]));
+        max[0] = fmax(max[0], fmax(hi[0], hi[1]));
+        return;
+    }
+    if ((num_channels % 2) == 0)
+    {
+        v2d s[2][DSP_MAX_CHANNELS / 2];
+        v2d lo[2][DSP_MAX_CHANNELS / 2];
+        v2d hi[2][DSP_MAX_CHANNELS / 2];
+        int pairs = num_channels / 2;
+        uint32_t i;
+        int p;
+        int k;
+
+        for (k = 0; k < 2; k++)
+        {
+            for (p = 0; p < pairs; p++)
+            {
+                s[k][p] = V2_SET(0.0);
+                lo[k][p] = V2_SET(INFINITY);
+                hi[k][p] = V2_SET(-INFINITY);
+            }
+        }
+        for (i = 0; i < frames; i++)
+        {
+            const double* x = data + (size_t)i * num_channels;
+            k = i & 1;
+            for (p = 0; p < pairs; p++)
+            {
+                v2d v = V2_LOAD(x + 2 * p);
+                s[k][p] = V2_ADD(s[k][p], v);
+                lo[k][p] = V2_MIN(lo[k][p], v);
+                hi[k][p] = V2_MAX(hi[k][p], v);
+            }
+        }
+        for (p = 0; p < pairs; p++)
+        {
+            V2_STORE(sum + 2 * p, V2_ADD(s[0][p], s[1][p]));
+            V2_STORE(min + 2 * p, V2_MIN(lo[0][p], lo[1][p]));
+            V2_STORE(max + 2 * p, V2_MAX(hi[0][p], hi[1][p]));
+        }
+        return;
+    }
+#endif
+    dsp_sum_minmax_scalar(data, frames, num_channels, sum, min, max);
+}
+
+
+/*****************************
+ * dsp_moments() - sums of the 2nd, 3rd and 4th powers of the
+ *                 differences from the mean of each channel
+ *
+ * The second pass of the statistics, once the mean is known.
+ * Done in pairs of channels, as dsp_sum_minmax().
+ *
+ * param data - samples, num_channels per frame
+ * param frames - number of frames
+ * param num_channels - number of channels in each frame
+ * param mean - mean of each channel
+ * param m2 - holds the sum of the squares of each channel on return
+ * param m3 - holds the sum of the cubes
+ * param m4 - holds the sum of the 4th powers
+****************************/
+
+void
+dsp_moments(const double* data, uint32_t frames, int num_channels,
+    const double* mean, double* m2, double* m3, double* m4)
+{
+#ifdef DSP_V2
+    if (num_channels == 1)
+    {
+        double means[2] = {mean[0], mean[0]};
+        double s2[2], s3[2], s4[2];
+        dsp_moments(data, frames / 2, 2, means, s2, s3, s4);
+        dsp_moments_scalar(data + (frames & ~1u), frames & 1u, 1, mean, m2, m3, m4);
+        m2[0] += s2[0] + s2[1];
+        m3[0] += s3[0] + s3[1];
+        m4[0] += s4[0] + s4[1];
+        return;
+    }
+    if ((num_channels % 2) == 0)
+    {
+        v2d mu[DSP_MAX_CHANNELS / 2];
+        v2d s2[2][DSP_MAX_CHANNELS / 2];
+        v2d s3[2][DSP_MAX_CHANNELS / 2];
+        v2d s4[2][DSP_MAX_CHANNELS / 2];
+        int pairs = num_channels / 2;
+        uint32_t i;
+        int p;
+        int k;
+
+        for (p = 0; p < pairs; p++)
+        {
+            mu[p] = V2_LOAD(mean + 2 * p);
+            for (k = 0; k < 2; k++)
+            {
+                s2[k][p] = V2_SET(0.0);
+                s3[k][p] = V2_SET(0.0);
+                s4[k][p] = V2_SET(0.0);
+            }
+        }
+        for (i = 0; i < frames; i++)
+        {
+            const double* x = data + (size_t)i * num_channels;
+            k = i & 1;
+            for (p = 0; p < pairs; p++)
+            {
+                v2d d = V2_SUB(V2_LOAD(x + 2 * p), mu[p]);
+                v2d d2 = V2_MUL(d, d);
+                s2[k][p] = V2_ADD(s2[k][p], d2);
+                s3[k][p] = V2_ADD(s3[k][p], V2_MUL(d2, d));
+                s4[k][p] = V2_ADD(s4[k][p], V2_MUL(d2, d2));
+            }
+        }
+        for (p = 0; p < pairs; p++)
+        {
+            V2_STORE(m2 + 2 * p, V2_ADD(s2[0][p], s2[1][p]));
+            V2_STORE(m3 + 2 * p, V2_ADD(s3[0][p], s3[1][p]));
+            V2_STORE(m4 + 2 * p, V2_ADD(s4[0][p], s4[1][p]));
+        }
+        return;
+    }
+#endif
+    dsp_moments_scalar(data, frames, num_channels, mean, m2, m3, m4);
+}
+
+
+/*****************************
+ * dsp_deinterleave_scalar() - scalar version of dsp_deinterleave()
+****************************/
+
+void
+dsp_deinterleave_scalar(double* out, const double* in, uint32_t frames,
+    int num_channels, int ch)
+{
+    uint32_t i;
+
+    for (i = 0; i < frames; i++)
+    {
+        out[i] = in[(size_t)i * num_channels + ch];
+    }
+}
+
+
+/*****************************
+ * dsp_scale_scalar() - scalar version of dsp_scale()
+****************************/
+
+void
+dsp_scale_scalar(double* out, const double* in, uint32_t n, double offset,
+    double gain)
+{
+    uint32_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        out[i] = (in[i] - offset) * gain;
+    }
+}
+
+
+/*****************************
+ * dsp_window_scalar() - scalar version of dsp_window()
+****************************/
+
+void
+dsp_window_scalar(double* out, const double* in, const double* window,
+    uint32_t n, double offset)
+{
+    uint32_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        out[i] = (in[i] - offset) * window[i];
+    }
+}
+
+
+/*****************************
+ * dsp_sum_scalar() - scalar version of dsp_sum()
+****************************/
+
+double
+dsp_sum_scalar(const double* x, uint32_t n)
+{
+    double sum = 0.0;
+    uint32_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        sum += x[i];
+    }
+    return sum;
+}
+
+
+/*****************************
+ * dsp_dot_scalar() - scalar version of dsp_dot()
+****************************/
+
+double
+dsp_dot_scalar(const double* a, const double* b, uint32_t n)
+{
+    double sum = 0.0;
+    uint32_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+
+/*****************************
+ * dsp_sum_minmax_scalar() - scalar version of dsp_sum_minmax()
+****************************/
+
+void
+dsp_sum_minmax_scalar(const double* data, uint32_t frames, int num_channels,
+    double* sum, double* min, double* max)
+{
+    uint32_t i;
+    int ch;
+
+    for (ch = 0; ch < num_channels; ch++)
+    {
+        sum[ch] = 0.0;
+        min[ch] = INFINITY;
+        max[ch] = -INFINITY;
+        for (i = 0; i < frames; i++)
+        {
+            double x = data[(size_t)i * num_channels + ch];
+            sum[ch] += x;
+            if (x < min[ch]) min[ch] = x;
+            if (x > max[ch]) max[ch] = x;
+        }
+    }
+}
+
+
+/*****************************
+ * dsp_moments_scalar() - scalar version of dsp_moments()
+****************************/
+
+void
+dsp_moments_scalar(const double* data, uint32_t frames, int num_channels,
+    const double* mean, double* m2, double* m3, double* m4)
+{
+    uint32_t i;
+    int ch;
+
+    for (ch = 0; ch < num_channels; ch++)
+    {
+        m2[ch] = 0.0;
+        m3[ch] = 0.0;
+        m4[ch] = 0.0;
+        for (i = 0; i < frames; i++)
+        {
+            double d = data[(size_t)i * num_channels + ch] - mean[ch];
+            double d2 = d * d;
+            m2[ch] += d2;
+            m3[ch] += d2 * d;
+            m4[ch] += d2 * d2;
+        }
+    }
+}
@@ -0,0 +1,53 @@
+/*****************************************
+ * dsp.h
+ *
+ * Kernels for the per block processing of the samples
+ *
+ * Each kernel has a SIMD version, if the compiler targets SSE2, AVX
+ * or NEON on 64 bit ARM, and a scalar version with _scalar added to
+ * its name, which is the reference the SIMD version is checked
+ * against by "make bench". Without SIMD the plain name calls the
+ * scalar version. The kernels which take frames work on interleaved
+ * samples, num_channels per frame, as mcc172_a_in_scan_read() returns.
+ *****************************************/
+#include <stdint.h>
+
+//header guard
+
+#ifndef DSP_H
+#define DSP_H
+
+#define DSP_MAX_CHANNELS 16
+
+/* name of the instruction set the SIMD versions use */
+#if defined(__AVX__)
+#define DSP_SIMD "AVX"
+#elif defined(__SSE2__)
+#define DSP_SIMD "SSE2"
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define DSP_SIMD "NEON"
+#else
+#define DSP_SIMD "none"
+#endif
+
+/* function declarations */
+void dsp_deinterleave(double*, const double*, uint32_t, int, int);
+void dsp_scale(double*, const double*, uint32_t, double, double);
+void dsp_window(double*, const double*, const double*, uint32_t, double);
+double dsp_sum(const double*, uint32_t);
+double dsp_dot(const double*, const double*, uint32_t);
+void dsp_sum_minmax(const double*, uint32_t, int, double*, double*, double*);
+void dsp_moments(const double*, uint32_t, int, const double*, double*,
+    double*, double*);
+
+void dsp_deinterleave_scalar(double*, const double*, uint32_t, int, int);
+void dsp_scale_scalar(double*, const double*, uint32_t, double, double);
+void dsp_window_scalar(double*, const double*, const double*, uint32_t, double);
+double dsp_sum_scalar(const double*, uint32_t);
+double dsp_dot_scalar(const double*, const double*, uint32_t);
+void dsp_sum_minmax_scalar(const double*, uint32_t, int, double*, double*,
+    double*);
+void dsp_moments_scalar(const double*, uint32_t, int, const double*, double*,
+    double*, double*);
+
+#endif
@@ -0,0 +1,294 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "envelope.h"
+
+/* Q of the two sections of a 4th order Butterworth filter */
+#define BUTTERWORTH_Q1 0.54119610
+#define BUTTERWORTH_Q2 1.30656296
+
+/* the envelope is sampled at least this many times its cut off frequency */
+#define ENVELOPE_OVERSAMPLE 4.0
+
+/* local function declarations */
+static void biquad_design(struct biquad*, bool, double, double, double);
+static void envelope_flush(struct envelope*);
+
+static const char* defect_names[DEFECT_COUNT] = {"BPFO", "BPFI", "BSF", "FTF"};
+
+/*****************************
+ * envelope_open() - sets up the envelope analysis of a scan
+ *
+ * Each channel is band pass filtered around a resonance of the
+ * machine, which the impacts of a bearing defect excite. The filtered
+ * signal is rectified and low pass filtered, which leaves its envelope,
+ * which repeats at the defect frequency. The envelope is decimated,
+ * as it has no high frequencies, and its spectrum is averaged.
+ *
+ * Any errors return false, otherwise return true
+ *
+ * param env - envelope analysis to set up
+ * param num_channels - number of channels in each frame
+ * param scan_rate - actual scan rate per channel
+ * param band_low - low edge of the band pass in Hz
+ * param band_high - high edge of the band pass in Hz
+ * param cutoff - low pass of the envelope in Hz
+ * param fft_size - samples in each FFT of the envelope, a power of 2
+ * param defects - DEFECT_COUNT defect frequencies in Hz, 0 if not used
+ * returns - false if a parameter is not valid or error allocating memory
+****************************/
+
+bool
+envelope_open(struct envelope* env, int num_channels, double scan_rate,
+    double band_low, double band_high, double cutoff, uint32_t fft_size,
+    double* defects)
+{
+    int ch;
+
+    memset(env, 0, sizeof(*env));
+    if ((band_low <= 0.0) || (band_high <= band_low) ||
+        (band_high >= scan_rate / 2.0) || (cutoff <= 0.0) ||
+        (cutoff >= scan_rate / 2.0))
+    {
+        return false;
+    }
+
+    env->num_channels = num_channels;
+    env->scan_rate = scan_rate;
+    env->band_low = band_low;
+    env->band_high = band_high;
+    env->cutoff = cutoff;
+    memcpy(env->defects, defects, sizeof(env->defects));
+
+    env->decimate = (uint32_t)(scan_rate / (ENVELOPE_OVERSAMPLE * cutoff));
+    if (env->decimate < 1)
+    {
+        env->decimate = 1;
+    }
+
+    if (!spectrum_open(&env->spectrum, num_channels, fft_size,
+        SPECTRUM_OVERLAP, WINDOW_HANN, scan_rate / env->decimate))
+    {
+        return false;
+    }
+    env->buf = malloc(sizeof(double) * ENVELOPE_BUF_FRAMES * num_channels);
+    if (env->buf == NULL)
+    {
+        spectrum_free(&env->spectrum);
+        return false;
+    }
+
+    for (ch = 0; ch < num_channels; ch++)
+    {
+        struct biquad* f = env->filters[ch];
+        biquad_design(&f[0], false, band_low, BUTTERWORTH_Q1, scan_rate);
+        biquad_design(&f[1], false, band_low, BUTTERWORTH_Q2, scan_rate);
+        biquad_design(&f[2], true, band_high, BUTTERWORTH_Q1, scan_rate);
+        biquad_design(&f[3], true, band_high, BUTTERWORTH_Q2, scan_rate);
+        biquad_design(&f[4], true, cutoff, BUTTERWORTH_Q1, scan_rate);
+        biquad_design(&f[5], true, cutoff, BUTTERWORTH_Q2, scan_rate);
+    }
+    return true;
+}
+
+
+/*****************************
+ * envelope_add() - adds frames of samples to the envelope analysis
+ *
+ * Every sample goes through the filters, which keep their state from
+ * one block to the next, but only one frame in decimate is kept.
+ *
+ * param env - envelope analysis of the scan
+ * param data - samples, num_channels per frame
+ * param frames - number of frames
+****************************/
+
+void
+envelope_add(struct envelope* env, const double* data, uint32_t frames)
+{
+    uint32_t i;
+    int ch;
+    int s;
+
+    for (i = 0; i < frames; i++)
+    {
+        bool keep = (++env->phase == env->decimate);
+
+        for (ch = 0; ch < env->num_channels; ch++)
+        {
+            struct biquad* f = env->filters[ch];
+            double x = data[(size_t)i * env->num_channels + ch];
+
+            for (s = 0; s < ENVELOPE_STAGES; s++)
+            {
+                //full wave rectify between the band pass and the low pass
+                if (s == ENVELOPE_BAND_STAGES)
+                {
+                    x = fabs(x);
+                }
+                double y = f[s].b0 * x + f[s].z1;
+                f[s].z1 = f[s].b1 * x - f[s].a1 * y + f[s].z2;
+                f[s].z2 = f[s].b2 * x - f[s].a2 * y;
+                x = y;
+            }
+
+            if (keep)
+            {
+                env->buf[env->fill * env->num_channels + ch] = x;
+            }
+        }
+
+        if (keep)
+        {
+            env->phase = 0;
+            if (++env->fill == ENVELOPE_BUF_FRAMES)
+            {
+                envelope_flush(env);
+            }
+        }
+    }
+}
+
+
+/*****************************
+ * envelope_write() - writes the envelope analysis to a file
+ *
+ * First the RMS amplitude of the envelope at each defect frequency
+ * and its harmonics, for each channel, then the envelope spectrum.
+ * A rise in the amplitude at a defect frequency, compared with
+ * earlier scans, is a sign of that defect.
+ *
+ * Any errors return false, otherwise return true
+ *
+ * param env - envelope analysis of the scan
+ * param filename - name of file, including path
+ * returns - false if error writing the file
+****************************/
+
+bool
+envelope_write(struct envelope* env, char* filename)
+{
+    bool ok = true;
+    int d;
+    int ch;
+    int h;
+
+    envelope_flush(env);
+
+    FILE* fp = fopen(filename, "w");
+    if (fp == NULL)
+    {
+        return false;
+    }
+
+    if (fprintf(fp, "# band pass %.1f to %.1f Hz, envelope low pass %.1f Hz, "
+        "decimated by %u\n# defect, frequency, channel, rms amplitude at 1x",
+        env->band_low, env->band_high, env->cutoff, env->decimate) < 0)
+    {
+        ok = false;
+    }
+    for (h = 2; h <= ENVELOPE_HARMONICS; h++)
+    {
+        fprintf(fp, ", %dx", h);
+    }
+    fprintf(fp, "\n");
+
+    for (d = 0; d < DEFECT_COUNT; d++)
+    {
+        if (env->defects[d] <= 0.0)
+        {
+            continue;
+        }
+        for (ch = 0; ch < env->num_channels; ch++)
+        {
+            fprintf(fp, "%s, %.3f, %d", defect_names[d], env->defects[d], ch);
+            for (h = 1; h <= ENVELOPE_HARMONICS; h++)
+            {
+                fprintf(fp, ", %.7f", spectrum_amplitude(&env->spectrum, ch,
+                    h * env->defects[d]));
+            }
+            fprintf(fp, "\n");
+        }
+    }
+
+    fprintf(fp, "#\n# envelope spectrum\n");
+    if (!spectrum_print(&env->spectrum, fp))
+    {
+        ok = false;
+    }
+    if (fclose(fp) != 0)
+    {
+        ok = false;
+    }
+    return ok;
+}
+
+
+/*****************************
+ * envelope_free() - frees the memory of an envelope analysis
+ *
+ * param env - envelope analysis of the scan
+****************************/
+
+void
+envelope_free(struct envelope* env)
+{
+    spectrum_free(&env->spectrum);
+    free(env->buf);
+    env->buf = NULL;
+}
+
+
+/*****************************
+ * envelope_flush() - passes the decimated envelope to its spectrum
+ *
+ * param env - envelope analysis of the scan
+****************************/
+
+static void
+envelope_flush(struct envelope* env)
+{
+    spectrum_add(&env->spectrum, env->buf, env->fill);
+    env->fill = 0;
+}
+
+
+/*****************************
+ * biquad_design() - works out the coefficients of a second order section
+ *
+ * Low pass or high pass, from the audio EQ cookbook of R. Bristow-Johnson.
+ * Two sections with the Q of BUTTERWORTH_Q1 and BUTTERWORTH_Q2 make a
+ * 4th order Butterworth filter.
+ *
+ * param f - section to design, its state is cleared
+ * param lowpass - true for low pass, false for high pass
+ * param freq - cut off frequency in Hz
+ * param q - quality factor
+ * param rate - sample rate in Hz
+****************************/
+
+static void
+biquad_design(struct biquad* f, bool lowpass, double freq, double q, double rate)
+{
+    double w0 = 2.0 * M_PI * freq / rate;
+    double cosw = cos(w0);
+    double alpha = sin(w0) / (2.0 * q);
+    double a0 = 1.0 + alpha;
+
+    if (lowpass)
+    {
+        f->b0 = (1.0 - cosw) / 2.0 / a0;
+        f->b1 = (1.0 - cosw) / a0;
+    }
+    else
+    {
+        f->b0 = (1.0 + cosw) / 2.0 / a0;
+        f->b1 = -(1.0 + cosw) / a0;
+    }
+    f->b2 = f->b0;
+    f->a1 = -2.0 * cosw / a0;
+    f->a2 = (1.0 - alpha) / a0;
+    f->z1 = 0.0;
+    f->z2 = 0.0;
+}
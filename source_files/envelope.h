@@ -0,0 +1,65 @@
+/*****************************************
+ * envelope.h
+ *
+ * Envelope analysis of each channel, for bearing defects
+ *****************************************/
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "spectrum.h"
+
+//header guard
+
+#ifndef ENVELOPE_H
+#define ENVELOPE_H
+
+#define ENVELOPE_CUTOFF 1000.0          //default low pass of the envelope, Hz
+#define ENVELOPE_FFT_SIZE 4096          //default size of the envelope FFT
+#define ENVELOPE_BAND_STAGES 4          //biquads of the band pass, 4th order each side
+#define ENVELOPE_LOW_STAGES 2           //biquads of the envelope low pass, 4th order
+#define ENVELOPE_STAGES (ENVELOPE_BAND_STAGES + ENVELOPE_LOW_STAGES)
+#define ENVELOPE_BUF_FRAMES 1024        //decimated frames passed to the spectrum at a time
+#define ENVELOPE_HARMONICS 3            //harmonics of each defect frequency reported
+
+/* bearing defect frequencies, the order of the tags in vib_params */
+enum envelope_defect
+{
+    DEFECT_BPFO = 0,                    //ball pass frequency, outer race
+    DEFECT_BPFI = 1,                    //ball pass frequency, inner race
+    DEFECT_BSF = 2,                     //ball spin frequency
+    DEFECT_FTF = 3,                     //fundamental train frequency, cage
+    DEFECT_COUNT = 4
+};
+
+/* second order section, direct form II transposed */
+struct biquad
+{
+    double b0, b1, b2;
+    double a1, a2;                      //a0 is 1
+    double z1, z2;                      //state
+};
+
+struct envelope
+{
+    int num_channels;
+    double scan_rate;
+    double band_low;                    //band pass around the resonance, Hz
+    double band_high;
+    double cutoff;                      //low pass of the rectified signal, Hz
+    uint32_t decimate;                  //envelope keeps one frame in this many
+    uint32_t phase;                     //frames since the last one kept
+    double defects[DEFECT_COUNT];       //defect frequencies in Hz, 0 if not used
+    struct biquad filters[SPECTRUM_MAX_CHANNELS][ENVELOPE_STAGES];
+    double* buf;                        //decimated envelope frames
+    uint32_t fill;                      //frames in buf
+    struct spectrum spectrum;           //spectrum of the envelope
+};
+
+/* function declarations */
+bool envelope_open(struct envelope*, int, double, double, double, double,
+    uint32_t, double*);
+void envelope_add(struct envelope*, const double*, uint32_t);
+bool envelope_write(struct envelope*, char*);
+void envelope_free(struct envelope*);
+
+#endif
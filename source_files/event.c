@@ -0,0 +1,527 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "event.h"
+#include "dsp.h"
+
+/* local function declarations */
+static uint32_t event_level_search(struct event*, const double*, uint32_t);
+static uint32_t event_level_rearm(struct event*, const double*, uint32_t);
+static uint32_t event_rms_search(struct event*, const double*, uint32_t);
+static bool event_rms_window(struct event*);
+static void event_keep(struct event*, const double*, uint32_t);
+static void event_reverse(struct event*, uint32_t, uint32_t);
+
+/*****************************
+ * event_open() - sets up the capture of events
+ *
+ * The frames of the scan are searched for a trigger, and the last
+ * pre_seconds of them are kept in memory, so an event is captured
+ * with what led up to it as well as what followed it.
+ *
+ * The level trigger fires on the first sample at or beyond the level,
+ * positive or negative. The rms trigger works out the RMS of each
+ * channel over windows of EVENT_RMS_WINDOW, and fires at the end of a
+ * window whose RMS is more than level times the long term RMS, the
+ * average of the windows before it. It only fires once EVENT_RMS_AVERAGE
+ * windows have been averaged, so the long term RMS has settled.
+ * The external trigger is the hardware trigger which started the scan,
+ * so the event is the start of the scan, and there is nothing before it.
+ *
+ * After an event the level and rms triggers wait for the hold off, then
+ * re-arm once the signal has dropped back below EVENT_REARM times the
+ * level, so a vibration which stays high is one event, not one after
+ * another. No more than max_events are captured.
+ *
+ * The level is in the units of the sensitivity, if the samples are raw
+ * ADC codes event_set_codes() converts it.
+ *
+ * Any errors return false, otherwise return true
+ *
+ * param ev - events to set up
+ * param trigger - one of enum event_trigger, not EVENT_NONE
+ * param num_channels - number of channels in each frame
+ * param scan_rate - actual scan rate per channel
+ * param level - level of the level trigger, ratio of the rms trigger
+ * param pre_seconds - time kept from before the trigger
+ * param post_seconds - time captured from the trigger on
+ * param holdoff_seconds - time after an event before the next can trigger
+ * param max_events - events captured, 0 for no limit
+ * returns - false if a parameter is not valid or error allocating memory
+****************************/
+
+bool
+event_open(struct event* ev, int trigger, int num_channels, double scan_rate,
+    double level, double pre_seconds, double post_seconds,
+    double holdoff_seconds, int max_events)
+{
+    int ch;
+
+    memset(ev, 0, sizeof(*ev));
+    if ((num_channels < 1) || (num_channels > EVENT_MAX_CHANNELS) ||
+        (trigger < EVENT_LEVEL) || (trigger > EVENT_EXTERNAL) ||
+        (pre_seconds < 0.0) || (post_seconds <= 0.0) ||
+        (holdoff_seconds < 0.0) || (max_events < 0) ||
+        ((trigger != EVENT_EXTERNAL) && (level <= 0.0)))
+    {
+        return false;
+    }
+
+    ev->trigger = trigger;
+    ev->num_channels = num_channels;
+    ev->level = level;
+    for (ch = 0; ch < num_channels; ch++)
+    {
+        ev->ch_level[ch] = level;
+    }
+    ev->max_events = max_events;
+    ev->holdoff_frames = (uint32_t)(holdoff_seconds * scan_rate + 0.5);
+    ev->armed = true;
+    ev->pre_frames = (trigger == EVENT_EXTERNAL) ? 0 :
+        (uint32_t)(pre_seconds * scan_rate + 0.5);
+    ev->post_frames = (uint32_t)(post_seconds * scan_rate + 0.5);
+    if (ev->post_frames < 1)
+    {
+        ev->post_frames = 1;
+    }
+    ev->window_frames = (uint32_t)(EVENT_RMS_WINDOW * scan_rate + 0.5);
+    if (ev->window_frames < 1)
+    {
+        ev->window_frames = 1;
+    }
+
+    if (ev->pre_frames > 0)
+    {
+        ev->buf = malloc(sizeof(double) * ev->pre_frames * num_channels);
+        if (ev->buf == NULL)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/*****************************
+ * event_set_codes() - sets the level trigger for samples of raw ADC codes
+ *
+ * The level stays in the units of the sensitivity, and is converted to
+ * the codes of each channel, so the codes are compared with it without
+ * scaling every sample. The level and rms triggers take the offset of
+ * the codes off each sample. The ratio of the rms trigger has no units.
+ *
+ * param ev - events, opened
+ * param units_per_code - units of one code, of each channel
+ * param code_offset - code of 0 units, of each channel
+****************************/
+
+void
+event_set_codes(struct event* ev, const double* units_per_code,
+    const double* code_offset)
+{
+    int ch;
+
+    for (ch = 0; ch < ev->num_channels; ch++)
+    {
+        ev->ch_level[ch] = ev->level / units_per_code[ch];
+        ev->ch_offset[ch] = code_offset[ch];
+    }
+}
+
+
+/*****************************
+ * event_search() - looks for a trigger in frames of the scan
+ *
+ * The frames before the trigger are kept, to go before the next event.
+ * If a trigger is found the frame it is on is the first frame of the
+ * event, post_left is set, and the rest of the frames, from the trigger
+ * on, are for event_post().
+ *
+ * The frames of the hold off, and of the level trigger until it has
+ * re-armed, are not searched. Once max_events have been captured
+ * nothing is.
+ *
+ * param ev - events
+ * param data - samples, num_channels per frame
+ * param frames - number of frames
+ * returns - frames before the trigger, frames if there was no trigger
+****************************/
+
+uint32_t
+event_search(struct event* ev, const double* data, uint32_t frames)
+{
+    size_t nch = ev->num_channels;
+    uint32_t n;
+
+    if ((ev->max_events > 0) && (ev->count >= ev->max_events))
+    {
+        n = frames;
+    }
+    else
+    {
+        n = (frames < ev->holdoff_left) ? frames : ev->holdoff_left;
+        ev->holdoff_left -= n;
+        if ((n < frames) && !ev->armed && (ev->trigger == EVENT_LEVEL))
+        {
+            n += event_level_rearm(ev, &data[n * nch], frames - n);
+        }
+
+        if ((n < frames) && (ev->trigger == EVENT_LEVEL))
+        {
+            n += event_level_search(ev, &data[n * nch], frames - n);
+        }
+        else if ((n < frames) && (ev->trigger == EVENT_RMS))
+        {
+            n += event_rms_search(ev, &data[n * nch], frames - n);
+        }
+        else if (n < frames)
+        {
+            n = ((ev->frame == 0) && (ev->count == 0)) ? 0 : frames;
+        }
+    }
+
+    event_keep(ev, data, n);
+    ev->frame += n;
+    if (n < frames)
+    {
+        ev->post_left = ev->post_frames;
+        ev->trigger_frame = ev->frame;
+        ev->count++;
+        ev->armed = false;
+        ev->quiet_frames = 0;
+    }
+    return n;
+}
+
+
+/*****************************
+ * event_pre() - frames kept from before the trigger
+ *
+ * The kept frames are moved round in place, so the oldest is first,
+ * which is only done once for each event.
+ *
+ * param ev - events, just triggered
+ * param frames - set to the number of frames kept, up to pre_frames
+ * returns - the frames, oldest first, NULL if none
+****************************/
+
+const double*
+event_pre(struct event* ev, uint32_t* frames)
+{
+    if (ev->buf_fill == ev->pre_frames)
+    {
+        //rotate the oldest, at buf_pos, to the start
+        event_reverse(ev, 0, ev->buf_pos);
+        event_reverse(ev, ev->buf_pos, ev->pre_frames);
+        event_reverse(ev, 0, ev->pre_frames);
+        ev->buf_pos = 0;
+    }
+    *frames = ev->buf_fill;
+    return ev->buf;
+}
+
+
+/*****************************
+ * event_post() - takes frames of the scan for the event being captured
+ *
+ * The frames are kept too, so events close together overlap, rather
+ * than the next event missing what led up to it. The hold off starts
+ * when the event has all its frames.
+ *
+ * param ev - events, with an event being captured
+ * param data - samples, num_channels per frame
+ * param frames - number of frames
+ * returns - frames which belong to the event, the rest are searched
+****************************/
+
+uint32_t
+event_post(struct event* ev, const double* data, uint32_t frames)
+{
+    uint32_t n = (frames < ev->post_left) ? frames : ev->post_left;
+
+    event_keep(ev, data, n);
+    ev->frame += n;
+    ev->post_left -= n;
+    if (ev->post_left == 0)
+    {
+        ev->holdoff_left = ev->holdoff_frames;
+    }
+    return n;
+}
+
+
+/*****************************
+ * event_free() - frees the memory of the events
+ *
+ * param ev - events set up by event_open()
+****************************/
+
+void
+event_free(struct event* ev)
+{
+    free(ev->buf);
+    ev->buf = NULL;
+}
+
+
+/*****************************
+ * event_level_search() - finds the first sample at or beyond the level
+ *
+ * Most blocks have no trigger in them, so the smallest and largest
+ * sample of each channel are found first, with the SIMD kernel, and
+ * only a block which has a trigger in it is searched sample by sample.
+ *
+ * param ev - events
+ * param data - samples, num_channels per frame
+ * param frames - number of frames
+ * returns - frame of the trigger, frames if there is none
+****************************/
+
+static uint32_t
+event_level_search(struct event* ev, const double* data, uint32_t frames)
+{
+    double sum[DSP_MAX_CHANNELS];
+    double min[DSP_MAX_CHANNELS];
+    double max[DSP_MAX_CHANNELS];
+    bool found = false;
+    uint32_t i;
+    int ch;
+
+    dsp_sum_minmax(data, frames, ev->num_channels, sum, min, max);
+    for (ch = 0; ch < ev->num_channels; ch++)
+    {
+        found = found || (max[ch] - ev->ch_offset[ch] >= ev->ch_level[ch]) ||
+            (min[ch] - ev->ch_offset[ch] <= -ev->ch_level[ch]);
+    }
+    if (!found)
+    {
+        return frames;
+    }
+
+    for (i = 0; i < frames; i++)
+    {
+        for (ch = 0; ch < ev->num_channels; ch++)
+        {
+            if (fabs(data[i * ev->num_channels + ch] - ev->ch_offset[ch]) >=
+                ev->ch_level[ch])
+            {
+                return i;
+            }
+        }
+    }
+    return frames;
+}
+
+
+/*****************************
+ * event_level_rearm() - waits for the signal to drop back below the level
+ *
+ * The level trigger re-arms once every channel has stayed below
+ * EVENT_REARM times the level for EVENT_RMS_WINDOW, so a vibration
+ * passing through zero does not re-arm it. A block which is all below
+ * is counted without searching it sample by sample.
+ *
+ * param ev - events, not armed
+ * param data - samples, num_channels per frame
+ * param frames - number of frames
+ * returns - frames up to and including the one it re-armed on, frames
+ * if it did not
+****************************/
+
+static uint32_t
+event_level_rearm(struct event* ev, const double* data, uint32_t frames)
+{
+    double sum[DSP_MAX_CHANNELS];
+    double min[DSP_MAX_CHANNELS];
+    double max[DSP_MAX_CHANNELS];
+    double rearm[DSP_MAX_CHANNELS];
+    bool quiet = true;
+    uint32_t i;
+    int ch;
+
+    dsp_sum_minmax(data, frames, ev->num_channels, sum, min, max);
+    for (ch = 0; ch < ev->num_channels; ch++)
+    {
+        rearm[ch] = ev->ch_level[ch] * EVENT_REARM;
+        quiet = quiet && (max[ch] - ev->ch_offset[ch] < rearm[ch]) &&
+            (min[ch] - ev->ch_offset[ch] > -rearm[ch]);
+    }
+    if (quiet && (ev->quiet_frames + frames < ev->window_frames))
+    {
+        ev->quiet_frames += frames;
+        return frames;
+    }
+
+    for (i = 0; i < frames; i++)
+    {
+        quiet = true;
+        for (ch = 0; ch < ev->num_channels; ch++)
+        {
+            quiet = quiet && (fabs(data[i * ev->num_channels + ch] -
+                ev->ch_offset[ch]) < rearm[ch]);
+        }
+        ev->quiet_frames = quiet ? ev->quiet_frames + 1 : 0;
+        if (ev->quiet_frames >= ev->window_frames)
+        {
+            ev->armed = true;
+            return i + 1;
+        }
+    }
+    return frames;
+}
+
+
+/*****************************
+ * event_rms_search() - finds the end of a window with a step in the RMS
+ *
+ * param ev - events
+ * param data - samples, num_channels per frame
+ * param frames - number of frames
+ * returns - last frame of the window which triggered, frames if none did
+****************************/
+
+static uint32_t
+event_rms_search(struct event* ev, const double* data, uint32_t frames)
+{
+    const double* frame;
+    double x;
+    uint32_t i;
+    int ch;
+
+    for (i = 0; i < frames; i++)
+    {
+        frame = &data[i * ev->num_channels];
+        for (ch = 0; ch < ev->num_channels; ch++)
+        {
+            x = frame[ch] - ev->ch_offset[ch];
+            ev->window_sum[ch] += x * x;
+        }
+        if ((++ev->window_fill == ev->window_frames) && event_rms_window(ev))
+        {
+            return i;
+        }
+    }
+    return frames;
+}
+
+
+/*****************************
+ * event_rms_window() - compares a full window to the long term RMS
+ *
+ * A window which does not trigger is added to the long term mean
+ * square, a plain average of the first EVENT_RMS_AVERAGE windows,
+ * then an exponential average with the same weight, so it follows
+ * slow changes but not a step. The window is then emptied.
+ *
+ * After an event it only triggers again once a window of every channel
+ * is back below EVENT_REARM times the level, or the long term RMS if
+ * that is higher. Until then the windows are still averaged, so a
+ * change which lasts becomes the long term RMS, and re-arms it.
+ *
+ * param ev - events, with a full window
+ * returns - true if the window triggered
+****************************/
+
+static bool
+event_rms_window(struct event* ev)
+{
+    double ratio = ev->level * ev->level;
+    double rearm = fmax(ev->level * EVENT_REARM, 1.0);
+    double weight;
+    double ms;
+    bool triggered = false;
+    bool quiet = true;
+    int ch;
+
+    for (ch = 0; ch < ev->num_channels; ch++)
+    {
+        ms = ev->window_sum[ch] / ev->window_frames;
+        triggered = triggered || (ev->armed &&
+            (ev->windows >= EVENT_RMS_AVERAGE) &&
+            (ms > ratio * ev->mean_square[ch]));
+        quiet = quiet && (ms <= rearm * rearm * ev->mean_square[ch]);
+    }
+    if (!triggered)
+    {
+        ev->armed = ev->armed || quiet;
+        weight = 1.0 / ((ev->windows < EVENT_RMS_AVERAGE) ?
+            ev->windows + 1 : EVENT_RMS_AVERAGE);
+        for (ch = 0; ch < ev->num_channels; ch++)
+        {
+            ms = ev->window_sum[ch] / ev->window_frames;
+            ev->mean_square[ch] += weight * (ms - ev->mean_square[ch]);
+        }
+        ev->windows++;
+    }
+
+    ev->window_fill = 0;
+    memset(ev->window_sum, 0, sizeof(ev->window_sum));
+    return triggered;
+}
+
+
+/*****************************
+ * event_keep() - adds frames to the frames kept from before a trigger
+ *
+ * param ev - events
+ * param data - samples, num_channels per frame
+ * param frames - number of frames, only the last pre_frames are kept
+****************************/
+
+static void
+event_keep(struct event* ev, const double* data, uint32_t frames)
+{
+    int nch = ev->num_channels;
+    uint32_t n;
+
+    if (ev->pre_frames == 0)
+    {
+        return;
+    }
+    if (frames > ev->pre_frames)
+    {
+        data += (size_t)(frames - ev->pre_frames) * nch;
+        frames = ev->pre_frames;
+    }
+
+    //up to the end of buf, then the rest from the start
+    n = ev->pre_frames - ev->buf_pos;
+    if (n > frames)
+    {
+        n = frames;
+    }
+    memcpy(&ev->buf[(size_t)ev->buf_pos * nch], data, sizeof(double) * n * nch);
+    memcpy(ev->buf, &data[(size_t)n * nch], sizeof(double) * (frames - n) * nch);
+    ev->buf_pos = (ev->buf_pos + frames) % ev->pre_frames;
+    ev->buf_fill = (ev->buf_fill + frames < ev->pre_frames) ?
+        ev->buf_fill + frames : ev->pre_frames;
+}
+
+
+/*****************************
+ * event_reverse() - reverses the order of kept frames
+ *
+ * param ev - events
+ * param first - first frame to reverse
+ * param end - one past the last frame
+****************************/
+
+static void
+event_reverse(struct event* ev, uint32_t first, uint32_t end)
+{
+    double tmp[EVENT_MAX_CHANNELS];
+    size_t size = sizeof(double) * ev->num_channels;
+    double* a;
+    double* b;
+
+    while (first + 1 < end)
+    {
+        end--;
+        a = &ev->buf[(size_t)first * ev->num_channels];
+        b = &ev->buf[(size_t)end * ev->num_channels];
+        memcpy(tmp, a, size);
+        memcpy(a, b, size);
+        memcpy(b, tmp, size);
+        first++;
+    }
+}
@@ -0,0 +1,68 @@
+/*****************************************
+ * event.h
+ *
+ * Triggered capture of events, with the frames before the trigger
+ *****************************************/
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+//header guard
+
+#ifndef EVENT_H
+#define EVENT_H
+
+#define EVENT_MAX_CHANNELS 16           //8 boards of 2 channels
+#define EVENT_RMS_WINDOW 0.1            //seconds of the short term RMS of the rms trigger
+#define EVENT_RMS_AVERAGE 20            //windows in the long term RMS, and before it triggers
+#define EVENT_REARM 0.8                 //fraction of the level the trigger re-arms below
+
+/* what starts an event, the order of the choices in vib_params */
+enum event_trigger
+{
+    EVENT_NONE = 0,                     //no events
+    EVENT_LEVEL = 1,                    //a sample is at or beyond the level, either sign
+    EVENT_RMS = 2,                      //short term RMS is level times the long term RMS
+    EVENT_EXTERNAL = 3                  //the hardware trigger started the scan
+};
+
+struct event
+{
+    int trigger;                        //one of enum event_trigger
+    int num_channels;
+    double level;                       //units, or the ratio of the rms trigger
+    double ch_level[EVENT_MAX_CHANNELS];    //level of each channel, as its samples
+    double ch_offset[EVENT_MAX_CHANNELS];   //sample of each channel at 0 units
+    uint32_t pre_frames;                //frames kept from before the trigger
+    uint32_t post_frames;               //frames captured from the trigger on
+    double* buf;                        //last pre_frames frames, circular, NULL if none
+    uint32_t buf_pos;                   //where the next frame goes
+    uint32_t buf_fill;                  //frames in buf
+    uint32_t post_left;                 //frames of the event still to capture, 0 if waiting
+    uint64_t frame;                     //frames of the scan so far
+    uint64_t trigger_frame;             //frame of the scan the last event triggered on
+    int count;                          //events triggered
+    int max_events;                     //events in a capture, 0 for no limit
+    uint32_t holdoff_frames;            //frames after an event before the next can trigger
+    uint32_t holdoff_left;              //frames of the hold off still to go
+    bool armed;                         //the signal has dropped back since the last event
+    uint32_t quiet_frames;              //frames in a row below the re-arm level
+
+    /* rms trigger */
+    uint32_t window_frames;             //frames in the short term RMS
+    uint32_t window_fill;               //frames added to the window so far
+    uint32_t windows;                   //windows added to the long term RMS
+    double window_sum[EVENT_MAX_CHANNELS];  //sum of squares of the window
+    double mean_square[EVENT_MAX_CHANNELS]; //long term mean square
+};
+
+/* function declarations */
+bool event_open(struct event*, int, int, double, double, double, double, double,
+    int);
+void event_set_codes(struct event*, const double*, const double*);
+uint32_t event_search(struct event*, const double*, uint32_t);
+const double* event_pre(struct event*, uint32_t*);
+uint32_t event_post(struct event*, const double*, uint32_t);
+void event_free(struct event*);
+
+#endif
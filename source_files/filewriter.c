@@ -0,0 +1,259 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "filewriter.h"
+
+/* local function declarations */
+static bool filewriter_flush(struct filewriter*);
+static void filewriter_reserve(struct filewriter*, uint64_t);
+static bool filewriter_pwrite(int, const void*, size_t, uint64_t);
+
+/*****************************
+ * filewriter_open() - creates a file, with space reserved for it
+ *
+ * Growing a file by small writes spreads it over the SD card, and
+ * each write can start a read, erase and write of a whole flash
+ * erase block, so the time a write takes is hard to predict. Space
+ * for the size expected is reserved when the file is created, with
+ * fallocate(), so it is in one piece, and the bytes are written a
+ * FILEWRITER_CHUNK at a time, at aligned offsets, with pwrite(). The
+ * space is reserved without changing the size of the file, so if the
+ * program stops the file holds what was written and no more.
+ * If the file grows past the size expected, more is reserved
+ * FILEWRITER_GROW at a time. If the file system cannot reserve space
+ * the file is still written in chunks.
+ *
+ * Any errors return false, otherwise return true
+ *
+ * param fw - file to open
+ * param filename - name of file, including path
+ * param expected - bytes the file is expected to have, 0 if not known
+ * returns - false if error creating the file or allocating the chunk
+****************************/
+
+bool
+filewriter_open(struct filewriter* fw, const char* filename, uint64_t expected)
+{
+    memset(fw, 0, sizeof(*fw));
+    fw->fd = -1;
+    if (posix_memalign((void**)&fw->chunk, FILEWRITER_ALIGN, FILEWRITER_CHUNK) != 0)
+    {
+        fw->chunk = NULL;
+        return false;
+    }
+    fw->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fw->fd < 0)
+    {
+        free(fw->chunk);
+        fw->chunk = NULL;
+        return false;
+    }
+    fw->reserve = true;
+    filewriter_reserve(fw, expected);
+    return true;
+}
+
+
+/*****************************
+ * filewriter_write() - adds bytes to the end of a file
+ *
+ * The bytes are copied to the chunk, which is written when it is full.
+ *
+ * Any errors return false, otherwise return true
+ *
+ * param fw - file opened by filewriter_open()
+ * param data - bytes to add
+ * param size - number of bytes
+ * returns - false if error writing the file
+****************************/
+
+bool
+filewriter_write(struct filewriter* fw, const void* data, size_t size)
+{
+    const uint8_t* p = data;
+    size_t n;
+
+    while (size > 0)
+    {
+        n = FILEWRITER_CHUNK - fw->fill;
+        if (n > size)
+        {
+            n = size;
+        }
+        memcpy(fw->chunk + fw->fill, p, n);
+        fw->fill += n;
+        p += n;
+        size -= n;
+        if ((fw->fill == FILEWRITER_CHUNK) && !filewriter_flush(fw))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/*****************************
+ * filewriter_rewrite() - changes bytes already added to a file
+ *
+ * Such as a header with the number of frames, once they are known.
+ * Bytes still in the chunk are changed there, the rest in the file.
+ *
+ * Any errors return false, otherwise return true
+ *
+ * param fw - file opened by filewriter_open()
+ * param data - new bytes
+ * param size - number of bytes
+ * param offset - where they go in the file, before the end of the file
+ * returns - false if error writing the file, or not written yet
+****************************/
+
+bool
+filewriter_rewrite(struct filewriter* fw, const void* data, size_t size,
+    uint64_t offset)
+{
+    const uint8_t* p = data;
+    size_t n = 0;
+
+    if (offset + size > fw->offset + fw->fill)
+    {
+        return false;
+    }
+    if (offset < fw->offset)
+    {
+        n = (offset + size <= fw->offset) ? size : fw->offset - offset;
+        if (!filewriter_pwrite(fw->fd, p, n, offset))
+        {
+            return false;
+        }
+    }
+    memcpy(fw->chunk + (offset + n - fw->offset), p + n, size - n);
+    return true;
+}
+
+
+/*****************************
+ * filewriter_close() - writes the rest of a file and closes it
+ *
+ * The size of the file is set to the bytes written, which gives
+ * back any space reserved but not used, and it is synced to the card,
+ * so it is all there once this returns.
+ *
+ * Any errors return false, otherwise return true
+ *
+ * param fw - file opened by filewriter_open()
+ * returns - false if error writing or closing the file
+****************************/
+
+bool
+filewriter_close(struct filewriter* fw)
+{
+    bool ok = true;
+
+    if (fw->fd >= 0)
+    {
+        ok = filewriter_flush(fw);
+        ok = (ftruncate(fw->fd, fw->offset) == 0) && ok;
+        ok = (fsync(fw->fd) == 0) && ok;
+        ok = (close(fw->fd) == 0) && ok;
+        fw->fd = -1;
+    }
+    free(fw->chunk);
+    fw->chunk = NULL;
+    return ok;
+}
+
+
+/*****************************
+ * filewriter_flush() - writes the chunk
+ *
+ * A chunk which is not full is only written at the end of the file,
+ * so every other write is a whole chunk at an aligned offset.
+ *
+ * param fw - file opened by filewriter_open()
+ * returns - false if error writing the file
+****************************/
+
+static bool
+filewriter_flush(struct filewriter* fw)
+{
+    if (fw->fill == 0)
+    {
+        return true;
+    }
+    if (fw->offset + fw->fill > fw->reserved)
+    {
+        filewriter_reserve(fw, fw->reserved + FILEWRITER_GROW);
+    }
+    if (!filewriter_pwrite(fw->fd, fw->chunk, fw->fill, fw->offset))
+    {
+        return false;
+    }
+    fw->offset += fw->fill;
+    fw->fill = 0;
+    return true;
+}
+
+
+/*****************************
+ * filewriter_reserve() - reserves space for a file, without changing its size
+ *
+ * If the file system cannot, eg it is FAT, or there is not the
+ * space, no more is tried, the writes find out if the card is full.
+ *
+ * param fw - file opened by filewriter_open()
+ * param size - bytes from the start of the file to reserve
+****************************/
+
+static void
+filewriter_reserve(struct filewriter* fw, uint64_t size)
+{
+    if (!fw->reserve || (size <= fw->reserved))
+    {
+        return;
+    }
+    if (fallocate(fw->fd, FALLOC_FL_KEEP_SIZE, fw->reserved, size - fw->reserved) != 0)
+    {
+        fw->reserve = false;
+        return;
+    }
+    fw->reserved = size;
+}
+
+
+/*****************************
+ * filewriter_pwrite() - writes all the bytes at an offset
+ *
+ * param fd - file
+ * param data - bytes
+ * param size - number of bytes
+ * param offset - where they go in the file
+ * returns - false if error writing the file
+****************************/
+
+static bool
+filewriter_pwrite(int fd, const void* data, size_t size, uint64_t offset)
+{
+    const uint8_t* p = data;
+    ssize_t n;
+
+    while (size > 0)
+    {
+        n = pwrite(fd, p, size, offset);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        p += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
@@ -0,0 +1,36 @@
+/*****************************************
+ * filewriter.h
+ *
+ * Large, aligned writes to a preallocated file
+ *****************************************/
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+//header guard
+
+#ifndef FILEWRITER_H
+#define FILEWRITER_H
+
+#define FILEWRITER_CHUNK (1 << 20)      //bytes written at a time, a multiple of the flash pages
+#define FILEWRITER_ALIGN 4096           //alignment of the chunk in memory and in the file
+#define FILEWRITER_GROW (16 << 20)      //bytes reserved at a time once past what was expected
+
+struct filewriter
+{
+    int fd;                             //-1 if not open
+    uint8_t* chunk;                     //bytes waiting to be written, FILEWRITER_CHUNK
+    uint32_t fill;                      //bytes in chunk
+    uint64_t offset;                    //where chunk goes in the file, bytes before it are written
+    uint64_t reserved;                  //bytes of the file with space reserved
+    bool reserve;                       //false once the file system cannot reserve space
+};
+
+/* function declarations */
+bool filewriter_open(struct filewriter*, const char*, uint64_t);
+bool filewriter_write(struct filewriter*, const void*, size_t);
+bool filewriter_rewrite(struct filewriter*, const void*, size_t, uint64_t);
+bool filewriter_close(struct filewriter*);
+
+#endif
@@ -0,0 +1,269 @@
+#include <math.h>
+#include "instrument.h"
+
+/* local function declarations */
+static uint32_t instrument_bin(uint32_t);
+static uint32_t instrument_bin_start(uint32_t);
+static uint32_t instrument_bin_end(uint32_t);
+static void instrument_inc(atomic_uint*, uint32_t);
+
+/* set by SIGUSR1 */
+static atomic_bool dump_wanted;
+
+/*****************************
+ * instrument_init() - sets up an empty histogram
+ *
+ * param inst - histogram to set up
+ * param name - what it measures, for instrument_write()
+ * param unit - unit of the values
+****************************/
+
+void
+instrument_init(struct instrument* inst, const char* name, const char* unit)
+{
+    int i;
+
+    inst->name = name;
+    inst->unit = unit;
+    for (i = 0; i < INSTRUMENT_BINS; i++)
+    {
+        atomic_init(&inst->counts[i], 0);
+    }
+    atomic_init(&inst->count, 0);
+    atomic_init(&inst->max, 0);
+    atomic_init(&inst->sum, 0);
+}
+
+
+/*****************************
+ * instrument_add() - adds a value to a histogram
+ *
+ * Only one thread adds to a histogram, so the counts are loaded and
+ * stored, which costs no more than a plain increment, rather than
+ * with a locked read-modify-write. Other threads can read them at
+ * any time, a count may be one behind.
+ *
+ * param inst - histogram to add to
+ * param value - value to add
+****************************/
+
+void
+instrument_add(struct instrument* inst, uint32_t value)
+{
+    instrument_inc(&inst->counts[instrument_bin(value)], 1);
+    instrument_inc(&inst->count, 1);
+    if (value > atomic_load_explicit(&inst->max, memory_order_relaxed))
+    {
+        atomic_store_explicit(&inst->max, value, memory_order_relaxed);
+    }
+    atomic_store_explicit(&inst->sum, value +
+        atomic_load_explicit(&inst->sum, memory_order_relaxed), memory_order_relaxed);
+}
+
+
+/*****************************
+ * instrument_percentile() - value a percentile of the values are at or below
+ *
+ * param inst - histogram
+ * param percent - percentile, 0 to 100
+ * returns - end of the bin the percentile is in, at most the largest
+ *           value, 0 if there are no values
+****************************/
+
+uint32_t
+instrument_percentile(struct instrument* inst, double percent)
+{
+    uint32_t max = atomic_load_explicit(&inst->max, memory_order_relaxed);
+    uint64_t total = 0;
+    uint64_t wanted;
+    uint64_t count = 0;
+    uint32_t i;
+
+    //add up the bins, rather than use count, in case a value is being added
+    for (i = 0; i < INSTRUMENT_BINS; i++)
+    {
+        total += atomic_load_explicit(&inst->counts[i], memory_order_relaxed);
+    }
+    wanted = (uint64_t)ceil(percent / 100.0 * total);
+    if (wanted < 1)
+    {
+        wanted = 1;
+    }
+    for (i = 0; i < INSTRUMENT_BINS; i++)
+    {
+        count += atomic_load_explicit(&inst->counts[i], memory_order_relaxed);
+        if (count >= wanted)
+        {
+            return (instrument_bin_end(i) < max) ? instrument_bin_end(i) : max;
+        }
+    }
+    return max;
+}
+
+
+/*****************************
+ * instrument_write() - writes a histogram to a file
+ *
+ * A line with the number of values, the mean, percentiles and the
+ * largest value, then a line for each bin with values in it, with the
+ * first and last value of the bin and the number of values in it.
+ *
+ * param inst - histogram
+ * param fp - file to write to
+ * param label - added to the start of the first line, such as the board
+ * returns - false if error writing the file
+****************************/
+
+bool
+instrument_write(struct instrument* inst, FILE* fp, const char* label)
+{
+    uint32_t count = atomic_load_explicit(&inst->count, memory_order_relaxed);
+    uint64_t sum = atomic_load_explicit(&inst->sum, memory_order_relaxed);
+    uint32_t n;
+    uint32_t i;
+
+    fprintf(fp, "%s%s, %s: count %u, mean %.1f, p50 %u, p90 %u, p99 %u, "
+        "p99.9 %u, max %u\n", label, inst->name, inst->unit, count,
+        (count > 0) ? (double)sum / count : 0.0,
+        instrument_percentile(inst, 50.0), instrument_percentile(inst, 90.0),
+        instrument_percentile(inst, 99.0), instrument_percentile(inst, 99.9),
+        atomic_load_explicit(&inst->max, memory_order_relaxed));
+    for (i = 0; i < INSTRUMENT_BINS; i++)
+    {
+        n = atomic_load_explicit(&inst->counts[i], memory_order_relaxed);
+        if (n > 0)
+        {
+            fprintf(fp, "    %u - %u\t%u\n", instrument_bin_start(i),
+                instrument_bin_end(i), n);
+        }
+    }
+    return !ferror(fp);
+}
+
+
+/*****************************
+ * instrument_signal() - signal handler which asks for the histograms
+ *
+ * Only sets a flag, which the writer thread checks with
+ * instrument_dump_wanted(), nothing else is safe in a handler.
+ *
+ * param sig - signal number, SIGUSR1
+****************************/
+
+void
+instrument_signal(int sig)
+{
+    (void)sig;
+    atomic_store(&dump_wanted, true);
+}
+
+
+/*****************************
+ * instrument_dump_wanted() - whether a signal has asked for the histograms
+ *
+ * returns - true once for each signal
+****************************/
+
+bool
+instrument_dump_wanted(void)
+{
+    return atomic_exchange(&dump_wanted, false);
+}
+
+
+/*****************************
+ * instrument_usec_since() - microseconds from a time to now
+ *
+ * param start - CLOCK_MONOTONIC time
+ * returns - microseconds since start
+****************************/
+
+uint32_t
+instrument_usec_since(struct timespec* start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)((now.tv_sec - start->tv_sec) * 1000000 +
+        (now.tv_nsec - start->tv_nsec) / 1000);
+}
+
+
+/*****************************
+ * instrument_bin() - bin of a value
+ *
+ * The position of the highest bit set picks the power of 2, the next
+ * INSTRUMENT_SUB_BITS bits the bin in it.
+ *
+ * param value - value
+ * returns - bin, 0 to INSTRUMENT_BINS - 1
+****************************/
+
+static uint32_t
+instrument_bin(uint32_t value)
+{
+    int k;
+
+    if (value < INSTRUMENT_SUB_BINS)
+    {
+        return value;
+    }
+    k = 31 - __builtin_clz(value);
+    return INSTRUMENT_SUB_BINS * (k - INSTRUMENT_SUB_BITS + 1) +
+        ((value >> (k - INSTRUMENT_SUB_BITS)) & (INSTRUMENT_SUB_BINS - 1));
+}
+
+
+/*****************************
+ * instrument_bin_start() - first value of a bin
+ *
+ * param bin - bin
+ * returns - smallest value in the bin
+****************************/
+
+static uint32_t
+instrument_bin_start(uint32_t bin)
+{
+    uint32_t k;
+
+    if (bin < INSTRUMENT_SUB_BINS)
+    {
+        return bin;
+    }
+    k = bin / INSTRUMENT_SUB_BINS + INSTRUMENT_SUB_BITS - 1;
+    return (uint32_t)(INSTRUMENT_SUB_BINS + bin % INSTRUMENT_SUB_BINS) <<
+        (k - INSTRUMENT_SUB_BITS);
+}
+
+
+/*****************************
+ * instrument_bin_end() - last value of a bin
+ *
+ * param bin - bin
+ * returns - largest value in the bin
+****************************/
+
+static uint32_t
+instrument_bin_end(uint32_t bin)
+{
+    if (bin == INSTRUMENT_BINS - 1)
+    {
+        return UINT32_MAX;
+    }
+    return instrument_bin_start(bin + 1) - 1;
+}
+
+
+/*****************************
+ * instrument_inc() - adds to a count only one thread changes
+ *
+ * param a - count
+ * param n - amount to add
+****************************/
+
+static void
+instrument_inc(atomic_uint* a, uint32_t n)
+{
+    atomic_store_explicit(a, atomic_load_explicit(a, memory_order_relaxed) + n,
+        memory_order_relaxed);
+}
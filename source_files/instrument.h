@@ -0,0 +1,45 @@
+/*****************************************
+ * instrument.h
+ *
+ * Histograms of the times and sizes of the reads and writes of a scan
+ *****************************************/
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+
+//header guard
+
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+/* values below INSTRUMENT_SUB_BINS have a bin each, above that each
+ * power of 2 is split into INSTRUMENT_SUB_BINS bins, so a value is
+ * known to within 1 part in INSTRUMENT_SUB_BINS, as in an HDR histogram */
+#define INSTRUMENT_SUB_BITS 5
+#define INSTRUMENT_SUB_BINS (1 << INSTRUMENT_SUB_BITS)
+#define INSTRUMENT_BINS (INSTRUMENT_SUB_BINS * (33 - INSTRUMENT_SUB_BITS))
+
+/* a histogram of 32 bit values, added to by one thread, which other
+ * threads can read at any time, such as to write it on SIGUSR1 */
+struct instrument
+{
+    const char* name;
+    const char* unit;
+    atomic_uint counts[INSTRUMENT_BINS];
+    atomic_uint count;                  //values added
+    atomic_uint max;
+    atomic_ullong sum;                  //for the mean
+};
+
+/* function declarations */
+void instrument_init(struct instrument*, const char*, const char*);
+void instrument_add(struct instrument*, uint32_t);
+uint32_t instrument_percentile(struct instrument*, double);
+bool instrument_write(struct instrument*, FILE*, const char*);
+void instrument_signal(int);
+bool instrument_dump_wanted(void);
+uint32_t instrument_usec_since(struct timespec*);
+
+#endif
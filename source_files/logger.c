@@ -0,0 +1,427 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include "logger.h"
+#include "utils.h"
+
+/* local function declarations */
+static void* logger_thread(void*);
+static struct logger_entry* logger_claim(uint32_t*);
+static void logger_drain(void);
+static bool logger_put(struct logger_entry*);
+static FILE* logger_file(const char*, const char*);
+static void logger_flush(void);
+
+/* messages waiting for the logger thread, each entry's seq says whose
+ * turn it is: seq == pos, free for the message at pos, seq == pos + 1,
+ * holds the message at pos, waiting to be written */
+static struct logger_entry entries[LOGGER_ENTRIES];
+static atomic_uint head;                //next message added, any thread
+static uint32_t tail;                   //next message written, logger thread only
+static atomic_uint dropped;             //messages dropped as the entries were full
+static atomic_uint writers;             //threads in logger_write() which may add an entry
+static atomic_bool running;
+static pthread_t thread;
+
+/* held while the log files are written, the logger thread waits on wake */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake;
+
+/* log files of the run, only used with lock held */
+static struct logger_file files[LOGGER_MAX_FILES];
+static int num_files;
+
+/*****************************
+ * logger_start() - starts the thread which writes the log files
+ *
+ * Before, each message opened the log file, named with the host name
+ * and the date and time then, appended the message and closed it, so
+ * a thread which logged an error waited for the file system, and a
+ * burst of messages could be spread over files with different names.
+ * Now a log file is opened with the first message of the run, named
+ * with the date and time then, and kept open, and the messages are
+ * added to the entries and written by the logger thread every
+ * LOGGER_FLUSH_USEC. logger_stop() is called on exit, so the messages
+ * are written whichever way the program ends.
+ *
+ * Before the thread is started, and after it is stopped, messages
+ * are written straight away by logger_write().
+ *
+ * The thread waits on a condition, with the monotonic clock, so
+ * logger_stop() wakes it, rather than waiting for the rest of the
+ * LOGGER_FLUSH_USEC.
+ *
+ * returns - false if error creating the thread
+****************************/
+
+bool
+logger_start(void)
+{
+    static bool stop_on_exit = false;
+    pthread_condattr_t attr;
+    uint32_t i;
+
+    if (atomic_load(&running))
+    {
+        return true;
+    }
+    //the first time
+    if (!stop_on_exit)
+    {
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&wake, &attr);
+        pthread_condattr_destroy(&attr);
+        atexit(logger_stop);
+        stop_on_exit = true;
+    }
+    for (i = 0; i < LOGGER_ENTRIES; i++)
+    {
+        atomic_init(&entries[i].seq, i);
+    }
+    atomic_init(&head, 0);
+    tail = 0;
+
+    atomic_store(&running, true);
+    if (pthread_create(&thread, NULL, logger_thread, NULL) != 0)
+    {
+        atomic_store(&running, false);
+        return false;
+    }
+    return true;
+}
+
+
+/*****************************
+ * logger_write() - adds a message to a log file
+ *
+ * The message is copied to an entry, with the wall clock and monotonic
+ * time and its severity, for the logger thread to write, so it never
+ * waits for the file, or for another thread. If the entries are full
+ * the message is dropped, and the logger thread adds a line with the
+ * number dropped to each log file.
+ *
+ * Each line of the file is the date time.fraction, the monotonic
+ * seconds, the severity and the message. A newline at the end of
+ * the message is not needed.
+ *
+ * writers counts the threads which may add an entry, so the logger
+ * thread, once it is stopped, waits for the entries they add before
+ * its last write. A message written straight away takes lock, so it
+ * waits for that last write rather than writing the files with it.
+ *
+ * param filename - log file, a constant, the host name and date are added
+ * param subdir - directory of the log file, a constant
+ * param severity - one of enum logger_severity
+ * param message - message
+ * returns - false if the message was dropped, or error writing it
+****************************/
+
+bool
+logger_write(const char* filename, const char* subdir, int severity,
+    const char* message)
+{
+    struct logger_entry now;
+    struct logger_entry* entry = &now;
+    uint32_t pos = 0;
+    size_t len;
+    bool result;
+
+    atomic_fetch_add(&writers, 1);
+    if (atomic_load(&running))
+    {
+        entry = logger_claim(&pos);
+        if (entry == NULL)
+        {
+            atomic_fetch_add(&dropped, 1);
+            atomic_fetch_sub(&writers, 1);
+            return false;
+        }
+    }
+    else
+    {
+        atomic_fetch_sub(&writers, 1);
+    }
+
+    clock_gettime(CLOCK_REALTIME, &entry->wall);
+    clock_gettime(CLOCK_MONOTONIC, &entry->mono);
+    entry->filename = filename;
+    entry->subdir = subdir;
+    entry->severity = severity;
+    len = strlen(message);
+    while ((len > 0) && (message[len - 1] == '\n'))
+    {
+        len--;
+    }
+    if (len > LOGGER_MESSAGE_SIZE - 1)
+    {
+        len = LOGGER_MESSAGE_SIZE - 1;
+    }
+    memcpy(entry->message, message, len);
+    entry->message[len] = '\0';
+
+    if (entry == &now)
+    {
+        pthread_mutex_lock(&lock);
+        result = logger_put(entry);
+        logger_flush();
+        pthread_mutex_unlock(&lock);
+        return result;
+    }
+    atomic_store_explicit(&entry->seq, pos + 1, memory_order_release);
+    atomic_fetch_sub(&writers, 1);
+    return true;
+}
+
+
+/*****************************
+ * logger_stop() - writes the messages waiting and stops the logger thread
+ *
+ * The thread is woken, so it stops straight away.
+****************************/
+
+void
+logger_stop(void)
+{
+    if (!atomic_exchange(&running, false))
+    {
+        return;
+    }
+    pthread_mutex_lock(&lock);
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+    pthread_join(thread, NULL);
+}
+
+
+/*****************************
+ * logger_thread() - writes the messages every LOGGER_FLUSH_USEC
+ *
+ * running is only looked at with lock held, and logger_stop() signals
+ * wake with it held, so the wake up cannot be missed. Once stopped, the
+ * entries of the threads still in logger_write() are waited for, then
+ * written, so every message added before the stop is.
+ *
+ * param arg - not used
+ * returns - NULL
+****************************/
+
+static void*
+logger_thread(void* arg)
+{
+    struct timespec deadline;
+    (void)arg;
+
+    pthread_mutex_lock(&lock);
+    while (atomic_load(&running))
+    {
+        logger_drain();
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_nsec += LOGGER_FLUSH_USEC * 1000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000;
+        deadline.tv_nsec %= 1000000000;
+        if (atomic_load(&running))
+        {
+            pthread_cond_timedwait(&wake, &lock, &deadline);
+        }
+    }
+
+    //the last messages, added before running was cleared
+    while (atomic_load(&writers) > 0)
+    {
+        sched_yield();
+    }
+    logger_drain();
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+
+/*****************************
+ * logger_claim() - takes the next free entry for a message
+ *
+ * Threads adding messages at the same time each take a different
+ * entry, by moving head on with a compare and swap.
+ *
+ * param pos - set to the position of the message
+ * returns - the entry, NULL if all the entries are waiting to be written
+****************************/
+
+static struct logger_entry*
+logger_claim(uint32_t* pos)
+{
+    struct logger_entry* entry;
+    uint32_t p = atomic_load_explicit(&head, memory_order_relaxed);
+    int32_t diff;
+
+    for (;;)
+    {
+        entry = &entries[p & (LOGGER_ENTRIES - 1)];
+        diff = (int32_t)(atomic_load_explicit(&entry->seq, memory_order_acquire) - p);
+        if (diff == 0)
+        {
+            //p is updated if another thread took the entry first
+            if (atomic_compare_exchange_weak_explicit(&head, &p, p + 1,
+                memory_order_relaxed, memory_order_relaxed))
+            {
+                *pos = p;
+                return entry;
+            }
+        }
+        else if (diff < 0)
+        {
+            return NULL;
+        }
+        else
+        {
+            p = atomic_load_explicit(&head, memory_order_relaxed);
+        }
+    }
+}
+
+
+/*****************************
+ * logger_drain() - writes the messages waiting, in the order they were added
+****************************/
+
+static void
+logger_drain(void)
+{
+    struct logger_entry* entry;
+    struct logger_entry note;
+    uint32_t n;
+    int i;
+
+    for (;;)
+    {
+        entry = &entries[tail & (LOGGER_ENTRIES - 1)];
+        if ((int32_t)(atomic_load_explicit(&entry->seq, memory_order_acquire) -
+            (tail + 1)) < 0)
+        {
+            break;
+        }
+        logger_put(entry);
+        atomic_store_explicit(&entry->seq, tail + LOGGER_ENTRIES, memory_order_release);
+        tail++;
+    }
+
+    n = atomic_exchange(&dropped, 0);
+    if (n > 0)
+    {
+        clock_gettime(CLOCK_REALTIME, &note.wall);
+        clock_gettime(CLOCK_MONOTONIC, &note.mono);
+        note.severity = LOGGER_WARNING;
+        snprintf(note.message, sizeof(note.message),
+            "Log full, messages dropped: %u", n);
+        for (i = 0; i < num_files; i++)
+        {
+            note.filename = files[i].filename;
+            note.subdir = files[i].subdir;
+            logger_put(&note);
+        }
+    }
+    logger_flush();
+}
+
+
+/*****************************
+ * logger_put() - writes a message to its log file
+ *
+ * param entry - message
+ * returns - false if error opening or writing the file
+****************************/
+
+static bool
+logger_put(struct logger_entry* entry)
+{
+    static const char* severities[] = {"info", "warning", "error"};
+    char wall[MAX_ARRAY_SIZE];
+    struct tm tm;
+    FILE* fp;
+
+    fp = logger_file(entry->filename, entry->subdir);
+    if (fp == NULL)
+    {
+        return false;
+    }
+    localtime_r(&entry->wall.tv_sec, &tm);
+    strftime(wall, sizeof(wall), "%Y-%m-%d %H:%M:%S", &tm);
+    return fprintf(fp, "%s.%06ld, %ld.%06ld, %s, %s\n", wall,
+        entry->wall.tv_nsec / 1000, (long)entry->mono.tv_sec,
+        entry->mono.tv_nsec / 1000, severities[entry->severity],
+        entry->message) > 0;
+}
+
+
+/*****************************
+ * logger_file() - log file of the run, opened the first time
+ *
+ * The name is the host name and the date and time it was opened,
+ * then the file name, as before.
+ *
+ * param filename - log file, without the host name and date
+ * param subdir - directory of the log file
+ * returns - the file, NULL if error opening it, or too many log files
+****************************/
+
+static FILE*
+logger_file(const char* filename, const char* subdir)
+{
+    char name[MAX_ARRAY_SIZE] = {0};
+    char path[MAX_ARRAY_SIZE] = {0};
+    FILE* fp;
+    int i;
+
+    for (i = 0; i < num_files; i++)
+    {
+        if ((strcmp(files[i].filename, filename) == 0) &&
+            (strcmp(files[i].subdir, subdir) == 0))
+        {
+            return files[i].fp;
+        }
+    }
+    if (num_files == LOGGER_MAX_FILES)
+    {
+        return NULL;
+    }
+
+    if (!utils_getnamedate(name, sizeof(name)) ||
+        (strlen(name) + strlen(filename) + 2 > sizeof(name)))
+    {
+        return NULL;
+    }
+    strcat(name, "_");
+    strcat(name, filename);
+    if (!utils_getfilepath(path, sizeof(path), (char*)subdir, name))
+    {
+        return NULL;
+    }
+    fp = fopen(path, "a");
+    if (fp == NULL)
+    {
+        return NULL;
+    }
+
+    files[num_files].filename = filename;
+    files[num_files].subdir = subdir;
+    files[num_files].fp = fp;
+    num_files++;
+    return fp;
+}
+
+
+/*****************************
+ * logger_flush() - writes what is buffered to the log files
+****************************/
+
+static void
+logger_flush(void)
+{
+    int i;
+
+    for (i = 0; i < num_files; i++)
+    {
+        fflush(files[i].fp);
+    }
+}
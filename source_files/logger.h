@@ -0,0 +1,55 @@
+/*****************************************
+ * logger.h
+ *
+ * The error log and scan report, written by a thread of their own
+ *****************************************/
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+
+//header guard
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#define LOGGER_ENTRIES 256              //messages waiting to be written, a power of 2
+#define LOGGER_MESSAGE_SIZE 512         //longest message, longer ones are cut short
+#define LOGGER_MAX_FILES 4              //different log files in a run
+#define LOGGER_FLUSH_USEC 100000        //how often the logger thread writes the messages
+
+/* how bad it is, written on each line */
+enum logger_severity
+{
+    LOGGER_INFO = 0,                    //for the record, such as the scan report
+    LOGGER_WARNING = 1,                 //something went wrong, but the scan carries on
+    LOGGER_ERROR = 2                    //a scan or the program has stopped
+};
+
+/* a message waiting to be written */
+struct logger_entry
+{
+    atomic_uint seq;                    //whose turn the entry is, see logger.c
+    const char* filename;               //log file, without the host name and date
+    const char* subdir;                 //directory of the log file
+    int severity;                       //one of enum logger_severity
+    struct timespec wall;               //CLOCK_REALTIME when the message was added
+    struct timespec mono;               //CLOCK_MONOTONIC when the message was added
+    char message[LOGGER_MESSAGE_SIZE];
+};
+
+/* a log file, opened with the first message of the run */
+struct logger_file
+{
+    const char* filename;
+    const char* subdir;
+    FILE* fp;
+};
+
+/* function declarations */
+bool logger_start(void);
+bool logger_write(const char*, const char*, int, const char*);
+void logger_stop(void);
+
+#endif
@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ring.h"
+
+/*****************************
+ * ring_init() - allocates the blocks of a ring
+ *
+ * The ring is shared by one producer thread, which fills blocks,
+ * and one consumer thread, which empties them. Neither side takes
+ * a lock, each only writes its own index, head or tail.
+ *
+ * Any errors return false, otherwise return true
+ *
+ * param ring - ring to initialise
+ * param num_blocks - number of blocks, has to be a power of 2
+ * param block_samples - size of each block in samples per channel
+ * param num_channels - number of channels in each block
+ * returns - false if error allocating memory
+****************************/
+
+bool
+ring_init(struct ring* ring, uint32_t num_blocks, uint32_t block_samples,
+    int num_channels)
+{
+    uint32_t i;
+
+    memset(ring, 0, sizeof(*ring));
+    if ((num_blocks == 0) || (num_blocks & (num_blocks - 1)))
+    {
+        return false;                   //not a power of 2
+    }
+
+    ring->blocks = calloc(num_blocks, sizeof(struct ring_block));
+    if (ring->blocks == NULL)
+    {
+        return false;
+    }
+    ring->num_blocks = num_blocks;
+    ring->block_samples = block_samples;
+    ring->num_channels = num_channels;
+
+    for (i = 0; i < num_blocks; i++)
+    {
+        ring->blocks[i].data = malloc(block_samples * num_channels * sizeof(double));
+        if (ring->blocks[i].data == NULL)
+        {
+            ring_free(ring);
+            return false;
+        }
+    }
+
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->closed, false);
+    atomic_init(&ring->high_water, 0);
+    atomic_init(&ring->full_count, 0);
+    return true;
+}
+
+
+/*****************************
+ * ring_free() - frees the blocks of a ring
+ *
+ * param ring - ring to free
+****************************/
+
+void
+ring_free(struct ring* ring)
+{
+    uint32_t i;
+
+    if (ring->blocks != NULL)
+    {
+        for (i = 0; i < ring->num_blocks; i++)
+        {
+            free(ring->blocks[i].data);
+        }
+        free(ring->blocks);
+    }
+    ring->blocks = NULL;
+    ring->num_blocks = 0;
+}
+
+
+/*****************************
+ * ring_reset() - empties a ring, so it can be used for another scan
+ *
+ * Only when neither thread is using it. The blocks are kept.
+ *
+ * param ring - ring to empty
+****************************/
+
+void
+ring_reset(struct ring* ring)
+{
+    atomic_store(&ring->head, 0);
+    atomic_store(&ring->tail, 0);
+    atomic_store(&ring->closed, false);
+    atomic_store(&ring->high_water, 0);
+    atomic_store(&ring->full_count, 0);
+}
+
+
+/*****************************
+ * ring_write_block() - gets the next free block, producer only
+ *
+ * The block is not seen by the consumer until ring_write_commit()
+ * is called. Never waits, if the ring is full returns NULL
+ * and the producer decides what to do.
+ *
+ * param ring - ring to write to
+ * returns - block to fill or NULL if the ring is full
+****************************/
+
+struct ring_block*
+ring_write_block(struct ring* ring)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    if (head - tail >= ring->num_blocks)
+    {
+        atomic_fetch_add_explicit(&ring->full_count, 1, memory_order_relaxed);
+        return NULL;
+    }
+    return &ring->blocks[head & (ring->num_blocks - 1)];
+}
+
+
+/*****************************
+ * ring_write_commit() - passes the block from ring_write_block() to the consumer
+ *
+ * param ring - ring being written to
+****************************/
+
+void
+ring_write_commit(struct ring* ring)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed) + 1;
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    uint32_t in_use = head - tail;
+
+    atomic_store_explicit(&ring->head, head, memory_order_release);
+
+    if (in_use > atomic_load_explicit(&ring->high_water, memory_order_relaxed))
+    {
+        atomic_store_explicit(&ring->high_water, in_use, memory_order_relaxed);
+    }
+}
+
+
+/*****************************
+ * ring_read_block() - gets the oldest filled block, consumer only
+ *
+ * The block stays owned by the consumer until ring_read_release()
+ * is called. Never waits, if the ring is empty returns NULL.
+ *
+ * param ring - ring to read from
+ * returns - filled block or NULL if the ring is empty
+****************************/
+
+struct ring_block*
+ring_read_block(struct ring* ring)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    if (head == tail)
+    {
+        return NULL;
+    }
+    return &ring->blocks[tail & (ring->num_blocks - 1)];
+}
+
+
+/*****************************
+ * ring_read_release() - returns the block from ring_read_block() to the producer
+ *
+ * param ring - ring being read from
+****************************/
+
+void
+ring_read_release(struct ring* ring)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+
+/*****************************
+ * ring_close() - producer has no more blocks to write
+ *
+ * param ring - ring to close
+****************************/
+
+void
+ring_close(struct ring* ring)
+{
+    atomic_store_explicit(&ring->closed, true, memory_order_release);
+}
+
+
+/*****************************
+ * ring_is_closed() - checks if producer has finished
+ *
+ * Blocks committed before the ring was closed can still be read,
+ * so the consumer should stop when the ring is closed and empty.
+ *
+ * param ring - ring to check
+ * returns - true if ring_close() has been called
+****************************/
+
+bool
+ring_is_closed(struct ring* ring)
+{
+    return atomic_load_explicit(&ring->closed, memory_order_acquire);
+}
+
+
+/*****************************
+ * ring_occupancy() - number of filled blocks waiting for the consumer
+ *
+ * param ring - ring to check
+ * returns - number of blocks in use
+****************************/
+
+uint32_t
+ring_occupancy(struct ring* ring)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    return head - tail;
+}
@@ -0,0 +1,51 @@
+/*****************************************
+ * ring.h
+ *
+ * Lock free single producer, single consumer ring of sample blocks
+ *****************************************/
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+//header guard
+
+#ifndef RING_H
+#define RING_H
+
+/* a block of interleaved samples, as returned by mcc172_a_in_scan_read() */
+struct ring_block
+{
+    uint32_t samples_per_channel;   // number of valid samples per channel
+    uint16_t status;                // scan status returned with the samples
+    double* data;                   // block_samples * num_channels samples
+};
+
+struct ring
+{
+    struct ring_block* blocks;
+    uint32_t num_blocks;            // has to be a power of 2
+    uint32_t block_samples;         // size of each block in samples per channel
+    int num_channels;
+
+    atomic_uint head;               // count of blocks written, producer only
+    atomic_uint tail;               // count of blocks read, consumer only
+    atomic_bool closed;             // producer has finished
+
+    /* occupancy statistics, written by the producer */
+    atomic_uint high_water;         // most blocks in use at one time
+    atomic_uint full_count;         // times the producer found the ring full
+};
+
+/* function declarations */
+bool ring_init(struct ring*, uint32_t, uint32_t, int);
+void ring_free(struct ring*);
+void ring_reset(struct ring*);
+struct ring_block* ring_write_block(struct ring*);
+void ring_write_commit(struct ring*);
+struct ring_block* ring_read_block(struct ring*);
+void ring_read_release(struct ring*);
+void ring_close(struct ring*);
+bool ring_is_closed(struct ring*);
+uint32_t ring_occupancy(struct ring*);
+
+#endif
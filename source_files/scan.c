@@ -0,0 +1,1163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <math.h>
+#include "scan.h"
+#include "scantofile.h"
+#include "mcc172.h"
+#include "daqhats.h"
+#include "logger.h"
+
+/* local function declarations */
+static uint32_t scan_merge(struct scan*, struct ring_block**, uint32_t*, double**);
+static double* scan_units(struct scan*, const double*, uint32_t);
+static bool scan_log_create(struct scan*, struct scan_log*, uint64_t);
+static void scan_log_name(struct scan_log*, const char*, char*);
+static uint64_t scan_log_bytes(struct scan_log*);
+static uint32_t scan_log_room(struct scan_log*, uint32_t);
+static void scan_log_next(struct scan*, struct scan_log*);
+static void scan_log_write(struct scan*, struct scan_log*, double*, uint32_t);
+static void scan_write_block(struct scan*, struct scan_log*, double*, uint32_t);
+static void scan_event_write(struct scan*, double*, uint32_t);
+static void scan_event_open(struct scan*, const double*, uint32_t);
+static void scan_event_close(struct scan*);
+static void scan_event_name(struct scan*, char*);
+
+/*****************************
+ * scan_set_threshold() - works out how many samples wait mode reads at a time
+ *
+ * The threshold is the number of samples acquired in the latency time,
+ * but not more than a fraction of the library's scan buffer, so there
+ * is room for the scan to carry on while the block is handled, and not
+ * more than fits in a block of the ring.
+ * The read timeout allows twice the time to acquire the threshold.
+ *
+ * param scan - scan to set read_threshold and read_timeout of
+ * param latency - seconds of data to wait for, SCAN_READ_LATENCY by default
+ * param buffer_samples - size of the library's scan buffer per channel
+****************************/
+
+void
+scan_set_threshold(struct scan* scan, double latency, uint32_t buffer_samples)
+{
+    double threshold = scan->scan_rate * latency;
+
+    if (threshold > buffer_samples / SCAN_THRESHOLD_DIVISOR)
+    {
+        threshold = buffer_samples / SCAN_THRESHOLD_DIVISOR;
+    }
+    if (threshold > scan->boards[0].ring.block_samples)
+    {
+        threshold = scan->boards[0].ring.block_samples;
+    }
+    if (threshold < 1.0)
+    {
+        threshold = 1.0;
+    }
+
+    scan->read_threshold = (uint32_t)threshold;
+    scan->read_timeout = 2.0 * scan->read_threshold / scan->scan_rate + 1.0;
+
+    #ifdef DEBUG_SCAN
+    printf ("scan_set_threshold() - threshold %u samples, timeout %.3f s\n",
+        scan->read_threshold, scan->read_timeout);
+    #endif
+}
+
+
+/*****************************
+ * scan_set_units() - works out how raw ADC codes are scaled to units
+ *
+ * With OPTS_NOSCALEDATA the frames are ADC codes, which are logged as
+ * they are, but the statistics, spectrum, envelope and event level are
+ * in the units of the sensitivity, so the codes are scaled with the
+ * formula in binlog.h, or the level converted to codes.
+ * The library calibrates the codes unless OPTS_NOCALIBRATEDATA is set,
+ * then the calibration coefficients of the channel are used too.
+ *
+ * param scan - scan with its options, sensitivity and calibration set
+****************************/
+
+void
+scan_set_units(struct scan* scan)
+{
+    bool uncalibrated = (scan->options & OPTS_NOCALIBRATEDATA) == OPTS_NOCALIBRATEDATA;
+    double slope;
+    int b;
+    int i;
+
+    for (b = 0; b < scan->num_boards; b++)
+    {
+        struct scan_board* board = &scan->boards[b];
+        for (i = 0; i < board->num_channels; i++)
+        {
+            int ch = b * board->num_channels + i;
+            slope = uncalibrated ? board->cal_slope[i] : 1.0;
+            scan->code_offset[ch] = uncalibrated ? board->cal_offset[i] : 0.0;
+            scan->units_per_code[ch] = slope * BINLOG_CODE_LSB * 1000.0 /
+                scan->sensitivity[ch];
+        }
+    }
+}
+
+
+/*****************************
+ * scan_acquire_thread() - reads the scan buffer of a board into its ring
+ *
+ * The producer side of the ring. Reads straight into free blocks of
+ * the ring and never does any file I/O, so a slow SD card cannot delay
+ * the next read. If the ring is full it waits for the writer thread,
+ * the data keeps accumulating in the library's scan buffer meanwhile.
+ *
+ * In poll mode it reads all the samples available, then sleeps for
+ * SCAN_READ_SLEEP_USEC, whatever the scan rate. In wait mode it reads
+ * straight away if the threshold has been reached, otherwise the
+ * library read waits until it has, so the thread wakes as soon as
+ * there is a block of data and sleeps the rest of the time.
+ *
+ * Each board of the scan has its own thread, so the boards are read
+ * in parallel, not one after the other.
+ *
+ * The samples waiting in the scan buffer before each read, which show
+ * how close the scan came to a buffer overrun, the time each read took
+ * and the samples it returned are added to the board's histograms.
+ *
+ * Stops when a finite scan finishes, when a continuous scan has
+ * read the wanted number of samples, or on an error, in which case
+ * result or error is set, and stop is set so the other boards stop too.
+ * Also stops if stop is set by another thread.
+ * Always closes the ring before returning.
+ *
+ * param arg - the struct scan_board to read
+ * returns - NULL
+****************************/
+
+void*
+scan_acquire_thread(void* arg)
+{
+    struct scan_board* board = arg;
+    struct scan* scan = board->scan;
+    struct ring* ring = &board->ring;
+    struct ring_block* block;
+    int32_t read_request_size = -1;     // '-1' means read all available samples
+    double timeout = 5.0;
+    uint16_t read_status = 0;
+    uint32_t samples_read_per_channel = 0;
+    uint32_t samples_available = 0;
+    struct timespec start;
+    int result = RESULT_SUCCESS;
+
+    if (scan->read_mode == READ_MODE_WAIT)
+    {
+        timeout = scan->read_timeout;
+    }
+
+    board->total_samples_read = 0;
+    while (!atomic_load(&scan->stop))
+    {
+        block = ring_write_block(ring);
+        if (block == NULL)
+        {
+            //writer thread is behind, give it time to catch up
+            usleep(SCAN_FULL_SLEEP_USEC);
+            continue;
+        }
+
+        result = mcc172_a_in_scan_status(board->address, &read_status,
+            &samples_available);
+        if (result != RESULT_SUCCESS)
+        {
+            board->result = result;
+            break;
+        }
+        instrument_add(&board->buffer_fill, samples_available);
+
+        if (scan->read_mode == READ_MODE_WAIT)
+        {
+            // read a backlog at once, otherwise wait for the threshold
+            read_request_size = (samples_available >= scan->read_threshold) ?
+                -1 : (int32_t)scan->read_threshold;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        result = mcc172_a_in_scan_read(board->address, &read_status,
+            read_request_size, timeout, block->data,
+            ring->block_samples * ring->num_channels, &samples_read_per_channel);
+        instrument_add(&board->read_time, instrument_usec_since(&start));
+        instrument_add(&board->read_samples, samples_read_per_channel);
+
+        // in wait mode a timeout only means the data is slow to arrive,
+        // such as before a trigger, keep what was read and wait again
+        if ((result == RESULT_TIMEOUT) && (scan->read_mode == READ_MODE_WAIT))
+        {
+            result = RESULT_SUCCESS;
+        }
+        if (result != RESULT_SUCCESS)
+        {
+            board->result = result;
+            break;
+        }
+        #ifdef DEBUG_SCAN
+        printf ("scan_acquire_thread() - Samples read per channel: %i\n",
+            samples_read_per_channel);
+        #endif
+
+        if (read_status & STATUS_HW_OVERRUN)
+        {
+            board->error = ERROR_HW_OVERRUN;
+            break;
+        }
+        else if (read_status & STATUS_BUFFER_OVERRUN)
+        {
+            board->error = ERROR_SCAN_OVERRUN;
+            break;
+        }
+
+        // in continuous mode only log up to the requested number of samples
+        uint32_t samples_to_log = samples_read_per_channel;
+        if (scan->continuous &&
+            (board->total_samples_read + samples_to_log > scan->total_samples_wanted))
+        {
+            samples_to_log = scan->total_samples_wanted - board->total_samples_read;
+        }
+        board->total_samples_read += samples_to_log;
+
+        if (samples_to_log > 0)
+        {
+            block->samples_per_channel = samples_to_log;
+            block->status = read_status;
+            ring_write_commit(ring);
+        }
+
+        // a continuous scan keeps running, so stop when we have enough samples
+        if (scan->continuous &&
+            (board->total_samples_read >= scan->total_samples_wanted))
+        {
+            break;
+        }
+
+        // a finite scan has finished when it stops running, and the
+        // scan buffer has been emptied, a full block may have left some
+        if (((read_status & STATUS_RUNNING) != STATUS_RUNNING) &&
+            (samples_read_per_channel < ring->block_samples))
+        {
+            break;
+        }
+
+        // if the block was filled there is more data waiting, read it now
+        if ((scan->read_mode == READ_MODE_POLL) &&
+            (samples_read_per_channel < ring->block_samples))
+        {
+            usleep(SCAN_READ_SLEEP_USEC);
+        }
+    }
+
+    // the other boards cannot be merged with this one any more
+    if ((board->result != RESULT_SUCCESS) || (board->error != NULL))
+    {
+        atomic_store(&scan->stop, true);
+    }
+    ring_close(ring);
+    return NULL;
+}
+
+
+/*****************************
+ * scan_writer_thread() - writes blocks from the rings to the log file
+ *
+ * The consumer side of the rings. The blocks of each board are merged
+ * into frames with the channels of every board, so the log file has
+ * one time aligned stream. The boards share a clock and a trigger,
+ * so sample n of every board was taken at the same time.
+ * The frames are added to the statistics, if there is a summary file,
+ * and to the spectrum and envelope analysis, if there are any, scaled
+ * to units first if they are raw ADC codes.
+ * If there is a decimation the decimated frames go to their own log file,
+ * the full rate frames are only logged if that was asked for.
+ * The time taken for each block of frames, and the part of it taken
+ * formatting and writing the log files, are added to the histograms.
+ * If SIGUSR1 has asked for them they are written to the perf file.
+ *
+ * Returns when the acquisition threads have closed the rings and every
+ * frame that can be merged has been written. Frames which only some
+ * boards read before an error are not written. Sets stop when it
+ * returns, so no acquisition thread waits for it.
+ *
+ * param arg - the struct scan shared with the acquisition threads
+ * returns - NULL
+****************************/
+
+void*
+scan_writer_thread(void* arg)
+{
+    struct scan* scan = arg;
+    struct ring_block* blocks[SCAN_MAX_BOARDS] = {NULL};
+    uint32_t offsets[SCAN_MAX_BOARDS] = {0};
+    uint32_t frames;
+    double* data = NULL;
+    double* units;
+    struct timespec start;
+    struct timespec log_start;
+    char tmp[MAX_ARRAY_SIZE * 2] = {0};
+    bool closed;
+    int b;
+
+    scan->total_frames_written = 0;
+    for (;;)
+    {
+        if (instrument_dump_wanted() && !scan_write_perf(scan, "on SIGUSR1"))
+        {
+            sprintf(tmp, "%s%s\n", ERROR_FILE_WRITE, scan->perf_file);
+            logger_write(FILE_ERROR_LOG, SUBD_RESULTS, LOGGER_WARNING, tmp);
+        }
+
+        //check closed before merging, so a last block cannot be missed
+        closed = true;
+        for (b = 0; b < scan->num_boards; b++)
+        {
+            closed = closed && ring_is_closed(&scan->boards[b].ring);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        frames = scan_merge(scan, blocks, offsets, &data);
+        if (frames == 0)
+        {
+            if (closed)
+            {
+                break;
+            }
+            usleep(SCAN_WRITE_SLEEP_USEC);
+            continue;
+        }
+
+        units = data;
+        if ((scan->units_buf != NULL) && ((scan->stats.fp != NULL) ||
+            (scan->spectrum.size > 0) || (scan->envelope.buf != NULL)))
+        {
+            units = scan_units(scan, data, frames);
+        }
+        if (scan->stats.fp != NULL)
+        {
+            stats_add(&scan->stats, units, frames);
+        }
+        if (scan->spectrum.size > 0)
+        {
+            spectrum_add(&scan->spectrum, units, frames);
+        }
+        if (scan->envelope.buf != NULL)
+        {
+            envelope_add(&scan->envelope, units, frames);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &log_start);
+        scan_log_write(scan, &scan->log, data, frames);
+        if (scan->event.trigger != EVENT_NONE)
+        {
+            scan_event_write(scan, data, frames);
+        }
+        if (scan->decimate.factor > 0)
+        {
+            scan_log_write(scan, &scan->declog, scan->decimate.out,
+                decimate_add(&scan->decimate, data, frames));
+        }
+        scan->total_frames_written += frames;
+        instrument_add(&scan->log_time, instrument_usec_since(&log_start));
+        instrument_add(&scan->write_time, instrument_usec_since(&start));
+    }
+
+    for (b = 0; b < scan->num_boards; b++)
+    {
+        if (blocks[b] != NULL)
+        {
+            ring_read_release(&scan->boards[b].ring);
+        }
+    }
+    //an event still being captured when the scan ends is cut short
+    scan_event_close(scan);
+    atomic_store(&scan->stop, true);
+    return NULL;
+}
+
+
+/*****************************
+ * scan_instrument_init() - sets up the histograms of a scan
+ *
+ * param scan - scan with num_boards set
+****************************/
+
+void
+scan_instrument_init(struct scan* scan)
+{
+    int b;
+
+    for (b = 0; b < scan->num_boards; b++)
+    {
+        instrument_init(&scan->boards[b].read_time, "read time", "us");
+        instrument_init(&scan->boards[b].read_samples, "samples per read",
+            "samples per channel");
+        instrument_init(&scan->boards[b].buffer_fill, "scan buffer before read",
+            "samples per channel");
+    }
+    instrument_init(&scan->write_time, "block time", "us");
+    instrument_init(&scan->log_time, "log write time", "us");
+}
+
+
+/*****************************
+ * scan_write_perf() - appends the histograms of a scan to the perf file
+ *
+ * A heading with the date and time, and when, then the histograms of
+ * each board and of the writer thread. Can be called while the scan
+ * is running, a histogram may be a value behind.
+ *
+ * param scan - the scan being logged
+ * param when - added to the heading, such as "on SIGUSR1"
+ * returns - false if error writing the file, true if written or no perf file
+****************************/
+
+bool
+scan_write_perf(struct scan* scan, const char* when)
+{
+    char date_time[MAX_ARRAY_SIZE] = {0};
+    char label[MAX_ARRAY_SIZE] = {0};
+    bool ok = true;
+    FILE* fp;
+    int b;
+
+    if (scan->perf_file[0] == '\0')
+    {
+        return true;
+    }
+    fp = fopen(scan->perf_file, "a");
+    if (fp == NULL)
+    {
+        return false;
+    }
+
+    utils_get_date_time(date_time, sizeof(date_time));
+    fprintf(fp, "%s, %s, %llu frames written, scan buffer %u samples per channel\n",
+        date_time, when, (unsigned long long)scan->total_frames_written,
+        scan->buffer_samples);
+    for (b = 0; b < scan->num_boards; b++)
+    {
+        struct scan_board* board = &scan->boards[b];
+        sprintf(label, "board %u, ", board->address);
+        ok = instrument_write(&board->read_time, fp, label) && ok;
+        ok = instrument_write(&board->read_samples, fp, label) && ok;
+        ok = instrument_write(&board->buffer_fill, fp, label) && ok;
+    }
+    ok = instrument_write(&scan->write_time, fp, "writer, ") && ok;
+    ok = instrument_write(&scan->log_time, fp, "writer, ") && ok;
+    fprintf(fp, "\n");
+    return (fclose(fp) == 0) && ok;
+}
+
+
+/*****************************
+ * scan_log_open() - creates a log file of a scan
+ *
+ * Text log files use the name as it is, binary log files have
+ * BINLOG_FILE_EXT added, and a header describing the scan.
+ * If the log format is none no file is created. A scan can have
+ * a full rate and a decimated log file, which only differ in rate,
+ * and a file for each event, which starts part way through the scan.
+ *
+ * If the options include OPTS_NOSCALEDATA the samples are ADC codes,
+ * which are stored in a binary log file, rounded, in int24 format,
+ * whatever the sample format, or compressed if it is compressed. If they are not calibrated either the
+ * calibration coefficients of each channel go in the header, so the
+ * codes can be scaled and calibrated when the file is read.
+ * Decimated codes are rounded to whole codes.
+ *
+ * If the log has a segment length or size set, the frames are split
+ * into segments, see scan_log_write(), and the segment number is
+ * added to the name, from _0001. Until a file is closed it has
+ * SCAN_PARTIAL_EXT added to its name, see scan_log_close().
+ *
+ * Any errors return false, otherwise return true
+ *
+ * param scan - scan to be logged
+ * param log - log file to create, with its format and segments set
+ * param filename - name of log file, without extension
+ * param sample_format - binary log files only, one of enum binlog_format
+ * param rate - rate of the frames logged
+ * param max_frames - most frames written at a time
+ * param first_frame - frame of the scan the file starts at, at this rate
+ * param expected_frames - frames the file is expected to have, space is
+ *                         reserved for a binary log file, 0 if not known
+ * returns - false if error creating the file or allocating its buffer
+****************************/
+
+bool
+scan_log_open(struct scan* scan, struct scan_log* log, char* filename,
+    int sample_format, double rate, uint32_t max_frames, uint64_t first_frame,
+    uint64_t expected_frames)
+{
+    snprintf(log->name, sizeof(log->name), "%s", filename);
+    log->sample_format = sample_format;
+    log->rate = rate;
+    log->max_frames = max_frames;
+    log->end_frame = (expected_frames > 0) ? first_frame + expected_frames : 0;
+    log->segment = ((log->segment_seconds > 0.0) || (log->segment_bytes > 0)) ? 1 : 0;
+    log->frame_bytes = 0.0;
+    return scan_log_create(scan, log, first_frame);
+}
+
+
+/*****************************
+ * scan_log_close() - closes a log file of a scan
+ *
+ * The file is synced to the card, then renamed without SCAN_PARTIAL_EXT,
+ * so a file with its proper name is complete, and can be picked up
+ * while the scan carries on. A power cut only leaves the file being
+ * written with SCAN_PARTIAL_EXT, with the frames written up to then.
+ * The file is renamed even if there were errors writing it, as the
+ * data written is still useful.
+ *
+ * param log - log file opened by scan_log_open()
+ * returns - false if there were any errors writing the file
+****************************/
+
+bool
+scan_log_close(struct scan_log* log)
+{
+    char partial[sizeof(log->filename) + sizeof(SCAN_PARTIAL_EXT)] = {0};
+    bool ok = !log->write_failed;
+
+    if (log->format == LOG_FORMAT_BINARY)
+    {
+        ok = binlog_close(&log->binlog) && ok;
+    }
+    else if (log->format == LOG_FORMAT_TEXT)
+    {
+        ok = textbuf_flush(&log->text) && ok;
+        textbuf_free(&log->text);
+        ok = (fsync(fileno(log->fp)) == 0) && ok;
+        ok = (fclose(log->fp) == 0) && ok;
+    }
+    else
+    {
+        return ok;
+    }
+
+    sprintf(partial, "%s%s", log->filename, SCAN_PARTIAL_EXT);
+    return utils_rename_synced(partial, log->filename) && ok;
+}
+
+
+/*****************************
+ * scan_log_create() - creates the file of a log, or of its next segment
+ *
+ * A segment has space reserved for its length, or for the frames left
+ * of the scan if fewer. The size of a segment includes the header of
+ * a binary log file, binary log files with a size per frame are cut
+ * at the last whole frame which fits, see scan_log_room().
+ * If the log has a chunk length a binary log file is chunked, see binlog.h.
+ *
+ * param scan - scan to be logged
+ * param log - log file set up by scan_log_open()
+ * param first_frame - frame of the scan the file starts at, at its rate
+ * returns - false if error creating the file or allocating its buffer
+****************************/
+
+static bool
+scan_log_create(struct scan* scan, struct scan_log* log, uint64_t first_frame)
+{
+    char partial[sizeof(log->filename) + sizeof(SCAN_PARTIAL_EXT)] = {0};
+    struct binlog_header header;
+    bool raw = (scan->options & OPTS_NOSCALEDATA) == OPTS_NOSCALEDATA;
+    bool uncalibrated = (scan->options & OPTS_NOCALIBRATEDATA) == OPTS_NOCALIBRATEDATA;
+    uint64_t expected_frames = 0;
+    uint64_t fit;
+    uint64_t nsec;
+    int i;
+    int b;
+
+    //time of the first frame in the file
+    nsec = scan->start_time.tv_nsec + (uint64_t)llround(first_frame / log->rate * 1e9);
+    log->start_sec = scan->start_time.tv_sec + nsec / 1000000000;
+    log->start_nsec = nsec % 1000000000;
+    log->date_sec = -1;
+    log->write_failed = false;
+    log->first_frame = first_frame;
+    log->frames = 0;
+    log->segment_frames = 0;
+    if ((log->segment > 0) && (log->segment_seconds > 0.0))
+    {
+        log->segment_frames = (uint64_t)llround(log->segment_seconds * log->rate);
+        if (log->segment_frames == 0)
+        {
+            log->segment_frames = 1;
+        }
+    }
+    if (log->end_frame > first_frame)
+    {
+        expected_frames = log->end_frame - first_frame;
+    }
+
+    if (log->format == LOG_FORMAT_BINARY)
+    {
+        binlog_header_init(&header,
+            (raw && (log->sample_format != BINLOG_COMPRESSED)) ? BINLOG_INT24 :
+            log->sample_format, scan->num_channels, log->rate);
+        header.options = scan->options;
+        header.start_sec = log->start_sec;
+        header.start_nsec = log->start_nsec;
+        utils_format_date_time(header.start_date, sizeof(header.start_date),
+            log->start_sec);
+        for (i = 0; i < scan->num_channels; i++)
+        {
+            header.sensitivity[i] = scan->sensitivity[i];
+        }
+        header.num_boards = scan->num_boards;
+        for (b = 0; b < scan->num_boards; b++)
+        {
+            struct scan_board* board = &scan->boards[b];
+            header.board_address[b] = board->address;
+            for (i = 0; raw && uncalibrated && (i < board->num_channels); i++)
+            {
+                header.cal_slope[b * board->num_channels + i] = board->cal_slope[i];
+                header.cal_offset[b * board->num_channels + i] = board->cal_offset[i];
+            }
+        }
+        if (raw)
+        {
+            header.flags |= BINLOG_FLAG_RAW_CODES;
+        }
+        header.segment = log->segment;
+        header.first_frame = first_frame;
+        if (log->chunk_seconds > 0.0)
+        {
+            header.flags |= BINLOG_FLAG_CHUNKED;
+            header.chunk_frames = (uint32_t)llround(log->chunk_seconds * log->rate);
+            if (header.chunk_frames == 0)
+            {
+                header.chunk_frames = 1;
+            }
+        }
+
+        //a segment of a size is only as many frames as fit, if they have a size
+        if ((log->segment > 0) && (log->segment_bytes > 0) &&
+            (header.sample_format != BINLOG_COMPRESSED))
+        {
+            fit = binlog_frames_in(&header, log->segment_bytes);
+            if (fit == 0)
+            {
+                fit = 1;
+            }
+            if ((log->segment_frames == 0) || (fit < log->segment_frames))
+            {
+                log->segment_frames = fit;
+            }
+        }
+        if ((log->segment_frames > 0) &&
+            ((expected_frames == 0) || (expected_frames > log->segment_frames)))
+        {
+            expected_frames = log->segment_frames;
+        }
+
+        scan_log_name(log, BINLOG_FILE_EXT, partial);
+        return binlog_open(&log->binlog, partial, &header, log->max_frames,
+            expected_frames);
+    }
+    else if (log->format == LOG_FORMAT_TEXT)
+    {
+        scan_log_name(log, "", partial);
+        log->fp = fopen(partial, "w");
+        if (log->fp == NULL)
+        {
+            return false;
+        }
+
+        //lines are formatted into our own buffer, which bypasses stdio
+        if (!textbuf_init(&log->text, fileno(log->fp), TEXTFMT_BUF_SIZE))
+        {
+            fclose(log->fp);
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/*****************************
+ * scan_log_name() - names the file of a log, or of its segment
+ *
+ * param log - log file set up by scan_log_open()
+ * param ext - extension of the file, "" if none
+ * param partial - returns the name the file has until it is closed
+****************************/
+
+static void
+scan_log_name(struct scan_log* log, const char* ext, char* partial)
+{
+    if (log->segment > 0)
+    {
+        snprintf(log->filename, sizeof(log->filename), "%s_%04u%s", log->name,
+            log->segment, ext);
+    }
+    else
+    {
+        snprintf(log->filename, sizeof(log->filename), "%s%s", log->name, ext);
+    }
+    sprintf(partial, "%s%s", log->filename, SCAN_PARTIAL_EXT);
+}
+
+
+/*****************************
+ * scan_log_bytes() - size of the file being written
+ *
+ * param log - log file opened by scan_log_open()
+ * returns - bytes written to the file, and waiting to be
+****************************/
+
+static uint64_t
+scan_log_bytes(struct scan_log* log)
+{
+    if (log->format == LOG_FORMAT_BINARY)
+    {
+        return log->binlog.file.offset + log->binlog.file.fill;
+    }
+    else if (log->format == LOG_FORMAT_TEXT)
+    {
+        return log->text.written + log->text.len;
+    }
+    return 0;
+}
+
+
+/*****************************
+ * scan_log_room() - how many frames can go in the segment being written
+ *
+ * A segment is full when it has the frames of its length, or the
+ * bytes of its size. The size of a frame of a compressed or text
+ * segment varies, so the room left is estimated from the size of the
+ * frames written so far, and the segment can go a little over its
+ * size. The first frames of a log are written before there is an
+ * estimate, so they can go over a size smaller than them.
+ *
+ * param log - log file opened by scan_log_open()
+ * param frames - frames to be written
+ * returns - frames which go in this segment, 0 if it is full
+****************************/
+
+static uint32_t
+scan_log_room(struct scan_log* log, uint32_t frames)
+{
+    uint64_t header = 0;
+    uint64_t pending = 0;
+    uint64_t bytes;
+    uint64_t room;
+
+    if (log->segment == 0)
+    {
+        return frames;
+    }
+    if (log->segment_frames > 0)
+    {
+        room = log->segment_frames - log->frames;
+        if (room < frames)
+        {
+            frames = room;
+        }
+    }
+    if (log->segment_bytes > 0)
+    {
+        //the frames of a chunk are not in the file until it is full
+        if (log->format == LOG_FORMAT_BINARY)
+        {
+            header = log->binlog.header.header_size;
+            pending = log->binlog.chunk_fill;
+        }
+        bytes = scan_log_bytes(log);
+        if ((log->frames > pending) && (bytes > header))
+        {
+            log->frame_bytes = (double)(bytes - header) / (log->frames - pending);
+        }
+        if ((log->frames > 0) && (bytes >= log->segment_bytes))
+        {
+            return 0;
+        }
+        if (log->frame_bytes > 0.0)
+        {
+            room = (bytes < log->segment_bytes) ?
+                (uint64_t)((log->segment_bytes - bytes) / log->frame_bytes) : 0;
+            room = (room > pending) ? room - pending : 0;
+            //a segment has at least one frame
+            if ((room == 0) && (log->frames == 0))
+            {
+                room = 1;
+            }
+            if (room < frames)
+            {
+                frames = room;
+            }
+        }
+    }
+    return frames;
+}
+
+
+/*****************************
+ * scan_log_next() - closes a full segment and creates the next
+ *
+ * The next segment starts at the frame after the last of the one
+ * before. If there were any errors writing the segment, adds message
+ * to the error log, and carries on. If the next one cannot be created
+ * the error is logged and the rest of the scan is not logged.
+ *
+ * param scan - the scan being logged
+ * param log - full rate or decimated log file
+****************************/
+
+static void
+scan_log_next(struct scan* scan, struct scan_log* log)
+{
+    char tmp[MAX_ARRAY_SIZE * 4] = {0};
+    uint64_t first_frame = log->first_frame + log->frames;
+
+    if (!scan_log_close(log))
+    {
+        sprintf(tmp, "%s%s\n", ERROR_FILE_WRITE, log->filename);
+        logger_write(FILE_ERROR_LOG, SUBD_RESULTS, LOGGER_ERROR, tmp);
+    }
+    log->segment++;
+    if (!scan_log_create(scan, log, first_frame))
+    {
+        log->format = LOG_FORMAT_NONE;
+        sprintf(tmp, "%s%s\n", ERROR_LOGFILE, log->filename);
+        logger_write(FILE_ERROR_LOG, SUBD_RESULTS, LOGGER_ERROR, tmp);
+    }
+}
+
+
+/*****************************
+ * scan_merge() - merges the next frames of every board
+ *
+ * Takes the current block of each board from its ring, and the offset
+ * of the first frame in it not yet written. As many frames as every
+ * board has are merged, at most merge_frames, and a block is released
+ * when all its frames are used. Boards read at different times, so the
+ * blocks of the boards do not line up, which is why the offsets are kept.
+ * With one board no merging is needed and data points into the block.
+ *
+ * param scan - the scan being logged
+ * param blocks - current block of each board, NULL if none
+ * param offsets - frames of the current block of each board already used
+ * param data - returns pointer to the merged frames
+ * returns - number of frames merged, 0 if a board has no data yet
+****************************/
+
+static uint32_t
+scan_merge(struct scan* scan, struct ring_block** blocks, uint32_t* offsets,
+    double** data)
+{
+    uint32_t frames = scan->merge_frames;
+    uint32_t available;
+    uint32_t i;
+    int b;
+    int ch;
+    int col = 0;
+
+    for (b = 0; b < scan->num_boards; b++)
+    {
+        if (blocks[b] == NULL)
+        {
+            blocks[b] = ring_read_block(&scan->boards[b].ring);
+            offsets[b] = 0;
+            if (blocks[b] == NULL)
+            {
+                return 0;
+            }
+        }
+        available = blocks[b]->samples_per_channel - offsets[b];
+        if (available < frames)
+        {
+            frames = available;
+        }
+    }
+
+    for (b = 0; b < scan->num_boards; b++)
+    {
+        struct scan_board* board = &scan->boards[b];
+        double* in = blocks[b]->data + offsets[b] * board->num_channels;
+
+        if (scan->num_boards == 1)
+        {
+            *data = in;
+        }
+        else
+        {
+            double* out = scan->merge_buf + col;
+            for (i = 0; i < frames; i++)
+            {
+                for (ch = 0; ch < board->num_channels; ch++)
+                {
+                    out[ch] = in[ch];
+                }
+                in += board->num_channels;
+                out += scan->num_channels;
+            }
+            col += board->num_channels;
+            *data = scan->merge_buf;
+        }
+
+        offsets[b] += frames;
+        if (offsets[b] == blocks[b]->samples_per_channel)
+        {
+            ring_read_release(&board->ring);
+            blocks[b] = NULL;
+        }
+    }
+    return frames;
+}
+
+
+/*****************************
+ * scan_units() - scales frames of raw ADC codes to units
+ *
+ * param scan - the scan being logged, with units_buf
+ * param data - codes, num_channels per frame
+ * param frames - number of frames, up to merge_frames
+ * returns - the frames in units, in units_buf
+****************************/
+
+static double*
+scan_units(struct scan* scan, const double* data, uint32_t frames)
+{
+    double* out = scan->units_buf;
+    uint32_t i;
+    int ch = 0;
+
+    for (i = 0; i < frames * scan->num_channels; i++)
+    {
+        out[i] = (data[i] - scan->code_offset[ch]) * scan->units_per_code[ch];
+        if (++ch == scan->num_channels)
+        {
+            ch = 0;
+        }
+    }
+    return out;
+}
+
+
+/*****************************
+ * scan_log_write() - writes frames of samples to a log file
+ *
+ * In the format of the log file, nothing is written if the format is none.
+ * When the segment being written is full the next is created, and the
+ * frames carry on in it, so the segments have every frame once.
+ *
+ * param scan - the scan being logged
+ * param log - full rate or decimated log file
+ * param data - samples, num_channels per frame
+ * param frames - number of frames
+****************************/
+
+static void
+scan_log_write(struct scan* scan, struct scan_log* log, double* data,
+    uint32_t frames)
+{
+    uint32_t n;
+
+    while ((frames > 0) && (log->format != LOG_FORMAT_NONE))
+    {
+        n = scan_log_room(log, frames);
+        if (n == 0)
+        {
+            scan_log_next(scan, log);
+            continue;
+        }
+
+        if (log->format == LOG_FORMAT_BINARY)
+        {
+            if (!binlog_write(&log->binlog, data, n))
+            {
+                log->write_failed = true;
+            }
+        }
+        else
+        {
+            scan_write_block(scan, log, data, n);
+        }
+        log->frames += n;
+        data += (size_t)n * scan->num_channels;
+        frames -= n;
+    }
+}
+
+
+/*****************************
+ * scan_write_block() - writes frames of samples to a text log file
+ *
+ * Each line has the date and time of the sample, worked out from the
+ * frame by textfmt_time(), then a column per channel. The date is only
+ * formatted again when the second changes. The lines are formatted by
+ * textfmt_line() into the text log's output buffer, which is written
+ * to the file in large chunks.
+ *
+ * param scan - the scan being logged
+ * param log - full rate or decimated log file
+ * param data - samples, num_channels per frame
+ * param frames - number of frames
+****************************/
+
+static void
+scan_write_block(struct scan* scan, struct scan_log* log, double* data,
+    uint32_t frames)
+{
+    struct textbuf* tb = &log->text;
+    uint32_t nsec;
+    int64_t sec;
+    uint32_t i;
+    char* p;
+
+    for (i = 0; i < frames; i++)
+    {
+        nsec = textfmt_time(log->start_sec, log->start_nsec,
+            (log->frames + i) / log->rate, &sec);
+        if (sec != log->date_sec)
+        {
+            log->date_len = utils_format_date_time(log->date, sizeof(log->date), sec);
+            log->date_sec = sec;
+        }
+
+        p = textbuf_reserve(tb);
+        p = textfmt_line(p, log->date, log->date_len, nsec * 1e-9,
+            &data[i * scan->num_channels], scan->num_channels);
+        tb->len = p - tb->buf;
+    }
+}
+
+
+
+/*****************************
+ * scan_event_write() - captures events from frames of the scan
+ *
+ * While waiting the frames are searched for a trigger. When one is
+ * found an event file is created, the frames kept from before the
+ * trigger are written to it, then the frames from the trigger on,
+ * until the event has all its frames, and the search starts again.
+ *
+ * param scan - the scan being logged
+ * param data - samples, num_channels per frame
+ * param frames - number of frames
+****************************/
+
+static void
+scan_event_write(struct scan* scan, double* data, uint32_t frames)
+{
+    struct event* ev = &scan->event;
+    const double* pre;
+    uint32_t pre_frames;
+    uint32_t n;
+
+    while (frames > 0)
+    {
+        if (ev->post_left == 0)
+        {
+            n = event_search(ev, data, frames);
+            data += (size_t)n * scan->num_channels;
+            frames -= n;
+            if (frames == 0)
+            {
+                break;
+            }
+            pre = event_pre(ev, &pre_frames);
+            scan_event_open(scan, pre, pre_frames);
+        }
+
+        n = event_post(ev, data, frames);
+        scan_log_write(scan, &scan->evlog, data, n);
+        data += (size_t)n * scan->num_channels;
+        frames -= n;
+        if (ev->post_left == 0)
+        {
+            scan_event_close(scan);
+        }
+    }
+}
+
+
+/*****************************
+ * scan_event_open() - creates the file of an event just triggered
+ *
+ * The file starts with the frames kept from before the trigger, they
+ * are written a block at a time, as the binary log only converts that
+ * many at a time. If the file cannot be created the error is logged,
+ * and the event is not written, but the scan carries on.
+ *
+ * param scan - the scan being logged
+ * param pre - frames from before the trigger, oldest first
+ * param pre_frames - number of them
+****************************/
+
+static void
+scan_event_open(struct scan* scan, const double* pre, uint32_t pre_frames)
+{
+    char filename[MAX_ARRAY_SIZE * 2] = {0};
+    char tmp[MAX_ARRAY_SIZE * 4] = {0};
+    uint32_t n;
+
+    scan_event_name(scan, filename);
+    scan->evlog.format = scan->event_format;
+    if (!scan_log_open(scan, &scan->evlog, filename, scan->sample_format,
+        scan->scan_rate, scan->merge_frames, scan->event.trigger_frame - pre_frames,
+        pre_frames + scan->event.post_frames))
+    {
+        scan->evlog.format = LOG_FORMAT_NONE;
+        sprintf(tmp, "%s%s\n", ERROR_LOGFILE, scan->evlog.filename);
+        logger_write(FILE_ERROR_LOG, SUBD_RESULTS, LOGGER_ERROR, tmp);
+        return;
+    }
+
+    while (pre_frames > 0)
+    {
+        n = (pre_frames < scan->merge_frames) ? pre_frames : scan->merge_frames;
+        scan_log_write(scan, &scan->evlog, (double*)pre, n);
+        pre += (size_t)n * scan->num_channels;
+        pre_frames -= n;
+    }
+}
+
+
+/*****************************
+ * scan_event_close() - closes the file of an event, if there is one
+ *
+ * If there were any errors writing the file, adds message to log file,
+ * but carries on, as the data written so far is still useful.
+ *
+ * param scan - the scan being logged
+****************************/
+
+static void
+scan_event_close(struct scan* scan)
+{
+    char tmp[MAX_ARRAY_SIZE * 4] = {0};
+
+    if (scan->evlog.format == LOG_FORMAT_NONE)
+    {
+        return;
+    }
+    if (!scan_log_close(&scan->evlog))
+    {
+        sprintf(tmp, "%s%s\n", ERROR_FILE_WRITE, scan->evlog.filename);
+        logger_write(FILE_ERROR_LOG, SUBD_RESULTS, LOGGER_ERROR, tmp);
+    }
+    scan->evlog.format = LOG_FORMAT_NONE;
+}
+
+
+/*****************************
+ * scan_event_name() - name of the file of the last event
+ *
+ * param scan - the scan being logged
+ * param filename - returns the name, without extension
+****************************/
+
+static void
+scan_event_name(struct scan* scan, char* filename)
+{
+    sprintf(filename, "%s%d", scan->event_file, scan->event.count);
+}
@@ -0,0 +1,175 @@
+/*****************************************
+ * scan.h
+ *
+ * Acquisition and writer threads for a scan
+ *****************************************/
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include "ring.h"
+#include "binlog.h"
+#include "textfmt.h"
+#include "stats.h"
+#include "spectrum.h"
+#include "envelope.h"
+#include "decimate.h"
+#include "event.h"
+#include "instrument.h"
+#include "utils.h"
+#include "daqhats.h"
+
+//header guard
+
+#ifndef SCAN_H
+#define SCAN_H
+
+/*
+ * if DEBUG_SCAN defined, enables simple debugging in source file
+ * in production "#define DEBUG_SCAN" should be commented out
+ */
+//#define DEBUG_SCAN
+
+/* when there is nothing to do the threads sleep for these times */
+#define SCAN_READ_SLEEP_USEC 100000     //between reads of the scan buffer
+#define SCAN_FULL_SLEEP_USEC 1000       //when the ring is full
+#define SCAN_WRITE_SLEEP_USEC 10000     //when the ring is empty
+
+/* how the acquisition thread waits for data */
+enum scan_read_mode
+{
+    READ_MODE_POLL = 0,                 //read all available, then sleep
+    READ_MODE_WAIT = 1                  //library read waits for a fill threshold
+};
+
+/* wait mode, the threshold is the samples for this time at the scan rate,
+ * at most a quarter of the library's scan buffer */
+#define SCAN_READ_LATENCY 0.05
+#define SCAN_THRESHOLD_DIVISOR 4
+
+/* log file formats */
+enum scan_log_format
+{
+    LOG_FORMAT_TEXT = 0,                //date time.fraction, value, value
+    LOG_FORMAT_BINARY = 1,              //binlog.h
+    LOG_FORMAT_NONE = 2                 //no samples, only the statistics
+};
+
+/* added to the name of a log file until it is closed */
+#define SCAN_PARTIAL_EXT ".partial"
+
+/* a log file of the scan, of the full rate or the decimated frames,
+ * it can be split into segments, each in its own file
+ */
+struct scan_log
+{
+    int format;                         //one of enum scan_log_format
+    double segment_seconds;             //length of a segment, 0 if not split on time
+    uint64_t segment_bytes;             //size of a segment, 0 if not split on size
+    double chunk_seconds;               //binary, length of a chunk, 0 if not chunked
+    FILE* fp;                           //text log file
+    struct textbuf text;                //output buffer for the text log file
+    struct binlog binlog;               //binary log file
+    int64_t start_sec;                  //time of the first frame of the file
+    int64_t start_nsec;
+    int64_t date_sec;                   //second of date, -1 until the first text line
+    char date[MAX_ARRAY_SIZE];          //date and time added to each text line
+    size_t date_len;
+    bool write_failed;                  //error writing to the log file
+
+    /* set by scan_log_open() */
+    char name[MAX_ARRAY_SIZE * 2];      //name given, without segment number or extension
+    char filename[MAX_ARRAY_SIZE * 3];  //name of the file, once it is closed
+    int sample_format;
+    double rate;
+    uint32_t max_frames;
+    uint64_t end_frame;                 //frame of the scan after the last expected, 0 if not known
+    uint32_t segment;                   //number of the segment, from 1, 0 if not split
+    uint64_t segment_frames;            //most frames in a segment, 0 if no limit
+    double frame_bytes;                 //bytes of a frame in the file, 0 until known
+    uint64_t first_frame;               //frame of the scan the file starts at
+    uint64_t frames;                    //frames written to the file
+};
+
+/* most boards in a stack, each has 2 channels */
+#define SCAN_MAX_BOARDS MAX_NUMBER_HATS
+
+struct scan;
+
+/* a board of the scan, each has its own acquisition thread and ring */
+struct scan_board
+{
+    struct scan* scan;                  //scan the board belongs to
+    uint8_t address;
+    int num_channels;                   //channels of this board
+    double cal_slope[2];                //calibration coefficients of each channel
+    double cal_offset[2];
+    struct ring ring;
+
+    /* acquisition thread results */
+    uint64_t total_samples_read;
+    int result;                         //library result code if a read failed
+    char* error;                        //error message if the scan failed
+
+    /* added to by the acquisition thread */
+    struct instrument read_time;        //of each mcc172_a_in_scan_read(), us
+    struct instrument read_samples;     //samples per channel of each read
+    struct instrument buffer_fill;      //samples per channel in the scan buffer before each read
+};
+
+/* scan shared by the acquisition threads and the writer thread */
+struct scan
+{
+    /* set up before the threads are started */
+    int num_boards;
+    struct scan_board boards[SCAN_MAX_BOARDS];
+    int num_channels;                   //channels of all the boards
+    uint32_t options;
+    bool continuous;
+    uint64_t total_samples_wanted;
+    int read_mode;                      //one of enum scan_read_mode
+    uint32_t read_threshold;            //wait mode, samples per channel per read
+    double read_timeout;                //wait mode, seconds to wait for them
+    uint32_t buffer_samples;            //size of the library's scan buffer per channel
+    double scan_rate;                   //actual scan rate per channel
+    double sensitivity[SCAN_MAX_BOARDS * 2];    //mV per unit of each channel
+    double units_per_code[SCAN_MAX_BOARDS * 2]; //raw codes, units = (code - code_offset)
+    double code_offset[SCAN_MAX_BOARDS * 2];    //  * units_per_code, of each channel
+    struct timespec start_time;         //wall clock time the scan started
+    struct scan_log log;                //full rate frames, format none if not logged
+    struct decimate decimate;           //decimation, factor is 0 if none
+    struct scan_log declog;             //decimated frames
+    struct stats stats;                 //summary file, fp is NULL if none
+    struct spectrum spectrum;           //averaged spectrum, size is 0 if none
+    struct envelope envelope;           //envelope analysis, buf is NULL if none
+    struct event event;                 //event capture, trigger is none if none
+    struct scan_log evlog;              //file of the event being captured
+    char event_file[MAX_ARRAY_SIZE];    //the event number is added to this name
+    int event_format;                   //log format of the event files
+    int sample_format;                  //of binary event files
+    atomic_bool stop;                   //a board failed, or the writer finished
+
+    /* writer thread state */
+    double* merge_buf;                  //frames of all the boards, side by side
+    uint32_t merge_frames;              //size of merge_buf in frames
+    double* units_buf;                  //raw codes scaled to units, NULL if not raw
+    uint64_t total_frames_written;
+
+    /* added to by the writer thread */
+    struct instrument write_time;       //for each block of frames, us
+    struct instrument log_time;         //formatting and writing the log files, us
+    char perf_file[MAX_ARRAY_SIZE];     //the histograms are written to, "" if none
+};
+
+/* function declarations */
+void scan_set_threshold(struct scan*, double, uint32_t);
+void scan_set_units(struct scan*);
+void* scan_acquire_thread(void*);
+void* scan_writer_thread(void*);
+bool scan_log_open(struct scan*, struct scan_log*, char*, int, double, uint32_t,
+    uint64_t, uint64_t);
+bool scan_log_close(struct scan_log*);
+void scan_instrument_init(struct scan*);
+bool scan_write_perf(struct scan*, const char*);
+
+#endif
@@ -4,65 +4,161 @@
  * Acquires blocks of analog input data for a user-specified group
  * of channels. The acquisition is stopped when the specified
  * number of samples is acquired for each channel.
+ *
+ * In continuous mode (OPTS_CONTINUOUS) the scan runs until the
+ * capture duration or the specified number of samples is reached.
+ * The data is read into a fixed size buffer which is reused for
+ * every read, so memory use does not grow with the capture length.
+ *
+ * With more than one MCC 172 in the stack, the first board is the
+ * clock and trigger master and the others are slaves, so all the
+ * boards sample at the same time. Each board is read by its own
+ * thread and the channels of all the boards are logged together.
+ *
+ * In daemon mode the boards are set up once and a scan is captured
+ * every capture interval, and on SIGUSR2, until SIGTERM.
  ****************************/
 #include <math.h>
+#include <pthread.h>
+#include <signal.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include "daqhats_utils.h"
 #include "scantofile.h"
 #include "utils.h"
+#include "logger.h"
+#include "scan.h"
 #include "mcc172.h"
 #include "daqhats.h"
 
 /* local function declarations */
+int  find_boards(uint8_t*);
 void get_log_file(char*, int);
 void add_to_errorlog_quit(char*);
+void shutdown_quit(char*);
+void write_scan_report(struct scan*);
 double utils_gettag_errchk_d(char*, char*);
 int    utils_gettag_errchk_i(char*, char*);
+int    utils_gettag_choice(char*, char*, const char**, int);
+char*  utils_gettag_channel(char*, char*, int, char*);
+void open_log_file(struct scan*, struct scan_log*, char*, int, double, uint32_t);
+void close_log_file(struct scan_log*);
 void stop_if_error(int);
 char* get_err_str(int);
 void iepe_power_off();
 void close_mcc172();
+bool wait_for_capture(double);
+int  wait_for_trigger(double, double, struct timespec*);
+void stop_scan(void);
+void capture_failed(char*, bool);
+void signal_capture(int);
+void signal_terminate(int);
 
 // folowing variables are global so error functions can close down the hardware
-uint8_t address = 0;    
-int channel_array[2 * 8];  //max of 8 boards with 2 channels each
+uint8_t addresses[SCAN_MAX_BOARDS];  //boards opened, master first
+int num_boards = 0;
+int channel_array[2];  //channels of each board
 int num_channels = 0;
 
+/* every tag of the xml parameters file, and what its value has to be,
+ * the file is checked against them before any tag is used
+ */
+static const struct config_tag config_tags[] = {
+    {PAR_SENSITIVITY, CONFIG_NUMBER, true},
+    {PAR_SCANRATE, CONFIG_NUMBER, false},
+    {PAR_IEPE_POWER, CONFIG_WORD, true},
+    {PAR_SAMPLES_CHANNEL, CONFIG_NUMBER, false},
+    {PAR_OPTIONS, CONFIG_NUMBER, false},
+    {PAR_NOCHANNELS, CONFIG_NUMBER, false},
+    {PAR_NOBOARDS, CONFIG_NUMBER, false},
+    {PAR_CAPTURE_SECONDS, CONFIG_NUMBER, false},
+    {PAR_READ_MODE, CONFIG_WORD, false},
+    {PAR_READ_LATENCY, CONFIG_NUMBER, false},
+    {PAR_LOG_FORMAT, CONFIG_WORD, false},
+    {PAR_SAMPLE_FORMAT, CONFIG_WORD, false},
+    {PAR_STATS_INTERVAL, CONFIG_NUMBER, false},
+    {PAR_FFT_SIZE, CONFIG_NUMBER, false},
+    {PAR_FFT_OVERLAP, CONFIG_NUMBER, false},
+    {PAR_FFT_WINDOW, CONFIG_WORD, false},
+    {PAR_ENV_BAND_LOW, CONFIG_NUMBER, false},
+    {PAR_ENV_BAND_HIGH, CONFIG_NUMBER, false},
+    {PAR_ENV_CUTOFF, CONFIG_NUMBER, false},
+    {PAR_ENV_FFT_SIZE, CONFIG_NUMBER, false},
+    {PAR_BPFO, CONFIG_NUMBER, false},
+    {PAR_BPFI, CONFIG_NUMBER, false},
+    {PAR_BSF, CONFIG_NUMBER, false},
+    {PAR_FTF, CONFIG_NUMBER, false},
+    {PAR_DECIMATE_TO, CONFIG_NUMBER, false},
+    {PAR_FULL_RATE_LOG, CONFIG_WORD, false},
+    {PAR_DAEMON, CONFIG_WORD, false},
+    {PAR_CAPTURE_INTERVAL, CONFIG_NUMBER, false},
+    {PAR_EVENT_TRIGGER, CONFIG_WORD, false},
+    {PAR_EVENT_LEVEL, CONFIG_NUMBER, false},
+    {PAR_PRE_TRIGGER, CONFIG_NUMBER, false},
+    {PAR_POST_TRIGGER, CONFIG_NUMBER, false},
+    {PAR_EVENT_HOLDOFF, CONFIG_NUMBER, false},
+    {PAR_EVENT_MAX, CONFIG_NUMBER, false},
+    {PAR_TRIGGER_SOURCE, CONFIG_WORD, false},
+    {PAR_TRIGGER_MODE, CONFIG_WORD, false},
+    {PAR_TRIGGER_TIMEOUT, CONFIG_NUMBER, false},
+    {PAR_SEGMENT_SECONDS, CONFIG_NUMBER, false},
+    {PAR_SEGMENT_MBYTES, CONFIG_NUMBER, false},
+    {PAR_CHUNK_SECONDS, CONFIG_NUMBER, false},
+    {NULL, CONFIG_WORD, false}
+};
+
+// set by the signal handlers, SIGTERM also stops the scan
+atomic_bool terminate_wanted;
+atomic_bool capture_wanted;
+struct scan* signal_scan = NULL;
+
 int main(void)
 {
     int result = RESULT_SUCCESS;
     uint8_t address = 0;
+    uint8_t found[SCAN_MAX_BOARDS];
+    int boards_wanted = 0;
     char channel_string[512];
     char options_str[512];
     char date_time[MAX_ARRAY_SIZE] = {0};       //used to add date and time to log file
     int i;
+    int b;
     
     /* actual scan rate read from mcc172, as loaded scan rate is internally converted to
      * to the nearest valid rate of 51.2 kHz divided by an integer between 1 and 256. */
     double actual_scan_rate = 0.0;    
-    double sample_time = 0.0;       //track time of sample displayed in log file
-    double sample_time_inc = 0.0;
 
     uint32_t options = OPTS_DEFAULT;
-    uint16_t read_status = 0;
-    uint32_t samples_read_per_channel = 0;
     uint8_t synced;
     uint8_t clock_source;
-    uint8_t iepe_enable;
-    
-    int32_t read_request_size = -1;     // '-1' means read all available samples
-    double timeout = 5.0;
+    uint8_t iepe_enable[SCAN_MAX_BOARDS * 2];
+
+    /* scan shared by the acquisition and writer threads */
+    struct scan scan = {0};
+    pthread_t acquire_threads[SCAN_MAX_BOARDS];
+    pthread_t writer_thread;
 
 
     /* set up file names */
     char config_file[MAX_ARRAY_SIZE] = {0};     //parameters from xml file to config the MCC172
     char log_file[MAX_ARRAY_SIZE] = {0};        //log of data collected from mcc172
-    FILE *fp_logfile;
+    char stats_file[MAX_ARRAY_SIZE] = {0};      //summary of the statistics of the data
+    char spectrum_file[MAX_ARRAY_SIZE] = {0};   //averaged spectrum of the data
+    char envelope_file[MAX_ARRAY_SIZE] = {0};   //envelope analysis of the data
+    char decimated_file[MAX_ARRAY_SIZE] = {0};  //log of the decimated data
+    struct sigaction action = {0};
     utils_get_date_time(date_time, sizeof(date_time));
 
     char tmp[MAX_ARRAY_SIZE * 2] = {0};
 
+    /* the error log and scan report are written by the logger thread,
+     * so a thread which logs a message does not wait for the file
+     */
+    if (!logger_start())
+    {
+        add_to_errorlog_quit(ERROR_LOGGER);
+    }
+
     /* get name and path of configuration file
      * if errors, add to error log file, and quit.
      */
@@ -73,6 +169,35 @@ int main(void)
         add_to_errorlog_quit(tmp);
     }
 
+    /* read the xml parameters file, once, and check every tag in it before
+     * any are used, so a mistyped tag or value stops the program, rather
+     * than being ignored
+     */
+    struct config* config = utils_getconfig(config_file);
+    if (config == NULL)
+    {
+        sprintf(tmp, "%s%s\n", ERROR_XMLFILE, config_file);
+        add_to_errorlog_quit(tmp);
+    }
+    const char* bad_tag;
+    switch (config_check(config, config_tags, &bad_tag))
+    {
+        case CONFIG_UNKNOWN:
+            sprintf(tmp, "%s%s\n", ERROR_XMLTAG_UNKNOWN, bad_tag);
+            add_to_errorlog_quit(tmp);
+            break;
+        case CONFIG_TWICE:
+            sprintf(tmp, "%s%s\n", ERROR_XMLTAG_TWICE, bad_tag);
+            add_to_errorlog_quit(tmp);
+            break;
+        case CONFIG_NOT_NUMBER:
+            sprintf(tmp, "%s%s\n", ERROR_XMLVALUE, bad_tag);
+            add_to_errorlog_quit(tmp);
+            break;
+        default:
+            break;
+    }
+
     /* get options from xml parameters file, if error will return zero
      * zero is the default value for options, so no error checking
      */
@@ -102,212 +227,618 @@ int main(void)
     num_channels = convert_chan_mask_to_array(channel_mask,
         channel_array);
 
-    //get sensitivity from xml parameters file and check for errors
-    double sensitivity = utils_gettag_errchk_d(config_file, PAR_SENSITIVITY);
+    /* get number of boards from xml parameters file,
+     * if missing will return zero and all the boards found are used
+     */
+    boards_wanted = utils_getxmltag_i(config_file, PAR_NOBOARDS);
+    int boards_found = find_boards(found);
+    if ((boards_wanted < 0) || (boards_wanted > boards_found))
+    {
+        sprintf(tmp, "%s%i, %i found\n", ERROR_NO_BOARDS, boards_wanted,
+            boards_found);
+        add_to_errorlog_quit(tmp);
+    }
+    if (boards_wanted == 0)
+    {
+        boards_wanted = boards_found;
+    }
+
+    #ifdef DEBUG_MAIN
+    printf ("main() - %i boards\n", boards_wanted);
+    #endif
+
+    /* get sensitivity and IEPE power state of each channel from xml parameters
+     * file and check for errors, a channel's own tag, the tag with "_ch" and
+     * the channel added, is used if there is one, otherwise the tag for all
+     */
+    char channel_tag[MAX_ARRAY_SIZE] = {0};
+    char* tag;
+    const char* iepe_powers[] = {"off", "on", NULL};
+    for (i = 0; i < boards_wanted * num_channels; i++)
+    {
+        tag = utils_gettag_channel(config_file, PAR_SENSITIVITY, i, channel_tag);
+        scan.sensitivity[i] = utils_gettag_errchk_d(config_file, tag);
+
+        tag = utils_gettag_channel(config_file, PAR_IEPE_POWER, i, channel_tag);
+        if (!utils_getxmltag(config_file, tag, tmp))
+        {
+            sprintf(tmp, "%s%s\n", ERROR_XMLTAG, tag);
+            add_to_errorlog_quit(tmp);
+        }
+        iepe_enable[i] = utils_gettag_choice(config_file, tag, iepe_powers, 0);
+    }
 
     //get samples per channel from xml parameters file and check for errors
     double sampl_per_chan =  utils_gettag_errchk_d(config_file, PAR_SAMPLES_CHANNEL);
            
     uint32_t samples_per_channel = (uint32_t)sampl_per_chan;
-    uint32_t buffer_size = samples_per_channel * num_channels;
+
+    /* get capture duration from xml parameters file, only used in continuous mode,
+     * if missing will return zero and samples_per_channel sets the capture length
+     */
+    double capture_seconds = utils_getxmltag_d(config_file, PAR_CAPTURE_SECONDS);
+    bool continuous = (options & OPTS_CONTINUOUS) == OPTS_CONTINUOUS;
+
+    /* get daemon mode from xml parameters file, off if missing, and the
+     * seconds between captures, if missing only captures on SIGUSR2
+     */
+    const char* daemon_modes[] = {"off", "on", NULL};
+    bool daemon_mode = utils_gettag_choice(config_file, PAR_DAEMON,
+        daemon_modes, 0);
+    double capture_interval = utils_getxmltag_d(config_file, PAR_CAPTURE_INTERVAL);
+
+    /* The acquisition thread of each board reads into the blocks of a ring,
+     * which are a fixed size, independent of the capture length, and are reused.
+     * Each read returns at most READ_BUF_SAMPLES samples per channel,
+     * the rest stay in the library's scan buffer until the next read.
+     * The writer thread merges the boards READ_BUF_SAMPLES frames at a time.
+     */
+    scan.num_boards = boards_wanted;
+    scan.num_channels = boards_wanted * num_channels;
+    for (b = 0; b < scan.num_boards; b++)
+    {
+        scan.boards[b].scan = &scan;
+        scan.boards[b].address = found[b];
+        scan.boards[b].num_channels = num_channels;
+        if (!ring_init(&scan.boards[b].ring, RING_BLOCKS, READ_BUF_SAMPLES,
+            num_channels))
+        {
+            add_to_errorlog_quit(ERROR_READ_BUF);
+        }
+    }
+    scan.merge_frames = READ_BUF_SAMPLES;
+    if (scan.num_boards > 1)
+    {
+        scan.merge_buf = malloc(sizeof(double) * scan.merge_frames *
+            scan.num_channels);
+        if (scan.merge_buf == NULL)
+        {
+            add_to_errorlog_quit(ERROR_READ_BUF);
+        }
+    }
+    //raw codes are scaled to units for the statistics, spectrum, envelope and events
+    if ((options & OPTS_NOSCALEDATA) == OPTS_NOSCALEDATA)
+    {
+        scan.units_buf = malloc(sizeof(double) * scan.merge_frames *
+            scan.num_channels);
+        if (scan.units_buf == NULL)
+        {
+            add_to_errorlog_quit(ERROR_READ_BUF);
+        }
+    }
 
     #ifdef DEBUG_MAIN
-    printf("main() - buffer size: %i\n", buffer_size);
+    printf("main() - ring of %i blocks of %i samples per channel\n",
+        RING_BLOCKS, READ_BUF_SAMPLES);
     #endif
 
-    double read_buf[buffer_size];
-    int total_samples_read = 0;
+    uint64_t total_samples_wanted = samples_per_channel;
 
     //get scanrate from xml parameters file and check for errors
     double scan_rate = utils_gettag_errchk_d(config_file, PAR_SCANRATE);
-    
-    // Select an MCC172 HAT device to use.
-    if (select_hat_device(HAT_ID_MCC_172, &address))
+
+    //get read mode from xml parameters file, poll if missing
+    const char* read_modes[] = {"poll", "wait", NULL};
+    scan.read_mode = utils_gettag_choice(config_file, PAR_READ_MODE,
+        read_modes, READ_MODE_POLL);
+
+    //get read latency for wait mode from xml parameters file, default if missing
+    double read_latency = utils_getxmltag_d(config_file, PAR_READ_LATENCY);
+    if (read_latency <= 0.0)
     {
-        // Error getting device.
-        add_to_errorlog_quit(ERROR_HAT_SELECT);
+        read_latency = SCAN_READ_LATENCY;
     }
-    
-    #ifdef DEBUG_MAIN
-    printf ("main() - selected MCC 172 device at address %d\n", address);
-    #endif
 
-    // Open a connection to the device.
-    result = mcc172_open(address);
-    stop_if_error(result);
+    //get log file format from xml parameters file, text if missing
+    const char* log_formats[] = {"text", "binary", "none", NULL};
+    int log_format = utils_gettag_choice(config_file, PAR_LOG_FORMAT,
+        log_formats, LOG_FORMAT_TEXT);
 
-    //get IEPE power state from xml parameters file and check for errors
-    result =  utils_getxmltag(config_file, PAR_IEPE_POWER, tmp);
-    //check we read tag from file
-    if (!result)
-    { 
-        //put a message on error log file
-        sprintf(tmp, "%s%s\n", ERROR_XMLTAG, PAR_IEPE_POWER);
-        utils_appendtofile(FILE_ERROR_LOG, SUBD_RESULTS, tmp);
-    }
+    /* get decimated rate from xml parameters file, no decimation if missing,
+     * with decimation the full rate data is only logged if asked for
+     */
+    double decimate_to = utils_getxmltag_d(config_file, PAR_DECIMATE_TO);
+    const char* full_rate_logs[] = {"off", "on", NULL};
+    int full_rate_log = utils_gettag_choice(config_file, PAR_FULL_RATE_LOG,
+        full_rate_logs, 0);
 
-    // Check if power on or off
-    if (strcmp(tmp, "on"))
-    { 
-        iepe_enable = 1;
+    /* get segment length and size from xml parameters file, the log files
+     * are split into a new segment at either, not split if both are missing
+     */
+    double segment_seconds = utils_getxmltag_d(config_file, PAR_SEGMENT_SECONDS);
+    double segment_mbytes = utils_getxmltag_d(config_file, PAR_SEGMENT_MBYTES);
+    uint64_t segment_bytes = (segment_mbytes > 0.0) ?
+        (uint64_t)(segment_mbytes * 1024 * 1024) : 0;
+
+    //get chunk length of binary log files from xml parameters file, not chunked if missing
+    double chunk_seconds = utils_getxmltag_d(config_file, PAR_CHUNK_SECONDS);
+
+    /* get event capture parameters from xml parameters file, no events if the
+     * trigger is missing, with events the full rate data is only logged if asked for,
+     * no hold off and no limit on the events if they are missing
+     */
+    const char* event_triggers[] = {"none", "level", "rms", "external", NULL};
+    int event_trigger = utils_gettag_choice(config_file, PAR_EVENT_TRIGGER,
+        event_triggers, EVENT_NONE);
+    double event_level = utils_getxmltag_d(config_file, PAR_EVENT_LEVEL);
+    double pre_trigger = utils_getxmltag_d(config_file, PAR_PRE_TRIGGER);
+    double post_trigger = utils_getxmltag_d(config_file, PAR_POST_TRIGGER);
+    double event_holdoff = utils_getxmltag_d(config_file, PAR_EVENT_HOLDOFF);
+    int event_max = (int)utils_getxmltag_d(config_file, PAR_EVENT_MAX);
+
+    /* get external trigger parameters from xml parameters file, no trigger if
+     * the source is missing, rising edge if the mode is missing, and the
+     * seconds to wait for it, if missing waits until SIGTERM
+     */
+    const char* trigger_sources[] = {"none", "external", NULL};
+    bool external_trigger = utils_gettag_choice(config_file, PAR_TRIGGER_SOURCE,
+        trigger_sources, 0);
+    //the choices are in the order of the trigger modes in daqhats.h
+    const char* trigger_modes[] = {"rising", "falling", "high", "low", NULL};
+    int trigger_mode = utils_gettag_choice(config_file, PAR_TRIGGER_MODE,
+        trigger_modes, TRIG_RISING_EDGE);
+    double trigger_timeout = utils_getxmltag_d(config_file, PAR_TRIGGER_TIMEOUT);
+
+    //get statistics interval from xml parameters file, no statistics if missing
+    double stats_interval = utils_getxmltag_d(config_file, PAR_STATS_INTERVAL);
+
+    //get spectrum parameters from xml parameters file, no spectrum if fft size missing
+    uint32_t fft_size = (uint32_t)utils_getxmltag_d(config_file, PAR_FFT_SIZE);
+    double fft_overlap = SPECTRUM_OVERLAP;
+    if (utils_getxmltag(config_file, PAR_FFT_OVERLAP, tmp))
+    {
+        fft_overlap = utils_getxmltag_d(config_file, PAR_FFT_OVERLAP);
     }
-    else if (strcmp(tmp, "off"))
-    { 
-        iepe_enable = 0;
+    const char* fft_windows[] = {"hann", "flattop", NULL};
+    int fft_window = utils_gettag_choice(config_file, PAR_FFT_WINDOW,
+        fft_windows, WINDOW_HANN);
+
+    /* get envelope analysis parameters from xml parameters file,
+     * no envelope analysis if the band is missing, defaults for the rest
+     */
+    double env_band_low = utils_getxmltag_d(config_file, PAR_ENV_BAND_LOW);
+    double env_band_high = utils_getxmltag_d(config_file, PAR_ENV_BAND_HIGH);
+    double env_cutoff = utils_getxmltag_d(config_file, PAR_ENV_CUTOFF);
+    if (env_cutoff <= 0.0)
+    {
+        env_cutoff = ENVELOPE_CUTOFF;
     }
-    else
+    uint32_t env_fft_size = (uint32_t)utils_getxmltag_d(config_file, PAR_ENV_FFT_SIZE);
+    if (env_fft_size == 0)
     {
-        utils_appendtofile(FILE_ERROR_LOG, SUBD_RESULTS, ERROR_IEPE_POWER);
-        mcc172_close(address);
-        return -1;
+        env_fft_size = ENVELOPE_FFT_SIZE;
     }
-   
-    for (i = 0; i < num_channels; i++)
+    //in the order of enum envelope_defect
+    double defects[DEFECT_COUNT];
+    defects[DEFECT_BPFO] = utils_getxmltag_d(config_file, PAR_BPFO);
+    defects[DEFECT_BPFI] = utils_getxmltag_d(config_file, PAR_BPFI);
+    defects[DEFECT_BSF] = utils_getxmltag_d(config_file, PAR_BSF);
+    defects[DEFECT_FTF] = utils_getxmltag_d(config_file, PAR_FTF);
+
+    //get binary sample format from xml parameters file, float32 if missing
+    //the choices are in the order of enum binlog_format, which starts at 1
+    const char* sample_formats[] = {"", "float32", "float64", "int24", "compressed", NULL};
+    int sample_format = utils_gettag_choice(config_file, PAR_SAMPLE_FORMAT,
+        sample_formats, BINLOG_FLOAT32);
+    
+    // Open a connection to each device, addresses are kept so errors can close them
+    for (b = 0; b < scan.num_boards; b++)
     {
-        result = mcc172_iepe_config_write(address, channel_array[i],
-            iepe_enable);
-        stop_if_error(result);
+        address = scan.boards[b].address;
+        #ifdef DEBUG_MAIN
+        printf ("main() - selected MCC 172 device at address %d\n", address);
+        #endif
 
-        result = mcc172_a_in_sensitivity_write(address, channel_array[i], 
-            sensitivity);
+        result = mcc172_open(address);
         stop_if_error(result);
+        addresses[num_boards++] = address;
+
+        //raw codes are scaled when the log file is read, which needs the calibration
+        for (i = 0; i < num_channels; i++)
+        {
+            result = mcc172_calibration_coefficient_read(address, channel_array[i],
+                &scan.boards[b].cal_slope[i], &scan.boards[b].cal_offset[i]);
+            stop_if_error(result);
+        }
     }
 
-    // Set the ADC clock to the desired rate.
-    result = mcc172_a_in_clock_config_write(address, SOURCE_LOCAL, scan_rate);
-    stop_if_error(result);
+    // set the IEPE power and sensitivity of each channel, read above
+    for (b = 0; b < num_boards; b++)
+    {
+        for (i = 0; i < num_channels; i++)
+        {
+            result = mcc172_iepe_config_write(addresses[b], channel_array[i],
+                iepe_enable[b * num_channels + i]);
+            stop_if_error(result);
+
+            result = mcc172_a_in_sensitivity_write(addresses[b],
+                channel_array[i], scan.sensitivity[b * num_channels + i]);
+            stop_if_error(result);
+        }
+    }
+
+    /* Set the ADC clock to the desired rate.
+     * A single board uses its own clock. With more than one board the
+     * slaves are configured first and the master last, the ADCs of all
+     * the boards are synchronized when the master is configured.
+     */
+    if (num_boards == 1)
+    {
+        result = mcc172_a_in_clock_config_write(addresses[0], SOURCE_LOCAL,
+            scan_rate);
+        stop_if_error(result);
+    }
+    else
+    {
+        for (b = num_boards - 1; b >= 0; b--)
+        {
+            result = mcc172_a_in_clock_config_write(addresses[b],
+                (b == 0) ? SOURCE_MASTER : SOURCE_SLAVE, scan_rate);
+            stop_if_error(result);
+        }
+    }
   
     // Wait for the ADCs to synchronize.
-    do
+    for (b = 0; b < num_boards; b++)
     {
-        result = mcc172_a_in_clock_config_read(address, &clock_source,
-            &actual_scan_rate, &synced);
-           
-        stop_if_error(result);
-        usleep(5000);
-    } while (synced == 0);
+        do
+        {
+            result = mcc172_a_in_clock_config_read(addresses[b], &clock_source,
+                &actual_scan_rate, &synced);
+               
+            stop_if_error(result);
+            usleep(5000);
+        } while (synced == 0);
+    }
 
-    sample_time = 0.0;
-    sample_time_inc = 1.0 / actual_scan_rate;
+    /* The boards only start on the same sample if they share a trigger,
+     * the master passes the signal on its TRIG terminal to the slaves.
+     * One board only waits for a trigger if asked to, or for an external event.
+     */
+    if ((num_boards > 1) || external_trigger || (event_trigger == EVENT_EXTERNAL))
+    {
+        for (b = 0; b < num_boards; b++)
+        {
+            result = mcc172_trigger_config(addresses[b], (num_boards == 1) ?
+                SOURCE_LOCAL : (b == 0) ? SOURCE_MASTER : SOURCE_SLAVE, trigger_mode);
+            stop_if_error(result);
+        }
+        options |= OPTS_EXTTRIGGER;
+    }
+
+    // a capture duration overrides samples_per_channel in continuous mode
+    if (continuous && (capture_seconds > 0.0))
+    {
+        total_samples_wanted = (uint64_t)(capture_seconds * actual_scan_rate + 0.5);
+    }
 
     #ifdef DEBUG_MAIN
     printf ("main() - Actual scan rate: %6.0f\n", actual_scan_rate);
-    printf ("main() - Sample time inc: %11.9f\n", sample_time_inc);
-    printf ("main() - Samples per channel: %i\n", samples_per_channel);
+    printf ("main() - Sample time inc: %11.9f\n", 1.0 / actual_scan_rate);
+    printf ("main() - Samples per channel: %llu\n",
+        (unsigned long long)total_samples_wanted);
     #endif
 
     convert_options_to_string(options, options_str);
 
-    // Configure and start the scan.
-    result = mcc172_a_in_scan_start(address, channel_mask, samples_per_channel,
-        options);
-    stop_if_error(result);
-    
-    #ifdef DEBUG_MAIN
-    uint32_t buffer_size_samples = 0;
-    result = mcc172_a_in_scan_buffer_size(address, &buffer_size_samples);
-    printf ("main() - Scan buffer size: %d\n", buffer_size_samples);
-    #endif
-
-    //get the name of log file that scanned data is saved in
-    get_log_file(log_file, sizeof(log_file));
-    
-    fp_logfile = fopen(log_file, "w");
-    if (fp_logfile == NULL)
-    { 
-        sprintf(tmp, "%s%s\n", ERROR_LOGFILE, log_file);
-        add_to_errorlog_quit(tmp);        
-    }
+    /* SIGUSR1 writes the histograms, SIGUSR2 asks for a capture in daemon mode,
+     * SIGTERM, or SIGINT, stops the scan, and the boards are shut down as normal
+     */
+    signal_scan = &scan;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    action.sa_handler = instrument_signal;
+    sigaction(SIGUSR1, &action, NULL);
+    action.sa_handler = signal_capture;
+    sigaction(SIGUSR2, &action, NULL);
+    action.sa_handler = signal_terminate;
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGINT, &action, NULL);
 
-     // Read the specified number of samples.
-    do
+    /* In daemon mode the boards stay open, with the clock synchronized and
+     * the IEPE sensors powered, and a scan is captured every capture interval
+     * and on SIGUSR2, until SIGTERM. Otherwise one scan is captured.
+     */
+    while (!atomic_load(&terminate_wanted) &&
+        (!daemon_mode || wait_for_capture(capture_interval)))
     {
-        result = mcc172_a_in_scan_read(address, &read_status, read_request_size,
-            timeout, read_buf, buffer_size, &samples_read_per_channel);
-           
-        stop_if_error(result);
-        #ifdef DEBUG_MAIN
-        printf ("main() - Samples read per channel: %i\n", samples_read_per_channel);
-        #endif
-
-        if (read_status & STATUS_HW_OVERRUN)
+        atomic_store(&scan.stop, false);
+        for (b = 0; b < scan.num_boards; b++)
         {
-            #ifdef DEBUG_MAIN           
-            printf(ERROR_HW_OVERRUN);
-            #endif
-            add_to_errorlog_quit(ERROR_HW_OVERRUN);
-            break;
+            ring_reset(&scan.boards[b].ring);
+            scan.boards[b].total_samples_read = 0;
+            scan.boards[b].result = RESULT_SUCCESS;
+            scan.boards[b].error = NULL;
         }
-        else if (read_status & STATUS_BUFFER_OVERRUN)
+        //SIGTERM may have come before stop was cleared
+        if (atomic_load(&terminate_wanted))
         {
-            #ifdef DEBUG_MAIN  
-            printf(ERROR_SCAN_OVERRUN);
-            #endif
-            add_to_errorlog_quit(ERROR_SCAN_OVERRUN);
             break;
         }
 
-        total_samples_read += samples_read_per_channel;
+        /* Configure and start the scan.
+         * In finite mode the library allocates a buffer for the whole scan.
+         * In continuous mode samples_per_channel is only used for sizing the
+         * library's circular buffer, zero selects the default size for the
+         * scan rate, so the memory used is independent of the capture length.
+         * The master is started last, so the slaves are waiting for its trigger.
+         */
+        for (b = num_boards - 1; b >= 0; b--)
+        {
+            result = mcc172_a_in_scan_start(addresses[b], channel_mask,
+                continuous ? 0 : samples_per_channel, options);
+            if (result != RESULT_SUCCESS)
+            {
+                shutdown_quit(get_err_str(result));
+            }
+        }
 
-        //add data to log file
-        char tmp_str [MAX_ARRAY_SIZE];
-        
-        if (samples_read_per_channel > 0)
+        /* With a trigger the first sample is at the trigger, not when the scan
+         * was started, which could be long before, so the times in the log
+         * files are from the trigger. If it does not come the capture fails.
+         */
+        if ((options & OPTS_EXTTRIGGER) == OPTS_EXTTRIGGER)
         {
-            int index = 0;
-            for (i = 0; i < samples_read_per_channel; i++)
+            result = wait_for_trigger(actual_scan_rate, trigger_timeout,
+                &scan.start_time);
+            if (result != RESULT_SUCCESS)
             {
-                index = i * 2;
-                /*************************************
-                 * Write scanned data to the log file
-                 * Check if one or two channels
-                *************************************/
-
-                //remove zero to left of decimal point
-                sprintf(tmp_str, "%.9f", sample_time);
-                char* s = strstr(tmp_str, ".");
-                if (num_channels == 1)
+                //SIGTERM while waiting is not an error
+                if (!atomic_load(&terminate_wanted))
                 {
-                    fprintf(fp_logfile, "%s%s, %12.7f\n",
-                        date_time, s, read_buf[index]);
+                    capture_failed((result == RESULT_TIMEOUT) ? ERROR_TRIGGER_TIMEOUT :
+                        get_err_str(result), daemon_mode);
                 }
-                else
+                stop_scan();
+                if (!daemon_mode)
                 {
-                    fprintf(fp_logfile, "%s%s, %12.7f, %12.7f\n",
-                        date_time, s, read_buf[index], read_buf[index+1]);
-                                       }
-                //increment time for a sample
-                sample_time += sample_time_inc;    
+                    break;
+                }
+                continue;
             }
         }
-        usleep(100000);
-    }
-    while ( (result == RESULT_SUCCESS) &&
-           ((read_status & STATUS_RUNNING) == STATUS_RUNNING) );
-
-     //now tidy up       
-    result = mcc172_a_in_scan_stop(address);
-    if (result != RESULT_SUCCESS)
-    {
+        else
+        {
+            clock_gettime(CLOCK_REALTIME, &scan.start_time);
+        }
+    
+        uint32_t buffer_size_samples = 0;
+        result = mcc172_a_in_scan_buffer_size(addresses[0], &buffer_size_samples);
+        if (result != RESULT_SUCCESS)
+        {
+            shutdown_quit(get_err_str(result));
+        }
         #ifdef DEBUG_MAIN
-        print_error(result);
+        printf ("main() - Scan buffer size: %d\n", buffer_size_samples);
         #endif
-        utils_appendtofile(FILE_ERROR_LOG, SUBD_RESULTS, get_err_str(result));
+
+        /* Read the specified number of samples.
+         * The acquisition thread reads the scan buffer into the ring,
+         * the writer thread empties the ring into the log file.
+         */
+        scan.options = options;
+        scan_set_units(&scan);
+        scan.continuous = continuous;
+        scan.total_samples_wanted = total_samples_wanted;
+        scan.scan_rate = actual_scan_rate;
+        scan.buffer_samples = buffer_size_samples / num_channels;
+        scan_set_threshold(&scan, read_latency, scan.buffer_samples);
+
+        //get the name of log file that scanned data is saved in
+        get_log_file(log_file, sizeof(log_file));
+
+        /* histograms of the reads and writes, written to the perf file at
+         * the end of the scan, and whenever SIGUSR1 is received
+         */
+        sprintf(scan.perf_file, "%s_%s", log_file, FILE_PERF);
+        scan_instrument_init(&scan);
+
+        if (stats_interval > 0.0)
+        {
+            sprintf(stats_file, "%s_%s", log_file, FILE_STATS);
+            if (!stats_open(&scan.stats, stats_file, scan.num_channels,
+                actual_scan_rate, stats_interval, scan.start_time))
+            {
+                sprintf(tmp, "%s%s\n", ERROR_LOGFILE, stats_file);
+                shutdown_quit(tmp);
+            }
+        }
+        if (fft_size > 0)
+        {
+            sprintf(spectrum_file, "%s_%s", log_file, FILE_SPECTRUM);
+            if (!spectrum_open(&scan.spectrum, scan.num_channels, fft_size,
+                fft_overlap, fft_window, actual_scan_rate))
+            {
+                sprintf(tmp, "%s%s or %s\n", ERROR_XMLVALUE, PAR_FFT_SIZE,
+                    PAR_FFT_OVERLAP);
+                shutdown_quit(tmp);
+            }
+        }
+        if ((env_band_low > 0.0) || (env_band_high > 0.0))
+        {
+            sprintf(envelope_file, "%s_%s", log_file, FILE_ENVELOPE);
+            if (!envelope_open(&scan.envelope, scan.num_channels, actual_scan_rate,
+                env_band_low, env_band_high, env_cutoff, env_fft_size, defects))
+            {
+                sprintf(tmp, "%s%s, %s, %s or %s\n", ERROR_XMLVALUE, PAR_ENV_BAND_LOW,
+                    PAR_ENV_BAND_HIGH, PAR_ENV_CUTOFF, PAR_ENV_FFT_SIZE);
+                shutdown_quit(tmp);
+            }
+        }
+        if (decimate_to > 0.0)
+        {
+            if (!decimate_open(&scan.decimate, scan.num_channels, actual_scan_rate,
+                decimate_to, scan.merge_frames))
+            {
+                sprintf(tmp, "%s%s\n", ERROR_XMLVALUE, PAR_DECIMATE_TO);
+                shutdown_quit(tmp);
+            }
+            #ifdef DEBUG_MAIN
+            printf("main() - decimated by %u to %.3f\n", scan.decimate.factor,
+                scan.decimate.out_rate);
+            #endif
+            sprintf(decimated_file, "%s_%s", log_file, FILE_DECIMATED);
+            scan.declog.format = log_format;
+            scan.declog.segment_seconds = segment_seconds;
+            scan.declog.segment_bytes = segment_bytes;
+            scan.declog.chunk_seconds = chunk_seconds;
+            open_log_file(&scan, &scan.declog, decimated_file, sample_format,
+                scan.decimate.out_rate, scan.decimate.max_frames);
+        }
+        /* each event goes in its own file, in the log format, with the
+         * frames from before the trigger, the writer thread creates them
+         */
+        scan.evlog.format = LOG_FORMAT_NONE;
+        scan.evlog.chunk_seconds = chunk_seconds;
+        if (event_trigger != EVENT_NONE)
+        {
+            if (!event_open(&scan.event, event_trigger, scan.num_channels,
+                actual_scan_rate, event_level, pre_trigger, post_trigger,
+                event_holdoff, event_max))
+            {
+                sprintf(tmp, "%s%s, %s, %s, %s, %s or %s\n", ERROR_XMLVALUE,
+                    PAR_EVENT_LEVEL, PAR_PRE_TRIGGER, PAR_POST_TRIGGER,
+                    PAR_EVENT_HOLDOFF, PAR_EVENT_MAX, PAR_NOCHANNELS);
+                shutdown_quit(tmp);
+            }
+            if (scan.units_buf != NULL)
+            {
+                event_set_codes(&scan.event, scan.units_per_code, scan.code_offset);
+            }
+            sprintf(scan.event_file, "%s_%s", log_file, FILE_EVENT);
+            scan.event_format = log_format;
+            scan.sample_format = sample_format;
+        }
+        scan.log.format = (((decimate_to > 0.0) || (event_trigger != EVENT_NONE)) &&
+            !full_rate_log) ? LOG_FORMAT_NONE : log_format;
+        scan.log.segment_seconds = segment_seconds;
+        scan.log.segment_bytes = segment_bytes;
+        scan.log.chunk_seconds = chunk_seconds;
+        open_log_file(&scan, &scan.log, log_file, sample_format, actual_scan_rate,
+            scan.merge_frames);
+
+        if (pthread_create(&writer_thread, NULL, scan_writer_thread, &scan) != 0)
+        {
+            shutdown_quit(ERROR_THREAD);
+        }
+        for (b = 0; b < num_boards; b++)
+        {
+            if (pthread_create(&acquire_threads[b], NULL, scan_acquire_thread,
+                &scan.boards[b]) != 0)
+            {
+                shutdown_quit(ERROR_THREAD);
+            }
+        }
+        for (b = 0; b < num_boards; b++)
+        {
+            pthread_join(acquire_threads[b], NULL);
+        }
+        pthread_join(writer_thread, NULL);
+
+        write_scan_report(&scan);
+        if (!scan_write_perf(&scan, "end of scan"))
+        {
+            sprintf(tmp, "%s%s\n", ERROR_FILE_WRITE, scan.perf_file);
+            logger_write(FILE_ERROR_LOG, SUBD_RESULTS, LOGGER_WARNING, tmp);
+        }
+
+        // errors in the acquisition threads are handled once the data read has been written
+        close_log_file(&scan.log);
+        if (scan.decimate.factor > 0)
+        {
+            close_log_file(&scan.declog);
+            decimate_free(&scan.decimate);
+        }
+        if (!stats_close(&scan.stats))
+        {
+            sprintf(tmp, "%s%s\n", ERROR_FILE_WRITE, stats_file);
+            logger_write(FILE_ERROR_LOG, SUBD_RESULTS, LOGGER_ERROR, tmp);
+        }
+        if (scan.spectrum.size > 0)
+        {
+            if (!spectrum_write(&scan.spectrum, spectrum_file))
+            {
+                sprintf(tmp, "%s%s\n", ERROR_FILE_WRITE, spectrum_file);
+                logger_write(FILE_ERROR_LOG, SUBD_RESULTS, LOGGER_ERROR, tmp);
+            }
+            spectrum_free(&scan.spectrum);
+        }
+        if (scan.envelope.buf != NULL)
+        {
+            if (!envelope_write(&scan.envelope, envelope_file))
+            {
+                sprintf(tmp, "%s%s\n", ERROR_FILE_WRITE, envelope_file);
+                logger_write(FILE_ERROR_LOG, SUBD_RESULTS, LOGGER_ERROR, tmp);
+            }
+            envelope_free(&scan.envelope);
+        }
+        if (scan.event.trigger != EVENT_NONE)
+        {
+            event_free(&scan.event);
+        }
+        for (b = 0; b < num_boards; b++)
+        {
+            if (scan.boards[b].result != RESULT_SUCCESS)
+            {
+                capture_failed(get_err_str(scan.boards[b].result), daemon_mode);
+            }
+            if (scan.boards[b].error != NULL)
+            {
+                #ifdef DEBUG_MAIN
+                printf("%s", scan.boards[b].error);
+                #endif
+                //how full the scan buffer was getting, the histograms have the detail
+                sprintf(tmp, "%sboard %u, scan buffer high water %u of %u samples, "
+                    "longest read %u us, longest block written %u us, see %s\n",
+                    ERROR_OVERRUN_INFO, scan.boards[b].address,
+                    atomic_load(&scan.boards[b].buffer_fill.max), scan.buffer_samples,
+                    atomic_load(&scan.boards[b].read_time.max),
+                    atomic_load(&scan.write_time.max), scan.perf_file);
+                logger_write(FILE_ERROR_LOG, SUBD_RESULTS, LOGGER_INFO, tmp);
+                capture_failed(scan.boards[b].error, daemon_mode);
+            }
+        }
+
+         //now tidy up       
+        stop_scan();
+
+        if (!daemon_mode)
+        {
+            break;
+        }
     }
-    
-    result = mcc172_a_in_scan_cleanup(address);
-    if (result != RESULT_SUCCESS)
+
+    for (b = 0; b < num_boards; b++)
     {
-        #ifdef DEBUG_MAIN
-        print_error(result);
-        #endif
-        utils_appendtofile(FILE_ERROR_LOG, SUBD_RESULTS, get_err_str(result));
+        ring_free(&scan.boards[b].ring);
     }
-    
+    free(scan.merge_buf);
+    free(scan.units_buf);
+
     // Turn off IEPE supply
     iepe_power_off();
 
-    close_mcc172(address);
+    close_mcc172();
 
     return 0;   
 }
@@ -320,12 +851,347 @@ int main(void)
 void
 add_to_errorlog_quit(char* message)
 {
-        utils_appendtofile(FILE_ERROR_LOG, SUBD_RESULTS, message);
+        logger_write(FILE_ERROR_LOG, SUBD_RESULTS, LOGGER_ERROR, message);
 
         exit(-1);
 }
 
 
+/****************************
+ * shutdown_quit() - add a message to the error log file, shut down the hardware, then quit
+ *
+ * param message - message to be written to the log file
+ ****************************/
+void
+shutdown_quit(char* message)
+{
+    int b;
+
+    logger_write(FILE_ERROR_LOG, SUBD_RESULTS, LOGGER_ERROR, message);
+
+    for (b = 0; b < num_boards; b++)
+    {
+        mcc172_a_in_scan_stop(addresses[b]);
+        mcc172_a_in_scan_cleanup(addresses[b]);
+    }
+
+    // Turn off IEPE supply
+    iepe_power_off();
+
+    close_mcc172();
+    exit(-1);
+}
+
+
+/****************************
+ * write_scan_report() - add the ring occupancy of a scan to the report file
+ *
+ * A line for each board. The high water mark shows how close the
+ * writer thread came to falling behind, the full count how often
+ * the acquisition thread had to wait for it. The scan buffer high
+ * water mark shows how close the board came to a buffer overrun.
+ * Then a line with the percentiles of the time the writer thread
+ * took for each block of frames.
+ *
+ * param scan - scan that has finished
+ ****************************/
+void
+write_scan_report(struct scan* scan)
+{
+    char tmp[MAX_ARRAY_SIZE * 2] = {0};
+    int b;
+
+    for (b = 0; b < scan->num_boards; b++)
+    {
+        struct scan_board* board = &scan->boards[b];
+        uint32_t high_water = atomic_load(&board->ring.high_water);
+
+        sprintf(tmp, "%sboard %u, %llu samples per channel, ring %u blocks of %u samples, "
+            "high water %u blocks (%u%%), ring full %u times, "
+            "scan buffer high water %u of %u samples\n",
+            REPORT_RING, board->address,
+            (unsigned long long)board->total_samples_read,
+            board->ring.num_blocks, board->ring.block_samples, high_water,
+            high_water * 100 / board->ring.num_blocks,
+            atomic_load(&board->ring.full_count),
+            atomic_load(&board->buffer_fill.max), scan->buffer_samples);
+
+        #ifdef DEBUG_MAIN
+        printf("main() - %s", tmp);
+        #endif
+        logger_write(FILE_SCAN_REPORT, SUBD_RESULTS, LOGGER_INFO, tmp);
+    }
+
+    struct instrument* wt = &scan->write_time;
+    sprintf(tmp, "%s%s%u blocks, latency p50 %u us, p90 %u us, p99 %u us, "
+        "p99.9 %u us, max %u us\n", REPORT_RING, REPORT_WRITER,
+        atomic_load(&wt->count), instrument_percentile(wt, 50.0),
+        instrument_percentile(wt, 90.0), instrument_percentile(wt, 99.0),
+        instrument_percentile(wt, 99.9), atomic_load(&wt->max));
+    #ifdef DEBUG_MAIN
+    printf("main() - %s", tmp);
+    #endif
+    logger_write(FILE_SCAN_REPORT, SUBD_RESULTS, LOGGER_INFO, tmp);
+
+    if (scan->event.trigger != EVENT_NONE)
+    {
+        sprintf(tmp, "%s%s%d captured, last at %.6f seconds\n", REPORT_RING,
+            REPORT_EVENTS, scan->event.count,
+            scan->event.trigger_frame / scan->scan_rate);
+        #ifdef DEBUG_MAIN
+        printf("main() - %s", tmp);
+        #endif
+        logger_write(FILE_SCAN_REPORT, SUBD_RESULTS, LOGGER_INFO, tmp);
+    }
+}
+
+
+/****************************
+ * wait_for_capture() - waits until the next capture in daemon mode
+ *
+ * Captures are at whole multiples of the interval since 1970 UTC,
+ * so an interval of 600 captures on the hour and every 10 minutes
+ * after it, whenever the daemon was started. If a capture takes
+ * longer than the interval, the captures it overlapped are skipped.
+ * SIGUSR2 asks for a capture straight away.
+ * Sleeps at most DAEMON_WAIT_SEC at a time, so a signal which comes
+ * just before the sleep is not missed for long.
+ *
+ * param interval - seconds between captures, 0 for only on SIGUSR2
+ * returns - true to capture, false if SIGTERM has been received
+ *****************************/
+bool
+wait_for_capture(double interval)
+{
+    struct timespec now;
+    struct timespec wake;
+    double next = 0.0;
+    double t;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    t = now.tv_sec + now.tv_nsec * 1e-9;
+    if (interval > 0.0)
+    {
+        next = (floor(t / interval) + 1.0) * interval;
+    }
+
+    while (!atomic_load(&terminate_wanted))
+    {
+        if (atomic_exchange(&capture_wanted, false))
+        {
+            return true;
+        }
+        clock_gettime(CLOCK_REALTIME, &now);
+        t = now.tv_sec + now.tv_nsec * 1e-9;
+        if ((interval > 0.0) && (t >= next))
+        {
+            return true;
+        }
+
+        if ((interval <= 0.0) || (next - t > DAEMON_WAIT_SEC))
+        {
+            t += DAEMON_WAIT_SEC;
+        }
+        else
+        {
+            t = next;
+        }
+        wake.tv_sec = (time_t)t;
+        wake.tv_nsec = (long)((t - wake.tv_sec) * 1e9);
+        //returns early on a signal
+        clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &wake, NULL);
+    }
+    return false;
+}
+
+
+/****************************
+ * wait_for_trigger() - waits for the trigger of the master board
+ *
+ * Polls the status of the master every TRIGGER_POLL_USEC until it is
+ * triggered. The samples already acquired when it is seen, at the scan
+ * rate, give the time of the trigger, to within the time of a status
+ * call, rather than the time it was seen.
+ *
+ * param rate - actual scan rate per channel
+ * param timeout - seconds to wait, 0 to wait until SIGTERM
+ * param trigger_time - set to the wall clock time of the trigger
+ * returns - RESULT_SUCCESS, RESULT_TIMEOUT if no trigger in time or SIGTERM,
+ *           or the result code of the status call
+ *****************************/
+int
+wait_for_trigger(double rate, double timeout, struct timespec* trigger_time)
+{
+    struct timespec start;
+    struct timespec now;
+    uint16_t status = 0;
+    uint32_t samples_available = 0;
+    int64_t nsec;
+    int result;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (!atomic_load(&terminate_wanted))
+    {
+        result = mcc172_a_in_scan_status(addresses[0], &status, &samples_available);
+        clock_gettime(CLOCK_REALTIME, trigger_time);
+        if (result != RESULT_SUCCESS)
+        {
+            return result;
+        }
+        if (status & STATUS_TRIGGERED)
+        {
+            //back to the first sample
+            nsec = trigger_time->tv_nsec - (int64_t)llround(samples_available / rate * 1e9);
+            trigger_time->tv_sec += nsec / 1000000000;
+            nsec %= 1000000000;
+            if (nsec < 0)
+            {
+                trigger_time->tv_sec--;
+                nsec += 1000000000;
+            }
+            trigger_time->tv_nsec = nsec;
+            return RESULT_SUCCESS;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if ((timeout > 0.0) && ((now.tv_sec - start.tv_sec) +
+            (now.tv_nsec - start.tv_nsec) * 1e-9 >= timeout))
+        {
+            break;
+        }
+        usleep(TRIGGER_POLL_USEC);
+    }
+    return RESULT_TIMEOUT;
+}
+
+
+/****************************
+ * stop_scan() - stops the scan of each board and frees its scan buffer
+ *
+ * Errors are added to the error log, and the rest are still stopped.
+ *****************************/
+void
+stop_scan(void)
+{
+    int result;
+    int b;
+
+    for (b = 0; b < num_boards; b++)
+    {
+        result = mcc172_a_in_scan_stop(addresses[b]);
+        if (result != RESULT_SUCCESS)
+        {
+            #ifdef DEBUG_MAIN
+            print_error(result);
+            #endif
+            logger_write(FILE_ERROR_LOG, SUBD_RESULTS, LOGGER_ERROR, get_err_str(result));
+        }
+    
+        result = mcc172_a_in_scan_cleanup(addresses[b]);
+        if (result != RESULT_SUCCESS)
+        {
+            #ifdef DEBUG_MAIN
+            print_error(result);
+            #endif
+            logger_write(FILE_ERROR_LOG, SUBD_RESULTS, LOGGER_ERROR, get_err_str(result));
+        }
+    }
+}
+
+
+/****************************
+ * capture_failed() - a board failed during a capture
+ *
+ * In daemon mode adds the message to the error log, the scan is
+ * stopped as normal and the next capture starts a new one.
+ * Otherwise the program quits, as if there was no daemon mode.
+ *
+ * param message - message to be written to the log file
+ * param daemon_mode - true if running as a daemon
+ *****************************/
+void
+capture_failed(char* message, bool daemon_mode)
+{
+    if (!daemon_mode)
+    {
+        shutdown_quit(message);
+    }
+    logger_write(FILE_ERROR_LOG, SUBD_RESULTS, LOGGER_ERROR, message);
+}
+
+
+/****************************
+ * signal_capture() - SIGUSR2 handler, asks for a capture in daemon mode
+ *
+ * param sig - signal number
+ *****************************/
+void
+signal_capture(int sig)
+{
+    (void)sig;
+    atomic_store(&capture_wanted, true);
+}
+
+
+/****************************
+ * signal_terminate() - SIGTERM and SIGINT handler, stops the program
+ *
+ * Stops a scan which is running, the acquisition threads finish their
+ * reads and the writer thread writes what has been read, then main()
+ * shuts down the boards and turns the IEPE supply off, as at the end
+ * of a scan. Only sets atomic flags, which is safe in a handler.
+ *
+ * param sig - signal number
+ *****************************/
+void
+signal_terminate(int sig)
+{
+    (void)sig;
+    atomic_store(&terminate_wanted, true);
+    if (signal_scan != NULL)
+    {
+        atomic_store(&signal_scan->stop, true);
+    }
+}
+
+
+/****************************
+ * find_boards() - gets the addresses of the MCC 172 boards in the stack
+ *
+ * Uses hat_list() so no user input is needed, unlike select_hat_device().
+ * If there are none, adds message to log file, and quits.
+ *
+ * param found - holds the addresses on return, lowest first
+ * returns - number of boards found, at most SCAN_MAX_BOARDS
+ *****************************/
+int
+find_boards(uint8_t* found)
+{
+    struct HatInfo list[MAX_NUMBER_HATS];
+    int count;
+    int i;
+
+    count = hat_list(HAT_ID_MCC_172, list);
+    if (count <= 0)
+    {
+        add_to_errorlog_quit(ERROR_HAT_SELECT);
+    }
+    if (count > SCAN_MAX_BOARDS)
+    {
+        count = SCAN_MAX_BOARDS;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        found[i] = list[i].address;
+        #ifdef DEBUG_MAIN
+        printf ("main() - find_boards() - MCC 172 at address %d\n", found[i]);
+        #endif
+    }
+    return count;
+}
+
+
 /****************************
  * get_log_file() - get the name and path to the log file
  *
@@ -419,6 +1285,130 @@ utils_gettag_errchk_i(char* filename, char* parameter)
 }
 
 
+/****************************
+ * utils_gettag_choice() - gets a tag value as one of a list of choices from an xml file
+ *
+ * Leading and trailing spaces in the tag value are ignored.
+ * If the tag is not in the file the default choice is returned.
+ * If the value is not one of the choices, adds message to log file,
+ * which will also terminate the program.
+ *
+ * param filename - name of xml file
+ * param parameter - tag we are looking for
+ * param choices - NULL terminated list of allowed values
+ * param default_choice - index returned if the tag is missing
+ * returns - index of the value in choices
+*****************************/
+int
+utils_gettag_choice(char* filename, char* parameter, const char** choices,
+    int default_choice)
+{
+    char buffer[MAX_ARRAY_SIZE] = {0};
+    char value[MAX_ARRAY_SIZE] = {0};
+    int i;
+
+    if (!utils_getxmltag(filename, parameter, buffer) ||
+        (sscanf(buffer, "%199s", value) != 1))
+    {
+        return default_choice;
+    }
+
+    for (i = 0; choices[i] != NULL; i++)
+    {
+        if (strcmp(value, choices[i]) == 0)
+        {
+            return i;
+        }
+    }
+
+    sprintf(buffer, "%s%s\n", ERROR_XMLVALUE, parameter);
+    add_to_errorlog_quit(buffer);
+    return default_choice;
+}
+
+
+/****************************
+ * utils_gettag_channel() - gets the tag of a setting for a channel
+ *
+ * A channel's own tag is the tag with CONFIG_CHANNEL_SUFFIX and the
+ * channel added, eg "sensitivity_ch3". The channels are numbered from 0,
+ * in the order of the columns of the log file.
+ *
+ * param filename - name of xml file
+ * param parameter - tag for all the channels
+ * param channel - channel, 0 to CONFIG_MAX_CHANNELS - 1
+ * param channel_tag - used for the channel's own tag
+ * returns - the channel's own tag if it is in the file, otherwise parameter
+*****************************/
+char*
+utils_gettag_channel(char* filename, char* parameter, int channel,
+    char* channel_tag)
+{
+    char buffer[MAX_ARRAY_SIZE] = {0};
+
+    sprintf(channel_tag, "%s%s%d", parameter, CONFIG_CHANNEL_SUFFIX, channel);
+    return utils_getxmltag(filename, channel_tag, buffer) ? channel_tag : parameter;
+}
+
+
+/****************************
+ * open_log_file() - creates the log file for a scan
+ *
+ * Text log files use the name as it is, binary log files have
+ * BINLOG_FILE_EXT added, and a header describing the scan,
+ * see scan_log_open(). If the log format is none no file is created.
+ * A binary log file has space reserved for the frames of the scan.
+ * If the log has segments set this creates the first, the writer
+ * thread creates the rest.
+ *
+ * If errors, shut down the hardware, add to error log, and quit
+ *
+ * param scan - scan to be logged
+ * param log - log file to create, with its format set
+ * param filename - name of log file, without extension
+ * param sample_format - binary log files only, one of enum binlog_format
+ * param rate - rate of the frames logged
+ * param max_frames - most frames written at a time
+ *****************************/
+void
+open_log_file(struct scan* scan, struct scan_log* log, char* filename,
+    int sample_format, double rate, uint32_t max_frames)
+{
+    char tmp[MAX_ARRAY_SIZE * 2] = {0};
+    uint64_t expected_frames = (uint64_t)(scan->total_samples_wanted * rate /
+        scan->scan_rate + 0.5);
+
+    if (!scan_log_open(scan, log, filename, sample_format, rate, max_frames, 0,
+        expected_frames))
+    {
+        sprintf(tmp, "%s%s\n", ERROR_LOGFILE, filename);
+        shutdown_quit(tmp);
+    }
+}
+
+
+/****************************
+ * close_log_file() - closes the log file for a scan
+ *
+ * If the log is split into segments this is the last one.
+ * If there were any errors writing the file, adds message to log file,
+ * but carries on, as the data written so far is still useful.
+ *
+ * param log - log file of the scan
+ *****************************/
+void
+close_log_file(struct scan_log* log)
+{
+    char tmp[MAX_ARRAY_SIZE * 4] = {0};
+
+    if (!scan_log_close(log))
+    {
+        sprintf(tmp, "%s%s\n", ERROR_FILE_WRITE, log->filename);
+        logger_write(FILE_ERROR_LOG, SUBD_RESULTS, LOGGER_ERROR, tmp);
+    }
+}
+
+
 /****************************
  * stop_if_error() - called to check for errors during scanning
  *
@@ -432,7 +1422,7 @@ stop_if_error(int result)
 {
     if (result != RESULT_SUCCESS)
     {
-        utils_appendtofile(FILE_ERROR_LOG, SUBD_RESULTS, get_err_str(result));
+        logger_write(FILE_ERROR_LOG, SUBD_RESULTS, LOGGER_ERROR, get_err_str(result));
         #ifdef DEBUG_MAIN
         print_error(result);
         #endif
@@ -454,24 +1444,28 @@ void
 iepe_power_off()
 {
     int i = 0;
+    int b = 0;
     int result = 0;
-    for (i = 0; i < num_channels; i++)
+    for (b = 0; b < num_boards; b++)
     {
-        result = mcc172_iepe_config_write(address, channel_array[i], 0);
-        if (result != RESULT_SUCCESS)
+        for (i = 0; i < num_channels; i++)
         {
-            
-            #ifdef DEBUG_MAIN
-            printf("main() - iepe_power_off()\n");
-            print_error(result);
-            #endif
+            result = mcc172_iepe_config_write(addresses[b], channel_array[i], 0);
+            if (result != RESULT_SUCCESS)
+            {
+                
+                #ifdef DEBUG_MAIN
+                printf("main() - iepe_power_off()\n");
+                print_error(result);
+                #endif
+            }
         }
     }
 }
 
 
 /****************************
- * close_mcc172() - shutdown the hardware
+ * close_mcc172() - shutdown the hardware, every board opened
  * 
  * If error appends it to the error log file.
 *****************************/
@@ -480,14 +1474,18 @@ void
 close_mcc172()
 {
     int result = 0;
-    result = mcc172_close(address);
-    if (result != RESULT_SUCCESS)
-    {        
-        utils_appendtofile(FILE_ERROR_LOG, SUBD_RESULTS, get_err_str(result));
-        #ifdef DEBUG_MAIN
-        printf("main() - close_mcc172()\n");
-        print_error(result);
-        #endif
+    int b = 0;
+    for (b = 0; b < num_boards; b++)
+    {
+        result = mcc172_close(addresses[b]);
+        if (result != RESULT_SUCCESS)
+        {        
+            logger_write(FILE_ERROR_LOG, SUBD_RESULTS, LOGGER_ERROR, get_err_str(result));
+            #ifdef DEBUG_MAIN
+            printf("main() - close_mcc172()\n");
+            print_error(result);
+            #endif
+        }
     }
 }
 
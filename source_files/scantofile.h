@@ -18,20 +18,53 @@
 #define SUBD_CONFIG  "./"
 #define FILE_VIB_CONFIG "vib_params"
 #define FILE_ERROR_LOG "errorlog"
+#define FILE_SCAN_REPORT "scanreport"
+#define FILE_STATS "stats"
+#define FILE_SPECTRUM "spectrum"
+#define FILE_ENVELOPE "envelope"
+#define FILE_DECIMATED "decimated"
+#define FILE_PERF "perf"
+#define FILE_EVENT "event"
 
 /* define error Messages */
 #define ERROR_LOGFILE "Error creating log file: "
 #define ERROR_XMLFILE "Error accessing xml file: "
 #define ERROR_XMLTAG "Error accessing xml tag: "
+#define ERROR_XMLVALUE "Error invalid value for xml tag: "
+#define ERROR_XMLTAG_UNKNOWN "Error unknown xml tag: "
+#define ERROR_XMLTAG_TWICE "Error xml tag more than once: "
 #define ERROR_FILE_OPEN "Error opening file: "
 #define ERROR_FILE_READ "Error reading to file: "
 #define ERROR_FILE_WRITE "Error writing to file: "
 #define ERROR_HAT_SELECT "Error selecting hat device"
-#define ERROR_IEPE_POWER "Error IEPE power, invalid selection"
 #define ERROR_IN_ADDR "Error in channel: "
 #define ERROR_HW_OVERRUN "Error hardware overrun\n"
 #define ERROR_SCAN_OVERRUN "Error scan buffer overrun\n"
 #define ERROR_NO_CHANNELS "Error incorrect number of channels: "
+#define ERROR_NO_BOARDS "Error incorrect number of boards: "
+#define ERROR_READ_BUF "Error allocating read buffer\n"
+#define ERROR_THREAD "Error creating scan thread\n"
+#define ERROR_LOGGER "Error creating logger thread\n"
+#define ERROR_OVERRUN_INFO "Before the error: "
+#define ERROR_TRIGGER_TIMEOUT "Error no trigger within the trigger timeout\n"
+
+/* define report messages */
+#define REPORT_RING "Scan complete: "
+#define REPORT_WRITER "writer, "
+#define REPORT_EVENTS "events, "
+
+/* size of the ring blocks mcc172_a_in_scan_read() reads into, in samples per channel,
+ * the blocks are reused for every read so memory use is independent of
+ * the number of samples in the scan
+ */
+#define READ_BUF_SAMPLES 8192
+#define RING_BLOCKS 32                  //has to be a power of 2
+
+/* while waiting for a trigger the status of the master is read this often */
+#define TRIGGER_POLL_USEC 1000
+
+/* in daemon mode the wait for the next capture wakes at least this often, seconds */
+#define DAEMON_WAIT_SEC 1.0
 
 
 /* define tags for xml parameters file */
@@ -42,5 +75,39 @@
 #define PAR_SAMPLES_CHANNEL "samples_per_channel"
 #define PAR_OPTIONS "options"
 #define PAR_NOCHANNELS "number_of_channels"
+#define PAR_NOBOARDS "number_of_boards"
+#define PAR_CAPTURE_SECONDS "capture_seconds"
+#define PAR_READ_MODE "read_mode"
+#define PAR_READ_LATENCY "read_latency"
+#define PAR_LOG_FORMAT "log_format"
+#define PAR_SAMPLE_FORMAT "sample_format"
+#define PAR_STATS_INTERVAL "stats_interval"
+#define PAR_FFT_SIZE "fft_size"
+#define PAR_FFT_OVERLAP "fft_overlap"
+#define PAR_FFT_WINDOW "fft_window"
+#define PAR_ENV_BAND_LOW "envelope_band_low"
+#define PAR_ENV_BAND_HIGH "envelope_band_high"
+#define PAR_ENV_CUTOFF "envelope_cutoff"
+#define PAR_ENV_FFT_SIZE "envelope_fft_size"
+#define PAR_BPFO "bpfo"
+#define PAR_BPFI "bpfi"
+#define PAR_BSF "bsf"
+#define PAR_FTF "ftf"
+#define PAR_DECIMATE_TO "decimate_to"
+#define PAR_FULL_RATE_LOG "full_rate_log"
+#define PAR_DAEMON "daemon"
+#define PAR_CAPTURE_INTERVAL "capture_interval"
+#define PAR_EVENT_TRIGGER "event_trigger"
+#define PAR_EVENT_LEVEL "event_level"
+#define PAR_PRE_TRIGGER "pre_trigger_seconds"
+#define PAR_POST_TRIGGER "post_trigger_seconds"
+#define PAR_EVENT_HOLDOFF "event_holdoff_seconds"
+#define PAR_EVENT_MAX "event_max"
+#define PAR_TRIGGER_SOURCE "trigger_source"
+#define PAR_TRIGGER_MODE "trigger_mode"
+#define PAR_TRIGGER_TIMEOUT "trigger_timeout"
+#define PAR_SEGMENT_SECONDS "segment_seconds"
+#define PAR_SEGMENT_MBYTES "segment_mbytes"
+#define PAR_CHUNK_SECONDS "chunk_seconds"
 
 #endif
@@ -0,0 +1,3 @@
+/* daqhats/daqhats.h - stands in for the installed header, daqhats_utils.h
+ * includes it from the daqhats directory */
+#include "../../../daqhats.h"
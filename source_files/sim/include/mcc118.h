@@ -0,0 +1,4 @@
+/* mcc118.h - not used by scantofile, stands in for the installed header */
+#ifndef _MCC_118_H
+#define _MCC_118_H
+#endif
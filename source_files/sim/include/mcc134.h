@@ -0,0 +1,17 @@
+/* mcc134.h - stands in for the installed header, only the thermocouple
+ * types, which daqhats_utils.h uses */
+#ifndef _MCC_134_H
+#define _MCC_134_H
+enum TcTypes
+{
+    TC_TYPE_J = 0,
+    TC_TYPE_K,
+    TC_TYPE_T,
+    TC_TYPE_E,
+    TC_TYPE_R,
+    TC_TYPE_S,
+    TC_TYPE_B,
+    TC_TYPE_N,
+    TC_DISABLED = 0xFF
+};
+#endif
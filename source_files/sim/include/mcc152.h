@@ -0,0 +1,4 @@
+/* mcc152.h - not used by scantofile, stands in for the installed header */
+#ifndef _MCC_152_H
+#define _MCC_152_H
+#endif
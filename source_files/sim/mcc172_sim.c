@@ -0,0 +1,1069 @@
+/*****************************************
+ * mcc172_sim.c
+ *
+ * Simulated MCC 172 HAT library, a drop in replacement for the
+ * mcc172_* and hat_* functions in libdaqhats, so scantofile can be
+ * run and benchmarked on an ordinary Linux computer without a
+ * Raspberry Pi or a MCC 172 board.
+ *
+ * The simulation is configured with environment variables:
+ *
+ *  MCC172_SIM_BOARDS   number of stacked boards, 1 to 8, default 1
+ *  MCC172_SIM_PACING   "realtime" (default) samples become available at
+ *                      the scan rate, or "fast" all requested samples
+ *                      are available immediately
+ *  MCC172_SIM_SIGNAL   comma separated list of signal components,
+ *                      amplitudes are in volts at the input:
+ *                        sine:<freq>:<amplitude>
+ *                        noise:<rms>
+ *                        bearing:<defect freq>:<resonance freq>:<amplitude>
+ *                      default "sine:100:0.5,noise:0.01"
+ *  MCC172_SIM_FAULT    comma separated list of faults to inject on the
+ *                      n'th call of mcc172_a_in_scan_read():
+ *                        hw_overrun@<n>
+ *                        buffer_overrun@<n>
+ *                        result=<result code>@<n>
+ *  MCC172_SIM_TRIGGER  seconds from the start of the master scan to
+ *                      the external trigger, default 0.1
+ *
+ * Samples are generated when they are read, from the sample index,
+ * so the data is the same for every run with the same settings.
+ *
+ * Built by "make sim", which links it in place of libdaqhats, with the
+ * headers in sim/include in place of the installed daqhats headers.
+ *****************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "daqhats.h"
+
+#define SIM_MAX_BOARDS      MAX_NUMBER_HATS
+#define SIM_NUM_CHANNELS    2
+#define SIM_MAX_COMPONENTS  8
+#define SIM_MAX_FAULTS      8
+#define SIM_BASE_RATE       51200.0
+#define SIM_MAX_CODE        8388607
+#define SIM_MIN_CODE        (-8388608)
+#define SIM_LSB             (5.0 / 8388608.0)
+
+enum sim_component_type
+{
+    SIM_SINE,
+    SIM_NOISE,
+    SIM_BEARING
+};
+
+struct sim_component
+{
+    int type;
+    double freq;            // sine frequency or bearing defect frequency
+    double resonance;       // bearing resonance frequency
+    double amplitude;       // peak volts, or rms volts for noise
+};
+
+enum sim_fault_type
+{
+    SIM_FAULT_HW_OVERRUN,
+    SIM_FAULT_BUFFER_OVERRUN,
+    SIM_FAULT_RESULT
+};
+
+struct sim_fault
+{
+    int type;
+    int result;
+    uint64_t read_no;
+};
+
+struct sim_board
+{
+    int open;
+    uint8_t iepe[SIM_NUM_CHANNELS];
+    double sensitivity[SIM_NUM_CHANNELS];
+    double cal_slope[SIM_NUM_CHANNELS];
+    double cal_offset[SIM_NUM_CHANNELS];
+    uint8_t clock_source;
+    double rate;
+    uint8_t trigger_source;
+    uint8_t trigger_mode;
+
+    /* scan state */
+    int active;
+    int running;
+    uint8_t channel_mask;
+    int num_channels;
+    int channels[SIM_NUM_CHANNELS];
+    uint32_t options;
+    uint32_t buffer_per_channel;
+    uint64_t finite_total;      // 0 in continuous mode
+    double start_time;          // time the first sample is acquired
+    uint64_t frames_read;
+    uint64_t frames_stopped;    // frames produced when the scan stopped
+    uint16_t status_latched;
+    uint64_t reads;
+    uint64_t noise_state[SIM_NUM_CHANNELS];
+};
+
+static struct sim_board boards[SIM_MAX_BOARDS];
+static int num_boards = -1;
+static int fast_pacing = 0;
+static double trigger_delay = 0.1;
+static double master_trigger_time = -1.0;
+static struct sim_component components[SIM_MAX_COMPONENTS];
+static int num_components = 0;
+static struct sim_fault faults[SIM_MAX_FAULTS];
+static int num_faults = 0;
+
+static struct MCC172DeviceInfo device_info =
+{
+    SIM_NUM_CHANNELS,
+    SIM_MIN_CODE,
+    SIM_MAX_CODE,
+    -5.0,
+    5.0 - SIM_LSB,
+    -5.0,
+    5.0
+};
+
+
+/****************************
+ * sim_now() - monotonic time in seconds
+ ****************************/
+static double
+sim_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+/****************************
+ * sim_parse_signal() - parse MCC172_SIM_SIGNAL into components
+ ****************************/
+static void
+sim_parse_signal(const char* spec)
+{
+    char buffer[512];
+    char* save = NULL;
+    char* item;
+
+    strncpy(buffer, spec, sizeof(buffer) - 1);
+    buffer[sizeof(buffer) - 1] = '\0';
+    num_components = 0;
+
+    for (item = strtok_r(buffer, ",", &save);
+         item != NULL && num_components < SIM_MAX_COMPONENTS;
+         item = strtok_r(NULL, ",", &save))
+    {
+        struct sim_component* c = &components[num_components];
+        memset(c, 0, sizeof(*c));
+        if (sscanf(item, "sine:%lf:%lf", &c->freq, &c->amplitude) == 2)
+        {
+            c->type = SIM_SINE;
+        }
+        else if (sscanf(item, "noise:%lf", &c->amplitude) == 1)
+        {
+            c->type = SIM_NOISE;
+        }
+        else if (sscanf(item, "bearing:%lf:%lf:%lf", &c->freq, &c->resonance,
+            &c->amplitude) == 3)
+        {
+            c->type = SIM_BEARING;
+        }
+        else
+        {
+            fprintf(stderr, "mcc172_sim: ignoring signal component %s\n", item);
+            continue;
+        }
+        num_components++;
+    }
+}
+
+
+/****************************
+ * sim_parse_faults() - parse MCC172_SIM_FAULT into faults
+ ****************************/
+static void
+sim_parse_faults(const char* spec)
+{
+    char buffer[512];
+    char* save = NULL;
+    char* item;
+    unsigned long long n;
+    int code;
+
+    strncpy(buffer, spec, sizeof(buffer) - 1);
+    buffer[sizeof(buffer) - 1] = '\0';
+    num_faults = 0;
+
+    for (item = strtok_r(buffer, ",", &save);
+         item != NULL && num_faults < SIM_MAX_FAULTS;
+         item = strtok_r(NULL, ",", &save))
+    {
+        struct sim_fault* f = &faults[num_faults];
+        if (sscanf(item, "hw_overrun@%llu", &n) == 1)
+        {
+            f->type = SIM_FAULT_HW_OVERRUN;
+        }
+        else if (sscanf(item, "buffer_overrun@%llu", &n) == 1)
+        {
+            f->type = SIM_FAULT_BUFFER_OVERRUN;
+        }
+        else if (sscanf(item, "result=%d@%llu", &code, &n) == 2)
+        {
+            f->type = SIM_FAULT_RESULT;
+            f->result = code;
+        }
+        else
+        {
+            fprintf(stderr, "mcc172_sim: ignoring fault %s\n", item);
+            continue;
+        }
+        f->read_no = n;
+        num_faults++;
+    }
+}
+
+
+/****************************
+ * sim_init() - read the simulation settings, once
+ ****************************/
+static void
+sim_init(void)
+{
+    char* s;
+    int b, ch;
+
+    if (num_boards >= 0)
+    {
+        return;
+    }
+
+    num_boards = 1;
+    s = getenv("MCC172_SIM_BOARDS");
+    if (s != NULL)
+    {
+        num_boards = atoi(s);
+        if (num_boards < 0) num_boards = 0;
+        if (num_boards > SIM_MAX_BOARDS) num_boards = SIM_MAX_BOARDS;
+    }
+
+    s = getenv("MCC172_SIM_PACING");
+    fast_pacing = (s != NULL) && (strcmp(s, "fast") == 0);
+
+    s = getenv("MCC172_SIM_TRIGGER");
+    if (s != NULL)
+    {
+        trigger_delay = strtod(s, NULL);
+    }
+
+    s = getenv("MCC172_SIM_SIGNAL");
+    sim_parse_signal(s != NULL ? s : "sine:100:0.5,noise:0.01");
+
+    s = getenv("MCC172_SIM_FAULT");
+    if (s != NULL)
+    {
+        sim_parse_faults(s);
+    }
+
+    for (b = 0; b < SIM_MAX_BOARDS; b++)
+    {
+        for (ch = 0; ch < SIM_NUM_CHANNELS; ch++)
+        {
+            // small, fixed calibration errors, so raw data differs from scaled
+            boards[b].cal_slope[ch] = 1.0 + 0.0005 * (b * SIM_NUM_CHANNELS + ch + 1);
+            boards[b].cal_offset[ch] = 10.0 * (ch + 1);
+        }
+    }
+}
+
+
+/****************************
+ * sim_board() - get an open board, or NULL if not open
+ ****************************/
+static struct sim_board*
+sim_board(uint8_t address)
+{
+    sim_init();
+    if ((address >= num_boards) || !boards[address].open)
+    {
+        return NULL;
+    }
+    return &boards[address];
+}
+
+
+/****************************
+ * sim_frames_produced() - number of frames acquired so far by a scan
+ ****************************/
+static uint64_t
+sim_frames_produced(struct sim_board* board)
+{
+    uint64_t produced;
+    double start = board->start_time;
+
+    if (!board->running)
+    {
+        return board->frames_stopped;
+    }
+
+    if (board->options & OPTS_EXTTRIGGER)
+    {
+        // triggered boards start acquiring at the master trigger,
+        // nothing is available before it, even when pacing is fast
+        if ((master_trigger_time < 0.0) || (sim_now() < master_trigger_time))
+        {
+            return 0;
+        }
+        start = master_trigger_time;
+    }
+
+    if (fast_pacing)
+    {
+        // everything up to the end of the scan, or a buffer full, is available
+        produced = board->frames_read + board->buffer_per_channel;
+    }
+    else
+    {
+        double elapsed = sim_now() - start;
+        produced = (elapsed > 0.0) ? (uint64_t)(elapsed * board->rate) : 0;
+    }
+
+    if (board->finite_total && (produced >= board->finite_total))
+    {
+        produced = board->finite_total;
+        board->frames_stopped = produced;
+        board->running = 0;
+    }
+    else if (produced - board->frames_read > board->buffer_per_channel)
+    {
+        // not read fast enough, data lost
+        board->status_latched |= STATUS_BUFFER_OVERRUN;
+        produced = board->frames_read + board->buffer_per_channel;
+        board->frames_stopped = produced;
+        board->running = 0;
+    }
+    return produced;
+}
+
+
+/****************************
+ * sim_noise() - gaussian noise from a per channel xorshift generator
+ ****************************/
+static double
+sim_noise(uint64_t* state)
+{
+    double u1, u2;
+    uint64_t x;
+
+    x = *state;
+    x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+    u1 = ((x >> 11) + 1.0) / 9007199254740993.0;
+    x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+    u2 = (x >> 11) / 9007199254740992.0;
+    *state = x;
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+
+/****************************
+ * sim_volts() - input voltage of a channel at a sample index
+ ****************************/
+static double
+sim_volts(struct sim_board* board, int channel, uint64_t index,
+    int board_no)
+{
+    double t = index / board->rate;
+    double v = 0.0;
+    double phase = 0.3 * (board_no * SIM_NUM_CHANNELS + channel);
+    int i;
+
+    for (i = 0; i < num_components; i++)
+    {
+        struct sim_component* c = &components[i];
+        switch (c->type)
+        {
+            case SIM_SINE:
+                v += c->amplitude * sin(2.0 * M_PI * c->freq * t + phase);
+                break;
+
+            case SIM_NOISE:
+                v += c->amplitude * sim_noise(&board->noise_state[channel]);
+                break;
+
+            case SIM_BEARING:
+            {
+                // decaying resonance excited once per defect period
+                double tp = fmod(t, 1.0 / c->freq);
+                v += c->amplitude * exp(-tp * c->resonance / 8.0) *
+                    sin(2.0 * M_PI * c->resonance * tp);
+                break;
+            }
+        }
+    }
+    return v;
+}
+
+
+/****************************
+ * sim_fill() - generate frames into a user buffer
+ ****************************/
+static void
+sim_fill(struct sim_board* board, int board_no, double* buffer,
+    uint32_t frames)
+{
+    uint32_t i;
+    int c;
+
+    for (i = 0; i < frames; i++)
+    {
+        uint64_t index = board->frames_read + i;
+        for (c = 0; c < board->num_channels; c++)
+        {
+            int ch = board->channels[c];
+            double volts = sim_volts(board, ch, index, board_no);
+            double value;
+
+            if (board->options & OPTS_NOSCALEDATA)
+            {
+                // ADC code, the library removes calibration as (code - offset) * slope
+                double code = volts / SIM_LSB;
+                if (board->options & OPTS_NOCALIBRATEDATA)
+                {
+                    code = code / board->cal_slope[ch] + board->cal_offset[ch];
+                }
+                code = floor(code + 0.5);
+                if (code > SIM_MAX_CODE) code = SIM_MAX_CODE;
+                if (code < SIM_MIN_CODE) code = SIM_MIN_CODE;
+                value = code;
+            }
+            else
+            {
+                if (board->options & OPTS_NOCALIBRATEDATA)
+                {
+                    volts = (volts / SIM_LSB / board->cal_slope[ch] +
+                        board->cal_offset[ch]) * SIM_LSB;
+                }
+                value = volts * 1000.0 / board->sensitivity[ch];
+            }
+            buffer[i * board->num_channels + c] = value;
+        }
+    }
+}
+
+
+/****************************
+ * sim_status() - current scan status flags
+ ****************************/
+static uint16_t
+sim_status(struct sim_board* board)
+{
+    uint16_t status = board->status_latched;
+
+    if (board->running)
+    {
+        status |= STATUS_RUNNING;
+    }
+    if (!(board->options & OPTS_EXTTRIGGER) ||
+        ((master_trigger_time >= 0.0) && (sim_now() >= master_trigger_time)))
+    {
+        status |= STATUS_TRIGGERED;
+    }
+    return status;
+}
+
+
+/*****************************************
+ * hat_* functions
+ *****************************************/
+
+int
+hat_list(uint16_t filter_id, struct HatInfo* list)
+{
+    int i;
+
+    sim_init();
+    if ((filter_id != HAT_ID_ANY) && (filter_id != HAT_ID_MCC_172))
+    {
+        return 0;
+    }
+    if (list != NULL)
+    {
+        for (i = 0; i < num_boards; i++)
+        {
+            list[i].address = i;
+            list[i].id = HAT_ID_MCC_172;
+            list[i].version = 1;
+            strcpy(list[i].product_name, "MCC 172 (simulated)");
+        }
+    }
+    return num_boards;
+}
+
+const char*
+hat_error_message(int result)
+{
+    switch (result)
+    {
+        case RESULT_SUCCESS:          return "Success.";
+        case RESULT_BAD_PARAMETER:    return "A parameter passed to the function was incorrect.";
+        case RESULT_BUSY:             return "The device is busy.";
+        case RESULT_TIMEOUT:          return "There was a timeout accessing a resource.";
+        case RESULT_LOCK_TIMEOUT:     return "There was a timeout while obtaining a resource lock.";
+        case RESULT_INVALID_DEVICE:   return "The device at the specified address is not the correct type.";
+        case RESULT_RESOURCE_UNAVAIL: return "A needed resource was not available.";
+        case RESULT_COMMS_FAILURE:    return "Could not communicate with the device.";
+        default:                      return "Unknown error.";
+    }
+}
+
+/* the MCC 172 does not generate interrupts, as on the real hardware
+ * the interrupt never becomes active */
+int
+hat_interrupt_state(void)
+{
+    return 0;
+}
+
+int
+hat_wait_for_interrupt(int timeout)
+{
+    if (timeout < 0)
+    {
+        pause();
+    }
+    else
+    {
+        usleep(timeout * 1000);
+    }
+    return RESULT_TIMEOUT;
+}
+
+int
+hat_interrupt_callback_enable(void (*function)(void*), void* user_data)
+{
+    (void)function;
+    (void)user_data;
+    return RESULT_SUCCESS;
+}
+
+int
+hat_interrupt_callback_disable(void)
+{
+    return RESULT_SUCCESS;
+}
+
+
+/*****************************************
+ * mcc172_* functions
+ *****************************************/
+
+int
+mcc172_open(uint8_t address)
+{
+    int ch;
+
+    sim_init();
+    if (address >= num_boards)
+    {
+        return RESULT_INVALID_DEVICE;
+    }
+    struct sim_board* board = &boards[address];
+    if (!board->open)
+    {
+        board->open = 1;
+        board->clock_source = SOURCE_LOCAL;
+        board->rate = SIM_BASE_RATE;
+        board->trigger_source = SOURCE_LOCAL;
+        board->trigger_mode = TRIG_RISING_EDGE;
+        for (ch = 0; ch < SIM_NUM_CHANNELS; ch++)
+        {
+            board->iepe[ch] = 0;
+            board->sensitivity[ch] = 1000.0;
+        }
+    }
+    return RESULT_SUCCESS;
+}
+
+int
+mcc172_is_open(uint8_t address)
+{
+    return sim_board(address) != NULL;
+}
+
+int
+mcc172_close(uint8_t address)
+{
+    struct sim_board* board = sim_board(address);
+    if (board == NULL)
+    {
+        return RESULT_SUCCESS;
+    }
+    board->open = 0;
+    board->active = 0;
+    board->running = 0;
+    return RESULT_SUCCESS;
+}
+
+struct MCC172DeviceInfo*
+mcc172_info(void)
+{
+    return &device_info;
+}
+
+int
+mcc172_blink_led(uint8_t address, uint8_t count)
+{
+    (void)count;
+    return sim_board(address) ? RESULT_SUCCESS : RESULT_BAD_PARAMETER;
+}
+
+int
+mcc172_firmware_version(uint8_t address, uint16_t* version)
+{
+    if ((sim_board(address) == NULL) || (version == NULL))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+    *version = 0x0100;
+    return RESULT_SUCCESS;
+}
+
+int
+mcc172_serial(uint8_t address, char* buffer)
+{
+    if ((sim_board(address) == NULL) || (buffer == NULL))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+    sprintf(buffer, "SIM0000%d", address);
+    return RESULT_SUCCESS;
+}
+
+int
+mcc172_calibration_date(uint8_t address, char* buffer)
+{
+    if ((sim_board(address) == NULL) || (buffer == NULL))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+    strcpy(buffer, "2020-01-01");
+    return RESULT_SUCCESS;
+}
+
+int
+mcc172_calibration_coefficient_read(uint8_t address, uint8_t channel,
+    double* slope, double* offset)
+{
+    struct sim_board* board = sim_board(address);
+    if ((board == NULL) || (channel >= SIM_NUM_CHANNELS) ||
+        (slope == NULL) || (offset == NULL))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+    *slope = board->cal_slope[channel];
+    *offset = board->cal_offset[channel];
+    return RESULT_SUCCESS;
+}
+
+int
+mcc172_calibration_coefficient_write(uint8_t address, uint8_t channel,
+    double slope, double offset)
+{
+    struct sim_board* board = sim_board(address);
+    if ((board == NULL) || (channel >= SIM_NUM_CHANNELS))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+    if (board->running)
+    {
+        return RESULT_BUSY;
+    }
+    board->cal_slope[channel] = slope;
+    board->cal_offset[channel] = offset;
+    return RESULT_SUCCESS;
+}
+
+int
+mcc172_iepe_config_read(uint8_t address, uint8_t channel, uint8_t* config)
+{
+    struct sim_board* board = sim_board(address);
+    if ((board == NULL) || (channel >= SIM_NUM_CHANNELS) || (config == NULL))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+    *config = board->iepe[channel];
+    return RESULT_SUCCESS;
+}
+
+int
+mcc172_iepe_config_write(uint8_t address, uint8_t channel, uint8_t config)
+{
+    struct sim_board* board = sim_board(address);
+    if ((board == NULL) || (channel >= SIM_NUM_CHANNELS) || (config > 1))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+    if (board->running)
+    {
+        return RESULT_BUSY;
+    }
+    board->iepe[channel] = config;
+    return RESULT_SUCCESS;
+}
+
+int
+mcc172_a_in_sensitivity_read(uint8_t address, uint8_t channel, double* value)
+{
+    struct sim_board* board = sim_board(address);
+    if ((board == NULL) || (channel >= SIM_NUM_CHANNELS) || (value == NULL))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+    *value = board->sensitivity[channel];
+    return RESULT_SUCCESS;
+}
+
+int
+mcc172_a_in_sensitivity_write(uint8_t address, uint8_t channel, double value)
+{
+    struct sim_board* board = sim_board(address);
+    if ((board == NULL) || (channel >= SIM_NUM_CHANNELS) || (value <= 0.0))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+    if (board->running)
+    {
+        return RESULT_BUSY;
+    }
+    board->sensitivity[channel] = value;
+    return RESULT_SUCCESS;
+}
+
+int
+mcc172_a_in_clock_config_read(uint8_t address, uint8_t* clock_source,
+    double* sample_rate_per_channel, uint8_t* synced)
+{
+    struct sim_board* board = sim_board(address);
+    if ((board == NULL) || (clock_source == NULL) ||
+        (sample_rate_per_channel == NULL) || (synced == NULL))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+    *clock_source = board->clock_source;
+    *sample_rate_per_channel = board->rate;
+    *synced = 1;
+    return RESULT_SUCCESS;
+}
+
+int
+mcc172_a_in_clock_config_write(uint8_t address, uint8_t clock_source,
+    double sample_rate_per_channel)
+{
+    struct sim_board* board = sim_board(address);
+    double divisor;
+
+    if ((board == NULL) || (clock_source > SOURCE_SLAVE) ||
+        (sample_rate_per_channel <= 0.0))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+    if (board->running)
+    {
+        return RESULT_BUSY;
+    }
+
+    // 51.2 kHz divided by an integer between 1 and 256
+    divisor = floor(SIM_BASE_RATE / sample_rate_per_channel + 0.5);
+    if (divisor < 1.0) divisor = 1.0;
+    if (divisor > 256.0) divisor = 256.0;
+
+    board->clock_source = clock_source;
+    board->rate = SIM_BASE_RATE / divisor;
+    return RESULT_SUCCESS;
+}
+
+int
+mcc172_trigger_config(uint8_t address, uint8_t source, uint8_t mode)
+{
+    struct sim_board* board = sim_board(address);
+    if ((board == NULL) || (source > SOURCE_SLAVE) ||
+        (mode > TRIG_ACTIVE_LOW))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+    if (board->running)
+    {
+        return RESULT_BUSY;
+    }
+    board->trigger_source = source;
+    board->trigger_mode = mode;
+    return RESULT_SUCCESS;
+}
+
+int
+mcc172_a_in_scan_start(uint8_t address, uint8_t channel_mask,
+    uint32_t samples_per_channel, uint32_t options)
+{
+    struct sim_board* board = sim_board(address);
+    int ch;
+
+    if ((board == NULL) || (channel_mask == 0) || (channel_mask > 0x03) ||
+        (options & OPTS_EXTCLOCK))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+    if (board->active)
+    {
+        return RESULT_BUSY;
+    }
+    if (!(options & OPTS_CONTINUOUS) && (samples_per_channel == 0))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+
+    board->channel_mask = channel_mask;
+    board->num_channels = 0;
+    for (ch = 0; ch < SIM_NUM_CHANNELS; ch++)
+    {
+        if (channel_mask & (1 << ch))
+        {
+            board->channels[board->num_channels++] = ch;
+        }
+        board->noise_state[ch] = 0x9E3779B97F4A7C15ULL ^
+            ((uint64_t)(address * SIM_NUM_CHANNELS + ch + 1) << 32);
+    }
+    board->options = options;
+
+    if (options & OPTS_CONTINUOUS)
+    {
+        uint32_t minimum;
+        if (board->rate <= 1024.0) minimum = 1000;
+        else if (board->rate <= 10240.0) minimum = 10000;
+        else minimum = 100000;
+        board->buffer_per_channel = (samples_per_channel > minimum) ?
+            samples_per_channel : minimum;
+        board->finite_total = 0;
+    }
+    else
+    {
+        board->buffer_per_channel = samples_per_channel;
+        board->finite_total = samples_per_channel;
+    }
+
+    board->active = 1;
+    board->running = 1;
+    board->frames_read = 0;
+    board->frames_stopped = 0;
+    board->status_latched = 0;
+    board->reads = 0;
+    board->start_time = sim_now();
+
+    // the master, or a board with its own trigger, fires the trigger
+    if ((options & OPTS_EXTTRIGGER) && (board->trigger_source != SOURCE_SLAVE))
+    {
+        master_trigger_time = board->start_time + trigger_delay;
+    }
+    return RESULT_SUCCESS;
+}
+
+int
+mcc172_a_in_scan_buffer_size(uint8_t address, uint32_t* buffer_size_samples)
+{
+    struct sim_board* board = sim_board(address);
+    if ((board == NULL) || (buffer_size_samples == NULL))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+    if (!board->active)
+    {
+        return RESULT_RESOURCE_UNAVAIL;
+    }
+    *buffer_size_samples = board->buffer_per_channel * board->num_channels;
+    return RESULT_SUCCESS;
+}
+
+int
+mcc172_a_in_scan_status(uint8_t address, uint16_t* status,
+    uint32_t* samples_per_channel)
+{
+    struct sim_board* board = sim_board(address);
+    if (board == NULL)
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+    if (!board->active)
+    {
+        return RESULT_RESOURCE_UNAVAIL;
+    }
+    uint64_t available = sim_frames_produced(board) - board->frames_read;
+    if (status != NULL)
+    {
+        *status = sim_status(board);
+    }
+    if (samples_per_channel != NULL)
+    {
+        *samples_per_channel = (uint32_t)available;
+    }
+    return RESULT_SUCCESS;
+}
+
+int
+mcc172_a_in_scan_read(uint8_t address, uint16_t* status,
+    int32_t samples_per_channel, double timeout, double* buffer,
+    uint32_t buffer_size_samples, uint32_t* samples_read_per_channel)
+{
+    struct sim_board* board = sim_board(address);
+    uint64_t available;
+    uint32_t max_frames;
+    uint32_t frames;
+    int i;
+
+    if ((board == NULL) || (status == NULL) ||
+        ((buffer == NULL) && (samples_per_channel != 0)))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+    if (!board->active)
+    {
+        return RESULT_RESOURCE_UNAVAIL;
+    }
+
+    board->reads++;
+    for (i = 0; i < num_faults; i++)
+    {
+        if (faults[i].read_no != board->reads)
+        {
+            continue;
+        }
+        switch (faults[i].type)
+        {
+            case SIM_FAULT_HW_OVERRUN:
+                board->status_latched |= STATUS_HW_OVERRUN;
+                board->frames_stopped = board->frames_read;
+                board->running = 0;
+                break;
+            case SIM_FAULT_BUFFER_OVERRUN:
+                board->status_latched |= STATUS_BUFFER_OVERRUN;
+                board->frames_stopped = board->frames_read;
+                board->running = 0;
+                break;
+            case SIM_FAULT_RESULT:
+                return faults[i].result;
+        }
+    }
+
+    max_frames = buffer_size_samples / board->num_channels;
+    if ((samples_per_channel >= 0) && ((uint32_t)samples_per_channel < max_frames))
+    {
+        max_frames = samples_per_channel;
+    }
+
+    available = sim_frames_produced(board) - board->frames_read;
+
+    // wait for the requested number of samples, or the timeout
+    if ((samples_per_channel > 0) && (available < max_frames) && (timeout != 0.0))
+    {
+        double end = sim_now() + timeout;
+        while ((available < max_frames) && board->running &&
+               ((timeout < 0.0) || (sim_now() < end)))
+        {
+            double wait = (max_frames - available) / board->rate;
+            if (wait > 0.01) wait = 0.01;
+            if (wait < 0.0005) wait = 0.0005;
+            usleep((useconds_t)(wait * 1e6));
+            available = sim_frames_produced(board) - board->frames_read;
+        }
+    }
+
+    frames = (available < max_frames) ? (uint32_t)available : max_frames;
+    sim_fill(board, address, buffer, frames);
+    board->frames_read += frames;
+
+    *status = sim_status(board);
+    if (samples_read_per_channel != NULL)
+    {
+        *samples_read_per_channel = frames;
+    }
+    if ((samples_per_channel > 0) && (frames < (uint32_t)samples_per_channel) &&
+        (timeout != 0.0) && board->running &&
+        (frames < buffer_size_samples / board->num_channels))
+    {
+        return RESULT_TIMEOUT;
+    }
+    return RESULT_SUCCESS;
+}
+
+int
+mcc172_a_in_scan_stop(uint8_t address)
+{
+    struct sim_board* board = sim_board(address);
+    if (board == NULL)
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+    if (board->running)
+    {
+        board->frames_stopped = sim_frames_produced(board);
+        board->running = 0;
+    }
+    return RESULT_SUCCESS;
+}
+
+int
+mcc172_a_in_scan_cleanup(uint8_t address)
+{
+    struct sim_board* board = sim_board(address);
+    if (board == NULL)
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+    board->active = 0;
+    board->running = 0;
+    if (board->options & OPTS_EXTTRIGGER)
+    {
+        master_trigger_time = -1.0;
+    }
+    return RESULT_SUCCESS;
+}
+
+int
+mcc172_a_in_scan_channel_count(uint8_t address)
+{
+    struct sim_board* board = sim_board(address);
+    if ((board == NULL) || !board->active)
+    {
+        return 0;
+    }
+    return board->num_channels;
+}
+
+int
+mcc172_test_signals_read(uint8_t address, uint8_t* clock, uint8_t* sync,
+    uint8_t* trigger)
+{
+    if ((sim_board(address) == NULL) || (clock == NULL) || (sync == NULL) ||
+        (trigger == NULL))
+    {
+        return RESULT_BAD_PARAMETER;
+    }
+    *clock = 0;
+    *sync = 1;
+    *trigger = 0;
+    return RESULT_SUCCESS;
+}
+
+int
+mcc172_test_signals_write(uint8_t address, uint8_t mode, uint8_t clock,
+    uint8_t sync)
+{
+    (void)mode;
+    (void)clock;
+    (void)sync;
+    return sim_board(address) ? RESULT_SUCCESS : RESULT_BAD_PARAMETER;
+}
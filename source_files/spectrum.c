@@ -0,0 +1,445 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "spectrum.h"
+#include "dsp.h"
+
+/* flat top window coefficients, as in scipy.signal.windows.flattop */
+#define FLATTOP_A0 0.21557895
+#define FLATTOP_A1 0.41663158
+#define FLATTOP_A2 0.277263158
+#define FLATTOP_A3 0.083578947
+#define FLATTOP_A4 0.006947368
+
+/* local function declarations */
+static void spectrum_segment(struct spectrum*, int);
+
+/*****************************
+ * spectrum_open() - sets up the spectrum of a scan
+ *
+ * Each channel is split into segments of size samples, which overlap,
+ * each segment is windowed and transformed, and the power of each
+ * frequency is averaged over all the segments, as in Welch's method.
+ * The window, twiddle factors and buffers are worked out once here,
+ * so adding samples does not allocate any memory.
+ *
+ * Any errors return false, otherwise return true
+ *
+ * param sp - spectrum to set up
+ * param num_channels - number of channels in each frame
+ * param size - samples in each segment, a power of 2
+ * param overlap - fraction of a segment shared with the next one
+ * param window - one of enum spectrum_window
+ * param scan_rate - actual scan rate per channel
+ * returns - false if a parameter is not valid or error allocating memory
+****************************/
+
+bool
+spectrum_open(struct spectrum* sp, int num_channels, uint32_t size,
+    double overlap, int window, double scan_rate)
+{
+    uint32_t half = size / 2;
+    uint32_t bits = 0;
+    uint32_t i, j;
+    int ch;
+
+    memset(sp, 0, sizeof(*sp));
+    if ((num_channels < 1) || (num_channels > SPECTRUM_MAX_CHANNELS) ||
+        (size < SPECTRUM_MIN_SIZE) || (size > SPECTRUM_MAX_SIZE) ||
+        (size & (size - 1)) || (overlap < 0.0) ||
+        (overlap >= SPECTRUM_MAX_OVERLAP))
+    {
+        return false;
+    }
+
+    sp->num_channels = num_channels;
+    sp->size = size;
+    sp->hop = size - (uint32_t)(overlap * size);
+    sp->window = window;
+    sp->scan_rate = scan_rate;
+
+    sp->coeffs = malloc(sizeof(double) * size);
+    sp->twiddles = malloc(sizeof(double) * size);
+    sp->bitrev = malloc(sizeof(uint32_t) * half);
+    sp->work = malloc(sizeof(double) * size);
+    if ((sp->coeffs == NULL) || (sp->twiddles == NULL) ||
+        (sp->bitrev == NULL) || (sp->work == NULL))
+    {
+        spectrum_free(sp);
+        return false;
+    }
+    for (ch = 0; ch < num_channels; ch++)
+    {
+        sp->segments[ch] = malloc(sizeof(double) * size);
+        sp->psd[ch] = calloc(half + 1, sizeof(double));
+        if ((sp->segments[ch] == NULL) || (sp->psd[ch] == NULL))
+        {
+            spectrum_free(sp);
+            return false;
+        }
+    }
+
+    //periodic windows, as used for spectral analysis
+    for (i = 0; i < size; i++)
+    {
+        double x = 2.0 * M_PI * i / size;
+        if (window == WINDOW_FLATTOP)
+        {
+            sp->coeffs[i] = FLATTOP_A0 - FLATTOP_A1 * cos(x) +
+                FLATTOP_A2 * cos(2.0 * x) - FLATTOP_A3 * cos(3.0 * x) +
+                FLATTOP_A4 * cos(4.0 * x);
+        }
+        else
+        {
+            sp->coeffs[i] = 0.5 - 0.5 * cos(x);
+        }
+        sp->window_power += sp->coeffs[i] * sp->coeffs[i];
+    }
+
+    for (i = 0; i < half; i++)
+    {
+        sp->twiddles[2 * i] = cos(2.0 * M_PI * i / size);
+        sp->twiddles[2 * i + 1] = -sin(2.0 * M_PI * i / size);
+    }
+
+    while ((1u << bits) < half)
+    {
+        bits++;
+    }
+    for (i = 0; i < half; i++)
+    {
+        uint32_t r = 0;
+        for (j = 0; j < bits; j++)
+        {
+            r |= ((i >> j) & 1) << (bits - 1 - j);
+        }
+        sp->bitrev[i] = r;
+    }
+    return true;
+}
+
+
+/*****************************
+ * spectrum_add() - adds frames of samples to the spectrum
+ *
+ * The samples of each channel are copied into its segment, and when
+ * a segment is full it is transformed. The last size - hop samples
+ * are kept as the start of the next segment.
+ *
+ * param sp - spectrum of the scan
+ * param data - samples, num_channels per frame
+ * param frames - number of frames
+****************************/
+
+void
+spectrum_add(struct spectrum* sp, const double* data, uint32_t frames)
+{
+    uint32_t n;
+    int ch;
+
+    while (frames > 0)
+    {
+        n = sp->size - sp->fill;
+        if (n > frames)
+        {
+            n = frames;
+        }
+
+        for (ch = 0; ch < sp->num_channels; ch++)
+        {
+            dsp_deinterleave(sp->segments[ch] + sp->fill, data, n,
+                sp->num_channels, ch);
+        }
+        sp->fill += n;
+        data += (size_t)n * sp->num_channels;
+        frames -= n;
+
+        if (sp->fill == sp->size)
+        {
+            for (ch = 0; ch < sp->num_channels; ch++)
+            {
+                spectrum_segment(sp, ch);
+                memmove(sp->segments[ch], sp->segments[ch] + sp->hop,
+                    sizeof(double) * (sp->size - sp->hop));
+            }
+            sp->fill = sp->size - sp->hop;
+            sp->count++;
+        }
+    }
+}
+
+
+/*****************************
+ * spectrum_write() - writes the averaged spectrum to a file
+ *
+ * Any errors return false, otherwise return true
+ *
+ * param sp - spectrum of the scan
+ * param filename - name of file, including path
+ * returns - false if error writing the file
+****************************/
+
+bool
+spectrum_write(struct spectrum* sp, char* filename)
+{
+    bool ok;
+
+    FILE* fp = fopen(filename, "w");
+    if (fp == NULL)
+    {
+        return false;
+    }
+    ok = spectrum_print(sp, fp);
+    if (fclose(fp) != 0)
+    {
+        ok = false;
+    }
+    return ok;
+}
+
+
+/*****************************
+ * spectrum_print() - writes the averaged spectrum to an open file
+ *
+ * The power spectral density is one sided, in units squared per Hz,
+ * the units being those of the samples. A line for each frequency,
+ * with a column for each channel.
+ *
+ * Any errors return false, otherwise return true
+ *
+ * param sp - spectrum of the scan
+ * param fp - file to write to
+ * returns - false if error writing the file
+****************************/
+
+bool
+spectrum_print(struct spectrum* sp, FILE* fp)
+{
+    uint32_t half = sp->size / 2;
+    double resolution = sp->scan_rate / sp->size;
+    bool ok = true;
+    uint32_t k;
+    int ch;
+
+    if (fprintf(fp, "# scan rate %.3f, fft size %u, overlap %u, window %s\n"
+        "# %llu segments, resolution %.6f Hz, power spectral density in units^2/Hz\n"
+        "# frequency", sp->scan_rate, sp->size, sp->size - sp->hop,
+        (sp->window == WINDOW_FLATTOP) ? "flattop" : "hann",
+        (unsigned long long)sp->count, resolution) < 0)
+    {
+        ok = false;
+    }
+    for (ch = 0; ch < sp->num_channels; ch++)
+    {
+        fprintf(fp, ", channel %d", ch);
+    }
+    fprintf(fp, "\n");
+
+    for (k = 0; (sp->count > 0) && (k <= half); k++)
+    {
+        if (fprintf(fp, "%.6f", k * resolution) < 0)
+        {
+            ok = false;
+        }
+        for (ch = 0; ch < sp->num_channels; ch++)
+        {
+            fprintf(fp, ", %.6e", spectrum_density(sp, ch, k));
+        }
+        fprintf(fp, "\n");
+    }
+    return ok;
+}
+
+
+/*****************************
+ * spectrum_density() - averaged power spectral density at a frequency
+ *
+ * The density of a segment is |X|^2 / (fs * sum w^2), doubled
+ * for all but the first and last frequencies, as it is one sided.
+ *
+ * param sp - spectrum of the scan
+ * param ch - channel
+ * param k - index of the frequency, 0 to size / 2
+ * returns - density in units squared per Hz, 0 if no segments yet
+****************************/
+
+double
+spectrum_density(struct spectrum* sp, int ch, uint32_t k)
+{
+    double side = ((k == 0) || (k == sp->size / 2)) ? 1.0 : 2.0;
+
+    if (sp->count == 0)
+    {
+        return 0.0;
+    }
+    return sp->psd[ch][k] * side /
+        (sp->scan_rate * sp->window_power * sp->count);
+}
+
+
+/*****************************
+ * spectrum_amplitude() - RMS amplitude of a tone in the spectrum
+ *
+ * The window spreads a tone over a few frequencies, so the density
+ * is summed over SPECTRUM_TONE_BINS either side of the nearest one.
+ *
+ * param sp - spectrum of the scan
+ * param ch - channel
+ * param freq - frequency of the tone in Hz
+ * returns - RMS amplitude in units, 0 if the frequency is out of range
+****************************/
+
+double
+spectrum_amplitude(struct spectrum* sp, int ch, double freq)
+{
+    double resolution = sp->scan_rate / sp->size;
+    int centre = (int)(freq / resolution + 0.5);
+    double power = 0.0;
+    int k;
+
+    if ((freq <= 0.0) || (centre > (int)(sp->size / 2)))
+    {
+        return 0.0;
+    }
+    for (k = centre - SPECTRUM_TONE_BINS; k <= centre + SPECTRUM_TONE_BINS; k++)
+    {
+        if ((k >= 0) && (k <= (int)(sp->size / 2)))
+        {
+            power += spectrum_density(sp, ch, k) * resolution;
+        }
+    }
+    return sqrt(power);
+}
+
+
+/*****************************
+ * spectrum_free() - frees the memory of a spectrum
+ *
+ * param sp - spectrum of the scan
+****************************/
+
+void
+spectrum_free(struct spectrum* sp)
+{
+    int ch;
+
+    free(sp->coeffs);
+    free(sp->twiddles);
+    free(sp->bitrev);
+    free(sp->work);
+    for (ch = 0; ch < SPECTRUM_MAX_CHANNELS; ch++)
+    {
+        free(sp->segments[ch]);
+        free(sp->psd[ch]);
+    }
+    memset(sp, 0, sizeof(*sp));
+}
+
+
+/*****************************
+ * spectrum_fft() - complex FFT of size / 2 points, in place
+ *
+ * Iterative radix-2 decimation in time. The points are interleaved,
+ * real then imaginary, which is how a real segment of size samples
+ * is treated as size / 2 complex points by spectrum_segment().
+ *
+ * param sp - spectrum with the twiddle factors and bit reversed index
+ * param z - size / 2 complex points
+****************************/
+
+void
+spectrum_fft(struct spectrum* sp, double* z)
+{
+    uint32_t m = sp->size / 2;
+    uint32_t len, half, stride, start, i, j;
+
+    for (i = 0; i < m; i++)
+    {
+        j = sp->bitrev[i];
+        if (j > i)
+        {
+            double tr = z[2 * i];
+            double ti = z[2 * i + 1];
+            z[2 * i] = z[2 * j];
+            z[2 * i + 1] = z[2 * j + 1];
+            z[2 * j] = tr;
+            z[2 * j + 1] = ti;
+        }
+    }
+
+    for (len = 2; len <= m; len <<= 1)
+    {
+        half = len / 2;
+        stride = sp->size / len;        //twiddle of this stage is W_size^(j * stride)
+        for (start = 0; start < m; start += len)
+        {
+            double* a = z + 2 * start;
+            double* b = a + 2 * half;
+            for (j = 0; j < half; j++)
+            {
+                double wr = sp->twiddles[2 * j * stride];
+                double wi = sp->twiddles[2 * j * stride + 1];
+                double tr = wr * b[2 * j] - wi * b[2 * j + 1];
+                double ti = wr * b[2 * j + 1] + wi * b[2 * j];
+                b[2 * j] = a[2 * j] - tr;
+                b[2 * j + 1] = a[2 * j + 1] - ti;
+                a[2 * j] += tr;
+                a[2 * j + 1] += ti;
+            }
+        }
+    }
+}
+
+
+/*****************************
+ * spectrum_segment() - adds the power of a full segment to the sum
+ *
+ * The mean of the segment is removed, so a DC offset does not leak
+ * into the low frequencies, then it is windowed. The real FFT of
+ * size samples is done as a complex FFT of size / 2 points, which
+ * is then split into the spectrum of the real samples.
+ *
+ * param sp - spectrum of the scan
+ * param ch - channel with a full segment
+****************************/
+
+static void
+spectrum_segment(struct spectrum* sp, int ch)
+{
+    double* z = sp->work;
+    double* segment = sp->segments[ch];
+    double* psd = sp->psd[ch];
+    uint32_t m = sp->size / 2;
+    double mean = dsp_sum(segment, sp->size) / sp->size;
+    uint32_t k;
+
+    dsp_window(z, segment, sp->coeffs, sp->size, mean);
+
+    spectrum_fft(sp, z);
+
+    //X[0] and X[m] are real
+    psd[0] += (z[0] + z[1]) * (z[0] + z[1]);
+    psd[m] += (z[0] - z[1]) * (z[0] - z[1]);
+
+    /* X[k] = E[k] + W^k O[k], where the transforms of the even and
+     * odd samples are E[k] = (Z[k] + conj(Z[m - k])) / 2 and
+     * O[k] = (Z[k] - conj(Z[m - k])) / 2i
+     */
+    for (k = 1; k < m; k++)
+    {
+        double zr = z[2 * k];
+        double zi = z[2 * k + 1];
+        double cr = z[2 * (m - k)];
+        double ci = -z[2 * (m - k) + 1];
+        double er = 0.5 * (zr + cr);
+        double ei = 0.5 * (zi + ci);
+        double or = 0.5 * (zi - ci);
+        double oi = -0.5 * (zr - cr);
+        double wr = sp->twiddles[2 * k];
+        double wi = sp->twiddles[2 * k + 1];
+        double xr = er + wr * or - wi * oi;
+        double xi = ei + wr * oi + wi * or;
+        psd[k] += xr * xr + xi * xi;
+    }
+}
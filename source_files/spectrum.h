@@ -0,0 +1,57 @@
+/*****************************************
+ * spectrum.h
+ *
+ * Welch averaged power spectral density of each channel
+ *****************************************/
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+//header guard
+
+#ifndef SPECTRUM_H
+#define SPECTRUM_H
+
+#define SPECTRUM_MAX_CHANNELS 16
+#define SPECTRUM_MIN_SIZE 16            //smallest FFT, has to be a power of 2
+#define SPECTRUM_MAX_SIZE 65536         //largest FFT
+#define SPECTRUM_MAX_OVERLAP 0.95       //segments overlap by less than this
+#define SPECTRUM_OVERLAP 0.5            //default overlap of segments
+#define SPECTRUM_TONE_BINS 2            //frequencies either side of a tone it spreads over
+
+/* window applied to each segment before the FFT */
+enum spectrum_window
+{
+    WINDOW_HANN = 0,                    //good frequency resolution
+    WINDOW_FLATTOP = 1                  //accurate amplitude of tones
+};
+
+struct spectrum
+{
+    int num_channels;
+    uint32_t size;                      //samples in each segment, 0 if disabled
+    uint32_t hop;                       //samples between the starts of segments
+    int window;                         //one of enum spectrum_window
+    double scan_rate;
+    double* coeffs;                     //window, size values
+    double window_power;                //sum of the squares of the window
+    double* twiddles;                   //exp(-2 pi i k / size), size / 2 complex values
+    uint32_t* bitrev;                   //bit reversed index, size / 2 values
+    double* work;                       //segment being transformed, size values
+    double* segments[SPECTRUM_MAX_CHANNELS];    //samples waiting, size values
+    uint32_t fill;                      //samples waiting in each segment
+    double* psd[SPECTRUM_MAX_CHANNELS]; //sum of the power, size / 2 + 1 values
+    uint64_t count;                     //segments summed
+};
+
+/* function declarations */
+bool spectrum_open(struct spectrum*, int, uint32_t, double, int, double);
+void spectrum_add(struct spectrum*, const double*, uint32_t);
+bool spectrum_write(struct spectrum*, char*);
+bool spectrum_print(struct spectrum*, FILE*);
+double spectrum_density(struct spectrum*, int, uint32_t);
+double spectrum_amplitude(struct spectrum*, int, double);
+void spectrum_free(struct spectrum*);
+void spectrum_fft(struct spectrum*, double*);
+
+#endif
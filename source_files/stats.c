@@ -0,0 +1,322 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "stats.h"
+#include "dsp.h"
+
+/* local function declarations */
+static void stats_write(struct stats*);
+
+/*****************************
+ * stats_open() - creates the summary file for a scan
+ *
+ * The statistics of each channel are worked out over intervals of
+ * the scan, and a line for each channel is written at the end of
+ * each interval, so the file is small however long the scan is.
+ *
+ * Any errors return false, otherwise return true
+ *
+ * param stats - statistics to set up
+ * param filename - name of summary file, including path
+ * param num_channels - number of channels in each frame
+ * param scan_rate - actual scan rate per channel
+ * param interval - seconds in each interval
+ * param start_time - wall clock time of the first sample
+ * returns - false if error creating the file
+****************************/
+
+bool
+stats_open(struct stats* stats, char* filename, int num_channels,
+    double scan_rate, double interval, struct timespec start_time)
+{
+    memset(stats, 0, sizeof(*stats));
+    if ((num_channels < 1) || (num_channels > STATS_MAX_CHANNELS))
+    {
+        return false;
+    }
+
+    stats->num_channels = num_channels;
+    stats->scan_rate = scan_rate;
+    stats->start_time = start_time;
+    stats->interval_frames = (uint64_t)(interval * scan_rate + 0.5);
+    if (stats->interval_frames < 1)
+    {
+        stats->interval_frames = 1;
+    }
+
+    stats->fp = fopen(filename, "w");
+    if (stats->fp == NULL)
+    {
+        return false;
+    }
+
+    if (fprintf(stats->fp, "# scan rate %.3f, interval %.3f s, %d channels\n"
+        "# time, channel, samples, rms, peak, peak_to_peak, crest_factor, "
+        "skewness, kurtosis\n", scan_rate,
+        stats->interval_frames / scan_rate, num_channels) < 0)
+    {
+        stats->failed = true;
+    }
+    return true;
+}
+
+
+/*****************************
+ * stats_add() - adds frames of samples to the statistics
+ *
+ * A block can end one interval and start the next, so it is split
+ * where an interval ends. The moments of each part are worked out
+ * by stats_block() and merged into the moments of the interval.
+ *
+ * param stats - statistics of the scan
+ * param data - samples, num_channels per frame
+ * param frames - number of frames
+****************************/
+
+void
+stats_add(struct stats* stats, const double* data, uint32_t frames)
+{
+    struct stats_moments block[STATS_MAX_CHANNELS];
+    uint32_t n;
+    int ch;
+
+    while (frames > 0)
+    {
+        n = frames;
+        if (n > stats->interval_frames - stats->frames)
+        {
+            n = stats->interval_frames - stats->frames;
+        }
+
+        stats_block(block, data, n, stats->num_channels);
+        for (ch = 0; ch < stats->num_channels; ch++)
+        {
+            stats_merge(&stats->channels[ch], &block[ch]);
+        }
+
+        stats->frames += n;
+        data += (size_t)n * stats->num_channels;
+        frames -= n;
+
+        if (stats->frames == stats->interval_frames)
+        {
+            stats_write(stats);
+        }
+    }
+}
+
+
+/*****************************
+ * stats_close() - closes the summary file
+ *
+ * Writes the statistics of a last, part interval if there is one.
+ *
+ * Any errors return false, otherwise return true
+ *
+ * param stats - statistics of the scan
+ * returns - false if error writing or closing the file
+****************************/
+
+bool
+stats_close(struct stats* stats)
+{
+    bool ok;
+
+    if (stats->fp == NULL)
+    {
+        return true;
+    }
+
+    if (stats->frames > 0)
+    {
+        stats_write(stats);
+    }
+    ok = !stats->failed;
+    if (fclose(stats->fp) != 0)
+    {
+        ok = false;
+    }
+    stats->fp = NULL;
+    return ok;
+}
+
+
+/*****************************
+ * stats_block() - works out the moments of each channel of a block of frames
+ *
+ * The block is in memory, so the mean is found first and then the
+ * sums of the powers of the differences from it. This is as accurate
+ * as a sample by sample Welford update, without a division per sample.
+ * Both passes go through the interleaved frames once, for all the
+ * channels, with dsp_sum_minmax() and dsp_moments().
+ *
+ * param moments - moments of each channel of the block
+ * param data - samples, num_channels per frame
+ * param n - number of frames
+ * param num_channels - number of channels in each frame
+****************************/
+
+void
+stats_block(struct stats_moments* moments, const double* data, uint32_t n,
+    int num_channels)
+{
+    double sum[STATS_MAX_CHANNELS];
+    double min[STATS_MAX_CHANNELS];
+    double max[STATS_MAX_CHANNELS];
+    double mean[STATS_MAX_CHANNELS];
+    double m2[STATS_MAX_CHANNELS];
+    double m3[STATS_MAX_CHANNELS];
+    double m4[STATS_MAX_CHANNELS];
+    int ch;
+
+    memset(moments, 0, sizeof(*moments) * num_channels);
+    if (n == 0)
+    {
+        return;
+    }
+
+    dsp_sum_minmax(data, n, num_channels, sum, min, max);
+    for (ch = 0; ch < num_channels; ch++)
+    {
+        mean[ch] = sum[ch] / n;
+    }
+    dsp_moments(data, n, num_channels, mean, m2, m3, m4);
+
+    for (ch = 0; ch < num_channels; ch++)
+    {
+        moments[ch].n = n;
+        moments[ch].mean = mean[ch];
+        moments[ch].m2 = m2[ch];
+        moments[ch].m3 = m3[ch];
+        moments[ch].m4 = m4[ch];
+        moments[ch].min = min[ch];
+        moments[ch].max = max[ch];
+    }
+}
+
+
+/*****************************
+ * stats_merge() - adds the moments of one set of samples to another
+ *
+ * Uses the pairwise update of Pebay, so intervals of any length can
+ * be built from blocks without losing accuracy.
+ *
+ * param a - moments to add to
+ * param b - moments to add
+****************************/
+
+void
+stats_merge(struct stats_moments* a, const struct stats_moments* b)
+{
+    double na = a->n;
+    double nb = b->n;
+    double n = na + nb;
+    double delta, d_n, d_n2;
+
+    if (b->n == 0)
+    {
+        return;
+    }
+    if (a->n == 0)
+    {
+        *a = *b;
+        return;
+    }
+
+    delta = b->mean - a->mean;
+    d_n = delta / n;
+    d_n2 = d_n * d_n;
+
+    a->m4 += b->m4 + delta * d_n * d_n2 * na * nb * (na * na - na * nb + nb * nb) +
+        6.0 * d_n2 * (na * na * b->m2 + nb * nb * a->m2) +
+        4.0 * d_n * (na * b->m3 - nb * a->m3);
+    a->m3 += b->m3 + delta * d_n2 * na * nb * (na - nb) +
+        3.0 * d_n * (na * b->m2 - nb * a->m2);
+    a->m2 += b->m2 + delta * d_n * na * nb;
+    a->mean += nb * d_n;
+    a->n += b->n;
+    if (b->min < a->min) a->min = b->min;
+    if (b->max > a->max) a->max = b->max;
+}
+
+
+/*****************************
+ * stats_result() - works out the condition monitoring values from moments
+ *
+ * param moments - moments of the samples of a channel
+ * param result - holds the values on return, all zero if no samples
+****************************/
+
+void
+stats_result(const struct stats_moments* moments, struct stats_result* result)
+{
+    double n = moments->n;
+
+    memset(result, 0, sizeof(*result));
+    if (moments->n == 0)
+    {
+        return;
+    }
+
+    result->rms = sqrt(moments->mean * moments->mean + moments->m2 / n);
+    result->peak = fmax(fabs(moments->min), fabs(moments->max));
+    result->peak_to_peak = moments->max - moments->min;
+    if (result->rms > 0.0)
+    {
+        result->crest_factor = result->peak / result->rms;
+    }
+    if (moments->m2 > 0.0)
+    {
+        result->skewness = sqrt(n) * moments->m3 / pow(moments->m2, 1.5);
+        result->kurtosis = n * moments->m4 / (moments->m2 * moments->m2);
+    }
+}
+
+
+/*****************************
+ * stats_write() - writes the statistics of an interval to the summary file
+ *
+ * A line for each channel, with the time of the start of the interval,
+ * then starts the next interval.
+ *
+ * param stats - statistics of the scan
+****************************/
+
+static void
+stats_write(struct stats* stats)
+{
+    struct stats_result result;
+    struct tm tm;
+    char date[64];
+    double offset = stats->intervals * stats->interval_frames / stats->scan_rate;
+    double seconds = stats->start_time.tv_nsec / 1e9 + offset;
+    time_t t = stats->start_time.tv_sec + (time_t)seconds;
+    int ch;
+
+    localtime_r(&t, &tm);
+    strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &tm);
+
+    for (ch = 0; ch < stats->num_channels; ch++)
+    {
+        stats_result(&stats->channels[ch], &result);
+        if (fprintf(stats->fp, "%s.%03d, %d, %llu, %.7f, %.7f, %.7f, %.4f, %.4f, %.4f\n",
+            date, (int)((seconds - floor(seconds)) * 1000.0), ch,
+            (unsigned long long)stats->channels[ch].n, result.rms, result.peak,
+            result.peak_to_peak, result.crest_factor, result.skewness,
+            result.kurtosis) < 0)
+        {
+            stats->failed = true;
+        }
+    }
+
+    //flushed every interval, so the summary so far is kept if the program stops
+    if (fflush(stats->fp) != 0)
+    {
+        stats->failed = true;
+    }
+
+    memset(stats->channels, 0, sizeof(stats->channels));
+    stats->frames = 0;
+    stats->intervals++;
+}
@@ -0,0 +1,63 @@
+/*****************************************
+ * stats.h
+ *
+ * Streaming vibration statistics of each channel
+ *****************************************/
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+//header guard
+
+#ifndef STATS_H
+#define STATS_H
+
+#define STATS_MAX_CHANNELS 16
+
+/* moments of the samples of a channel, about their mean */
+struct stats_moments
+{
+    uint64_t n;                         //number of samples
+    double mean;
+    double m2;                          //sums of powers of (sample - mean)
+    double m3;
+    double m4;
+    double min;
+    double max;
+};
+
+/* condition monitoring values worked out from the moments */
+struct stats_result
+{
+    double rms;                         //including any DC
+    double peak;                        //largest magnitude
+    double peak_to_peak;
+    double crest_factor;                //peak / rms
+    double skewness;                    //0 for a symmetric signal
+    double kurtosis;                    //3 for gaussian noise, not excess kurtosis
+};
+
+/* summary of a scan, a line for each channel every interval */
+struct stats
+{
+    FILE* fp;                           //summary file
+    int num_channels;
+    double scan_rate;
+    struct timespec start_time;         //wall clock time of the first sample
+    uint64_t interval_frames;           //frames in an interval, 0 if disabled
+    uint64_t frames;                    //frames so far in the current interval
+    uint64_t intervals;                 //intervals written
+    bool failed;                        //a write to the file failed
+    struct stats_moments channels[STATS_MAX_CHANNELS];
+};
+
+/* function declarations */
+bool stats_open(struct stats*, char*, int, double, double, struct timespec);
+void stats_add(struct stats*, const double*, uint32_t);
+bool stats_close(struct stats*);
+void stats_block(struct stats_moments*, const double*, uint32_t, int);
+void stats_merge(struct stats_moments*, const struct stats_moments*);
+void stats_result(const struct stats_moments*, struct stats_result*);
+
+#endif
@@ -0,0 +1,386 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include "textfmt.h"
+
+/* Values are formatted with integer arithmetic after scaling by a power of 10.
+ * Above these limits the scaled value is too coarse to round exactly,
+ * so printf is used, as it also is for infinity and NaN.
+ */
+#define F12_7_LIMIT 1e8                 //largest value for textfmt_f12_7()
+#define FRAC9_LIMIT 4e6                 //largest time for textfmt_frac9()
+#define PARSE_MAX_DIGITS 15             //most digits textfmt_parse() reads itself
+
+/* local function declarations */
+static bool textfmt_round(double, double, uint64_t*);
+
+/*****************************
+ * textfmt_round() - scales a positive value and rounds it to an integer
+ *
+ * Rounding has to match printf, which rounds the exact binary value.
+ * The product value * scale has a rounding error of half a bit,
+ * so if the fraction is that close to one half it cannot be known
+ * which way printf rounds, and false is returned.
+ * This happens for about one value in a million.
+ *
+ * param value - value to round, zero or more
+ * param scale - power of 10 to scale by
+ * param result - the rounded, scaled value
+ * returns - false if too close to call, printf has to be used
+****************************/
+
+static bool
+textfmt_round(double value, double scale, uint64_t* result)
+{
+    double scaled = value * scale;
+    double whole = floor(scaled);
+    double frac = scaled - whole;
+
+    if (fabs(frac - 0.5) <= scaled * 1e-15 + 1e-9)
+    {
+        return false;
+    }
+    *result = (uint64_t)whole + (frac > 0.5);
+    return true;
+}
+
+
+/*****************************
+ * textfmt_f12_7() - formats a value the same as printf("%12.7f")
+ *
+ * Does not use stdio or the locale, so is several times faster.
+ * Writes at least 12 chars, more if the value needs them, up to
+ * TEXTFMT_MAX_VALUE, the string is not null terminated. Values too
+ * large to round exactly are formatted by snprintf(), bounded the same.
+ *
+ * param out - where to write the chars
+ * param value - value to format
+ * returns - pointer to the char after the last one written
+****************************/
+
+char*
+textfmt_f12_7(char* out, double value)
+{
+    char digits[32];
+    char* p = digits + sizeof(digits);
+    double x = fabs(value);
+    uint64_t n;
+    uint64_t whole;
+    uint32_t frac;
+    int i;
+    int len;
+
+    if (!(x < F12_7_LIMIT) || !textfmt_round(x, 1e7, &n))
+    {
+        len = snprintf(out, TEXTFMT_MAX_VALUE + 1, "%12.7f", value);
+        return out + ((len < TEXTFMT_MAX_VALUE) ? len : TEXTFMT_MAX_VALUE);
+    }
+
+    //build the number from the right
+    whole = n / 10000000;
+    frac = n % 10000000;
+    for (i = 0; i < 7; i++)
+    {
+        *--p = '0' + frac % 10;
+        frac /= 10;
+    }
+    *--p = '.';
+    do
+    {
+        *--p = '0' + whole % 10;
+        whole /= 10;
+    } while (whole > 0);
+
+    //printf keeps the sign of negative values which round to zero
+    if (signbit(value))
+    {
+        *--p = '-';
+    }
+
+    len = digits + sizeof(digits) - p;
+    for (i = len; i < 12; i++)
+    {
+        *out++ = ' ';
+    }
+    memcpy(out, p, len);
+    return out + len;
+}
+
+
+/*****************************
+ * textfmt_frac9() - formats the fraction of a time in seconds
+ *
+ * Writes the same chars as printf("%.9f") from the decimal point,
+ * which is how the text log shows the time of a sample.
+ * The string is not null terminated.
+ *
+ * param out - where to write the chars
+ * param seconds - time to format
+ * returns - pointer to the char after the last one written
+****************************/
+
+char*
+textfmt_frac9(char* out, double seconds)
+{
+    char tmp[TEXTFMT_MAX_VALUE + 8];
+    uint64_t n;
+    uint32_t frac;
+    int i;
+
+    if (!(seconds >= 0.0) || !(seconds < FRAC9_LIMIT) ||
+        !textfmt_round(seconds, 1e9, &n))
+    {
+        snprintf(tmp, sizeof(tmp), "%.9f", seconds);
+        char* s = strchr(tmp, '.');
+        //a time of inf or nan has no decimal point, and no fraction
+        if (s == NULL)
+        {
+            return out;
+        }
+        i = strlen(s);
+        memcpy(out, s, i);
+        return out + i;
+    }
+
+    frac = n % 1000000000;
+    out[0] = '.';
+    for (i = 9; i > 0; i--)
+    {
+        out[i] = '0' + frac % 10;
+        frac /= 10;
+    }
+    return out + 10;
+}
+
+
+/*****************************
+ * textfmt_line() - formats a line of the text log file
+ *
+ * Output is the same as
+ * fprintf("%s%s, %12.7f, %12.7f\n", date, fraction of time, value, value)
+ * with a column for each channel.
+ *
+ * param out - where to write the line, at least TEXTFMT_MAX_LINE chars
+ * param date - date and time of the sample, to the second
+ * param date_len - length of date
+ * param seconds - time of the sample, only its fraction is written
+ * param values - one value for each channel
+ * param num_channels - number of values
+ * returns - pointer to the char after the newline
+****************************/
+
+char*
+textfmt_line(char* out, const char* date, size_t date_len, double seconds,
+    const double* values, int num_channels)
+{
+    int ch;
+
+    memcpy(out, date, date_len);
+    out = textfmt_frac9(out + date_len, seconds);
+    for (ch = 0; ch < num_channels; ch++)
+    {
+        *out++ = ',';
+        *out++ = ' ';
+        out = textfmt_f12_7(out, values[ch]);
+    }
+    *out++ = '\n';
+    return out;
+}
+
+
+/*****************************
+ * textfmt_time() - time of a frame of a log file
+ *
+ * The time is the time of the first frame of the file plus the time
+ * from it to the frame, frame / rate, worked out for each frame rather
+ * than by adding up the time between frames, so it does not drift, and
+ * the text of a binary file has the same times as a text log file.
+ *
+ * param start_sec - time of the first frame, seconds since 1970
+ * param start_nsec - nanoseconds of the time of the first frame
+ * param seconds - time of the frame from the first frame
+ * param sec - set to the seconds since 1970 of the frame
+ * returns - nanoseconds of the time of the frame
+****************************/
+
+uint32_t
+textfmt_time(int64_t start_sec, int64_t start_nsec, double seconds, int64_t* sec)
+{
+    double whole = floor(seconds);
+    int64_t nsec = start_nsec + llround((seconds - whole) * 1e9);
+
+    *sec = start_sec + (int64_t)whole + nsec / 1000000000;
+    return (uint32_t)(nsec % 1000000000);
+}
+
+
+/*****************************
+ * textfmt_parse() - reads a value formatted by textfmt_f12_7()
+ *
+ * Leading spaces are skipped. Up to 15 digits make an integer less
+ * than 2^53, which divided by an exact power of 10 is rounded the
+ * same as strtod(), so the value read is the one strtod() gives,
+ * without its cost. Anything else, such as
+ * an exponent, inf or nan, is read by strtod(), so the value must be
+ * followed by a char which is not part of a number, eg ',' or '\n'.
+ *
+ * param in - the chars of the value
+ * param value - the value read
+ * returns - pointer to the char after the value, NULL if not a number
+****************************/
+
+const char*
+textfmt_parse(const char* in, double* value)
+{
+    static const double power10[PARSE_MAX_DIGITS + 1] = {1e0, 1e1, 1e2,
+        1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15};
+    const char* p;
+    char* end;
+    uint64_t n = 0;
+    int digits = 0;
+    int decimals = 0;
+    bool negative;
+
+    while (*in == ' ')
+    {
+        in++;
+    }
+    p = in;
+    negative = (*p == '-');
+    if (negative)
+    {
+        p++;
+    }
+    while ((*p >= '0') && (*p <= '9') && (digits < PARSE_MAX_DIGITS))
+    {
+        n = n * 10 + (*p++ - '0');
+        digits++;
+    }
+    if (*p == '.')
+    {
+        p++;
+        while ((*p >= '0') && (*p <= '9') && (digits < PARSE_MAX_DIGITS))
+        {
+            n = n * 10 + (*p++ - '0');
+            digits++;
+            decimals++;
+        }
+    }
+
+    //too many digits, or not a plain number, strtod() reads it
+    if ((digits == 0) || ((*p >= '0') && (*p <= '9')) || (*p == 'e') ||
+        (*p == 'E'))
+    {
+        *value = strtod(in, &end);
+        return (end == in) ? NULL : end;
+    }
+
+    *value = (double)n / power10[decimals];
+    if (negative)
+    {
+        *value = -*value;
+    }
+    return p;
+}
+
+
+/*****************************
+ * textbuf_init() - allocates an output buffer for a file
+ *
+ * Any errors return false, otherwise return true
+ *
+ * param tb - output buffer
+ * param fd - file descriptor the buffer is written to
+ * param size - size of the buffer, TEXTFMT_BUF_SIZE is a good choice
+ * returns - false if error allocating memory
+****************************/
+
+bool
+textbuf_init(struct textbuf* tb, int fd, size_t size)
+{
+    tb->fd = fd;
+    tb->size = size;
+    tb->len = 0;
+    tb->written = 0;
+    tb->failed = false;
+    tb->buf = malloc(size);
+    return tb->buf != NULL;
+}
+
+
+/*****************************
+ * textbuf_reserve() - makes room for a line in the output buffer
+ *
+ * Flushes the buffer to the file if less than TEXTFMT_MAX_LINE is free.
+ * After writing the line the caller sets len to the end of the line.
+ *
+ * param tb - output buffer
+ * returns - where to write the next line
+****************************/
+
+char*
+textbuf_reserve(struct textbuf* tb)
+{
+    if (tb->size - tb->len < TEXTFMT_MAX_LINE)
+    {
+        textbuf_flush(tb);
+    }
+    return tb->buf + tb->len;
+}
+
+
+/*****************************
+ * textbuf_flush() - writes the contents of the output buffer to the file
+ *
+ * The buffer is emptied even if there is an error, so a full disk
+ * does not stop the caller, but failed is set.
+ *
+ * Any errors return false, otherwise return true
+ *
+ * param tb - output buffer
+ * returns - false if error writing to the file
+****************************/
+
+bool
+textbuf_flush(struct textbuf* tb)
+{
+    size_t done = 0;
+    ssize_t result;
+
+    while (done < tb->len)
+    {
+        result = write(tb->fd, tb->buf + done, tb->len - done);
+        if (result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            tb->failed = true;
+            break;
+        }
+        done += result;
+    }
+    tb->written += done;
+    tb->len = 0;
+    return !tb->failed;
+}
+
+
+/*****************************
+ * textbuf_free() - frees an output buffer, without flushing it
+ *
+ * param tb - output buffer
+****************************/
+
+void
+textbuf_free(struct textbuf* tb)
+{
+    free(tb->buf);
+    tb->buf = NULL;
+    tb->size = 0;
+    tb->len = 0;
+}
@@ -0,0 +1,44 @@
+/*****************************************
+ * textfmt.h
+ *
+ * Fast formatting, and reading, of the text log file
+ *****************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <float.h>
+
+//header guard
+
+#ifndef TEXTFMT_H
+#define TEXTFMT_H
+
+#define TEXTFMT_BUF_SIZE (1024 * 1024)  //bytes written to the file at a time
+#define TEXTFMT_MAX_CHANNELS 16         //most values on a line
+#define TEXTFMT_MAX_VALUE (DBL_MAX_10_EXP + 10) //longest value, -DBL_MAX with 7 decimals
+#define TEXTFMT_MAX_LINE (64 + TEXTFMT_MAX_CHANNELS * (TEXTFMT_MAX_VALUE + 2))
+                                        //longest line, date, time and 16 values
+
+/* output buffer, written to the file descriptor when nearly full */
+struct textbuf
+{
+    int fd;
+    char* buf;
+    size_t size;
+    size_t len;
+    uint64_t written;                   //bytes written to the file
+    bool failed;                        //a write to the file failed
+};
+
+/* function declarations */
+char* textfmt_f12_7(char*, double);
+char* textfmt_frac9(char*, double);
+char* textfmt_line(char*, const char*, size_t, double, const double*, int);
+uint32_t textfmt_time(int64_t, int64_t, double, int64_t*);
+const char* textfmt_parse(const char*, double*);
+bool textbuf_init(struct textbuf*, int, size_t);
+char* textbuf_reserve(struct textbuf*);
+bool textbuf_flush(struct textbuf*);
+void textbuf_free(struct textbuf*);
+
+#endif
@@ -4,7 +4,9 @@
 #include <time.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
 #include "utils.h"
+#include "config.h"
 #include <stdbool.h>
 #include <string.h>
 
@@ -77,15 +79,34 @@ utils_getnamedate(char* buffer, int buf_size)
 ****************************/   
 int
 utils_get_date_time(char* buffer, int size) {
-    struct tm* time_now;
-    time_t now;
+
+    return utils_format_date_time(buffer, size, time(NULL));
+}
+
+
+/****************************
+ * utils_format_date_time () formats a date and time as utils_get_date_time()
+ *
+ * Used for the time a triggered scan started, rather than now.
+ * 
+ * If buffer is too small or any errors function returns zero
+ * and the contents of buffer are undefined.
+ * 
+ * param buffer - is a char array to store the results in
+ * param size - is the size of the buffer char array
+ * param when - time to format, seconds since 1970
+ * returns - the size of the string returned in buffer or 0 if error  
+****************************/   
+int
+utils_format_date_time(char* buffer, int size, time_t when) {
+    struct tm time_when;
     int result;
     
-    now = time(NULL);
-    time_now = localtime(&now);
-    result = strftime(buffer, size, "%Y-%m-%d %H:%M:%S", time_now);
+    //localtime_r(), as the logger thread can be naming a file at the same time
+    localtime_r(&when, &time_when);
+    result = strftime(buffer, size, "%Y-%m-%d %H:%M:%S", &time_when);
     #ifdef DEBUG_UTILS
-    printf("utils_get_date_time() - %s\n", buffer);
+    printf("utils_format_date_time() - %s\n", buffer);
     #endif
 
     return result;                         //strftime() returns 0 on error
@@ -133,182 +154,129 @@ utils_getfilepath(char* buffer, int buf_size, char* sub_dir, char* file_name)
 
 
 /****************************
- * utils_appendto file() appends a message to a file
+ * utils_rename_synced() renames a file and syncs its directory
  *
- * If the file does not exist it is created.
- * Date and time are pre-appended to the filename
+ * The rename replaces the name in one step, so the file is seen
+ * with its old name or its new name, never neither. The directory
+ * is synced so the new name is on the card, otherwise a power cut
+ * soon after could bring back the old one. The file itself should
+ * be synced before it is renamed.
  *
  * Any errors return false, otherwise return true
- *  
- * param filename - name of file
- * param subdir - sub directory where file is stored
- * param message - message to write
- * returns - false if error in appending to the file
+ *
+ * param from - name of file, including path
+ * param to - new name, in the same directory
+ * returns - false if error renaming the file or syncing the directory
 ****************************/
 
 bool
-utils_appendtofile(char* filename, char* subdir, char* message)
+utils_rename_synced(char* from, char* to)
 {
-    char buffer[MAX_ARRAY_SIZE] = {0};
-    char tmpfilename[MAX_ARRAY_SIZE] = {0};
-    
-    //pre-append date and time to file name
-    utils_getnamedate(tmpfilename, sizeof(tmpfilename));
-    strcat(tmpfilename, "_");
-    strcat(tmpfilename, filename);
+    char dir[MAX_ARRAY_SIZE * 2] = ".";
+    char* slash = strrchr(to, '/');
+    size_t len;
+    int fd;
+    bool ok;
 
-    //get absolute path to the file
-    int result = 0;
-    result = utils_getfilepath(buffer, MAX_ARRAY_SIZE, subdir, tmpfilename);
-    if (result ==0 )
-    {        
+    if (rename(from, to) != 0)
+    {
         return false;
     }
-    
-    FILE *fp;
-    fp = fopen(buffer, "a");
-    if (fp == NULL)
+
+    //the directory is the name up to the last '/', "/" if that is the first
+    if (slash != NULL)
     {
-        return false;
+        len = (slash == to) ? 1 : slash - to;
+        if (len >= sizeof(dir))
+        {
+            return false;
+        }
+        memcpy(dir, to, len);
+        dir[len] = '\0';
     }
-     
-    #ifdef DEBUG_UTILS
-    printf("utils_appendtofile - message: %s\n", message);
-    #endif
-  
-    result = fprintf(fp, message);
-    fclose(fp);
-    if (result <= 0 )
+    fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (fd < 0)
     {
         return false;
     }
-    
-    return true;    
+    ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
+
+
+/****************************
+ * utils_getconfig() gets the tags of an xml file
+ *
+ * The file is read into a table of tags by config_load() the first
+ * time, and the table is kept, so each tag after that is looked up
+ * rather than the file read again. The file is only read once,
+ * so changes to it while the program runs are not seen.
+ *
+ * Any error reading the file returns NULL.
+ *
+ * param filename - name of xml file
+ * returns - table of the tags in the file, or NULL if error
+*****************************/
+
+struct config*
+utils_getconfig(char *filename)
+{
+    static struct config config;
+    static char config_file[MAX_ARRAY_SIZE] = {0};
+
+    if (strcmp(filename, config_file) != 0)
+    {
+        config_free(&config);
+        config_file[0] = '\0';
+        if (!config_load(&config, filename))
+        {
+            return NULL;
+        }
+        strncpy(config_file, filename, sizeof(config_file) - 1);
+    }
+    return &config;
 }
 
 
 /****************************
  * utils_getxmltag() gets a tag value as a string from an xml file
  *
- * Only supports a very simple xml file.
- * Assumes file size is less than MAX_FILE_SIZE.
- * File has to be small as file contents, excluding comments
- * are read into memory.
+ * Only supports a very simple xml file, see config_load().
+ * Uses utils_getconfig(), so the file is only read once.
  *
- * Any error or cannot find the tag, returns zero
+ * Any error or cannot find the tag, or an empty value, returns zero
  * and the contents of tagvalue are undefined.
- * Only MAX_FILE_SIZE chars are read, the rest are ignored.
+ * At most MAX_ARRAY_SIZE - 1 chars of the value are returned.
  *
  * param filename - name of xml file
  * param tag - tag we are looking for
- * param tagvalue - tag value from the file
+ * param tagvalue - tag value from the file, at least MAX_ARRAY_SIZE chars
  * returns - size of tagvalue or 0 if error
 *****************************/
 
 int
 utils_getxmltag(char *filename, char *tag, char *tagvalue)
 {
-   
+    struct config* config = utils_getconfig(filename);
+    const char* value;
+
     #ifdef DEBUG_UTILS
     printf("utils_getxmltagvalue - filename: %s\n", filename);
     #endif
-    
-    int len = 0;
-    char openingtag[MAX_ARRAY_SIZE] = {0}; //store tags here
-    char closingtag[MAX_ARRAY_SIZE] = {0};
-    
-    //get data from file
-    FILE* fp;
-    fp = fopen(filename, "r");
-      if (fp == NULL)
-    {
-        return 0;
-    }
-    
-    char buffer[MAX_ARRAY_SIZE] = {0};
-    char filebuffer[MAX_FILE_SIZE] = {0};
-    int charcount = 0;
-    
-    while (fgets(buffer, MAX_ARRAY_SIZE, fp) != NULL)
-    {  
-        //strip out comments and check file not too large
-       
-        if ( strncmp(buffer, "<!", 2) != 0 )
-        {
-            if ( (charcount += strlen(buffer)) < MAX_FILE_SIZE)
-                  strcat(filebuffer, buffer);
-        }
-    }
-    if (strlen(filebuffer) <= 0)
-    { 
-        return 0;
-    }
-    fclose(fp);
-    
-    #ifdef DEBUG_UTILS
-    sscanf(filebuffer,"%20s", buffer);
-    printf("utils_getxmltagvalue - start of file: %s\n",buffer);
-    #endif
 
-    //Create opening tag
-    strcpy(openingtag, "<");
-    strcat(openingtag, tag);
-    strcat(openingtag, ">");
-
-    //Create closing tag
-    strcpy(closingtag, "</");
-    strcat(closingtag, tag);
-    strcat(closingtag, ">");
-
-    int pos = 0;
-    int posopeningtag = 0;
-    int posclosingtag = 0;
-    bool openingtagfound = false;
-    bool closingtagfound = false;
-    len = sizeof(filebuffer);
-   
-    //Get opening tag position in data read from file
-    
-    for (pos = 0; pos < len; pos++)
+    if (config == NULL)
     {
-        if ( !memcmp(openingtag, filebuffer+pos, strlen(openingtag)) )
-        {
-            posopeningtag = pos;
-            openingtagfound = true;
-            break;
-        }
+        return 0;
     }
-
-    //Get closing tag position in data read from file
-    for (pos = 0; pos < len; pos++)
-    {
-        if ( !memcmp(closingtag, filebuffer+pos, strlen(closingtag)) )
-        {
-            posclosingtag = pos;
-            closingtagfound = true;
-            break;
-        }
-    }
-
-    if (!openingtagfound || !closingtagfound)
+    value = config_get(config, tag);
+    if (value == NULL)
     {
         return 0;
     }
 
-    /* Note no check if number of chars about to read from filebuffer,
-     * will fit into the char array, tagvalue */
-    int charsintag = posclosingtag-posopeningtag-strlen(openingtag);
-      
-    //Get tag value
-    memcpy(
-        tagvalue,
-        filebuffer+posopeningtag+strlen(openingtag),
-        posclosingtag-posopeningtag-strlen(openingtag)
-        );
-
-    //ensure string is terminated with a null character
-    tagvalue[charsintag] = '\0';
-    
+    strncpy(tagvalue, value, MAX_ARRAY_SIZE - 1);
+    tagvalue[MAX_ARRAY_SIZE - 1] = '\0';
     return strlen(tagvalue);
 }
 
@@ -316,7 +284,8 @@ utils_getxmltag(char *filename, char *tag, char *tagvalue)
 /****************************
  * utils_getxmltag_d() gets a tag value as a double from an xml file
  *
- * Uses utils_getxmltag() to get the string and then converts it to a double
+ * Uses utils_getconfig() and config_get_d(), which has the number
+ * config_check() converted, so the value is not converted again.
  * Default value is 0, so if error returns 0.0
  *
  * param filename - name of xml file
@@ -327,23 +296,20 @@ utils_getxmltag(char *filename, char *tag, char *tagvalue)
 double
 utils_getxmltag_d(char *filename, char *tag)
 {
-    char buffer[MAX_ARRAY_SIZE] = {0};
-    
-    if ( utils_getxmltag(filename, tag, buffer) )
-    { 
-        return  strtod(buffer, NULL);
-    }
-    else
-    {   //error getting tag
+    struct config* config = utils_getconfig(filename);
+
+    if (config == NULL)
+    {   //error reading the file
         return 0.0;
     }
+    return config_get_d(config, tag);
 }
 
 
 /****************************
  * utils_getxmltag_i() gets a tag value as an integer from an xml file
  *
- * Uses utils_getxmltag() to get the string and then converts it to a integer
+ * Uses utils_getxmltag_d() and takes the whole number part
  * Default value is 0, so if error returns 0
  *
  * param filename - name of xml file
@@ -354,16 +320,7 @@ utils_getxmltag_d(char *filename, char *tag)
 int
 utils_getxmltag_i(char *filename, char *tag)
 {
-    char buffer[MAX_ARRAY_SIZE] = {0};
-    
-    if ( utils_getxmltag(filename, tag, buffer) )
-    { 
-        return  atoi(buffer);
-    }
-    else
-    {   //error getting tag
-        return 0;
-    }
+    return (int)utils_getxmltag_d(filename, tag);
 }
 
 
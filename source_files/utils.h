@@ -3,6 +3,8 @@
  *
  *****************************************/
 #include <stdbool.h>
+#include <time.h>
+#include "config.h"
 
 //header guard
 
@@ -17,17 +19,18 @@
 
 /* define various maximum size of buffers used */ 
 #define MAX_ARRAY_SIZE 200
-#define MAX_FILE_SIZE 2000
 
 /* function declarations */   
 int utils_getnamedate(char*, int);
 int utils_getfilepath(char*, int, char*, char*);
+struct config* utils_getconfig(char*);
 int utils_getxmltag(char*, char*, char*);
 double utils_getxmltag_d(char*, char*);
 int utils_getxmltag_i(char*, char*);
 long utils_getxmltag_l(char*, char*);
-bool utils_appendtofile(char*, char*, char*);
+bool utils_rename_synced(char*, char*);
 int utils_get_date_time(char*, int);
+int utils_format_date_time(char*, int, time_t);
 
 
 #endif
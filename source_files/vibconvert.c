@@ -0,0 +1,1333 @@
+/******************************
+ * vibconvert
+ *
+ * Converts a log file of scantofile to another format, all of it or
+ * the frames of a time range.
+ *
+ * The input is a text log file, or a binary log file of any sample
+ * format, chunked or not, which is found from the first bytes of the
+ * file. The output is a text log file, with the lines scantofile would
+ * have written, or a binary log file of a sample format, chunked if
+ * -c is given.
+ *
+ * The input file is mapped into memory, not read, and split into
+ * pieces which are converted by a thread each, as many at the same
+ * time as there are CPUs, or -j threads. A text file is split at the
+ * ends of lines, a binary file into its chunks, the blocks of its
+ * compressed samples, or runs of frames. Batches of pieces are
+ * converted in turn, the next while the last is written, in order, to
+ * the output. The samples of compressed output are coded as they are
+ * written, so by one thread.
+ *
+ * A text file does not have the scan rate, it is found from the time
+ * of the lines, or given with -r, or the sensitivity of its channels,
+ * which int24 and compressed samples are quantised with, as in
+ * vib_params. This is given with -s, the default of 1000 mV per unit
+ * keeps values of up to 5 units. The time of the first line of a text
+ * file is the start time of the file, but which frame of the scan it
+ * is is not known, so it is taken as the first.
+ *
+ * usage: vibconvert [-j threads] [-r scan rate] [-s sensitivity]
+ *                   [-c chunk seconds] <input file> <output file> <format>
+ *                   [from seconds] [to seconds]
+ *        format is text, float32, float64, int24 or compressed,
+ *        the times are from the start of the input file
+ * returns - 0 if the file was converted, 1 if not
+ ****************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "binlog.h"
+#include "codec.h"
+#include "textfmt.h"
+
+#define CONVERT_MAX_THREADS 64
+#define CONVERT_PIECE_SAMPLES (256 * 1024)  //samples in a piece of a binary file not chunked
+#define CONVERT_TEXT_PIECE (1024 * 1024)    //bytes in a piece of a text file
+#define CONVERT_BATCH_SAMPLES (8 * 1024 * 1024) //samples decoded at the same time
+#define CONVERT_BATCH_PIECES 64             //most pieces in a batch
+#define CONVERT_MAX_FRAMES (1u << 24)       //more frames in a chunk or block is not a valid file
+#define CONVERT_CLOCK 51200.0               //MCC 172 scan rates are this divided by a whole number
+#define CONVERT_TEXT 0                      //output format of a text log file
+
+/* a part of the input file, converted by one thread */
+struct piece
+{
+    const uint8_t* data;                    //in the mapped file
+    size_t bytes;
+    uint64_t first_frame;                   //frame of the input file the piece starts at
+    uint32_t frames;
+    uint32_t skip;                          //frames before the time range
+    uint32_t keep;                          //frames in the time range
+    bool columns;                           //chunked, a column of samples for each channel
+    bool check;                             //chunked, the checksum is checked
+    uint32_t checksum;
+};
+
+/* the file being converted */
+struct convert
+{
+    const uint8_t* map;                     //the input file
+    size_t size;
+    bool text_in;                           //the input is a text log file
+    uint32_t out_format;                    //CONVERT_TEXT or one of enum binlog_format
+    bool codes;                             //the frames are int24 codes, not units
+    struct binlog_header header;            //of the input, made up for a text file
+    double scale[BINLOG_MAX_CHANNELS];      //units per int24 code
+    struct piece* pieces;
+    uint32_t count;                         //pieces
+    uint32_t size_pieces;                   //pieces allocated
+    uint32_t max_frames;                    //most frames in a piece
+    int threads;
+    int fd;                                 //text output
+    struct binlog log;                      //binary output
+};
+
+enum job
+{
+    JOB_COUNT,                              //count the lines of text pieces
+    JOB_CONVERT                             //decode pieces, and format them if text
+};
+
+/* pieces converted at the same time, by threads which take one each in turn */
+struct batch
+{
+    struct convert* cv;
+    enum job job;
+    uint32_t first;                         //first piece
+    uint32_t count;                         //pieces
+    atomic_uint next;                       //next piece for a thread to take
+    double* values;                         //decoded frames of the pieces
+    size_t offset[CONVERT_BATCH_PIECES];    //of the frames of each piece in values
+    char* text[CONVERT_BATCH_PIECES];       //text output of each piece
+    size_t text_size[CONVERT_BATCH_PIECES];
+    const char* out[CONVERT_BATCH_PIECES];  //text to write, in text or the input file
+    size_t out_len[CONVERT_BATCH_PIECES];
+    const char* error[CONVERT_BATCH_PIECES];//NULL if converted
+    pthread_t threads[CONVERT_MAX_THREADS];
+    int num_threads;
+};
+
+/* local function declarations */
+static uint32_t parse_format(const char*);
+static bool add_piece(struct convert*, const uint8_t*, size_t, uint64_t, uint32_t);
+static const char* binary_pieces(struct convert*);
+static bool chunk_valid(struct convert*, struct binlog_chunk*);
+static const char* text_pieces(struct convert*, double, double);
+static const char* parse_line(const char*, const char*, uint32_t, double*, uint32_t*);
+static double find_rate(const char*, const char*, uint32_t);
+static uint64_t select_range(struct convert*, uint64_t, uint64_t, uint32_t*);
+static void output_header(struct convert*, struct binlog_header*, double);
+static bool convert_all(struct convert*);
+static uint32_t batch_fill(struct batch*, uint32_t);
+static void batch_start(struct batch*, uint32_t, uint32_t, enum job);
+static void batch_join(struct batch*);
+static void* batch_thread(void*);
+static const char* convert_piece(struct batch*, uint32_t, int32_t**);
+static const char* parse_piece(struct convert*, struct piece*, double*);
+static const char* decode_piece(struct convert*, struct piece*, double*, int32_t**);
+static bool format_piece(struct batch*, uint32_t, struct piece*, double*);
+static bool write_batch(struct batch*);
+static bool write_all(int, const char*, size_t);
+static double now(void);
+
+int main(int argc, char* argv[])
+{
+    struct convert cv;
+    struct binlog_header header;
+    struct stat in_stat;
+    struct stat out_stat;
+    double rate = 0.0;
+    double sensitivity = 1000.0;
+    double chunk_seconds = 0.0;
+    double start;
+    uint64_t from = 0;
+    uint64_t to = UINT64_MAX;
+    uint64_t frames;
+    uint64_t bytes = 0;
+    uint32_t max_keep;
+    uint32_t i;
+    const char* error;
+    bool ok;
+    int fd;
+    int opt;
+
+    memset(&cv, 0, sizeof(cv));
+    cv.fd = -1;
+    cv.log.file.fd = -1;
+    cv.threads = sysconf(_SC_NPROCESSORS_ONLN);
+    while ((opt = getopt(argc, argv, "j:r:s:c:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'j': cv.threads = atoi(optarg); break;
+            case 'r': rate = atof(optarg); break;
+            case 's': sensitivity = atof(optarg); break;
+            case 'c': chunk_seconds = atof(optarg); break;
+            default: argc = 0; break;
+        }
+    }
+    if ((argc - optind < 3) || (argc - optind > 5) ||
+        ((cv.out_format = parse_format(argv[optind + 2])) > BINLOG_COMPRESSED) ||
+        !(sensitivity > 0.0))
+    {
+        fprintf(stderr, "usage: vibconvert [-j threads] [-r scan rate] [-s sensitivity]\n"
+            "                  [-c chunk seconds] <input file> <output file> <format>\n"
+            "                  [from seconds] [to seconds]\n"
+            "       format is text, float32, float64, int24 or compressed\n");
+        return 1;
+    }
+    if (cv.threads < 1)
+    {
+        cv.threads = 1;
+    }
+    if (cv.threads > CONVERT_MAX_THREADS)
+    {
+        cv.threads = CONVERT_MAX_THREADS;
+    }
+
+    //the whole input file is mapped, the threads read the pieces from it
+    fd = open(argv[optind], O_RDONLY);
+    if ((fd < 0) || (fstat(fd, &in_stat) != 0))
+    {
+        fprintf(stderr, "vibconvert: cannot open %s\n", argv[optind]);
+        return 1;
+    }
+    if ((stat(argv[optind + 1], &out_stat) == 0) && (out_stat.st_dev == in_stat.st_dev) &&
+        (out_stat.st_ino == in_stat.st_ino))
+    {
+        fprintf(stderr, "vibconvert: the output file is the input file\n");
+        close(fd);
+        return 1;
+    }
+    cv.size = in_stat.st_size;
+    if (cv.size == 0)
+    {
+        fprintf(stderr, "vibconvert: %s is empty\n", argv[optind]);
+        close(fd);
+        return 1;
+    }
+    cv.map = mmap(NULL, cv.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (cv.map == MAP_FAILED)
+    {
+        fprintf(stderr, "vibconvert: cannot map %s\n", argv[optind]);
+        return 1;
+    }
+    madvise((void*)cv.map, cv.size, MADV_SEQUENTIAL);
+    start = now();
+
+    cv.text_in = (cv.size < sizeof(cv.header)) ||
+        (memcmp(cv.map, BINLOG_MAGIC, sizeof(cv.header.magic)) != 0);
+    error = cv.text_in ? text_pieces(&cv, rate, sensitivity) : binary_pieces(&cv);
+    if (error != NULL)
+    {
+        fprintf(stderr, "vibconvert: %s: %s\n", argv[optind], error);
+        free(cv.pieces);
+        munmap((void*)cv.map, cv.size);
+        return 1;
+    }
+
+    if (argc - optind > 3)
+    {
+        from = (uint64_t)(atof(argv[optind + 3]) * cv.header.scan_rate);
+    }
+    if (argc - optind > 4)
+    {
+        to = (uint64_t)(atof(argv[optind + 4]) * cv.header.scan_rate);
+    }
+    frames = select_range(&cv, from, to, &max_keep);
+    for (i = 0; i < cv.count; i++)
+    {
+        bytes += cv.pieces[i].bytes;
+    }
+
+    //ADC codes are kept as they are, if the output has codes too
+    cv.codes = !cv.text_in && (cv.header.flags & BINLOG_FLAG_RAW_CODES) &&
+        ((cv.out_format == BINLOG_INT24) || (cv.out_format == BINLOG_COMPRESSED));
+    for (i = 0; i < cv.header.num_channels; i++)
+    {
+        cv.scale[i] = cv.header.cal_slope[i] * cv.header.code_lsb * 1000.0 /
+            cv.header.sensitivity[i];
+    }
+
+    if (cv.out_format == CONVERT_TEXT)
+    {
+        cv.fd = open(argv[optind + 1], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        ok = cv.fd >= 0;
+    }
+    else
+    {
+        output_header(&cv, &header, chunk_seconds);
+        ok = binlog_open(&cv.log, argv[optind + 1], &header,
+            (max_keep > 0) ? max_keep : 1, frames);
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "vibconvert: cannot create %s\n", argv[optind + 1]);
+        free(cv.pieces);
+        munmap((void*)cv.map, cv.size);
+        return 1;
+    }
+
+    ok = convert_all(&cv);
+    if (cv.out_format == CONVERT_TEXT)
+    {
+        ok = (close(cv.fd) == 0) && ok;
+    }
+    else
+    {
+        ok = binlog_close(&cv.log) && ok;
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "vibconvert: error writing %s\n", argv[optind + 1]);
+    }
+    start = now() - start + 1e-9;
+    if (stat(argv[optind + 1], &out_stat) != 0)
+    {
+        out_stat.st_size = 0;
+    }
+
+    printf("%llu frames of %u channels in %.2f s, %.1f MB read at %.0f MB/s, "
+        "%.1f MB written at %.0f MB/s\n", (unsigned long long)frames,
+        cv.header.num_channels, start, bytes / 1e6, bytes / 1e6 / start,
+        out_stat.st_size / 1e6, out_stat.st_size / 1e6 / start);
+    free(cv.pieces);
+    munmap((void*)cv.map, cv.size);
+    return ok ? 0 : 1;
+}
+
+
+/****************************
+ * parse_format() - the output format of its name
+ *
+ * returns - CONVERT_TEXT, one of enum binlog_format, or more if not known
+ ****************************/
+static uint32_t
+parse_format(const char* name)
+{
+    const char* formats[] = {"text", "float32", "float64", "int24", "compressed", NULL};
+    uint32_t i;
+
+    for (i = 0; (formats[i] != NULL) && (strcmp(formats[i], name) != 0); i++)
+    {
+    }
+    return i;
+}
+
+
+/****************************
+ * add_piece() - adds a piece of the input file to those to convert
+ *
+ * returns - false if out of memory
+ ****************************/
+static bool
+add_piece(struct convert* cv, const uint8_t* data, size_t bytes, uint64_t first_frame,
+    uint32_t frames)
+{
+    struct piece* grown;
+    struct piece* pc;
+
+    if (cv->count == cv->size_pieces)
+    {
+        cv->size_pieces = (cv->size_pieces > 0) ? 2 * cv->size_pieces : 64;
+        grown = realloc(cv->pieces, sizeof(*grown) * cv->size_pieces);
+        if (grown == NULL)
+        {
+            return false;
+        }
+        cv->pieces = grown;
+    }
+    pc = &cv->pieces[cv->count++];
+    memset(pc, 0, sizeof(*pc));
+    pc->data = data;
+    pc->bytes = bytes;
+    pc->first_frame = first_frame;
+    pc->frames = frames;
+    if (frames > cv->max_frames)
+    {
+        cv->max_frames = frames;
+    }
+    return true;
+}
+
+
+/****************************
+ * binary_pieces() - splits a binary log file into pieces
+ *
+ * A chunked file is split into its chunks, from the index, or if there
+ * is none by reading the struct of each in turn. A compressed file is
+ * split into its blocks, which have to be found in turn, but are only
+ * decoded later. Other files are split into runs of frames. A chunk or
+ * block cut short at the end of a file which was not closed is left out.
+ *
+ * returns - NULL, or what is wrong with the file
+ ****************************/
+static const char*
+binary_pieces(struct convert* cv)
+{
+    struct binlog_header* h = &cv->header;
+    uint64_t frame_size;
+    uint64_t pos;
+    uint64_t frames;
+    uint64_t frame = 0;
+    uint32_t piece_frames;
+    uint32_t n;
+    uint32_t i;
+    struct binlog_chunk chunk;
+    struct codec_block block;
+
+    memcpy(h, cv->map, sizeof(*h));
+    frame_size = (uint64_t)binlog_sample_size(h->sample_format) * h->num_channels;
+    if ((h->num_channels < 1) || (h->num_channels > BINLOG_MAX_CHANNELS) ||
+        (frame_size == 0) || (h->header_size < sizeof(*h)) ||
+        (h->header_size > cv->size) || !(h->scan_rate > 0.0))
+    {
+        return "header of the binary log file not valid";
+    }
+    pos = h->header_size;
+
+    if ((h->flags & BINLOG_FLAG_CHUNKED) && (h->index_offset != 0) && (h->chunk_count > 0))
+    {
+        if ((h->index_offset > cv->size) ||
+            ((cv->size - h->index_offset) / sizeof(chunk) < h->chunk_count))
+        {
+            return "index cut short";
+        }
+        for (i = 0; i < h->chunk_count; i++)
+        {
+            memcpy(&chunk, cv->map + h->index_offset + i * sizeof(chunk), sizeof(chunk));
+            if (!chunk_valid(cv, &chunk))
+            {
+                return "chunk in the index not valid";
+            }
+            if (!add_piece(cv, cv->map + chunk.offset, chunk.bytes, chunk.first_frame,
+                chunk.frames))
+            {
+                return "out of memory";
+            }
+            cv->pieces[cv->count - 1].columns = (h->sample_format != BINLOG_COMPRESSED);
+            cv->pieces[cv->count - 1].check = true;
+            cv->pieces[cv->count - 1].checksum = chunk.checksum;
+        }
+    }
+    else if (h->flags & BINLOG_FLAG_CHUNKED)
+    {
+        //not closed, no index
+        while (pos + sizeof(chunk) <= cv->size)
+        {
+            memcpy(&chunk, cv->map + pos, sizeof(chunk));
+            if ((chunk.frames == 0) || (chunk.offset != pos + sizeof(chunk)) ||
+                (chunk.bytes > cv->size - chunk.offset))
+            {
+                break;
+            }
+            if (!chunk_valid(cv, &chunk))
+            {
+                return "chunk not valid";
+            }
+            if (!add_piece(cv, cv->map + chunk.offset, chunk.bytes, chunk.first_frame,
+                chunk.frames))
+            {
+                return "out of memory";
+            }
+            cv->pieces[cv->count - 1].columns = (h->sample_format != BINLOG_COMPRESSED);
+            cv->pieces[cv->count - 1].check = true;
+            cv->pieces[cv->count - 1].checksum = chunk.checksum;
+            pos = chunk.offset + chunk.bytes;
+        }
+    }
+    else if (h->sample_format == BINLOG_COMPRESSED)
+    {
+        while (pos + sizeof(block) <= cv->size)
+        {
+            memcpy(&block, cv->map + pos, sizeof(block));
+            if ((block.frames == 0) || (block.frames > CONVERT_MAX_FRAMES) ||
+                (block.bytes > codec_max_bytes(block.frames, h->num_channels)))
+            {
+                return "block not valid";
+            }
+            if (block.bytes > cv->size - pos - sizeof(block))
+            {
+                break;
+            }
+            if (!add_piece(cv, cv->map + pos + sizeof(block), block.bytes, frame,
+                block.frames))
+            {
+                return "out of memory";
+            }
+            frame += block.frames;
+            pos += sizeof(block) + block.bytes;
+        }
+    }
+    else
+    {
+        frames = (cv->size - pos) / frame_size;
+        if ((h->frame_count != 0) && (h->frame_count < frames))
+        {
+            frames = h->frame_count;
+        }
+        piece_frames = CONVERT_PIECE_SAMPLES / h->num_channels;
+        for (frame = 0; frame < frames; frame += n)
+        {
+            n = (frames - frame < piece_frames) ? frames - frame : piece_frames;
+            if (!add_piece(cv, cv->map + pos + frame * frame_size, n * frame_size,
+                frame, n))
+            {
+                return "out of memory";
+            }
+        }
+    }
+
+    if (cv->count == 0)
+    {
+        return "no frames";
+    }
+    return NULL;
+}
+
+
+/****************************
+ * chunk_valid() - checks the struct of a chunk is for a chunk in the file
+ ****************************/
+static bool
+chunk_valid(struct convert* cv, struct binlog_chunk* chunk)
+{
+    uint32_t nch = cv->header.num_channels;
+
+    if ((chunk->frames == 0) || (chunk->frames > CONVERT_MAX_FRAMES) ||
+        (chunk->offset < cv->header.header_size) || (chunk->offset > cv->size) ||
+        (chunk->bytes > cv->size - chunk->offset))
+    {
+        return false;
+    }
+    if (cv->header.sample_format == BINLOG_COMPRESSED)
+    {
+        return chunk->bytes <= codec_max_bytes(chunk->frames, nch);
+    }
+    return chunk->bytes ==
+        (uint64_t)chunk->frames * nch * binlog_sample_size(cv->header.sample_format);
+}
+
+
+/****************************
+ * text_pieces() - splits a text log file into pieces, at the ends of lines
+ *
+ * The lines of each piece are counted, by the threads, so the frame
+ * each piece starts at is known. A header is made up for the file,
+ * with the time of the first line, and the scan rate given, or found
+ * from the times of the lines. A last line with no newline, from a
+ * file which was not closed, is left out.
+ *
+ * returns - NULL, or what is wrong with the file
+ ****************************/
+static const char*
+text_pieces(struct convert* cv, double rate, double sensitivity)
+{
+    const char* text = (const char*)cv->map;
+    const char* end = text + cv->size;
+    const char* p;
+    const char* q;
+    const char* dot;
+    double values[BINLOG_MAX_CHANNELS];
+    uint32_t nch = 0;
+    uint32_t frac;
+    uint64_t frame = 0;
+    uint32_t i;
+    struct batch* b;
+    struct tm tm;
+
+    while ((end > text) && (end[-1] != '\n'))
+    {
+        end--;
+    }
+    if (end == text)
+    {
+        return "no lines in the file";
+    }
+
+    //the columns of the first line, after the date and time, are the channels
+    q = memchr(text, '\n', end - text);
+    dot = memchr(text, '.', q - text);
+    for (p = (dot != NULL) ? dot : q; p < q; p++)
+    {
+        nch += (*p == ',');
+    }
+    if ((dot == NULL) || (nch < 1) || (nch > BINLOG_MAX_CHANNELS) ||
+        (dot - text >= (long)sizeof(cv->header.start_date)) ||
+        (parse_line(text, end, nch, values, &frac) == NULL))
+    {
+        return "not a binary or text log file";
+    }
+
+    if (!(rate > 0.0))
+    {
+        rate = find_rate(text, end, nch);
+        if (!(rate > 0.0))
+        {
+            return "the scan rate cannot be found from the times of the lines, "
+                "give it with -r";
+        }
+    }
+    binlog_header_init(&cv->header, BINLOG_FLOAT64, nch, rate);
+    for (i = 0; i < nch; i++)
+    {
+        cv->header.sensitivity[i] = sensitivity;
+    }
+    memcpy(cv->header.start_date, text, dot - text);
+    memset(&tm, 0, sizeof(tm));
+    if (sscanf(cv->header.start_date, "%d-%d-%d %d:%d:%d", &tm.tm_year, &tm.tm_mon,
+        &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6)
+    {
+        return "date and time of the first line not valid";
+    }
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+    cv->header.start_sec = mktime(&tm);
+    cv->header.start_nsec = frac;
+
+    for (p = text; p < end; p = q)
+    {
+        q = (end - p > CONVERT_TEXT_PIECE) ?
+            (const char*)memchr(p + CONVERT_TEXT_PIECE, '\n', end - p - CONVERT_TEXT_PIECE) + 1 :
+            end;
+        if (!add_piece(cv, (const uint8_t*)p, q - p, 0, 0))
+        {
+            return "out of memory";
+        }
+    }
+
+    b = calloc(1, sizeof(*b));
+    if (b == NULL)
+    {
+        return "out of memory";
+    }
+    b->cv = cv;
+    batch_start(b, 0, cv->count, JOB_COUNT);
+    batch_join(b);
+    free(b);
+    for (i = 0; i < cv->count; i++)
+    {
+        cv->pieces[i].first_frame = frame;
+        frame += cv->pieces[i].frames;
+        if (cv->pieces[i].frames > cv->max_frames)
+        {
+            cv->max_frames = cv->pieces[i].frames;
+        }
+    }
+    return NULL;
+}
+
+
+/****************************
+ * parse_line() - reads a line of a text log file
+ *
+ * param frac - returns the fraction of a second of the time, in ns,
+ *              NULL if not wanted
+ * returns - the next line, NULL if the line is not valid
+ ****************************/
+static const char*
+parse_line(const char* p, const char* end, uint32_t num_channels, double* values,
+    uint32_t* frac)
+{
+    const char* eol = memchr(p, '\n', end - p);
+    uint32_t ch;
+
+    if (eol == NULL)
+    {
+        return NULL;
+    }
+    p = memchr(p, '.', eol - p);
+    if (p == NULL)
+    {
+        return NULL;
+    }
+    p++;
+    if (frac != NULL)
+    {
+        *frac = 0;
+        for (ch = 0; (ch < 9) && (*p >= '0') && (*p <= '9'); ch++)
+        {
+            *frac = *frac * 10 + (*p++ - '0');
+        }
+        if (ch < 9)
+        {
+            return NULL;
+        }
+    }
+    while ((*p >= '0') && (*p <= '9'))
+    {
+        p++;
+    }
+
+    for (ch = 0; ch < num_channels; ch++)
+    {
+        if (*p != ',')
+        {
+            return NULL;
+        }
+        p = textfmt_parse(p + 1, &values[ch]);
+        if ((p == NULL) || (p > eol))
+        {
+            return NULL;
+        }
+    }
+    while ((*p == ' ') || (*p == '\r'))
+    {
+        p++;
+    }
+    return (p == eol) ? eol + 1 : NULL;
+}
+
+
+/****************************
+ * find_rate() - the scan rate, from the times of the lines of a text file
+ *
+ * The lines only have the fraction of a second of their time, so the
+ * longest run of lines in the first piece, without the time going past
+ * a whole second, gives the rate. If within 10 ppm of a rate the MCC 172
+ * scans at, 51.2 kHz divided by a whole number, it is that rate.
+ *
+ * returns - the scan rate, 0 if there are not enough lines
+ ****************************/
+static double
+find_rate(const char* text, const char* end, uint32_t num_channels)
+{
+    double values[BINLOG_MAX_CHANNELS];
+    const char* p = text;
+    uint32_t frac;
+    uint32_t last = 0;
+    uint32_t run_start = 0;
+    uint32_t run_lines = 0;                 //lines in the run, from 1
+    uint32_t best_lines = 0;                //lines after the first of the longest run
+    uint32_t best_ns = 0;
+    double rate;
+    double divisor;
+
+    if (end - text > CONVERT_TEXT_PIECE)
+    {
+        end = text + CONVERT_TEXT_PIECE;
+    }
+    while ((p = parse_line(p, end, num_channels, values, &frac)) != NULL)
+    {
+        if ((run_lines > 0) && (frac > last))
+        {
+            if (run_lines > best_lines)
+            {
+                best_lines = run_lines;
+                best_ns = frac - run_start;
+            }
+            run_lines++;
+        }
+        else
+        {
+            run_start = frac;
+            run_lines = 1;
+        }
+        last = frac;
+    }
+    if (best_lines == 0)
+    {
+        return 0.0;
+    }
+
+    rate = best_lines * 1e9 / best_ns;
+    divisor = nearbyint(CONVERT_CLOCK / rate);
+    if ((divisor >= 1.0) && (fabs(CONVERT_CLOCK / divisor - rate) < rate * 1e-5))
+    {
+        rate = CONVERT_CLOCK / divisor;
+    }
+    return rate;
+}
+
+
+/****************************
+ * select_range() - picks the frames of the pieces from and to frames
+ *
+ * Pieces with none of the frames are left out.
+ *
+ * param max_keep - returns the most frames kept in a piece
+ * returns - the number of frames
+ ****************************/
+static uint64_t
+select_range(struct convert* cv, uint64_t from, uint64_t to, uint32_t* max_keep)
+{
+    struct piece* pc;
+    uint64_t frames = 0;
+    uint64_t first;
+    uint64_t last;
+    uint32_t count = 0;
+    uint32_t i;
+
+    *max_keep = 0;
+    cv->max_frames = 0;
+    for (i = 0; i < cv->count; i++)
+    {
+        pc = &cv->pieces[i];
+        first = (pc->first_frame > from) ? pc->first_frame : from;
+        last = pc->first_frame + pc->frames;
+        if (last > to)
+        {
+            last = to;
+        }
+        if (first >= last)
+        {
+            continue;
+        }
+        pc->skip = first - pc->first_frame;
+        pc->keep = last - first;
+        frames += pc->keep;
+        if (pc->keep > *max_keep)
+        {
+            *max_keep = pc->keep;
+        }
+        if (pc->frames > cv->max_frames)
+        {
+            cv->max_frames = pc->frames;
+        }
+        cv->pieces[count++] = *pc;
+    }
+    cv->count = count;
+    return frames;
+}
+
+
+/****************************
+ * output_header() - header of a binary output file
+ *
+ * The header of the input, with the sample format of the output, and
+ * the time and frame of the scan of the first frame in the time range.
+ * Calibration is only kept with the ADC codes it is for.
+ ****************************/
+static void
+output_header(struct convert* cv, struct binlog_header* header, double chunk_seconds)
+{
+    uint64_t from;
+    uint64_t nsec;
+    time_t start;
+    struct tm tm;
+    int i;
+
+    *header = cv->header;
+    header->version = BINLOG_VERSION;
+    header->header_size = sizeof(*header);
+    header->sample_format = cv->out_format;
+    header->frame_count = 0;
+    if (!cv->codes)
+    {
+        header->flags &= ~BINLOG_FLAG_RAW_CODES;
+        for (i = 0; i < BINLOG_MAX_CHANNELS; i++)
+        {
+            header->cal_slope[i] = 1.0;
+            header->cal_offset[i] = 0.0;
+        }
+    }
+    header->flags &= ~BINLOG_FLAG_CHUNKED;
+    header->chunk_frames = 0;
+    header->chunk_count = 0;
+    header->index_offset = 0;
+    if (chunk_seconds > 0.0)
+    {
+        header->flags |= BINLOG_FLAG_CHUNKED;
+        header->chunk_frames = (uint32_t)llround(chunk_seconds * header->scan_rate);
+        if (header->chunk_frames == 0)
+        {
+            header->chunk_frames = 1;
+        }
+    }
+
+    if ((cv->count > 0) && (cv->pieces[0].first_frame + cv->pieces[0].skip > 0))
+    {
+        from = cv->pieces[0].first_frame + cv->pieces[0].skip;
+        header->first_frame += from;
+        nsec = header->start_nsec + (uint64_t)llround(from / header->scan_rate * 1e9);
+        header->start_sec += nsec / 1000000000;
+        header->start_nsec = nsec % 1000000000;
+        start = header->start_sec;
+        localtime_r(&start, &tm);
+        memset(header->start_date, 0, sizeof(header->start_date));
+        strftime(header->start_date, sizeof(header->start_date), "%Y-%m-%d %H:%M:%S", &tm);
+    }
+}
+
+
+/****************************
+ * convert_all() - converts the pieces, and writes them to the output
+ *
+ * While a batch is written the next is converted.
+ *
+ * returns - false if a piece could not be converted, or written
+ ****************************/
+static bool
+convert_all(struct convert* cv)
+{
+    struct batch* batches = calloc(2, sizeof(*batches));
+    size_t samples = (size_t)cv->max_frames * cv->header.num_channels;
+    uint32_t next = 0;
+    uint32_t j;
+    int cur = 0;
+    int i;
+    bool ok = true;
+
+    if (samples < CONVERT_BATCH_SAMPLES)
+    {
+        samples = CONVERT_BATCH_SAMPLES;
+    }
+    for (i = 0; (batches != NULL) && (i < 2); i++)
+    {
+        batches[i].cv = cv;
+        batches[i].values = malloc(sizeof(double) * samples);
+        if (batches[i].values == NULL)
+        {
+            ok = false;
+        }
+    }
+    if ((batches == NULL) || !ok)
+    {
+        fprintf(stderr, "vibconvert: out of memory\n");
+        ok = false;
+    }
+
+    if (ok)
+    {
+        next = batch_fill(&batches[0], 0);
+    }
+    while (ok && (batches[cur].count > 0))
+    {
+        batch_join(&batches[cur]);
+        batches[1 - cur].count = 0;
+        if (next < cv->count)
+        {
+            next += batch_fill(&batches[1 - cur], next);
+        }
+        if (!write_batch(&batches[cur]))
+        {
+            batch_join(&batches[1 - cur]);
+            ok = false;
+        }
+        cur = 1 - cur;
+    }
+
+    for (i = 0; (batches != NULL) && (i < 2); i++)
+    {
+        free(batches[i].values);
+        for (j = 0; j < CONVERT_BATCH_PIECES; j++)
+        {
+            free(batches[i].text[j]);
+        }
+    }
+    free(batches);
+    return ok;
+}
+
+
+/****************************
+ * batch_fill() - starts the threads converting the pieces from first
+ *
+ * As many pieces are taken as the values of the batch have room for.
+ *
+ * returns - the number of pieces taken
+ ****************************/
+static uint32_t
+batch_fill(struct batch* b, uint32_t first)
+{
+    struct convert* cv = b->cv;
+    size_t samples = 0;
+    size_t n;
+    uint32_t count = 0;
+
+    while ((first + count < cv->count) && (count < CONVERT_BATCH_PIECES))
+    {
+        n = (size_t)cv->pieces[first + count].frames * cv->header.num_channels;
+        if ((count > 0) && (samples + n > CONVERT_BATCH_SAMPLES))
+        {
+            break;
+        }
+        b->offset[count] = samples;
+        samples += n;
+        count++;
+    }
+    batch_start(b, first, count, JOB_CONVERT);
+    return count;
+}
+
+
+/****************************
+ * batch_start() - starts the threads doing a job on pieces
+ *
+ * If no thread can be started the job is done before returning.
+ ****************************/
+static void
+batch_start(struct batch* b, uint32_t first, uint32_t count, enum job job)
+{
+    int threads = (b->cv->threads < (int)count) ? b->cv->threads : (int)count;
+
+    b->job = job;
+    b->first = first;
+    b->count = count;
+    atomic_init(&b->next, 0);
+    for (b->num_threads = 0; b->num_threads < threads; b->num_threads++)
+    {
+        if (pthread_create(&b->threads[b->num_threads], NULL, batch_thread, b) != 0)
+        {
+            break;
+        }
+    }
+    if (b->num_threads == 0)
+    {
+        batch_thread(b);
+    }
+}
+
+
+/****************************
+ * batch_join() - waits for the threads of a batch to finish
+ ****************************/
+static void
+batch_join(struct batch* b)
+{
+    while (b->num_threads > 0)
+    {
+        pthread_join(b->threads[--b->num_threads], NULL);
+    }
+}
+
+
+/****************************
+ * batch_thread() - takes pieces of the batch in turn, until none are left
+ ****************************/
+static void*
+batch_thread(void* arg)
+{
+    struct batch* b = arg;
+    struct piece* pc;
+    const char* p;
+    const char* end;
+    int32_t* codes = NULL;
+    uint32_t j;
+
+    while ((j = atomic_fetch_add(&b->next, 1)) < b->count)
+    {
+        if (b->job == JOB_CONVERT)
+        {
+            b->error[j] = convert_piece(b, j, &codes);
+            continue;
+        }
+        pc = &b->cv->pieces[b->first + j];
+        end = (const char*)pc->data + pc->bytes;
+        for (p = (const char*)pc->data; (p = memchr(p, '\n', end - p)) != NULL; p++)
+        {
+            pc->frames++;
+        }
+    }
+    free(codes);
+    return NULL;
+}
+
+
+/****************************
+ * convert_piece() - decodes a piece, and formats it if the output is text
+ *
+ * The lines of a text file are not read for text output, as they are
+ * the lines of the output.
+ *
+ * param codes - codes of a compressed piece, allocated for the thread
+ * returns - NULL, or what is wrong with the piece
+ ****************************/
+static const char*
+convert_piece(struct batch* b, uint32_t j, int32_t** codes)
+{
+    struct convert* cv = b->cv;
+    struct piece* pc = &cv->pieces[b->first + j];
+    double* values = b->values + b->offset[j];
+    const char* p = (const char*)pc->data;
+    const char* end = p + pc->bytes;
+    const char* error;
+    uint32_t i;
+
+    if (cv->text_in && (cv->out_format == CONVERT_TEXT))
+    {
+        for (i = 0; i < pc->skip; i++)
+        {
+            p = (const char*)memchr(p, '\n', end - p) + 1;
+        }
+        b->out[j] = p;
+        for (i = 0; i < pc->keep; i++)
+        {
+            p = (const char*)memchr(p, '\n', end - p) + 1;
+        }
+        b->out_len[j] = p - b->out[j];
+        return NULL;
+    }
+
+    error = cv->text_in ? parse_piece(cv, pc, values) : decode_piece(cv, pc, values, codes);
+    if ((error == NULL) && (cv->out_format == CONVERT_TEXT) &&
+        !format_piece(b, j, pc, values + (size_t)pc->skip * cv->header.num_channels))
+    {
+        error = "out of memory";
+    }
+    return error;
+}
+
+
+/****************************
+ * parse_piece() - reads the lines of a piece of a text file in the range
+ *
+ * The values of the lines are where they would be with the lines
+ * before the range, so the same as decode_piece().
+ ****************************/
+static const char*
+parse_piece(struct convert* cv, struct piece* pc, double* values)
+{
+    uint32_t nch = cv->header.num_channels;
+    const char* p = (const char*)pc->data;
+    const char* end = p + pc->bytes;
+    uint32_t i;
+
+    for (i = 0; i < pc->skip; i++)
+    {
+        p = (const char*)memchr(p, '\n', end - p) + 1;
+    }
+    for (i = pc->skip; i < pc->skip + pc->keep; i++)
+    {
+        p = parse_line(p, end, nch, &values[(size_t)i * nch], NULL);
+        if (p == NULL)
+        {
+            return "line not valid";
+        }
+    }
+    return NULL;
+}
+
+
+/****************************
+ * decode_piece() - converts the samples of a piece of a binary file to values
+ *
+ * int24 codes are converted to units, unless the output has codes too.
+ ****************************/
+static const char*
+decode_piece(struct convert* cv, struct piece* pc, double* values, int32_t** codes)
+{
+    uint32_t nch = cv->header.num_channels;
+    uint32_t size = binlog_sample_size(cv->header.sample_format);
+    size_t frame_step = pc->columns ? size : (size_t)size * nch;
+    size_t channel_step = pc->columns ? (size_t)size * pc->frames : size;
+    const uint8_t* p;
+    double* v;
+    float f;
+    double d;
+    int32_t code;
+    uint32_t ch;
+    uint32_t i;
+
+    if (pc->check && (binlog_crc32(0, pc->data, pc->bytes) != pc->checksum))
+    {
+        return "checksum error";
+    }
+
+    if (cv->header.sample_format == BINLOG_COMPRESSED)
+    {
+        if (*codes == NULL)
+        {
+            *codes = malloc(sizeof(int32_t) * cv->max_frames * nch);
+            if (*codes == NULL)
+            {
+                return "out of memory";
+            }
+        }
+        if (!codec_decode(pc->data, pc->bytes, pc->frames, nch, *codes))
+        {
+            return "block not valid";
+        }
+        for (i = 0, ch = 0; i < pc->frames * nch; i++)
+        {
+            values[i] = cv->codes ? (*codes)[i] :
+                ((*codes)[i] - cv->header.cal_offset[ch]) * cv->scale[ch];
+            if (++ch == nch)
+            {
+                ch = 0;
+            }
+        }
+        return NULL;
+    }
+
+    for (ch = 0; ch < nch; ch++)
+    {
+        p = pc->data + ch * channel_step;
+        v = values + ch;
+        switch (cv->header.sample_format)
+        {
+            case BINLOG_FLOAT32:
+                for (i = 0; i < pc->frames; i++, p += frame_step, v += nch)
+                {
+                    memcpy(&f, p, sizeof(f));
+                    *v = f;
+                }
+                break;
+            case BINLOG_FLOAT64:
+                for (i = 0; i < pc->frames; i++, p += frame_step, v += nch)
+                {
+                    memcpy(&d, p, sizeof(d));
+                    *v = d;
+                }
+                break;
+            default:
+                for (i = 0; i < pc->frames; i++, p += frame_step, v += nch)
+                {
+                    code = (int32_t)(p[0] | (p[1] << 8) | ((uint32_t)(int8_t)p[2] << 16));
+                    *v = cv->codes ? code :
+                        (code - cv->header.cal_offset[ch]) * cv->scale[ch];
+                }
+                break;
+        }
+    }
+    return NULL;
+}
+
+
+/****************************
+ * format_piece() - formats the frames of a piece in the range as text lines
+ *
+ * The lines are the same as scantofile writes, the time of each is
+ * worked out from its frame by textfmt_time(), and the date is only
+ * formatted again when the second changes.
+ *
+ * returns - false if out of memory
+ ****************************/
+static bool
+format_piece(struct batch* b, uint32_t j, struct piece* pc, double* values)
+{
+    struct convert* cv = b->cv;
+    uint32_t nch = cv->header.num_channels;
+    uint64_t frame = pc->first_frame + pc->skip;
+    int64_t date_sec = -1;
+    char date[sizeof(cv->header.start_date)];
+    size_t date_len = 0;
+    size_t len = 0;
+    size_t size;
+    char* grown;
+    uint32_t nsec;
+    int64_t sec;
+    time_t when;
+    struct tm tm;
+    uint32_t i;
+
+    for (i = 0; i < pc->keep; i++)
+    {
+        if (b->text_size[j] - len < TEXTFMT_MAX_LINE)
+        {
+            size = (b->text_size[j] > 0) ? 2 * b->text_size[j] : TEXTFMT_BUF_SIZE;
+            grown = realloc(b->text[j], size);
+            if (grown == NULL)
+            {
+                return false;
+            }
+            b->text[j] = grown;
+            b->text_size[j] = size;
+        }
+        nsec = textfmt_time(cv->header.start_sec, cv->header.start_nsec,
+            (frame + i) / cv->header.scan_rate, &sec);
+        if (sec != date_sec)
+        {
+            when = sec;
+            localtime_r(&when, &tm);
+            date_len = strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &tm);
+            date_sec = sec;
+        }
+        len = textfmt_line(b->text[j] + len, date, date_len, nsec * 1e-9,
+            &values[(size_t)i * nch], nch) - b->text[j];
+    }
+    b->out[j] = b->text[j];
+    b->out_len[j] = len;
+    return true;
+}
+
+
+/****************************
+ * write_batch() - writes the pieces of a batch to the output, in order
+ *
+ * returns - false if a piece was not converted, or the write failed
+ ****************************/
+static bool
+write_batch(struct batch* b)
+{
+    struct convert* cv = b->cv;
+    struct piece* pc;
+    uint32_t j;
+
+    for (j = 0; j < b->count; j++)
+    {
+        pc = &cv->pieces[b->first + j];
+        if (b->error[j] != NULL)
+        {
+            fprintf(stderr, "vibconvert: %s, in frames %llu to %llu\n", b->error[j],
+                (unsigned long long)pc->first_frame,
+                (unsigned long long)(pc->first_frame + pc->frames - 1));
+            return false;
+        }
+        if (cv->out_format == CONVERT_TEXT)
+        {
+            if (!write_all(cv->fd, b->out[j], b->out_len[j]))
+            {
+                return false;
+            }
+        }
+        else if (!binlog_write(&cv->log,
+            b->values + b->offset[j] + (size_t)pc->skip * cv->header.num_channels, pc->keep))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/****************************
+ * write_all() - writes all the bytes to a file
+ ****************************/
+static bool
+write_all(int fd, const char* data, size_t bytes)
+{
+    ssize_t result;
+
+    while (bytes > 0)
+    {
+        result = write(fd, data, bytes);
+        if (result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        data += result;
+        bytes -= result;
+    }
+    return true;
+}
+
+
+/****************************
+ * now() - monotonic time in seconds
+ ****************************/
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
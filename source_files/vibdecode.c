@@ -0,0 +1,231 @@
+/******************************
+ * vibdecode
+ *
+ * Decodes a binary log file with compressed samples.
+ *
+ * Each block of the file is decoded by codec.c and written as int24
+ * samples, so the output is a binary log file with the same header,
+ * apart from the sample format, and exactly the codes which were
+ * logged. If the file was not closed, eg the power failed, the
+ * blocks are decoded up to the last whole one, and the frame count
+ * is set in the output. The chunks of a chunked file are decoded the
+ * same way, and their checksums checked, the output is not chunked.
+ *
+ * usage: vibdecode <compressed file> <int24 file>
+ * returns - 0 if the file was decoded, 1 if not
+ ****************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "binlog.h"
+#include "codec.h"
+
+#define DECODE_MAX_FRAMES (1u << 24)    //more frames in a block is not a valid file
+
+/* local function declarations */
+static bool read_header(FILE*, struct binlog_header*);
+static int decode_blocks(FILE*, FILE*, struct binlog_header*, bool, uint64_t,
+    uint64_t*, uint64_t*);
+
+int main(int argc, char* argv[])
+{
+    struct binlog_header header;
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    uint64_t index_offset;
+    bool chunked;
+    int result;
+    FILE* in;
+    FILE* out;
+
+    if (argc != 3)
+    {
+        fprintf(stderr, "usage: vibdecode <compressed file> <int24 file>\n");
+        return 1;
+    }
+    in = fopen(argv[1], "rb");
+    if (in == NULL)
+    {
+        fprintf(stderr, "vibdecode: cannot open %s\n", argv[1]);
+        return 1;
+    }
+    if (!read_header(in, &header))
+    {
+        fprintf(stderr, "vibdecode: %s is not a binary log file with "
+            "compressed samples\n", argv[1]);
+        fclose(in);
+        return 1;
+    }
+    out = fopen(argv[2], "wb");
+    if (out == NULL)
+    {
+        fprintf(stderr, "vibdecode: cannot create %s\n", argv[2]);
+        fclose(in);
+        return 1;
+    }
+
+    //the header is written again at the end, with the frame count
+    chunked = (header.flags & BINLOG_FLAG_CHUNKED) != 0;
+    index_offset = header.index_offset;
+    header.sample_format = BINLOG_INT24;
+    header.flags &= ~BINLOG_FLAG_CHUNKED;
+    header.chunk_frames = 0;
+    header.chunk_count = 0;
+    header.index_offset = 0;
+    result = decode_blocks(in, out, &header, chunked, index_offset, &frames, &bytes);
+    if ((header.frame_count != 0) && (header.frame_count != frames) && (result == 0))
+    {
+        fprintf(stderr, "vibdecode: header has %llu frames, %llu decoded\n",
+            (unsigned long long)header.frame_count, (unsigned long long)frames);
+    }
+    header.frame_count = frames;
+    if ((fseek(out, 0, SEEK_SET) != 0) ||
+        (fwrite(&header, sizeof(header), 1, out) != 1) || (fclose(out) != 0))
+    {
+        fprintf(stderr, "vibdecode: error writing %s\n", argv[2]);
+        result = 1;
+    }
+    fclose(in);
+
+    printf("%llu frames of %u channels, %llu bytes compressed, %.2f times "
+        "smaller than int24\n", (unsigned long long)frames, header.num_channels,
+        (unsigned long long)bytes,
+        (bytes > 0) ? 3.0 * frames * header.num_channels / bytes : 0.0);
+    return result;
+}
+
+
+/****************************
+ * read_header() - reads the header and checks it is a compressed file
+ *
+ * Leaves the file at the first block.
+ ****************************/
+static bool
+read_header(FILE* fp, struct binlog_header* header)
+{
+    if ((fread(header, sizeof(*header), 1, fp) != 1) ||
+        (memcmp(header->magic, BINLOG_MAGIC, sizeof(header->magic)) != 0) ||
+        (header->sample_format != BINLOG_COMPRESSED) ||
+        (header->num_channels < 1) || (header->num_channels > BINLOG_MAX_CHANNELS) ||
+        (header->header_size < sizeof(*header)))
+    {
+        return false;
+    }
+    return fseek(fp, header->header_size, SEEK_SET) == 0;
+}
+
+
+/****************************
+ * decode_blocks() - decodes each block and writes it as int24 samples
+ *
+ * The header is written first, so the samples start at the same place.
+ * A block cut short at the end of the file is left out, any other
+ * error stops the decoding. In a chunked file each block is a chunk,
+ * up to the index, or the end of the file if it has none.
+ *
+ * returns - 0 if every block was decoded, 1 if not
+ ****************************/
+static int
+decode_blocks(FILE* in, FILE* out, struct binlog_header* header, bool chunked,
+    uint64_t index_offset, uint64_t* frames, uint64_t* bytes)
+{
+    uint32_t nch = header->num_channels;
+    struct codec_block block;
+    struct binlog_chunk chunk;
+    uint32_t max_frames = 0;
+    uint8_t* coded = NULL;
+    int32_t* codes = NULL;
+    uint8_t* packed = NULL;
+    uint32_t i;
+    int result = 0;
+
+    if ((fwrite(header, sizeof(*header), 1, out) != 1) ||
+        (fseek(out, header->header_size, SEEK_SET) != 0))
+    {
+        return 1;
+    }
+
+    for (;;)
+    {
+        if (chunked)
+        {
+            if (((index_offset != 0) && ((uint64_t)ftell(in) >= index_offset)) ||
+                (fread(&chunk, sizeof(chunk), 1, in) != 1))
+            {
+                break;
+            }
+            block.frames = chunk.frames;
+            block.bytes = chunk.bytes;
+        }
+        else if (fread(&block, sizeof(block), 1, in) != 1)
+        {
+            break;
+        }
+        if ((block.frames == 0) || (block.frames > DECODE_MAX_FRAMES) ||
+            (block.bytes > codec_max_bytes(block.frames, nch)))
+        {
+            fprintf(stderr, "vibdecode: block not valid after %llu frames\n",
+                (unsigned long long)*frames);
+            result = 1;
+            break;
+        }
+        if (block.frames > max_frames)
+        {
+            max_frames = block.frames;
+            free(coded);
+            free(codes);
+            free(packed);
+            coded = malloc(codec_max_bytes(max_frames, nch));
+            codes = malloc(sizeof(int32_t) * max_frames * nch);
+            packed = malloc((size_t)3 * max_frames * nch);
+            if ((coded == NULL) || (codes == NULL) || (packed == NULL))
+            {
+                fprintf(stderr, "vibdecode: out of memory\n");
+                result = 1;
+                break;
+            }
+        }
+
+        if (fread(coded, 1, block.bytes, in) != block.bytes)
+        {
+            fprintf(stderr, "vibdecode: last block cut short, left out\n");
+            break;
+        }
+        if (chunked && (binlog_crc32(0, coded, block.bytes) != chunk.checksum))
+        {
+            fprintf(stderr, "vibdecode: checksum error in the chunk after %llu frames\n",
+                (unsigned long long)*frames);
+            result = 1;
+            break;
+        }
+        if (!codec_decode(coded, block.bytes, block.frames, nch, codes))
+        {
+            fprintf(stderr, "vibdecode: block not valid after %llu frames\n",
+                (unsigned long long)*frames);
+            result = 1;
+            break;
+        }
+
+        for (i = 0; i < block.frames * nch; i++)
+        {
+            packed[3 * i] = codes[i] & 0xff;
+            packed[3 * i + 1] = (codes[i] >> 8) & 0xff;
+            packed[3 * i + 2] = (codes[i] >> 16) & 0xff;
+        }
+        if (fwrite(packed, 3, (size_t)block.frames * nch, out) != (size_t)block.frames * nch)
+        {
+            fprintf(stderr, "vibdecode: error writing\n");
+            result = 1;
+            break;
+        }
+        *frames += block.frames;
+        *bytes += (chunked ? sizeof(chunk) : sizeof(block)) + block.bytes;
+    }
+
+    free(coded);
+    free(codes);
+    free(packed);
+    return result;
+}
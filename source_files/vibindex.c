@@ -0,0 +1,237 @@
+/******************************
+ * vibindex
+ *
+ * Shows the chunks of a chunked binary log file, from its index.
+ *
+ * A line for each chunk, with the time of its first frame, the number
+ * of frames, and the minimum, maximum and RMS of each channel, so the
+ * whole file, or the time asked for, can be seen at a glance, without
+ * reading the samples. With a time range only the chunks in it are
+ * shown, which gives where in the file the samples of that time are.
+ * If the file was not closed, eg the power failed, there is no index,
+ * and the chunks are found by reading the struct of each in turn.
+ * With -c the samples of each chunk shown are read and the checksum
+ * checked.
+ *
+ * usage: vibindex [-c] <binary log file> [from seconds] [to seconds]
+ *        the times are from the start of the file
+ * returns - 0 if the chunks were read and their checksums correct, 1 if not
+ ****************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include "binlog.h"
+
+/* local function declarations */
+static bool read_header(FILE*, struct binlog_header*);
+static struct binlog_chunk* read_index(FILE*, struct binlog_header*, uint32_t*);
+static bool check_chunk(FILE*, struct binlog_chunk*);
+static void print_time(struct binlog_header*, uint64_t);
+
+int main(int argc, char* argv[])
+{
+    struct binlog_header header;
+    struct binlog_chunk* index;
+    struct binlog_chunk* c;
+    uint32_t count;
+    uint32_t i;
+    uint32_t ch;
+    uint64_t from = 0;
+    uint64_t to = UINT64_MAX;
+    bool check = false;
+    int errors = 0;
+    int arg = 1;
+    FILE* fp;
+
+    if ((argc > 1) && (strcmp(argv[1], "-c") == 0))
+    {
+        check = true;
+        arg++;
+    }
+    if ((argc - arg < 1) || (argc - arg > 3))
+    {
+        fprintf(stderr, "usage: vibindex [-c] <binary log file> "
+            "[from seconds] [to seconds]\n");
+        return 1;
+    }
+    fp = fopen(argv[arg], "rb");
+    if (fp == NULL)
+    {
+        fprintf(stderr, "vibindex: cannot open %s\n", argv[arg]);
+        return 1;
+    }
+    if (!read_header(fp, &header))
+    {
+        fprintf(stderr, "vibindex: %s is not a chunked binary log file\n", argv[arg]);
+        fclose(fp);
+        return 1;
+    }
+    if (argc - arg > 1)
+    {
+        from = (uint64_t)(atof(argv[arg + 1]) * header.scan_rate);
+    }
+    if (argc - arg > 2)
+    {
+        to = (uint64_t)(atof(argv[arg + 2]) * header.scan_rate);
+    }
+
+    index = read_index(fp, &header, &count);
+    if (index == NULL)
+    {
+        fprintf(stderr, "vibindex: no chunks in %s\n", argv[arg]);
+        fclose(fp);
+        return 1;
+    }
+
+    printf("# %u channels at %.3f Hz, %u chunks of %u frames, %s\n",
+        header.num_channels, header.scan_rate, count, header.chunk_frames,
+        (header.index_offset != 0) ? "from the index" : "not closed, no index");
+    printf("# time, first frame, frames, byte offset");
+    for (ch = 0; ch < header.num_channels; ch++)
+    {
+        printf(", ch%u min, ch%u max, ch%u rms", ch, ch, ch);
+    }
+    printf("\n");
+
+    for (i = 0; i < count; i++)
+    {
+        c = &index[i];
+        //chunks which end before the range, or start after it, are left out
+        if ((c->first_frame + c->frames <= from) || (c->first_frame >= to))
+        {
+            continue;
+        }
+        print_time(&header, c->first_frame);
+        printf(", %llu, %u, %llu", (unsigned long long)c->first_frame, c->frames,
+            (unsigned long long)c->offset);
+        for (ch = 0; ch < header.num_channels; ch++)
+        {
+            printf(", %.7f, %.7f, %.7f", c->min[ch], c->max[ch], c->rms[ch]);
+        }
+        printf("\n");
+        if (check && !check_chunk(fp, c))
+        {
+            printf("# checksum error in chunk %u\n", i);
+            errors++;
+        }
+    }
+
+    free(index);
+    fclose(fp);
+    return (errors > 0) ? 1 : 0;
+}
+
+
+/****************************
+ * read_header() - reads the header and checks it is a chunked file
+ ****************************/
+static bool
+read_header(FILE* fp, struct binlog_header* header)
+{
+    return (fread(header, sizeof(*header), 1, fp) == 1) &&
+        (memcmp(header->magic, BINLOG_MAGIC, sizeof(header->magic)) == 0) &&
+        (header->flags & BINLOG_FLAG_CHUNKED) && (header->chunk_frames > 0) &&
+        (header->num_channels >= 1) && (header->num_channels <= BINLOG_MAX_CHANNELS) &&
+        (header->header_size >= sizeof(*header)) && (header->scan_rate > 0.0);
+}
+
+
+/****************************
+ * read_index() - reads the index, or the struct of each chunk if none
+ *
+ * Without the index a chunk cut short at the end of the file is left out.
+ *
+ * returns - the chunks, which the caller frees, NULL if none
+ ****************************/
+static struct binlog_chunk*
+read_index(FILE* fp, struct binlog_header* header, uint32_t* count)
+{
+    struct binlog_chunk* index = NULL;
+    struct binlog_chunk* grown;
+    uint32_t size = 0;
+    long end;
+
+    *count = 0;
+    if ((header->index_offset != 0) && (header->chunk_count > 0))
+    {
+        index = malloc(sizeof(*index) * header->chunk_count);
+        if ((index == NULL) || (fseek(fp, header->index_offset, SEEK_SET) != 0) ||
+            (fread(index, sizeof(*index), header->chunk_count, fp) != header->chunk_count))
+        {
+            free(index);
+            return NULL;
+        }
+        *count = header->chunk_count;
+        return index;
+    }
+
+    if ((fseek(fp, 0, SEEK_END) != 0) || ((end = ftell(fp)) < 0) ||
+        (fseek(fp, header->header_size, SEEK_SET) != 0))
+    {
+        return NULL;
+    }
+    for (;;)
+    {
+        if (*count == size)
+        {
+            size = (size > 0) ? 2 * size : 64;
+            grown = realloc(index, sizeof(*index) * size);
+            if (grown == NULL)
+            {
+                break;
+            }
+            index = grown;
+        }
+        if ((fread(&index[*count], sizeof(*index), 1, fp) != 1) ||
+            (index[*count].frames == 0) ||
+            (index[*count].offset + index[*count].bytes > (uint64_t)end) ||
+            (fseek(fp, index[*count].offset + index[*count].bytes, SEEK_SET) != 0))
+        {
+            break;
+        }
+        (*count)++;
+    }
+    if (*count == 0)
+    {
+        free(index);
+        return NULL;
+    }
+    return index;
+}
+
+
+/****************************
+ * check_chunk() - reads the samples of a chunk and checks its checksum
+ ****************************/
+static bool
+check_chunk(FILE* fp, struct binlog_chunk* chunk)
+{
+    uint8_t* samples = malloc(chunk->bytes > 0 ? chunk->bytes : 1);
+    bool ok;
+
+    ok = (samples != NULL) && (fseek(fp, chunk->offset, SEEK_SET) == 0) &&
+        (fread(samples, 1, chunk->bytes, fp) == chunk->bytes) &&
+        (binlog_crc32(0, samples, chunk->bytes) == chunk->checksum);
+    free(samples);
+    return ok;
+}
+
+
+/****************************
+ * print_time() - prints the local date and time of a frame of the file
+ ****************************/
+static void
+print_time(struct binlog_header* header, uint64_t frame)
+{
+    double t = header->start_nsec * 1e-9 + frame / header->scan_rate;
+    time_t sec = header->start_sec + (time_t)t;
+    char date[32];
+    struct tm tm;
+
+    localtime_r(&sec, &tm);
+    strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &tm);
+    printf("%s.%06ld", date, (long)((t - (time_t)t) * 1e6));
+}